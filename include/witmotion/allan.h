@@ -0,0 +1,125 @@
+/*!
+    \file allan.h
+    \brief Allan deviation estimators for the noise characterization of the inertial sensors
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the streaming (bounded memory) and the offline (fully overlapping) Allan deviation estimators and the extraction of the standard noise parameters from the resulting curve: angle/velocity random walk, bias instability and rate random walk.
+*/
+
+#ifndef WITMOTION_ALLAN
+#define WITMOTION_ALLAN
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+
+#include <vector>
+
+namespace witmotion
+{
+
+/*!
+  \brief Single point of the Allan deviation curve.
+*/
+struct witmotion_allan_point
+{
+    double tau; ///< Averaging time, seconds
+    double deviation; ///< Allan deviation \f$ \sigma(\tau) \f$, in units of the measured value
+    uint64_t terms; ///< Number of squared differences averaged to obtain the point
+};
+
+/*!
+  \brief Noise parameters estimated from the Allan deviation curve.
+
+  The values are expressed in units of the measured value and seconds. For the angular velocity in \f$ deg/s \f$ the random walk is obtained in \f$ deg/\sqrt{s} \f$ (multiply by 60 to get \f$ deg/\sqrt{h} \f$). Zero value means that the corresponding region of the curve has not been observed.
+*/
+struct witmotion_noise_parameters
+{
+    double random_walk; ///< Angle (velocity) random walk, \f$ N = \sigma(\tau)\sqrt{\tau} \f$ at the point of \f$ -1/2 \f$ slope
+    double bias_instability; ///< Bias instability, \f$ B = \sigma_{min} / 0.664 \f$
+    double bias_instability_tau; ///< Averaging time of the curve minimum, seconds
+    double rate_random_walk; ///< Rate random walk, \f$ K = \sigma(\tau)\sqrt{3/\tau} \f$ at the point of \f$ +1/2 \f$ slope
+};
+
+/*!
+  \brief Streaming octave-spaced Allan variance accumulator for a single channel.
+
+  The averaging times are \f$ \tau_k = 2^k \tau_0 \f$. For the first `overlapped_octaves` octaves the fully overlapping estimator is calculated from the ring buffer of the integrated samples, whose size is fixed at construction. For the longer averaging times the cascade of the non-overlapping cluster accumulators is used: every octave keeps only the previous cluster average and the accumulated squared differences, so the memory does not grow with the acquisition time.
+
+  The sample period is supplied only when the curve is read, so the accumulator can be fed before the actual output rate is known.
+*/
+class witmotion_allan_variance
+{
+private:
+    struct cluster_level
+    {
+        double pending; ///< First half of the next-octave cluster
+        bool has_pending;
+        double previous; ///< Previous cluster average
+        bool has_previous;
+        double squares; ///< Sum of squared differences of the adjacent cluster averages
+        uint64_t terms;
+    };
+    size_t octaves;
+    size_t overlapped_octaves;
+    std::vector<cluster_level> levels;
+    std::vector<double> phase; ///< Ring buffer of the integrated samples
+    size_t phase_head;
+    double integral;
+    double offset;
+    uint64_t count;
+    std::vector<double> overlapped_squares;
+    std::vector<uint64_t> overlapped_terms;
+    void PushCluster(const size_t level, const double average);
+public:
+    witmotion_allan_variance(const size_t max_octaves = 32,
+                             const size_t overlapped = 12);
+    void Push(const double value); ///< Accumulates one sample
+    void Reset();
+    uint64_t Count() const;
+    /*!
+      \brief Reads the current Allan deviation curve.
+
+      \param sample_period - \f$ \tau_0 \f$, seconds
+      \return Curve points with at least one squared difference accumulated, sorted by \f$ \tau \f$
+     */
+    std::vector<witmotion_allan_point> Deviation(const double sample_period) const;
+};
+
+/*!
+  \brief Streaming Allan deviation over the decoded frames for the accelerometer and gyroscope axes.
+*/
+class witmotion_frame_allan
+{
+public:
+    witmotion_allan_variance acceleration[3];
+    witmotion_allan_variance angular_velocity[3];
+    void Push(const witmotion_frame& frame);
+    void Reset();
+};
+
+/*!
+  \brief Calculates the fully overlapping Allan deviation on octave-spaced averaging times for the stored series.
+
+  \param samples - measurement series acquired with the constant period
+  \param sample_period - \f$ \tau_0 \f$, seconds
+ */
+std::vector<witmotion_allan_point> allan_deviation(const std::vector<double>& samples,
+                                                   const double sample_period);
+
+/*!
+  \brief Calculates \ref allan_deviation for several channels in parallel.
+
+  \param channels - measurement series, one per channel
+  \param sample_period - \f$ \tau_0 \f$, seconds
+  \param threads - maximal number of worker threads, `0` means hardware concurrency
+ */
+std::vector<std::vector<witmotion_allan_point>> allan_deviation(const std::vector<std::vector<double>>& channels,
+                                                                const double sample_period,
+                                                                const size_t threads = 0);
+
+/*!
+  \brief Extracts the noise parameters from the Allan deviation curve using the slope method.
+ */
+witmotion_noise_parameters allan_noise_parameters(const std::vector<witmotion_allan_point>& curve);
+
+}
+#endif
@@ -0,0 +1,99 @@
+/*!
+    \file bandwidth.h
+    \brief UART bandwidth planning for the measurement set, the output frequency and the baud rate
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    Every output cycle of the sensor contains one 11-byte packet per enabled measurement. When the output exceeds the capacity of the link, the sensor silently reduces it, and neither \ref ridOutputValueSet, \ref ridOutputFrequency nor \ref ridPortBaudRate reports that. This header file contains the planner choosing the minimal baud rate carrying the requested output with the configurable headroom, and producing the configuration sequence applied by \ref QAbstractWitmotionSensorController::ApplyConfiguration.
+*/
+
+#ifndef WITMOTION_BANDWIDTH
+#define WITMOTION_BANDWIDTH
+#include "witmotion/types.h"
+#include "witmotion/util.h"
+
+#include <string>
+#include <vector>
+
+namespace witmotion
+{
+
+enum witmotion_device_class
+{
+    dcWT31N, ///< Fixed measurement set, 10 or 100 Hz, 9600 or 115200 baud
+    dcWT901,
+    dcJY901 ///< \ref dcWT901 with the altimeter
+};
+
+static const double WITMOTION_BANDWIDTH_DEFAULT_HEADROOM = 0.2; ///< Fraction of the link capacity left free by default
+
+bool witmotion_device_class_from_name(const std::string& name, witmotion_device_class& device_class); ///< Parses `WT31N`, `WT901` or `JY901`, case-insensitive, \return `false` if unknown
+/*!
+  \brief Parses the measurement name as accepted by the controller applications.
+
+  The name is matched case-insensitively by its part, e.g. `accel`, `velocity`, `angles` or `euler`, `magnet`, `rtc` or `clock`, `status`, `alti` or `baro`, `orientation` or `quaternion`.
+  \return `false` if the name is not recognized
+ */
+bool witmotion_measurement_from_name(const std::string& name, witmotion_packet_id& id);
+
+/*!
+  \brief Link load of the output configuration, see \ref witmotion_bandwidth_planner::Plan.
+*/
+struct witmotion_bandwidth_plan
+{
+    uint16_t measurements; ///< \ref ridOutputValueSet setting, bit \f$ i \f$ enables the packet ID `0x50 + i`
+    size_t types; ///< Packet types per output cycle
+    int32_t frequency; ///< Output frequency argument of \ref witmotion_output_frequency
+    double load; ///< Output byte rate, bytes per second
+    uint32_t baud; ///< Minimal supported baud rate carrying the load with the headroom, the maximal supported one if none does
+    double utilization; ///< Load to the capacity of the link at \ref baud, 8N1 framing
+    bool sufficient; ///< The utilization does not exceed `1 - headroom`
+    bool saturated; ///< The load exceeds the capacity at \ref baud, the sensor will reduce the output
+    int32_t max_frequency; ///< Highest supported output frequency carried at \ref baud with the headroom, zero if none
+};
+
+/*!
+  \brief Bandwidth planner for one device class.
+
+  The load of the output configuration is `11 bytes * packet types * frequency`, the capacity of the link is `baud / 10` bytes per second. The planner chooses the lowest baud rate supported by the device class keeping the utilization within `1 - headroom`, the headroom absorbs the clock tolerance of the sensor and the USB-serial adapter and leaves the room for the configuration replies.
+*/
+class witmotion_bandwidth_planner
+{
+private:
+    witmotion_device_class device;
+    double headroom;
+    std::string error;
+public:
+    witmotion_bandwidth_planner(const witmotion_device_class device_class, const double headroom_fraction = WITMOTION_BANDWIDTH_DEFAULT_HEADROOM);
+    static const std::vector<uint32_t>& BaudRates(const witmotion_device_class device_class); ///< Supported baud rates, ascending
+    static const std::vector<int32_t>& Frequencies(const witmotion_device_class device_class); ///< Supported output frequency arguments of \ref witmotion_output_frequency, by the output rate ascending
+    static const std::set<witmotion_packet_id>& PacketTypes(const witmotion_device_class device_class); ///< Packet types which can be enabled
+    static const std::set<witmotion_packet_id>& DefaultPacketTypes(const witmotion_device_class device_class); ///< Packet types enabled by the factory settings
+    void SetHeadroom(const double fraction); ///< Fraction of the link capacity left free, from 0 to 1
+    double Headroom() const;
+    /*!
+      \brief Computes the link load and chooses the baud rate.
+
+      \param types - packet types to be enabled, for \ref dcWT31N they should belong to its fixed set and the whole set is counted
+      \param frequency - output frequency argument of \ref witmotion_output_frequency
+      \param plan - the result, valid only if `true` is returned
+      \return `false` if the packet type or the frequency is not supported by the device class, see \ref Error
+     */
+    bool Plan(const std::set<witmotion_packet_id>& types, const int32_t frequency, witmotion_bandwidth_plan& plan);
+    /*!
+      \brief Computes the link load at the given baud rate instead of choosing it, e.g. to check the current configuration.
+
+      \return `false` if the configuration is not supported by the device class, see \ref Error
+     */
+    bool Check(const std::set<witmotion_packet_id>& types, const int32_t frequency, const uint32_t baud, witmotion_bandwidth_plan& plan);
+    /*!
+      \brief Builds the configuration sequence of the plan: unlock, measurement set, output frequency, baud rate if changed, save.
+
+      \param plan - result of \ref Plan or \ref Check
+      \param current_baud - baud rate of the open port, the baud rate command is omitted if it is the same
+     */
+    witmotion_config_sequence Sequence(const witmotion_bandwidth_plan& plan, const uint32_t current_baud) const;
+    std::string Error() const;
+};
+
+}
+#endif
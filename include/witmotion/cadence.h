@@ -0,0 +1,98 @@
+/*!
+    \file cadence.h
+    \brief Effective output rate and packet loss estimation per packet type
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    The sensor silently outputs less than configured when the link is saturated, and the packets damaged on the line are dropped by the parser. This header file contains the online estimator comparing the received packet stream with the expected cadence of every packet type.
+*/
+
+#ifndef WITMOTION_CADENCE
+#define WITMOTION_CADENCE
+#include "witmotion/types.h"
+
+#include <ostream>
+
+namespace witmotion
+{
+
+static const size_t WITMOTION_CADENCE_PACKET_TYPES = 11; ///< Packet IDs from \ref pidRTC to \ref pidGPSAccuracy
+
+/*!
+  \brief Estimated cadence of one packet type.
+*/
+struct witmotion_cadence_statistics
+{
+    uint64_t received;
+    uint64_t missing; ///< Estimated number of the packets lost, see \ref witmotion_cadence_estimator
+    uint64_t duplicated; ///< Packets repeating the payload of the previous packet of the same type, i.e. the sensor output the same sample again
+    uint64_t gaps; ///< Inter-arrival times exceeding the gap threshold
+    int64_t max_gap; ///< Longest inter-arrival time, ns
+    double expected_rate; ///< Configured or learned output frequency, Hz, zero while unknown
+    double effective_rate; ///< Received packets per second over the session, Hz
+};
+
+/*!
+  \brief Snapshot of \ref witmotion_cadence_estimator, delivered by \ref QAbstractWitmotionSensorController::Cadence.
+*/
+struct witmotion_cadence_report
+{
+    witmotion_cadence_statistics types[WITMOTION_CADENCE_PACKET_TYPES]; ///< Indexed by the packet ID minus \ref pidRTC
+    size_t cycle_length; ///< Number of the packet types in the learned output cycle, zero while learning
+};
+
+/*!
+  \brief Online estimator of the effective output rate and the packet loss per packet type.
+
+  Every output cycle of the sensor contains the enabled packet types in the fixed order. The estimator learns this order from the data (the same order observed in three consecutive cycles) and counts the packets skipped in the order as missing; the order is re-learned when the new packet type appears, e.g. after the reconfiguration. The loss of the whole cycles does not break the order, so when the output frequency is configured by \ref SetExpectedRate, the number of missing packets is also estimated as the difference between the expected and the received packet count over the session, and the larger estimate is reported.
+
+  The gap is counted when the inter-arrival time exceeds the threshold in the expected periods. The expected period is taken from the configured frequency, or from the effective rate otherwise. The host arrival times of the packets are grouped by the USB-serial adapters, so the threshold should exceed the adapter latency timer in periods.
+  \note The estimator is not thread-safe, it should be fed and queried from the same thread.
+*/
+class witmotion_cadence_estimator
+{
+private:
+    struct type_state
+    {
+        uint64_t received;
+        uint64_t skipped; ///< Missing by the cycle order
+        uint64_t duplicated;
+        uint64_t gaps;
+        int64_t first;
+        int64_t last;
+        int64_t max_gap;
+        uint8_t payload[8];
+    };
+    type_state types[WITMOTION_CADENCE_PACKET_TYPES];
+    double configured_rate;
+    double gap_threshold;
+    uint8_t order[WITMOTION_CADENCE_PACKET_TYPES]; ///< Learned cycle, packet ID offsets
+    int position[WITMOTION_CADENCE_PACKET_TYPES]; ///< Position of the packet type in the cycle, -1 if absent
+    size_t order_length; ///< Zero while learning
+    uint8_t candidate[WITMOTION_CADENCE_PACKET_TYPES];
+    size_t candidate_length;
+    uint8_t learned[WITMOTION_CADENCE_PACKET_TYPES];
+    size_t learned_length;
+    size_t confirmations;
+    int previous; ///< Cycle position of the previous packet, -1 if unknown
+    void Learn(const size_t index);
+    void Lock();
+    double ExpectedRate(const size_t index) const;
+public:
+    /*!
+      \param rate - configured output frequency, Hz, zero learns the rate from the data
+      \param threshold - gap threshold, expected periods
+     */
+    witmotion_cadence_estimator(const double rate = 0.0, const double threshold = 3.0);
+    void SetExpectedRate(const double rate); ///< Hz, zero learns the rate from the data
+    void SetGapThreshold(const double periods);
+    void Push(const witmotion_datapacket& packet, const int64_t timestamp); ///< \param timestamp - packet arrival time, nanoseconds
+    void Reset();
+    witmotion_cadence_report Statistics() const;
+    void Report(std::ostream& out) const; ///< Prints the table of the estimates for all the received packet types
+};
+
+}
+
+Q_DECLARE_METATYPE(witmotion::witmotion_cadence_report); ///< \private
+
+#endif
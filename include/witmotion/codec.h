@@ -0,0 +1,180 @@
+/*!
+    \file codec.h
+    \brief Lossless compressed recording format for the acquired packets
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the block codec and the recording file writer/reader. The packet cells (\ref witmotion_datapacket `datastore.raw_cells`) are slowly varying 16-bit values, so every packet is stored as the difference from the previous packet of the same type.
+
+    \section codec-format Format
+    All the multibyte values are little-endian, the packet cells are taken in the host byte order as `raw_cells`.
+    - Every packet of the block is encoded as the tag byte (packet type index `id - 0x50` in the low 4 bits, bit 4 set if the CRC byte does not match the content and is stored explicitly), the control byte and the cell deltas. The deltas from the previous packet of the same type in the block are zigzag-mapped and stored by group variable-length encoding: the control byte contains four 2-bit lengths (0 to 2 bytes) of the four deltas, so the zero delta takes no space and the decoder reads all the lengths at once. The packets with the unexpected header byte or the unregistered ID are stored verbatim after the tag byte `0xFF`.
+    - If the timestamps are enabled, every packet is followed by the zigzag-mapped difference of the consecutive timestamp intervals (the second difference) as LEB128 variable-length integer, which is 1 byte for the regular stream.
+    - The prediction state is reset at the beginning of every block, so the blocks are decoded independently and in parallel.
+    - File: header (\ref WITMOTION_RECORDING_HEADER_SIZE bytes: magic \ref WITMOTION_RECORDING_MAGIC, version (2 bytes), flags (2 bytes, bit 0 is set if the timestamps are stored), block size in packets (4 bytes), reserved (4 bytes)), blocks, block index and footer.
+    - Block: packet count (4 bytes), payload size (4 bytes), timestamp of the first packet (8 bytes), payload.
+    - Block index: \ref witmotion_recording_block entries of 32 bytes (offset, first packet number, first timestamp, packet count, block size). Footer: index offset (8 bytes), number of entries (4 bytes), magic \ref WITMOTION_RECORDING_INDEX_MAGIC. If the footer is missing because the writer has not been closed, the reader recovers the index by walking the block headers.
+*/
+
+#ifndef WITMOTION_CODEC
+#define WITMOTION_CODEC
+#include "witmotion/types.h"
+
+#include <string>
+#include <vector>
+
+namespace witmotion
+{
+
+static const uint32_t WITMOTION_RECORDING_MAGIC = 0x43524D57; ///< "WMRC"
+static const uint32_t WITMOTION_RECORDING_INDEX_MAGIC = 0x49524D57; ///< "WMRI"
+static const uint16_t WITMOTION_RECORDING_VERSION = 1;
+static const size_t WITMOTION_RECORDING_HEADER_SIZE = 16;
+static const size_t WITMOTION_RECORDING_BLOCK_HEADER_SIZE = 16;
+static const size_t WITMOTION_RECORDING_INDEX_ENTRY_SIZE = 32;
+static const size_t WITMOTION_RECORDING_FOOTER_SIZE = 16;
+
+/*!
+  \brief Incremental encoder of one block, see \ref codec-format.
+
+  The encoding costs a few arithmetic operations per cell and appends to the preallocated payload buffer, so it can be run on the reader thread.
+*/
+class witmotion_packet_block_encoder
+{
+private:
+    bool timestamps;
+    int16_t previous[16][4];
+    int64_t first_timestamp;
+    int64_t previous_timestamp;
+    int64_t previous_interval;
+    size_t count;
+    std::vector<uint8_t> payload;
+public:
+    /*!
+      \param store_timestamps - encode the timestamps along with the packets
+      \param reserve - number of packets to preallocate the payload buffer for
+     */
+    witmotion_packet_block_encoder(const bool store_timestamps = false,
+                                   const size_t reserve = 4096);
+    void Reset(); ///< Starts the new block
+    void Push(const witmotion_datapacket& packet, const int64_t timestamp = 0);
+    size_t Count() const; ///< Number of the packets in the block
+    int64_t FirstTimestamp() const;
+    const std::vector<uint8_t>& Payload() const;
+};
+
+/*!
+  \brief Decodes the block payload produced by \ref witmotion_packet_block_encoder.
+
+  \param payload - payload head
+  \param size - payload size in bytes
+  \param count - number of the packets in the block
+  \param first_timestamp - timestamp of the first packet stored in the block header
+  \param store_timestamps - whether the timestamps are encoded
+  \param packets - destination array of `count` packets
+  \param timestamps - destination array of `count` timestamps, may be `nullptr`
+  \return `false` if the payload is malformed
+ */
+bool decode_packet_block(const uint8_t* payload,
+                         const size_t size,
+                         const size_t count,
+                         const int64_t first_timestamp,
+                         const bool store_timestamps,
+                         witmotion_datapacket* packets,
+                         int64_t* timestamps);
+
+/*!
+  \brief Block index entry of the recording file.
+*/
+struct witmotion_recording_block
+{
+    uint64_t offset; ///< Offset of the block header in the file
+    uint64_t first_packet; ///< Number of the first packet of the block in the recording
+    int64_t first_timestamp;
+    uint32_t packets;
+    uint32_t size; ///< Block size including the header, bytes
+};
+
+/*!
+  \brief Writes the compressed recording file.
+
+  The packets are encoded as they arrive, the complete block is written by a single `write` call.
+  \note Only one thread may push.
+*/
+class witmotion_recording_writer: public witmotion_packet_sink
+{
+private:
+    std::string filename;
+    bool timestamps;
+    size_t block_packets;
+    int fd;
+    uint64_t offset;
+    uint64_t packets;
+    witmotion_packet_block_encoder encoder;
+    std::vector<witmotion_recording_block> index;
+    std::vector<uint8_t> output;
+    std::string error;
+    bool WriteBlock();
+    bool WriteAll(const uint8_t* data, const size_t size);
+public:
+    /*!
+      \param file - recording file name, the existing file is truncated
+      \param store_timestamps - store the acquisition timestamps along with the packets
+      \param block_size - number of packets per block
+     */
+    witmotion_recording_writer(const std::string& file,
+                               const bool store_timestamps = false,
+                               const size_t block_size = 4096);
+    virtual ~witmotion_recording_writer();
+    bool Open(); ///< Creates the file and writes the header, returns `false` and sets \ref Error on failure
+    bool Close(); ///< Writes the last block, the index and the footer
+    bool IsOpen() const;
+    const std::string& Error() const;
+    virtual void Consume(const witmotion_datapacket& packet); ///< Pushes the packet with the current `steady_clock` timestamp
+    bool Push(const witmotion_datapacket& packet, const int64_t timestamp = 0); ///< Returns `false` if the block cannot be written
+    uint64_t Packets() const;
+    uint64_t Bytes() const; ///< Number of the bytes written so far
+};
+
+/*!
+  \brief Reads the compressed recording file.
+
+  The blocks are read by `pread`, so \ref Read can be called from several threads concurrently to decode the different blocks in parallel.
+*/
+class witmotion_recording_reader
+{
+private:
+    std::string filename;
+    int fd;
+    bool timestamps;
+    bool recovered;
+    uint64_t packets;
+    std::vector<witmotion_recording_block> index;
+    std::string error;
+    bool ReadIndex(const uint64_t file_size);
+    bool RecoverIndex(const uint64_t file_size);
+public:
+    explicit witmotion_recording_reader(const std::string& file);
+    ~witmotion_recording_reader();
+    bool Open(); ///< Reads the header and the block index, returns `false` and sets \ref Error on failure
+    void Close();
+    const std::string& Error() const;
+    bool Timestamps() const; ///< Whether the timestamps are stored
+    bool Recovered() const; ///< Whether the index has been rebuilt because the footer is missing
+    uint64_t Packets() const;
+    const std::vector<witmotion_recording_block>& Blocks() const;
+    size_t Find(const uint64_t packet) const; ///< Index of the block containing the packet number, or the number of blocks if out of range
+    /*!
+      \brief Reads and decodes one block.
+
+      \param block - block index in \ref Blocks
+      \param decoded - receives the packets
+      \param decoded_timestamps - if not `nullptr`, receives the timestamps (zeros if they are not stored)
+      \return `false` if the block cannot be read or is malformed
+     */
+    bool Read(const size_t block,
+              std::vector<witmotion_datapacket>& decoded,
+              std::vector<int64_t>* decoded_timestamps = nullptr) const;
+};
+
+}
+#endif
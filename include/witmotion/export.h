@@ -0,0 +1,196 @@
+/*!
+    \file export.h
+    \brief Export of the decoded frames to the analysis-friendly file formats
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the column-oriented (structure of arrays) buffer of the decoded frames and the exporters writing it to CSV, NumPy `.npy` and `.npz` and the columnar binary format. All the exporters write the data in chunks as they arrive, so the files of any length are exported with the bounded memory.
+
+    The NumPy files contain the raw column arrays behind the fixed-size header, so the multi-gigabyte columns are opened instantly by `numpy.load(file, mmap_mode='r')`. The `.npz` archive is stored without compression: `numpy.load` reads every column from it directly, and the column data can be memory-mapped at the member offset as well.
+
+    \section export-columns Columns
+    Every \ref witmotion_frame is exported as one row of \ref WITMOTION_EXPORT_COLUMNS columns: `timestamp` (nanoseconds, `int64`), `mask` (\ref witmotion_frame::mask, `uint32`), `acceleration_x`..`acceleration_z`, `angular_velocity_x`..`angular_velocity_z`, `roll`, `pitch`, `yaw`, `magnetic_field_x`..`magnetic_field_z`, `orientation_x`..`orientation_w`, `temperature` (`float32`), `pressure` and `altitude` (`float64`). The values of the packet types absent in the row mask are not valid.
+
+    \section export-columnar Columnar binary format
+    All the multibyte values are in the host byte order (little-endian on all the supported platforms).
+    - Header: magic \ref WITMOTION_COLUMNAR_MAGIC, version (2 bytes), number of columns (2 bytes), then the column descriptors: NumPy type kind character (`i`, `u` or `f`), element size in bytes, name length and the name.
+    - Chunks: number of rows (4 bytes), reserved (4 bytes), then the values of every column for all the rows of the chunk, column after column. The chunk of the column of `n` rows is directly readable as the array, e.g. by `numpy.frombuffer`.
+*/
+
+#ifndef WITMOTION_EXPORT
+#define WITMOTION_EXPORT
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace witmotion
+{
+
+static const size_t WITMOTION_EXPORT_COLUMNS = 21;
+static const uint32_t WITMOTION_COLUMNAR_MAGIC = 0x46434D57; ///< "WMCF"
+static const uint16_t WITMOTION_COLUMNAR_VERSION = 1;
+
+/*!
+  \brief Export file formats.
+*/
+enum witmotion_export_format
+{
+    exportCSV, ///< Comma-separated values with the header line, one file
+    exportNumPy, ///< Directory of `.npy` files, one per column
+    exportNumPyArchive, ///< Uncompressed `.npz` archive of the `.npy` columns
+    exportColumnar ///< Columnar binary format, see \ref export-columnar
+};
+
+/*!
+  \brief Column descriptor, see \ref export-columns.
+*/
+struct witmotion_export_column
+{
+    const char* name;
+    char kind; ///< NumPy type kind: `i` - signed integer, `u` - unsigned integer, `f` - floating point
+    size_t size; ///< Element size, bytes
+};
+
+const witmotion_export_column* export_columns(); ///< Array of \ref WITMOTION_EXPORT_COLUMNS descriptors
+
+/*!
+  \brief Structure of arrays holding the decoded frames column by column.
+*/
+class witmotion_frame_columns
+{
+private:
+    size_t rows;
+    std::vector<std::vector<uint8_t>> columns;
+public:
+    explicit witmotion_frame_columns(const size_t reserve = 0); ///< \param reserve - number of rows to preallocate
+    void Append(const witmotion_frame& frame);
+    void Clear(); ///< Removes the rows, keeping the memory
+    size_t Rows() const;
+    const uint8_t* Column(const size_t index) const; ///< Values of the column as the array of \ref witmotion_export_column::size bytes elements
+    uint8_t* Column(const size_t index);
+};
+
+/*!
+  \brief Base class of the exporters.
+
+  The frames consumed one by one are accumulated into the chunk of the fixed number of rows, which is written at once. The already decoded chunks can be written directly by \ref Write.
+  \note The exporter is not thread-safe.
+*/
+class witmotion_frame_exporter: public witmotion_frame_sink
+{
+protected:
+    std::string path;
+    std::string error;
+    uint64_t rows;
+    size_t chunk_rows;
+    witmotion_frame_columns buffer;
+    virtual bool WriteColumns(const witmotion_frame_columns& chunk) = 0;
+    virtual bool Finish() = 0; ///< Completes and closes the file
+    bool Fail(const std::string& message); ///< Sets \ref Error with the system error description, returns `false`
+public:
+    /*!
+      \param output - output path, the existing files are truncated
+      \param chunk - number of rows per chunk
+     */
+    witmotion_frame_exporter(const std::string& output, const size_t chunk = 4096);
+    virtual ~witmotion_frame_exporter() {}
+    virtual bool Open() = 0; ///< Creates the output, returns `false` and sets \ref Error on failure
+    virtual bool IsOpen() const = 0;
+    bool Close(); ///< Writes the buffered rows and completes the output
+    const std::string& Error() const;
+    virtual void Consume(const witmotion_frame& frame);
+    bool Write(const witmotion_frame_columns& chunk); ///< Writes the buffered rows and then the chunk
+    bool Flush(); ///< Writes the buffered rows
+    uint64_t Rows() const; ///< Number of the rows written or buffered
+};
+
+/*!
+  \brief CSV exporter, the header line contains the column names.
+*/
+class witmotion_csv_exporter: public witmotion_frame_exporter
+{
+private:
+    int fd;
+    std::vector<char> output;
+protected:
+    virtual bool WriteColumns(const witmotion_frame_columns& chunk);
+    virtual bool Finish();
+public:
+    witmotion_csv_exporter(const std::string& file, const size_t chunk = 4096);
+    virtual ~witmotion_csv_exporter();
+    virtual bool Open();
+    virtual bool IsOpen() const;
+};
+
+/*!
+  \brief NumPy exporter writing every column to the separate `.npy` file in the output directory.
+
+  The array header is written with the zero length and the space reserved for any row count, and is rewritten in place with the actual shape at close, so the columns are streamed without knowing the number of rows in advance. The files can be loaded by `numpy.load`, including the memory-mapped mode.
+*/
+class witmotion_npy_exporter: public witmotion_frame_exporter
+{
+private:
+    std::vector<int> files;
+protected:
+    virtual bool WriteColumns(const witmotion_frame_columns& chunk);
+    virtual bool Finish();
+public:
+    witmotion_npy_exporter(const std::string& directory, const size_t chunk = 4096); ///< \param directory - created if it does not exist
+    virtual ~witmotion_npy_exporter();
+    virtual bool Open();
+    virtual bool IsOpen() const;
+};
+
+/*!
+  \brief NumPy archive exporter writing all the columns to the single uncompressed `.npz` file.
+
+  The ZIP members have to be contiguous, so the columns are streamed to the `.npy` files in the staging directory `FILE.parts` next to the archive, and are packed into the archive at close. The staging files are removed after the archive is written, or kept if it fails. The archive uses ZIP64 records and has no size limit.
+*/
+class witmotion_npz_exporter: public witmotion_frame_exporter
+{
+private:
+    witmotion_npy_exporter staging;
+    std::string staging_directory;
+protected:
+    virtual bool WriteColumns(const witmotion_frame_columns& chunk);
+    virtual bool Finish();
+public:
+    witmotion_npz_exporter(const std::string& file, const size_t chunk = 4096);
+    virtual ~witmotion_npz_exporter();
+    virtual bool Open();
+    virtual bool IsOpen() const;
+};
+
+/*!
+  \brief Columnar binary exporter, see \ref export-columnar.
+*/
+class witmotion_columnar_exporter: public witmotion_frame_exporter
+{
+private:
+    int fd;
+    std::vector<uint8_t> output;
+protected:
+    virtual bool WriteColumns(const witmotion_frame_columns& chunk);
+    virtual bool Finish();
+public:
+    witmotion_columnar_exporter(const std::string& file, const size_t chunk = 4096);
+    virtual ~witmotion_columnar_exporter();
+    virtual bool Open();
+    virtual bool IsOpen() const;
+};
+
+/*!
+  \brief Creates the exporter of the requested format.
+
+  \param format - output format
+  \param output - file name, or the directory name for \ref exportNumPy
+  \param chunk - number of rows per chunk
+ */
+std::unique_ptr<witmotion_frame_exporter> create_frame_exporter(const witmotion_export_format format,
+                                                                const std::string& output,
+                                                                const size_t chunk = 4096);
+
+}
+#endif
@@ -0,0 +1,192 @@
+/*!
+    \file filter.h
+    \brief Digital filter banks and decimators for the decoded measurement channels
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the coefficient design routines for the windowed-sinc FIR and the Butterworth biquad IIR filters, and the filter banks applying the same filter to many channels at once. The banks keep the channel states in structure-of-arrays layout, so the inner loops run over the channels and are vectorized by the compiler: hundreds of channels (e.g. accelerometers and gyroscopes of many sensors) can be filtered at the full output rate for negligible CPU time.
+*/
+
+#ifndef WITMOTION_FILTER
+#define WITMOTION_FILTER
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+
+#include <vector>
+
+namespace witmotion
+{
+
+/*!
+  \brief Frequency response type for the filter design routines.
+*/
+enum witmotion_filter_type
+{
+    filterLowPass,
+    filterHighPass
+};
+
+/*!
+  \brief Normalized coefficients of the second-order IIR section, \f$ H(z) = \frac{b_0 + b_1 z^{-1} + b_2 z^{-2}}{1 + a_1 z^{-1} + a_2 z^{-2}} \f$.
+*/
+struct witmotion_biquad
+{
+    float b0;
+    float b1;
+    float b2;
+    float a1;
+    float a2;
+};
+
+/*!
+  \brief Designs the linear phase FIR filter by the windowed-sinc method with Blackman window.
+
+  \param taps - number of coefficients, for \ref filterHighPass it is rounded up to the odd value
+  \param cutoff - cutoff frequency normalized to the sample rate, \f$ (0, 0.5) \f$
+  \param type - response type
+  \return Coefficients with the unity gain in the passband
+ */
+std::vector<float> design_fir(const size_t taps,
+                              const double cutoff,
+                              const witmotion_filter_type type = filterLowPass);
+
+/*!
+  \brief Designs the Butterworth IIR filter as the cascade of the second-order sections.
+
+  \param order - filter order, odd orders contain one first-order section
+  \param cutoff - cutoff (-3 dB) frequency normalized to the sample rate, \f$ (0, 0.5) \f$
+  \param type - response type
+ */
+std::vector<witmotion_biquad> design_butterworth(const size_t order,
+                                                 const double cutoff,
+                                                 const witmotion_filter_type type = filterLowPass);
+
+/*!
+  \brief FIR filter and decimator applied to a set of channels.
+
+  The input and output samples are rows of `channels` values acquired at the same instant. The history is stored as the doubled ring of rows, so every tap is applied to the whole contiguous row at once. With decimation factor \f$ M \f$ only every \f$ M \f$-th output is calculated, which is computationally equivalent to the polyphase decimator: the cost per input row is \f$ taps / M \f$ multiply-accumulate operations per channel.
+*/
+class witmotion_fir_bank
+{
+private:
+    std::vector<float> coefficients;
+    size_t channels;
+    size_t decimation;
+    size_t phase;
+    size_t position;
+    std::vector<float> history; ///< `2 * taps` rows of `channels` values
+public:
+    /*!
+      \param taps - filter coefficients, see \ref design_fir
+      \param count - number of channels
+      \param factor - decimation factor, `1` means no decimation
+     */
+    witmotion_fir_bank(const std::vector<float>& taps,
+                       const size_t count,
+                       const size_t factor = 1);
+    size_t Channels() const;
+    size_t Decimation() const;
+    /*!
+      \brief Accumulates one input row.
+
+      \param input - `Channels()` values
+      \param output - receives `Channels()` filtered values when the decimated output is due
+      \return `true` if `output` was filled
+     */
+    bool Push(const float* input, float* output);
+    /*!
+      \brief Filters the block of input rows.
+
+      \param input - `rows * Channels()` values, row-major
+      \param rows - number of input rows
+      \param output - receives up to `rows / Decimation() + 1` output rows
+      \return Number of output rows written
+     */
+    size_t Process(const float* input, const size_t rows, float* output);
+    void Reset();
+};
+
+/*!
+  \brief Biquad cascade IIR filter and decimator applied to a set of channels.
+
+  Every section is calculated in transposed direct form II, the states of all the channels are kept in contiguous arrays per section. The filter runs at the input rate, and every \f$ M \f$-th output row is delivered. For decimation the cutoff should be set below \f$ 0.5 / M \f$ of the input rate to avoid aliasing.
+*/
+class witmotion_iir_bank
+{
+private:
+    std::vector<witmotion_biquad> sections;
+    size_t channels;
+    size_t decimation;
+    size_t phase;
+    std::vector<float> state; ///< Per section: `channels` values of \f$ z_1 \f$ followed by `channels` values of \f$ z_2 \f$
+    std::vector<float> buffer;
+public:
+    /*!
+      \param cascade - second-order sections, see \ref design_butterworth
+      \param count - number of channels
+      \param factor - decimation factor, `1` means no decimation
+     */
+    witmotion_iir_bank(const std::vector<witmotion_biquad>& cascade,
+                       const size_t count,
+                       const size_t factor = 1);
+    size_t Channels() const;
+    size_t Decimation() const;
+    bool Push(const float* input, float* output); ///< Same as \ref witmotion_fir_bank::Push
+    size_t Process(const float* input, const size_t rows, float* output); ///< Same as \ref witmotion_fir_bank::Process
+    void Reset();
+};
+
+/*!
+  \brief Applies the filter bank to the accelerations, angular velocities and magnetic field of the decoded frames.
+
+  The frames are forwarded to the next \ref witmotion_frame_sink at the decimated rate with the filtered values replaced, so the stage can be inserted after \ref witmotion_frame_assembler or \ref witmotion_resampling_clock. Only the frames containing both \ref pidAcceleration and \ref pidAngularVelocity are filtered; the magnetic field channels are filtered with the last known values if the frame does not contain \ref pidMagnetometer.
+  \tparam Bank - \ref witmotion_fir_bank or \ref witmotion_iir_bank
+*/
+template<typename Bank> class witmotion_frame_filter: public witmotion_frame_sink
+{
+private:
+    static const size_t frame_channels = 9;
+    Bank bank;
+    witmotion_frame_sink* sink;
+    float input[frame_channels];
+    float output[frame_channels];
+public:
+    template<typename Coefficients> witmotion_frame_filter(const Coefficients& coefficients,
+                                                           witmotion_frame_sink* consumer,
+                                                           const size_t factor = 1):
+        bank(coefficients, frame_channels, factor),
+        sink(consumer)
+    {
+        for(size_t i = 0; i < frame_channels; i++)
+            input[i] = 0.f;
+    }
+    virtual void Consume(const witmotion_frame& frame)
+    {
+        if(!frame.Has(pidAcceleration) || !frame.Has(pidAngularVelocity))
+            return;
+        for(size_t i = 0; i < 3; i++)
+        {
+            input[i] = frame.acceleration[i];
+            input[i + 3] = frame.angular_velocity[i];
+            if(frame.Has(pidMagnetometer))
+                input[i + 6] = frame.magnetic_field[i];
+        }
+        if(!bank.Push(input, output))
+            return;
+        witmotion_frame filtered = frame;
+        for(size_t i = 0; i < 3; i++)
+        {
+            filtered.acceleration[i] = output[i];
+            filtered.angular_velocity[i] = output[i + 3];
+            filtered.magnetic_field[i] = output[i + 6];
+        }
+        if(sink != nullptr)
+            sink->Consume(filtered);
+    }
+    Bank& Filter()
+    {
+        return bank;
+    }
+};
+
+}
+#endif
@@ -0,0 +1,77 @@
+/*!
+    \file frame.h
+    \brief Decoded measurement frames assembled from the packet stream
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    The sensor outputs every measurement type as a separate packet. This header file defines the structure grouping the decoded values of one output cycle and the assembler building these structures from the packet stream.
+*/
+
+#ifndef WITMOTION_FRAME
+#define WITMOTION_FRAME
+#include "witmotion/types.h"
+#include "witmotion/util.h"
+
+namespace witmotion
+{
+
+/*!
+  \brief Decoded values of one sensor output cycle.
+
+  Only the values whose packet type bit is set in \ref mask are valid. The bit index is the packet ID offset from \ref pidRTC, see \ref witmotion_frame::Has.
+*/
+struct witmotion_frame
+{
+    int64_t timestamp; ///< Timestamp of the first packet of the frame, nanoseconds, the clock is defined by the caller
+    uint32_t mask; ///< Bit set of the packet types present in the frame
+    float acceleration[3]; ///< Linear accelerations [X-Y-Z], \f$ m/s^2 \f$
+    float angular_velocity[3]; ///< Angular velocities [X-Y-Z], \f$ deg/s \f$
+    float angles[3]; ///< Euler angles [Roll-Pitch-Yaw], \f$ deg \f$
+    float magnetic_field[3]; ///< Magnetic field [X-Y-Z], raw units
+    float orientation[4]; ///< Orientation quaternion [X-Y-Z-W]
+    float temperature; ///< Temperature from the last packet containing it, \f$ ^{\circ}C \f$
+    double pressure; ///< Barometric pressure, Pa
+    double altitude; ///< Barometric altitude, m
+    bool Has(const witmotion_packet_id id) const;
+    static uint32_t Bit(const witmotion_packet_id id);
+};
+
+/*!
+  \brief Abstract interface for the consumers of the decoded frames.
+
+  Unlike \ref witmotion_packet_sink, the frames can be delivered from the threads other than the reader one (e.g. by \ref witmotion_resampling_clock), so the implementation should be thread-safe with respect to the rest of the application.
+*/
+class witmotion_frame_sink
+{
+public:
+    virtual ~witmotion_frame_sink() {}
+    virtual void Consume(const witmotion_frame& frame) = 0;
+};
+
+/*!
+  \brief Builds \ref witmotion_frame structures from the packet stream.
+
+  The frame is considered complete when the packet type already present in the frame arrives again, i.e. when the next output cycle of the sensor begins. The assembler does not allocate memory.
+*/
+class witmotion_frame_assembler
+{
+private:
+    witmotion_frame current;
+public:
+    witmotion_frame_assembler();
+    /*!
+      \brief Accumulates the packet into the current frame.
+
+      \param packet - acquired data packet
+      \param timestamp - packet acquisition time, nanoseconds
+      \param completed - receives the previous frame if it has been completed by this packet
+      \return `true` if `completed` was filled
+     */
+    bool Push(const witmotion_datapacket& packet,
+              const int64_t timestamp,
+              witmotion_frame& completed);
+    bool Flush(witmotion_frame& completed); ///< Outputs the incomplete current frame, if it is not empty, and starts the new one
+    void Reset();
+};
+
+}
+#endif
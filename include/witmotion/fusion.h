@@ -0,0 +1,95 @@
+/*!
+    \file fusion.h
+    \brief Host-side orientation fusion (AHRS) on the raw inertial measurements
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the Madgwick and Mahony orientation filters calculated on the host from the decoded accelerations, angular velocities and magnetic field. Unlike the sensor firmware fusion (\ref pidAngles, \ref pidOrientation, \ref ridTransitionAlgorithm) the filter gains are tunable, and the on-device angle output can be disabled to save the UART bandwidth.
+*/
+
+#ifndef WITMOTION_FUSION
+#define WITMOTION_FUSION
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+#include "witmotion/statistics.h"
+
+#include <vector>
+
+namespace witmotion
+{
+
+/*!
+  \brief Orientation fusion algorithm.
+*/
+enum witmotion_fusion_algorithm
+{
+    fusionMadgwick, ///< Gradient descent filter by S. Madgwick, the gain is \f$ \beta \f$
+    fusionMahony ///< Nonlinear complementary filter by R. Mahony, the gains are \f$ K_p \f$ and \f$ K_i \f$
+};
+
+/*!
+  \brief Batch of the measurements for \ref witmotion_orientation_fusion::Update in structure-of-arrays layout.
+
+  Every pointer refers to an array containing one value per sensor. The angular velocities are expected in \f$ deg/s \f$, as decoded by \ref decode_angular_velocities. The accelerations and magnetic field are normalized internally, so the units are irrelevant. If `magnetic_field` pointers are `nullptr`, the 6-axis (IMU) update is performed for all the sensors.
+*/
+struct witmotion_fusion_input
+{
+    const float* acceleration[3];
+    const float* angular_velocity[3];
+    const float* magnetic_field[3];
+};
+
+/*!
+  \brief Madgwick/Mahony orientation filter bank for one or many sensors.
+
+  The filter states are kept in the structure-of-arrays layout and updated in one branch-free loop over the sensors, so the quaternion math for the whole batch is auto-vectorized by the compiler. Sensors with zero accelerometer (or magnetometer) norm in the batch skip the corresponding correction step. The bank does not allocate memory after construction.
+
+  The wall-clock cost of every \ref Update call is accumulated per sensor in nanoseconds and can be read by \ref Cost.
+*/
+class witmotion_orientation_fusion
+{
+private:
+    witmotion_fusion_algorithm algorithm;
+    size_t sensors;
+    float beta;
+    float kp;
+    float ki;
+    bool profiling;
+    std::vector<float> q0, q1, q2, q3; ///< Orientation quaternions [W-X-Y-Z]
+    std::vector<float> integral_x, integral_y, integral_z; ///< Mahony integral feedback terms
+    witmotion_running_statistics cost;
+    void UpdateMadgwick(const witmotion_fusion_input& input, const float dt);
+    void UpdateMahony(const witmotion_fusion_input& input, const float dt);
+public:
+    /*!
+      \brief Constructs the filter bank.
+
+      \param fusion - algorithm to use
+      \param count - number of sensors processed by every \ref Update call
+     */
+    witmotion_orientation_fusion(const witmotion_fusion_algorithm fusion = fusionMadgwick,
+                                 const size_t count = 1);
+    size_t Sensors() const;
+    void SetMadgwickGain(const float gain); ///< Sets \f$ \beta \f$, default is `0.1`
+    void SetMahonyGains(const float proportional, const float integral); ///< Sets \f$ K_p \f$ and \f$ K_i \f$, defaults are `0.5` and `0.0`
+    void SetProfiling(const bool enabled); ///< Toggles the update cost measurement, enabled by default
+    /*!
+      \brief Advances all the filters in the bank by one sample.
+
+      \param input - measurements for all the sensors
+      \param dt - sample period, seconds
+     */
+    void Update(const witmotion_fusion_input& input, const float dt);
+    /*!
+      \brief Advances the single-sensor filter by one decoded frame.
+
+      The frame should contain \ref pidAcceleration and \ref pidAngularVelocity packets, otherwise it is ignored. If \ref pidMagnetometer is present, the 9-axis update is performed. Only the first sensor of the bank is updated.
+      \return `true` if the filter has been updated
+     */
+    bool Update(const witmotion_frame& frame, const float dt);
+    void Orientation(const size_t sensor, float& x, float& y, float& z, float& w) const; ///< Reads the quaternion [X-Y-Z-W], as in \ref decode_orientation
+    void Reset(); ///< Resets all the orientations to identity and clears the integral terms and the cost statistics
+    const witmotion_running_statistics& Cost() const; ///< Update cost per sensor, nanoseconds
+};
+
+}
+#endif
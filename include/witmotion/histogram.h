@@ -0,0 +1,77 @@
+/*!
+    \file histogram.h
+    \brief Fixed-memory log-bucketed histograms of the packet timing
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the HdrHistogram-style histogram of the durations and the per-packet-type timing statistics collected by \ref QBaseSerialWitmotionSensorReader and \ref QAbstractWitmotionSensorController. The inter-arrival time distribution shows whether the configured output frequency is actually met and reveals the USB-serial adapters delivering the data in bursts by their latency timer; the read-to-delivery latency distribution shows the delay added by the reader and the signal delivery.
+*/
+
+#ifndef WITMOTION_HISTOGRAM
+#define WITMOTION_HISTOGRAM
+#include "witmotion/types.h"
+
+#include <atomic>
+#include <ostream>
+
+namespace witmotion
+{
+
+static const size_t WITMOTION_HISTOGRAM_SUB_BITS = 5; ///< \f$ 2^5 \f$ linear sub-buckets per power of two, the relative bucket width is within 1/32
+static const size_t WITMOTION_HISTOGRAM_MAX_BITS = 40; ///< Values up to \f$ 2^{40} \f$ ns (18 minutes), the larger values are counted at the maximum
+static const size_t WITMOTION_HISTOGRAM_BUCKETS = (WITMOTION_HISTOGRAM_MAX_BITS - WITMOTION_HISTOGRAM_SUB_BITS + 1) << WITMOTION_HISTOGRAM_SUB_BITS;
+static const size_t WITMOTION_TIMING_PACKET_TYPES = 11; ///< Packet IDs from \ref pidRTC to \ref pidGPSAccuracy
+static const size_t WITMOTION_TIMING_RING = 4096; ///< Read timestamps kept for the packets not yet delivered by the signal
+
+/*!
+  \brief Log-linear histogram of the durations with the fixed memory footprint.
+
+  The values below \f$ 2^5 \f$ are counted exactly, every following power of two is split into 32 equal sub-buckets, as in HdrHistogram with the precision of about 1.5 significant digits. The percentiles are reported as the upper bound of the bucket, so the relative error does not exceed 3% over the whole range.
+  \note Only one thread may record, any thread may query the histogram at any moment. The recording is a few relaxed loads and stores without the read-modify-write instructions.
+*/
+class witmotion_hdr_histogram
+{
+private:
+    std::atomic<uint64_t> counts[WITMOTION_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<int64_t> min_value;
+    std::atomic<int64_t> max_value;
+public:
+    witmotion_hdr_histogram();
+    static size_t Index(const int64_t value); ///< Bucket index of the value, ns
+    static int64_t UpperBound(const size_t index); ///< Largest value counted by the bucket, ns
+    void Record(const int64_t value); ///< Counts the value, ns, the negative values are counted as zero
+    void Reset(); ///< Should be called from the recording thread
+    uint64_t Count() const;
+    double Mean() const; ///< ns, exact
+    int64_t Min() const; ///< ns, exact, zero if empty
+    int64_t Max() const; ///< ns, exact, zero if empty
+    int64_t Percentile(const double fraction) const; ///< ns, \param fraction - from 0 to 1, e.g. `0.999` for p99.9
+    uint64_t CountBelow(const int64_t value) const; ///< Values counted in the buckets below the one containing the value, exact for the powers of two, ns
+};
+
+/*!
+  \brief Timing statistics of one sensor per packet type.
+
+  The reader calls \ref Arrival with the time of the port read returning the packet, and the inter-arrival time of the packet type is counted. The controller calls \ref Delivery when the packet is received from the signal or the sink, and the read-to-delivery latency is counted. The packets are delivered in the order of arrival, so the read timestamps are passed between the threads through the ring indexed by the packet sequence number; the latency is not counted for the packets delayed by more than \ref WITMOTION_TIMING_RING packets.
+  \note The object uses about 200 KiB. \ref Arrival and \ref Delivery may be called from two different threads, any thread may query the histograms.
+*/
+class witmotion_packet_timing
+{
+private:
+    int64_t last_arrival[WITMOTION_TIMING_PACKET_TYPES];
+    std::atomic<int64_t> ring[WITMOTION_TIMING_RING];
+    std::atomic<uint64_t> arrived;
+    uint64_t delivered;
+public:
+    witmotion_hdr_histogram interarrival[WITMOTION_TIMING_PACKET_TYPES]; ///< Indexed by the packet ID minus \ref pidRTC
+    witmotion_hdr_histogram latency[WITMOTION_TIMING_PACKET_TYPES]; ///< Indexed by the packet ID minus \ref pidRTC
+    witmotion_packet_timing();
+    void Arrival(const uint8_t id, const int64_t timestamp); ///< \param timestamp - time of the port read, nanoseconds of `std::chrono::steady_clock`
+    void Delivery(const uint8_t id, const int64_t timestamp);
+    double Rate(const uint8_t id) const; ///< Effective output frequency of the packet type, Hz, by the mean inter-arrival time, zero if unknown
+    void Report(std::ostream& out) const; ///< Prints the table of the rates and the percentiles for all the received packet types
+};
+
+}
+#endif
@@ -0,0 +1,98 @@
+/*!
+    \file history.h
+    \brief Fixed-memory time-indexed history of the decoded frames
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the circular history of the timestamped frames for a single sensor, answering "last N seconds" and arbitrary time range queries without unbounded storage. The history is written by one thread (usually the reader one) and can be queried concurrently by any number of reader threads without blocking the writer.
+*/
+
+#ifndef WITMOTION_HISTORY
+#define WITMOTION_HISTORY
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+
+#include <atomic>
+#include <vector>
+
+namespace witmotion
+{
+
+/*!
+  \brief Contiguous block of the frames stored in the history, no copy is made.
+*/
+struct witmotion_history_span
+{
+    const witmotion_frame* data;
+    size_t size;
+};
+
+/*!
+  \brief Result of the time range query on \ref witmotion_frame_history.
+
+  The frames are referred in place. Since the storage is circular, the range is represented by up to two contiguous spans in the chronological order; the second span is empty if the range does not wrap around the end of the buffer.
+*/
+struct witmotion_history_range
+{
+    uint64_t first; ///< Sequence number of the first frame in the range
+    uint64_t count; ///< Total number of frames in both spans
+    witmotion_history_span spans[2];
+};
+
+/*!
+  \brief Circular time-indexed history of the decoded frames.
+
+  The memory is allocated at construction. Every appended frame gets the sequence number; when the buffer is full, the oldest frame is overwritten. The frame timestamps are expected to be non-decreasing (as produced by \ref witmotion_frame_assembler), so the time range queries are resolved by the binary search in \f$ O(\log n) \f$.
+
+  The writer never waits for the readers. The queries return zero-copy views (\ref witmotion_history_range) which stay valid until the writer wraps around and overwrites the first frame of the range: after processing the view the reader should call \ref Valid, in the same way as for the sequence lock, and repeat the query if it returns `false`. \ref Copy performs this procedure internally.
+  \note Only one thread may call \ref Append. \ref Reset should not be called concurrently with the queries.
+*/
+class witmotion_frame_history: public witmotion_frame_sink
+{
+private:
+    std::vector<witmotion_frame> ring;
+    std::atomic<uint64_t> head; ///< Number of frames appended
+    const witmotion_frame& At(const uint64_t sequence) const;
+    uint64_t LowerBound(uint64_t begin, uint64_t end, const int64_t timestamp) const;
+    uint64_t UpperBound(uint64_t begin, uint64_t end, const int64_t timestamp) const;
+    witmotion_history_range View(const uint64_t begin, const uint64_t end) const;
+public:
+    /*!
+      \param capacity - maximal number of the stored frames
+     */
+    explicit witmotion_frame_history(const size_t capacity);
+    size_t Capacity() const;
+    uint64_t Appended() const; ///< Total number of frames appended since construction or \ref Reset
+    void Append(const witmotion_frame& frame);
+    virtual void Consume(const witmotion_frame& frame); ///< Same as \ref Append, allows to install the history as \ref witmotion_frame_sink
+    /*!
+      \brief Finds the stored frames with timestamps in the closed interval.
+
+      \param from - start of the interval, nanoseconds
+      \param to - end of the interval, nanoseconds
+     */
+    witmotion_history_range Range(const int64_t from, const int64_t to) const;
+    /*!
+      \brief Finds the stored frames not older than `duration` relatively to the newest frame.
+
+      \param duration - time window, nanoseconds
+     */
+    witmotion_history_range Latest(const int64_t duration) const;
+    bool Valid(const witmotion_history_range& range) const; ///< Checks that the frames referred by the view have not been overwritten by the writer during processing
+    /*!
+      \brief Copies the frames with timestamps in the closed interval.
+
+      \param from - start of the interval, nanoseconds
+      \param to - end of the interval, nanoseconds
+      \param frames - receives the frames, the previous content is replaced
+      \param attempts - number of query repetitions if the writer overwrote the range during the copy
+      \return `true` if the consistent copy has been obtained
+     */
+    bool Copy(const int64_t from,
+              const int64_t to,
+              std::vector<witmotion_frame>& frames,
+              const size_t attempts = 4) const;
+    void Reset();
+};
+
+}
+#endif
@@ -36,7 +36,8 @@ public:
                                  const bool altimeter = true);
     QWitmotionJY901Sensor(const QString device,
                           const QSerialPort::BaudRate rate,
-                          const uint32_t polling_period = 50);
+                          const uint32_t polling_period = 50,
+                          QThread* shared_engine = nullptr);
 };
 
 }
@@ -0,0 +1,116 @@
+/*!
+    \file log-writer.h
+    \brief Asynchronous acquisition log writer
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the log writer moving the file I/O away from the acquisition and user interface threads. The packets are copied into the one of two preallocated blocks without locking, the background thread formats the other block and writes it to the file by large sequential writes, so the memory used by the log is bounded regardless of the acquisition duration.
+*/
+
+#ifndef WITMOTION_LOG_WRITER
+#define WITMOTION_LOG_WRITER
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+#include "witmotion/export.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace witmotion
+{
+
+/*!
+  \brief Log file formats.
+*/
+enum witmotion_log_format
+{
+    logText, ///< Decoded values, one line per packet, as printed by the controller applications
+    logBinary, ///< Raw packets as transmitted by the sensor, 11 bytes per packet, readable by \ref witmotion_packet_parser and `witmotion-allan`
+    logNumPy, ///< Decoded frames, the directory of `.npy` column files, see \ref witmotion_npy_exporter
+    logNumPyArchive ///< Decoded frames, the uncompressed `.npz` archive, see \ref witmotion_npz_exporter
+};
+
+/*!
+  \brief Writes the acquired packets to the file from the dedicated thread.
+
+  The producer side (\ref Push or \ref Consume) is wait-free: the record is appended to the active block, and the full block is handed over to the writer thread by an atomic flag. If the writer thread has not finished the previous block yet, the new packets are dropped and counted by \ref Dropped instead of growing the memory or blocking the producer. The partially filled block is handed over not later than the flush interval after the writer requests it, so the log follows the acquisition with the bounded delay.
+  \note Only one thread may push. \ref Close should be called after the producer stops.
+*/
+class witmotion_log_writer: public witmotion_packet_sink
+{
+private:
+    struct record
+    {
+        int64_t timestamp;
+        witmotion_datapacket packet;
+    };
+    std::string filename;
+    witmotion_log_format format;
+    uint32_t flush_interval;
+    uint32_t sync_interval;
+    int fd;
+    std::vector<record> blocks[2];
+    size_t filled[2];
+    std::atomic<bool> ready[2]; ///< Set by the producer when the block is handed over, cleared by the writer thread when written
+    size_t active;
+    std::atomic<bool> flush_requested;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> failed;
+    uint64_t lines;
+    int64_t origin;
+    std::vector<char> output;
+    std::unique_ptr<witmotion_frame_exporter> exporter; ///< Used by the NumPy formats instead of the file descriptor
+    witmotion_frame_assembler frames;
+    std::thread worker;
+    std::mutex wakeup_guard;
+    std::condition_variable wakeup;
+    std::string error;
+    void Run();
+    void Handover();
+    void Write(const size_t block);
+    bool Flush();
+public:
+    /*!
+      \param file - log file name, the existing file is truncated. The output directory name for \ref logNumPy
+      \param log_format - file format
+      \param block_size - number of packets per block, the memory used is about `2 * block_size * 32` bytes
+      \param flush_ms - maximal delay between the acquisition and the write of the packet, milliseconds
+      \param sync_ms - minimal interval between `fdatasync` calls, milliseconds, 0 disables the synchronization. Ignored for the NumPy formats
+     */
+    witmotion_log_writer(const std::string& file,
+                         const witmotion_log_format log_format = logText,
+                         const size_t block_size = 32768,
+                         const uint32_t flush_ms = 500,
+                         const uint32_t sync_ms = 0);
+    virtual ~witmotion_log_writer();
+    /*!
+      \brief Creates the file and starts the writer thread.
+
+      \param preamble - text written to the beginning of the file synchronously, used only by \ref logText
+      \return `false` if the file cannot be created, \ref Error contains the reason
+     */
+    bool Open(const std::string& preamble = "");
+    void Close(); ///< Writes the remaining packets, stops the writer thread and closes the file
+    bool IsOpen() const;
+    const std::string& Error() const; ///< Reason of the failure of \ref Open, or of the write failure in the writer thread after \ref Close
+    virtual void Consume(const witmotion_datapacket& packet); ///< Pushes the packet with the current `steady_clock` timestamp
+    /*!
+      \brief Appends the packet to the log.
+
+      \param packet - acquired packet
+      \param timestamp - acquisition time, nanoseconds. The text and NumPy formats store the time relative to the first packet
+      \return `false` if the packet is dropped
+     */
+    bool Push(const witmotion_datapacket& packet, const int64_t timestamp);
+    uint64_t Written() const; ///< Number of the packets written to the file
+    uint64_t Dropped() const; ///< Number of the packets dropped because the writer thread was late
+};
+
+}
+#endif
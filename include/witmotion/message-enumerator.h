@@ -5,9 +5,13 @@
 #include <QCommandLineOption>
 #include <QFile>
 #include <QIODevice>
+#include <QTimer>
 
+#include <deque>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include <signal.h>
 #include <stdlib.h>
@@ -19,7 +23,7 @@
 namespace witmotion
 {
 
-class QGeneralSensorController: public QObject
+class QGeneralSensorController: public QObject, public witmotion_packet_sink
 {
     Q_OBJECT
 private:
@@ -36,8 +40,16 @@ private:
     QStringList log;
     QFile* logfile;
     QSet<uint8_t> unknown;
+    bool live;
+    int64_t live_started; ///< ns of `std::chrono::steady_clock`
+    std::unique_ptr<witmotion_sensor_metrics> metrics;
+    std::unique_ptr<witmotion_packet_timing> timing;
+    std::deque<std::pair<int64_t, witmotion_metrics_snapshot>> history; ///< Snapshots covering the last second, the rates are taken over it
+    std::string screen; ///< Refresh buffer, reused between the refreshes
+    QTimer* refresh_timer;
 
     void BuildLog();
+    void Render(const int64_t now, const witmotion_metrics_snapshot& current);
 public:
     QGeneralSensorController(const QString port, const QSerialPort::BaudRate rate);
     virtual ~QGeneralSensorController();
@@ -45,9 +57,18 @@ public:
     void SetLog(const QString name);
     void SetInterval(uint32_t ms);
     void SetTimeout(uint32_t ms);
+    /*!
+      \brief Enables the live census refreshed on the screen, should be called before \ref Start.
+
+      The port is read on the data arrival and drained completely, the packets are counted by the reader metrics and timing in the reader thread and never queued to the main thread, so the reader keeps up with 115200 baud. Every refresh renders the screen into one buffer written at once.
+      \param refresh_ms - screen refresh period
+     */
+    void SetLive(const uint32_t refresh_ms);
+    virtual void Consume(const witmotion_datapacket& packet);
 public slots:
     void Packet(const witmotion_datapacket& packet);
     void Error(const QString& description);
+    void Refresh();
 signals:
     void RunReader();
 };
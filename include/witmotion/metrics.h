@@ -0,0 +1,126 @@
+/*!
+    \file metrics.h
+    \brief Operational metrics of the acquisition and their export in the Prometheus text format
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the per-sensor metrics fed by \ref QBaseSerialWitmotionSensorReader and \ref QAbstractWitmotionSensorController, and the registry exporting them to the Prometheus text exposition format. The registry output is written to the file atomically, so it can be served by the textfile collector of `node_exporter`.
+
+    \section metrics-names Exported metrics
+    All the metrics carry the label `sensor` set to the name given to \ref witmotion_metrics_registry::Sensor.
+    - `witmotion_bytes_total`, `witmotion_reads_total` - bytes read from the port and the reads returning data;
+    - `witmotion_packets_total` - packets delivered by the parser, with the label `id` (e.g. `id="0x51"`);
+    - `witmotion_crc_failures_total`, `witmotion_resyncs_total` - see \ref witmotion_parser_statistics;
+    - `witmotion_unregistered_packets_total` - packets dropped by the controller as not supported by the device class;
+    - `witmotion_timeouts_total`, `witmotion_errors_total` - reported data timeouts and all the reported errors;
+    - `witmotion_port_opens_total` - port openings, the reconnections are the openings after the first one;
+    - `witmotion_config_writes_total` - configuration commands sent to the sensor;
+    - `witmotion_backlog_bytes` - bytes pending in the port buffer at the last read;
+    - `witmotion_poll_interval_seconds` - poll interval of the reader;
+    - `witmotion_data_age_seconds` - time since the last read returning data, absent before the first one;
+    - `witmotion_read_duration_seconds` - histogram of the duration of the read, parsing and delivery per poll.
+*/
+
+#ifndef WITMOTION_METRICS
+#define WITMOTION_METRICS
+#include "witmotion/types.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace witmotion
+{
+
+static const size_t WITMOTION_METRICS_PACKET_TYPES = 11; ///< Packet IDs from \ref pidRTC to \ref pidGPSAccuracy
+static const size_t WITMOTION_METRICS_BUCKETS = 22; ///< Duration histogram buckets: up to \f$ 2^i \f$ microseconds inclusive for \f$ i = 0 \ldots 20 \f$, and the overflow bucket
+
+/*!
+  \brief Values of \ref witmotion_sensor_metrics taken at once, used for the export and the \ref QAbstractWitmotionSensorController::Statistics signal.
+*/
+struct witmotion_metrics_snapshot
+{
+    uint64_t bytes;
+    uint64_t reads;
+    uint64_t packets[WITMOTION_METRICS_PACKET_TYPES]; ///< Indexed by the packet ID minus \ref pidRTC
+    uint64_t crc_failures;
+    uint64_t resyncs;
+    uint64_t unregistered;
+    uint64_t timeouts;
+    uint64_t errors;
+    uint64_t port_opens;
+    uint64_t config_writes;
+    int64_t backlog; ///< Bytes
+    uint32_t poll_interval; ///< ms
+    int64_t last_data; ///< Timestamp of the last read returning data, nanoseconds of `std::chrono::steady_clock`, zero before the first one
+    uint64_t read_duration[WITMOTION_METRICS_BUCKETS]; ///< Non-cumulative bucket counts
+    uint64_t read_duration_sum; ///< ns
+};
+
+/*!
+  \brief Metrics of one sensor.
+
+  The counters are updated by the relaxed atomic operations from the reader and the controller threads and can be read from any thread. The reader updates the byte, parser and duration metrics once per poll and increments only the packet counter per packet, so the metrics add no locking and no allocation to the acquisition.
+*/
+class witmotion_sensor_metrics
+{
+private:
+    std::string name;
+public:
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> reads;
+    std::atomic<uint64_t> packets[WITMOTION_METRICS_PACKET_TYPES];
+    std::atomic<uint64_t> crc_failures;
+    std::atomic<uint64_t> resyncs;
+    std::atomic<uint64_t> unregistered;
+    std::atomic<uint64_t> timeouts;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> port_opens;
+    std::atomic<uint64_t> config_writes;
+    std::atomic<int64_t> backlog;
+    std::atomic<uint32_t> poll_interval;
+    std::atomic<int64_t> last_data;
+    std::atomic<uint64_t> read_duration[WITMOTION_METRICS_BUCKETS];
+    std::atomic<uint64_t> read_duration_sum;
+    explicit witmotion_sensor_metrics(const std::string& sensor);
+    const std::string& Name() const;
+    void Packet(const uint8_t id) ///< Counts the delivered packet
+    {
+        size_t index = static_cast<size_t>(id - pidRTC);
+        if(index < WITMOTION_METRICS_PACKET_TYPES)
+            packets[index].fetch_add(1, std::memory_order_relaxed);
+    }
+    void ReadDuration(const int64_t duration); ///< Accumulates the duration of one poll, ns
+    witmotion_metrics_snapshot Snapshot() const;
+};
+
+/*!
+  \brief Owns the sensor metrics and exports them in the Prometheus text exposition format.
+
+  The registration is protected by the mutex, the metrics objects stay at the same address until the registry is destroyed.
+*/
+class witmotion_metrics_registry
+{
+private:
+    std::mutex guard;
+    std::vector<std::unique_ptr<witmotion_sensor_metrics>> sensors;
+    std::string error;
+public:
+    witmotion_sensor_metrics* Sensor(const std::string& name); ///< Returns the metrics of the sensor, creating them on the first call
+    std::string Format(); ///< All the metrics in the Prometheus text exposition format
+    /*!
+      \brief Writes \ref Format output to the file atomically.
+
+      The output is written to the temporary file `FILE.tmp` and renamed over the file, so the readers never see the partial output. The textfile collector of `node_exporter` reads the files with the `.prom` extension only.
+      \return `false` and sets \ref Error on failure
+     */
+    bool WriteTextfile(const std::string& file);
+    const std::string& Error() const;
+};
+
+}
+
+Q_DECLARE_METATYPE(witmotion::witmotion_metrics_snapshot); ///< \private
+
+#endif
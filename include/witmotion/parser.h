@@ -0,0 +1,117 @@
+/*!
+    \file parser.h
+    \brief Allocation-free byte stream parser for the Witmotion UART protocol
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the packet parser state machine used by \ref QBaseSerialWitmotionSensorReader. It is separated from the reader to be usable on any byte source (serial port, capture file, memory buffer) without involving Qt event delivery.
+*/
+
+#ifndef WITMOTION_PARSER
+#define WITMOTION_PARSER
+#include "witmotion/types.h"
+#include "witmotion/util.h"
+#include "witmotion/trace.h"
+
+namespace witmotion
+{
+
+/*!
+  \brief Cumulative counters maintained by \ref witmotion_packet_parser.
+*/
+struct witmotion_parser_statistics
+{
+    uint64_t bytes; ///< Total number of bytes passed to the parser
+    uint64_t packets; ///< Number of packets delivered to the handler
+    uint64_t crc_failures; ///< Number of complete packets dropped because of CRC mismatch (only counted when validation is enabled)
+    uint64_t resyncs; ///< Number of times the header byte was followed by an unregistered packet ID, so the parser had to search for the next header
+};
+
+/*!
+  \brief Byte stream state machine assembling 11-byte \ref witmotion_datapacket structures.
+
+  The parser keeps only fixed-size internal storage and delivers the assembled packets to a caller-provided handler in place, so the steady-state parsing performs no heap allocation. The handler is a template parameter to allow inlining of lambda functions.
+*/
+class witmotion_packet_parser
+{
+private:
+    enum read_state_t
+    {
+        rsUnknown,
+        rsClear,
+        rsRead
+    }read_state;
+    witmotion_typed_packets packets;
+    witmotion_typed_bytecounts counts;
+    witmotion_packet_id read_cell;
+    bool validate;
+    witmotion_parser_statistics statistics;
+    uint64_t packet_end;
+public:
+    witmotion_packet_parser(const bool validation = false);
+    void SetValidation(const bool value);
+    void Reset(); ///< Drops the partially assembled packet, the counters are left intact
+    const witmotion_parser_statistics& Statistics() const;
+    uint64_t PacketEnd() const; ///< Stream offset following the last byte of the packet being delivered, valid in the handler, e.g. to locate the bytes skipped between the packets
+    /*!
+      \brief Parses a chunk of the byte stream.
+
+      \param data - pointer to the chunk head
+      \param length - chunk length in bytes
+      \param handler - callable object accepting `const witmotion_datapacket&`, invoked for every assembled (and validated, if requested) packet
+     */
+    template<typename Handler> void Feed(const uint8_t* data,
+                                         const size_t length,
+                                         Handler&& handler)
+    {
+        statistics.bytes += length;
+        for(size_t i = 0; i < length; i++)
+        {
+            uint8_t current_byte = data[i];
+            if(read_state == rsClear)
+            {
+                read_state = (current_byte == WITMOTION_HEADER_BYTE) ? rsUnknown : rsClear;
+            }
+            else if(read_state == rsUnknown)
+            {
+                if(id_registered(current_byte))
+                {
+                    read_cell = static_cast<witmotion_packet_id>(current_byte);
+                    counts[read_cell] = 0;
+                    packets[read_cell].header_byte = WITMOTION_HEADER_BYTE;
+                    packets[read_cell].id_byte = read_cell;
+                    read_state = rsRead;
+                }
+                else
+                {
+                    WITMOTION_TRACE1(resync, current_byte);
+                    statistics.resyncs++;
+                    read_state = rsClear;
+                }
+            }
+            else
+            {
+                if(counts[read_cell] == 8)
+                {
+                    packets[read_cell].crc = current_byte;
+                    if(!validate || (packet_crc(packets[read_cell]) == packets[read_cell].crc))
+                    {
+                        statistics.packets++;
+                        packet_end = statistics.bytes - length + i + 1;
+                        handler(packets[read_cell]);
+                    }
+                    else
+                    {
+                        WITMOTION_TRACE3(crc_failure, read_cell, current_byte, packet_crc(packets[read_cell]));
+                        statistics.crc_failures++;
+                    }
+                    read_state = rsClear;
+                }
+                else
+                    packets[read_cell].datastore.raw[counts[read_cell]++] = current_byte;
+            }
+        }
+    }
+};
+
+}
+#endif
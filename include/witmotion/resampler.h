@@ -0,0 +1,156 @@
+/*!
+    \file resampler.h
+    \brief Resampling of the decoded measurements onto the uniform time grid
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    The packets arrive with the USB and the poll timer jitter, and every packet type is acquired at its own instant. This header file contains the resampler interpolating the timestamped measurements onto the fixed clock, and the dedicated timer thread delivering the resampled frames at the constant cadence, independently from the reader polling interval.
+*/
+
+#ifndef WITMOTION_RESAMPLER
+#define WITMOTION_RESAMPLER
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+#include "witmotion/statistics.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace witmotion
+{
+
+/*!
+  \brief Interpolates the timestamped measurements at arbitrary time instants.
+
+  Every measurement type (accelerations, angular velocities, angles, magnetic field, orientation quaternion, temperature, barometry) is kept in the separate ring buffer of the fixed depth, so the memory is bounded and the oldest samples are overwritten. The vectors are interpolated linearly, the Euler angles along the shortest arc, and the orientation quaternion by spherical linear interpolation (slerp).
+
+  The resampled frame is requested for the time instant delayed by the configured latency: the latency should exceed the maximal packet inter-arrival time to keep every requested instant between two acquired samples. If the instant is newer than the last sample of some type, its last value is held and \ref Underruns counter is incremented. If it is older than the oldest buffered sample, the oldest value is used and \ref Overruns counter is incremented, which means that the buffer depth is too low for the requested latency.
+
+  All the methods are thread-safe, so the resampler can be fed from the reader thread and sampled from \ref witmotion_resampling_clock.
+  \note Timestamps are expected in nanoseconds of `std::chrono::steady_clock`, as the timer thread uses this clock.
+*/
+class witmotion_resampler
+{
+private:
+    enum channel_id
+    {
+        chAcceleration,
+        chAngularVelocity,
+        chAngles,
+        chMagnetometer,
+        chOrientation,
+        chTemperature,
+        chAltimeter,
+        chCount
+    };
+    struct sample
+    {
+        int64_t timestamp;
+        double value[4];
+    };
+    struct channel
+    {
+        std::vector<sample> ring;
+        size_t head; ///< Index of the newest sample
+        size_t size;
+    };
+    int64_t latency;
+    channel channels[chCount];
+    uint64_t underruns;
+    uint64_t overruns;
+    mutable std::mutex guard;
+    void Store(const channel_id id, const int64_t timestamp, const double* value, const size_t count);
+    bool Interpolate(const channel_id id, const int64_t timestamp, double* value);
+public:
+    /*!
+      \brief Constructs the resampler.
+
+      \param delay - output latency, nanoseconds
+      \param depth - ring buffer depth per measurement type, samples
+     */
+    witmotion_resampler(const int64_t delay,
+                        const size_t depth = 64);
+    int64_t Latency() const;
+    void SetLatency(const int64_t delay);
+    /*!
+      \brief Decodes the packet and stores the values with the given timestamp.
+
+      \param packet - acquired data packet
+      \param timestamp - acquisition time, nanoseconds of `std::chrono::steady_clock`
+     */
+    void Push(const witmotion_datapacket& packet, const int64_t timestamp);
+    void Push(const witmotion_datapacket& packet); ///< Stores the packet with the current time as a timestamp
+    /*!
+      \brief Interpolates all the measurement types at `timestamp - Latency()`.
+
+      \param timestamp - output time instant, nanoseconds of `std::chrono::steady_clock`
+      \param frame - receives the interpolated values, the `timestamp` field is set to the interpolation instant and the `mask` field marks the available measurement types
+      \return `true` if at least one measurement type is available
+     */
+    bool Sample(const int64_t timestamp, witmotion_frame& frame);
+    uint64_t Underruns() const; ///< Number of measurements held because no newer sample was acquired
+    uint64_t Overruns() const; ///< Number of measurements requested before the oldest buffered sample
+    void Reset();
+};
+
+/*!
+  \brief Hands the frames over from \ref witmotion_resampling_clock to another thread, e.g. to the application event loop printing and logging them.
+
+  The queue is bounded: the frames arriving while it is full are dropped and counted, so the slow consumer never blocks the timer thread.
+*/
+class witmotion_frame_queue: public witmotion_frame_sink
+{
+private:
+    std::vector<witmotion_frame> frames;
+    size_t capacity;
+    uint64_t dropped;
+    mutable std::mutex guard;
+public:
+    explicit witmotion_frame_queue(const size_t depth = 1024);
+    virtual void Consume(const witmotion_frame& frame);
+    void Take(std::vector<witmotion_frame>& taken); ///< Replaces the content of `taken` with the queued frames, the buffers are swapped without the allocation
+    uint64_t Dropped() const; ///< Number of the frames dropped because the queue was full
+};
+
+/*!
+  \brief Dedicated timer thread delivering the resampled frames at the fixed cadence.
+
+  The thread sleeps until the absolute deadlines of `std::chrono::steady_clock`, so the period does not accumulate the drift of the delivery time. If the thread wakes up later than one full period, the missed ticks are skipped and counted instead of being delivered in a burst. The wake-up lateness is accumulated in \ref Jitter.
+*/
+class witmotion_resampling_clock
+{
+private:
+    witmotion_resampler* resampler;
+    witmotion_frame_sink* sink;
+    int64_t period;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> ticks;
+    std::atomic<uint64_t> missed;
+    witmotion_running_statistics jitter;
+    mutable std::mutex jitter_guard;
+    void Run();
+public:
+    /*!
+      \brief Constructs the timer, the thread is not started.
+
+      \param source - resampler to read the frames from
+      \param consumer - receiver of the frames, called from the timer thread
+      \param interval - output period, nanoseconds
+     */
+    witmotion_resampling_clock(witmotion_resampler* source,
+                               witmotion_frame_sink* consumer,
+                               const int64_t interval);
+    ~witmotion_resampling_clock();
+    void Start();
+    void Stop(); ///< Stops and joins the thread, blocks up to one period
+    bool Running() const;
+    int64_t Period() const;
+    uint64_t Ticks() const; ///< Number of frames delivered
+    uint64_t Missed() const; ///< Number of ticks skipped because of the late wake-up
+    witmotion_running_statistics Jitter() const; ///< Wake-up lateness, nanoseconds
+};
+
+}
+#endif
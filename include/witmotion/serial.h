@@ -3,12 +3,16 @@
 
 #include "witmotion/types.h"
 #include "witmotion/util.h"
+#include "witmotion/parser.h"
+#include "witmotion/metrics.h"
+#include "witmotion/histogram.h"
+#include "witmotion/cadence.h"
+
+#include <atomic>
 
 #include <QtCore>
 #include <QSerialPort>
 
-#include <list>
-
 namespace witmotion
 {
 
@@ -22,69 +26,152 @@ private:
     qint64 last_avail;
     quint16 avail_rep_count;
     uint8_t raw_data[128];
-    bool validate;
     bool user_defined_return_interval;
+    uint32_t user_return_interval; ///< ms, set by \ref SetSensorPollInterval, the upper bound of the adaptive interval
     uint32_t return_interval;
     bool user_defined_timeout;
     uint32_t timeout_ms;
     uint32_t timeout_counter;
+    bool event_driven;
+    uint32_t latency_budget; ///< ms, nonzero enables the adaptive poll interval
+    double output_frequency; ///< Hz, from the configuration sent by the library, zero if unknown
+    std::atomic<double> configured_frequency; ///< Copy of \ref output_frequency readable from the other threads
+    uint32_t output_types; ///< Packet types per output cycle, from the configuration sent by the library, zero if unknown
+    uint64_t window_bytes;
+    int64_t window_start;
+    double observed_rate; ///< Bytes per second over the last window, zero if unknown
 protected:
     QTextStream ttyout;
     QTimer* poll_timer;
     QMetaObject::Connection timer_connection;
     QMetaObject::Connection config_connection;
-    enum read_state_t
-    {
-        rsUnknown,
-        rsClear,
-        rsRead
-    }read_state;
-    witmotion_typed_packets packets;
-    witmotion_typed_bytecounts counts;
-    witmotion_packet_id read_cell;
+    QMetaObject::Connection read_connection;
+    witmotion_packet_parser parser;
+    witmotion_packet_sink* packet_sink;
+    witmotion_sensor_metrics* metrics;
+    witmotion_parser_statistics reported; ///< Parser counters already added to \ref metrics
+    witmotion_packet_timing* timing;
 
     volatile bool configuring;
-    std::list<witmotion_config_packet> configuration;
+    witmotion_config_queue configuration;
+    witmotion_config_sequence sequence; ///< Sequence being applied by \ref ContinueSequence, the zero length if none
+    size_t sequence_position; ///< Next command of \ref sequence
+    QTimer* sequence_timer; ///< Paces the commands of \ref sequence by \ref witmotion_config_sequence.delay without blocking the thread
     virtual void ReadData();
     virtual void Configure();
     virtual void SendConfig(const witmotion_config_packet& packet);
+    bool WriteConfig(const witmotion_config_packet& packet); ///< Writes one command to the port and switches the port after the \ref ridPortBaudRate command, \return `false` if the port write or the switch failed
+    void ConfigurationApplied(const bool error); ///< Completes the configuration pass, warns if the configured output exceeds the link capacity
+    void ContinueSequence(); ///< Writes the next command of \ref sequence and schedules the following one, completes the sequence after the last one
+    void FinishSequence(const bool error);
+    void ReportMetrics(const int64_t started, const qint64 backlog);
+    void AdaptPollInterval(const bool forced); ///< Recomputes the adaptive poll interval, the small changes are ignored unless `forced`
+    uint32_t AdaptiveIntervalBound() const; ///< Latency budget limited by the poll interval set by \ref SetSensorPollInterval, ms
 public:
-    void SetBaudRate(const QSerialPort::BaudRate& rate);
     QBaseSerialWitmotionSensorReader(const QString device, const QSerialPort::BaudRate rate);
     virtual ~QBaseSerialWitmotionSensorReader();
     virtual void RunPoll();
     virtual void Suspend();
+    void Shutdown(); ///< Closes the port and schedules the deletion of the reader in its thread, used when the reader thread is shared by several sensors
     void ValidatePackets(const bool value);
+    void SetPacketSink(witmotion_packet_sink* sink);
     void SetSensorPollInterval(const uint32_t ms);
     void SetSensorTimeout(const uint32_t ms);
+    void SetEventDriven(const bool value); ///< Reads the port on `readyRead` instead of waiting for the next timer tick, should be called before \ref RunPoll
+    void SetMetrics(witmotion_sensor_metrics* value); ///< Should be called before \ref RunPoll, `nullptr` disables the metrics
+    void SetTiming(witmotion_packet_timing* value); ///< Should be called before \ref RunPoll, `nullptr` disables the timing statistics
+    double ConfiguredFrequency() const; ///< Output frequency written to the sensor by the last \ref ridOutputFrequency command, Hz, zero if none was sent; thread-safe
+    /*!
+      \brief Derives the poll interval from the link load instead of using the fixed one, see \ref witmotion_poll_interval.
+
+      The output frequency and the packet types are taken from the configuration commands sent through the reader (\ref ridOutputFrequency, \ref ridOutputValueSet), so the interval follows the reconfiguration at runtime. Until they are known, the interval follows the observed byte rate. The interval set by \ref SetSensorPollInterval is kept as the upper bound, so the adaptation only shortens it. The timeout, unless set by \ref SetSensorTimeout, is extended to three output periods (1 s while the frequency is unknown). Should be called before \ref RunPoll.
+      \param ms - latency budget, the maximal poll interval together with the one set by \ref SetSensorPollInterval, zero restores the fixed interval
+     */
+    void SetLatencyBudget(const uint32_t ms);
+    /*!
+      \brief Writes the whole configuration sequence at once, the slot invoked in the reader thread.
+
+      The pending commands queued by \ref SendConfig are written first. The commands of the sequence are written one by one, paced by the single-shot timer, so the thread keeps serving the other readers sharing it during the delays; the reads of this port and the other configuration commands are held until the sequence completes. If the sequence contains the \ref ridPortBaudRate command, the port is switched to the new rate right after it, so the following commands, e.g. \ref ridSaveSettings, reach the sensor at the new rate. The sequence is rejected with \ref Error if the port is not open yet or the previous sequence is still being applied.
+     */
+    virtual void SendConfigSequence(const witmotion_config_sequence& value);
+signals:
+    void Configured(); ///< Emitted when the configuration pass or sequence has been written without errors, the errors are reported by \ref Error
 };
 
-class QAbstractWitmotionSensorController: public QObject
+class QAbstractWitmotionSensorController: public QObject, public witmotion_packet_sink
 {
     Q_OBJECT
 private:
     QThread reader_thread;
+    QThread* engine; ///< Reader thread shared with the other sensors, `nullptr` if the own \ref reader_thread is used
 protected:
     QString port_name;
     QSerialPort::BaudRate port_rate;
     QBaseSerialWitmotionSensorReader* reader;
     QTextStream ttyout;
+    witmotion_packet_sink* packet_sink;
+    witmotion_sensor_metrics* metrics;
+    QTimer* statistics_timer;
+    witmotion_packet_timing* timing;
+    witmotion_cadence_estimator* cadence;
+    int64_t cadence_interval; ///< ns
+    int64_t cadence_reported;
+    double cadence_rate; ///< Configured output frequency last passed to \ref cadence, Hz
+    void Deliver(const witmotion_datapacket& packet, const int64_t timestamp); ///< Feeds the cadence estimator with the registered packet
 public:
     virtual const std::set<witmotion_packet_id>* RegisteredPacketTypes() = 0;
-    QAbstractWitmotionSensorController(const QString tty_name, const QSerialPort::BaudRate rate);
+    /*!
+      \param tty_name - serial device name
+      \param rate - port baud rate
+      \param shared_engine - running thread serving the readers of several sensors in one event loop, e.g. in the daemon, `nullptr` starts the own reader thread. The reader is stopped synchronously in that thread when the controller is destroyed, so the thread should outlive the controller
+     */
+    QAbstractWitmotionSensorController(const QString tty_name, const QSerialPort::BaudRate rate, QThread* shared_engine = nullptr);
     virtual void Start() = 0;
     virtual ~QAbstractWitmotionSensorController();
     virtual void Calibrate() = 0;
     virtual void SetBaudRate(const QSerialPort::BaudRate& rate) = 0;
     void SetValidation(const bool validate);
+    void SetEventDriven(const bool value); ///< See \ref QBaseSerialWitmotionSensorReader::SetEventDriven, should be called before \ref Start
+    void SetSensorTimeout(const uint32_t ms); ///< Maximal period without data before the error is reported, ms, should be called before \ref Start
+    void SetPacketSink(witmotion_packet_sink* sink);
+    /*!
+      \brief Feeds the metrics from the reader and the controller, should be called before \ref Start.
+
+      \param value - metrics of the sensor, usually obtained from \ref witmotion_metrics_registry::Sensor, `nullptr` disables the metrics
+      \param interval - period of the \ref Statistics signal, ms, zero disables the signal
+     */
+    void SetMetrics(witmotion_sensor_metrics* value, const uint32_t interval = 0);
+    void SetTiming(witmotion_packet_timing* value); ///< Collects the per-packet-type inter-arrival and read-to-delivery timing, should be called before \ref Start
+    void SetLatencyBudget(const uint32_t ms); ///< See \ref QBaseSerialWitmotionSensorReader::SetLatencyBudget, should be called before \ref Start
+    /*!
+      \brief Feeds the estimator of the effective rate and the packet loss, should be called before \ref Start.
+
+      The estimator is fed from the thread delivering the packets: the thread of the controller, or the reader thread if the packet sink is installed. Once the output frequency is written to the sensor, e.g. by `SetPollingRate` of the derived classes or \ref ApplyConfiguration, it becomes the expected rate of the estimator. It should be queried from the same thread, or through the \ref Cadence signal.
+      \param value - estimator, `nullptr` disables the estimation
+      \param interval - period of the \ref Cadence signal, ms, zero disables the signal
+     */
+    void SetCadence(witmotion_cadence_estimator* value, const uint32_t interval = 0);
+    /*!
+      \brief Applies the configuration sequence atomically, e.g. the one produced by \ref witmotion_bandwidth_planner::Sequence.
+
+      Unlike the setters of the derived classes, the call does not block, and the commands are not interleaved with the port reads. Should be called after \ref Start.
+     */
+    void ApplyConfiguration(const witmotion_config_sequence& sequence);
+    virtual void Consume(const witmotion_datapacket& packet);
 public slots:
     virtual void Packet(const witmotion_datapacket& packet);
     virtual void Error(const QString& description);
 signals:
     void RunReader();
+    void StopReader();
+    void SuspendReader(); ///< Suspends the reader in its own thread, emitted on the error
     void ErrorOccurred(const QString& description);
     void Acquired(const witmotion_datapacket& packet);
     void SendConfig(const witmotion_config_packet& packet);
+    void SendConfigSequence(const witmotion_config_sequence& sequence);
+    void Statistics(const witmotion_metrics_snapshot& snapshot);
+    void Cadence(const witmotion_cadence_report& report);
+    void Configured(); ///< See \ref QBaseSerialWitmotionSensorReader::Configured
 };
 
 }
@@ -0,0 +1,110 @@
+/*!
+    \file shared-memory.h
+    \brief POSIX shared memory publisher and client for the multi-process data distribution
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    Only one process can own the serial port. This header file contains the publisher which mirrors the acquired stream into the POSIX shared memory object, and the client reading it from any number of other processes. The publisher is fed directly from the reader thread (\ref witmotion_packet_sink), the client reads the shared memory without system calls, so the fan-out costs a few memory copies per consumer.
+
+    The shared memory object contains:
+    - the latest value block per packet type, protected by the sequence lock;
+    - the ring of the recent decoded frames (\ref witmotion_frame), every slot protected by its own sequence stamp, so the readers never block the publisher and detect overwritten slots.
+*/
+
+#ifndef WITMOTION_SHARED_MEMORY
+#define WITMOTION_SHARED_MEMORY
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+
+#include <string>
+
+namespace witmotion
+{
+
+static const uint32_t WITMOTION_SHM_MAGIC = 0x574D5348; ///< "WMSH"
+static const uint32_t WITMOTION_SHM_VERSION = 1;
+static const size_t WITMOTION_SHM_PACKET_TYPES = 11; ///< Packet IDs from \ref pidRTC to \ref pidGPSAccuracy
+
+/*!
+  \brief Writes the acquired stream into the POSIX shared memory object.
+
+  The packets are stored into the latest value blocks and assembled into the frames by the internal \ref witmotion_frame_assembler. The timestamps are taken from `std::chrono::steady_clock` (`CLOCK_MONOTONIC`), which is common for all the processes of the host. The object is created by \ref Open and removed by \ref Close or the destructor.
+  \note Only one thread may publish. To publish from the reader thread, install the object by \ref QAbstractWitmotionSensorController::SetPacketSink.
+*/
+class witmotion_shm_publisher: public witmotion_packet_sink
+{
+private:
+    std::string name;
+    size_t capacity;
+    void* memory;
+    size_t size;
+    witmotion_frame_assembler frames;
+    std::string error;
+public:
+    /*!
+      \param object - shared memory object name, starting with `/`, e.g. `/witmotion-ttyUSB0`
+      \param depth - number of frames kept in the ring
+     */
+    witmotion_shm_publisher(const std::string& object,
+                            const size_t depth = 1024);
+    virtual ~witmotion_shm_publisher();
+    bool Open(); ///< Creates (or re-creates) and maps the shared memory object, returns `false` and sets \ref Error on failure
+    void Close(); ///< Unmaps and unlinks the shared memory object
+    bool IsOpen() const;
+    const std::string& Error() const;
+    virtual void Consume(const witmotion_datapacket& packet); ///< Publishes the packet with the current timestamp
+    void Publish(const witmotion_datapacket& packet, const int64_t timestamp);
+    void Publish(const witmotion_frame& frame); ///< Appends the frame assembled elsewhere to the ring
+};
+
+/*!
+  \brief Reads the stream published by \ref witmotion_shm_publisher.
+
+  After \ref Open all the read methods access the mapped memory only, no system calls are made. The reads are wait-free for the publisher and may be retried by the client if the publisher updates the same block concurrently.
+*/
+class witmotion_shm_client
+{
+private:
+    std::string name;
+    const void* memory;
+    size_t size;
+    size_t capacity;
+    std::string error;
+public:
+    explicit witmotion_shm_client(const std::string& object);
+    ~witmotion_shm_client();
+    bool Open(); ///< Maps the shared memory object read-only, returns `false` and sets \ref Error if it does not exist or is incompatible
+    void Close();
+    bool IsOpen() const;
+    const std::string& Error() const;
+    size_t Capacity() const;
+    /*!
+      \brief Reads the latest packet of the given type.
+
+      \param id - packet type
+      \param packet - receives the packet
+      \param timestamp - receives the acquisition time, nanoseconds of `CLOCK_MONOTONIC`
+      \param updates - if not `nullptr`, receives the number of the packets of this type published so far
+      \return `false` if no packet of this type has been published, or the block could not be read consistently within a bounded number of attempts, e.g. because the publisher died in the middle of the write
+     */
+    bool Latest(const witmotion_packet_id id,
+                witmotion_datapacket& packet,
+                int64_t& timestamp,
+                uint64_t* updates = nullptr) const;
+    uint64_t Head() const; ///< Sequence number of the next frame to be published
+    /*!
+      \brief Reads the new frames.
+
+      \param cursor - sequence number of the next frame to read, updated on return. If the client lags behind by more than \ref Capacity frames, the cursor jumps to the oldest available frame
+      \param frames - destination array
+      \param count - destination array size
+      \param lost - if not `nullptr`, receives the number of the frames skipped because of the lag
+      \return Number of frames written
+     */
+    size_t Poll(uint64_t& cursor,
+                witmotion_frame* frames,
+                const size_t count,
+                uint64_t* lost = nullptr) const;
+};
+
+}
+#endif
@@ -0,0 +1,128 @@
+/*!
+    \file statistics.h
+    \brief Streaming statistics accumulators for the decoded measurements
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the constant-memory accumulators used to characterize sensor noise on arbitrarily long acquisition sessions without storing the samples.
+*/
+
+#ifndef WITMOTION_STATISTICS
+#define WITMOTION_STATISTICS
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+
+namespace witmotion
+{
+
+/*!
+  \brief Running mean/variance accumulator for a single measurement channel.
+
+  Implements the single-pass Welford recurrence in double precision, so the result stays numerically stable on long sessions (millions of samples) and the memory footprint is constant. The accumulator can be queried at any moment during the acquisition. Two accumulators can be merged by \ref Merge (Chan et al. parallel formula), which allows to collect partial statistics in different threads.
+*/
+class witmotion_running_statistics
+{
+private:
+    uint64_t count;
+    double mean;
+    double m2;
+    double min_value;
+    double max_value;
+public:
+    witmotion_running_statistics();
+    void Push(const double value); ///< Accumulates one sample
+    void Merge(const witmotion_running_statistics& other); ///< Accumulates all the samples seen by another accumulator
+    void Reset();
+    uint64_t Count() const;
+    double Mean() const;
+    double Variance() const; ///< Unbiased (sample) variance, \f$ \frac{1}{n-1}\sum(x_i - \bar{x})^2 \f$, zero for less than 2 samples
+    double StandardDeviation() const;
+    double Min() const;
+    double Max() const;
+};
+
+/*!
+  \brief Running covariance matrix accumulator for an `N`-dimensional measurement vector.
+
+  Multivariate generalization of the Welford recurrence: keeps the running mean vector and the \f$ N \times N \f$ co-moment matrix in double precision, so the memory footprint is constant. The full matrix, including the cross-axis terms, can be read at any moment.
+*/
+template<size_t N> class witmotion_running_covariance
+{
+private:
+    uint64_t count;
+    double mean[N];
+    double comoment[N][N];
+public:
+    witmotion_running_covariance()
+    {
+        Reset();
+    }
+    template<typename T> void Push(const T* value)
+    {
+        double delta[N];
+        count++;
+        for(size_t i = 0; i < N; i++)
+        {
+            delta[i] = static_cast<double>(value[i]) - mean[i];
+            mean[i] += delta[i] / static_cast<double>(count);
+        }
+        for(size_t i = 0; i < N; i++)
+            for(size_t j = i; j < N; j++)
+                comoment[i][j] += delta[i] * (static_cast<double>(value[j]) - mean[j]);
+    }
+    void Reset()
+    {
+        count = 0;
+        for(size_t i = 0; i < N; i++)
+        {
+            mean[i] = 0.0;
+            for(size_t j = 0; j < N; j++)
+                comoment[i][j] = 0.0;
+        }
+    }
+    uint64_t Count() const
+    {
+        return count;
+    }
+    double Mean(const size_t i) const
+    {
+        return mean[i];
+    }
+    double Covariance(const size_t i, const size_t j) const ///< Unbiased covariance between components `i` and `j`, zero for less than 2 samples
+    {
+        if(count < 2)
+            return 0.0;
+        return ((i <= j) ? comoment[i][j] : comoment[j][i]) / static_cast<double>(count - 1);
+    }
+    /*!
+      \brief Writes the full matrix in row-major order, as expected by ROS `covariance` message fields.
+
+      \param matrix - destination array of `N * N` elements
+     */
+    template<typename T> void Matrix(T* matrix) const
+    {
+        for(size_t i = 0; i < N; i++)
+            for(size_t j = 0; j < N; j++)
+                matrix[i * N + j] = static_cast<T>(Covariance(i, j));
+    }
+};
+
+/*!
+  \brief Online noise covariance accumulator over the decoded frames.
+
+  Accumulates full 3x3 covariance matrices for acceleration, angular velocity, Euler angles and magnetic field, and the 6x6 joint covariance of acceleration and angular velocity, which contains the accelerometer/gyroscope cross-covariance block. Only the frames containing the corresponding packet types contribute to each matrix.
+*/
+class witmotion_frame_covariance
+{
+public:
+    witmotion_running_covariance<3> acceleration;
+    witmotion_running_covariance<3> angular_velocity;
+    witmotion_running_covariance<3> angles;
+    witmotion_running_covariance<3> magnetic_field;
+    witmotion_running_covariance<6> inertial; ///< Joint [ax, ay, az, wx, wy, wz] covariance, the upper right 3x3 block is the accelerometer/gyroscope cross-covariance
+    witmotion_running_statistics temperature;
+    void Push(const witmotion_frame& frame);
+    void Reset();
+};
+
+}
+#endif
@@ -0,0 +1,173 @@
+/*!
+    \file stream.h
+    \brief Local streaming server and client over Unix domain sockets
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the compact binary protocol used to distribute the acquired packets and the decoded frames of one or many sensors to the local subscribers, the server implementation used by `witmotiond` and the minimal blocking client.
+
+    \section stream-protocol Protocol
+    All the multibyte values are little-endian, floating point values are IEEE 754.
+    - After connecting, the subscriber sends the subscription request of \ref WITMOTION_STREAM_REQUEST_SIZE bytes: message type \ref smtSubscribe (1 byte), mode \ref smtPackets or \ref smtFrames (1 byte), packet type mask (2 bytes, bit `i` enables packet ID `0x50 + i`), sensor mask (2 bytes, bit `i` enables sensor `i`), batch size (2 bytes, number of records per message). The request can be repeated at any time to change the subscription.
+    - The server sends the messages consisting of the header of \ref WITMOTION_STREAM_HEADER_SIZE bytes: message type (1 byte), reserved (1 byte), number of records (2 bytes), number of records dropped since the previous message because the subscriber did not read fast enough (4 bytes); and the records following the header.
+    - Packet record (\ref WITMOTION_STREAM_PACKET_RECORD_SIZE bytes): sensor index (1 byte), acquisition timestamp (8 bytes, nanoseconds of `CLOCK_MONOTONIC`), the packet as transmitted by the sensor (11 bytes).
+    - Frame record (\ref WITMOTION_STREAM_FRAME_RECORD_SIZE bytes): sensor index (1 byte), timestamp (8 bytes), mask (4 bytes), accelerations, angular velocities, angles, magnetic field (3 floats each), orientation (4 floats), temperature (1 float), pressure and altitude (2 doubles). For the frame mode the packet type mask selects the frames containing at least one of the enabled packet types.
+*/
+
+#ifndef WITMOTION_STREAM
+#define WITMOTION_STREAM
+#include "witmotion/types.h"
+#include "witmotion/frame.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace witmotion
+{
+
+/*!
+  \brief Stream protocol message types.
+*/
+enum witmotion_stream_message_type
+{
+    smtSubscribe = 0x01, ///< Subscription request, subscriber to server
+    smtPackets = 0x10, ///< Batch of packet records, also used as a mode in the subscription request
+    smtFrames = 0x11 ///< Batch of frame records, also used as a mode in the subscription request
+};
+
+static const size_t WITMOTION_STREAM_REQUEST_SIZE = 8;
+static const size_t WITMOTION_STREAM_HEADER_SIZE = 8;
+static const size_t WITMOTION_STREAM_PACKET_RECORD_SIZE = 20;
+static const size_t WITMOTION_STREAM_FRAME_RECORD_SIZE = 97;
+static const size_t WITMOTION_STREAM_MAX_SENSORS = 16;
+
+/*!
+  \brief Subscription parameters, see \ref stream-protocol.
+*/
+struct witmotion_stream_subscription
+{
+    witmotion_stream_message_type mode;
+    uint16_t packet_mask;
+    uint16_t sensor_mask;
+    uint16_t batch;
+};
+
+void encode_stream_subscription(const witmotion_stream_subscription& subscription, uint8_t* data);
+bool decode_stream_subscription(const uint8_t* data, witmotion_stream_subscription& subscription); ///< Returns `false` if the request is malformed
+void encode_stream_packet(const uint8_t sensor, const witmotion_datapacket& packet, const int64_t timestamp, uint8_t* data);
+void decode_stream_packet(const uint8_t* data, uint8_t& sensor, witmotion_datapacket& packet, int64_t& timestamp);
+void encode_stream_frame(const uint8_t sensor, const witmotion_frame& frame, uint8_t* data);
+void decode_stream_frame(const uint8_t* data, uint8_t& sensor, witmotion_frame& frame);
+
+/*!
+  \brief Unix domain socket server distributing the acquired data to the subscribers.
+
+  \ref Publish is called from the reader threads of the sensors (see \ref witmotion_stream_sensor_sink). It encodes the records into the bounded per-subscriber buffers allocated at the subscription time, so the reader threads never wait for the sockets. The dedicated I/O thread accepts the connections, handles the subscription requests and sends the batches by the non-blocking writes. When the subscriber is not able to read in time, its buffer fills up and the new records are dropped for this subscriber only; the number of the dropped records is reported in the next message header.
+
+  The batch is sent when the requested number of records is collected, or when the flush interval elapses.
+*/
+class witmotion_stream_server
+{
+private:
+    struct subscriber;
+    std::string path;
+    size_t buffer_size;
+    uint32_t flush_interval;
+    int listener;
+    int wakeup[2];
+    std::atomic<bool> running;
+    std::thread worker;
+    std::mutex subscribers_guard;
+    std::vector<std::unique_ptr<subscriber>> subscribers;
+    witmotion_frame_assembler frames[WITMOTION_STREAM_MAX_SENSORS];
+    std::string error;
+    void Run();
+    void Accept();
+    bool Receive(subscriber& client);
+    bool Send(subscriber& client, const bool flush);
+    void Wake();
+public:
+    /*!
+      \param socket_path - filesystem path of the socket, the stale file is replaced
+      \param buffer - per-subscriber buffer size, bytes
+      \param flush_ms - maximal delay of the incomplete batch, milliseconds
+     */
+    witmotion_stream_server(const std::string& socket_path,
+                            const size_t buffer = 262144,
+                            const uint32_t flush_ms = 10);
+    ~witmotion_stream_server();
+    bool Open(); ///< Creates the socket and starts the I/O thread, returns `false` and sets \ref Error on failure
+    void Close(); ///< Stops the I/O thread, disconnects the subscribers and removes the socket file
+    const std::string& Error() const;
+    size_t Subscribers();
+    /*!
+      \brief Distributes the packet to the subscribers.
+
+      Different sensors can be published from different threads concurrently, but every sensor index should be published from one thread only, as the frames are assembled per sensor.
+
+      \param sensor - sensor index, less than \ref WITMOTION_STREAM_MAX_SENSORS
+      \param packet - acquired packet
+      \param timestamp - acquisition time, nanoseconds of `CLOCK_MONOTONIC`
+     */
+    void Publish(const uint8_t sensor, const witmotion_datapacket& packet, const int64_t timestamp);
+};
+
+/*!
+  \brief Packet sink forwarding the packets of one sensor to \ref witmotion_stream_server with the current timestamp.
+
+  Install it by \ref QAbstractWitmotionSensorController::SetPacketSink to serve the subscribers directly from the reader thread.
+*/
+class witmotion_stream_sensor_sink: public witmotion_packet_sink
+{
+private:
+    witmotion_stream_server* server;
+    uint8_t sensor;
+    witmotion_packet_sink* next;
+public:
+    /*!
+      \param target - server to publish to
+      \param index - sensor index
+      \param chained - optional sink receiving the same packets after the server, e.g. \ref witmotion_shm_publisher
+     */
+    witmotion_stream_sensor_sink(witmotion_stream_server* target,
+                                 const uint8_t index,
+                                 witmotion_packet_sink* chained = nullptr);
+    virtual void Consume(const witmotion_datapacket& packet);
+};
+
+/*!
+  \brief Minimal blocking subscriber for \ref witmotion_stream_server.
+*/
+class witmotion_stream_client
+{
+private:
+    int socket_fd;
+    std::string error;
+    bool ReadExactly(uint8_t* data, const size_t size);
+public:
+    witmotion_stream_client();
+    ~witmotion_stream_client();
+    bool Connect(const std::string& socket_path); ///< Returns `false` and sets \ref Error on failure
+    bool Subscribe(const witmotion_stream_subscription& subscription);
+    /*!
+      \brief Blocks until the next message is received.
+
+      \param type - receives the message type
+      \param records - receives the encoded records, decode them by \ref decode_stream_packet or \ref decode_stream_frame
+      \param count - receives the number of the records
+      \param dropped - receives the number of the records dropped by the server since the previous message
+      \return `false` if the connection is closed or the protocol error occurred
+     */
+    bool Read(witmotion_stream_message_type& type,
+              std::vector<uint8_t>& records,
+              size_t& count,
+              uint32_t& dropped);
+    void Disconnect();
+    const std::string& Error() const;
+};
+
+}
+#endif
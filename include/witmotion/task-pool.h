@@ -0,0 +1,62 @@
+/*!
+    \file task-pool.h
+    \brief Work-stealing thread pool for the offline processing
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the thread pool used by the offline tools to process many capture files, and the parts of the large ones, on all the available cores. The tasks have very different durations (the file sizes are arbitrary), so every worker owns the task queue and the idle workers steal the tasks from the others instead of waiting for the single shared queue to be refilled.
+*/
+
+#ifndef WITMOTION_TASK_POOL
+#define WITMOTION_TASK_POOL
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace witmotion
+{
+
+/*!
+  \brief Thread pool with the per-worker queues and the work stealing.
+
+  The task submitted from the worker thread (e.g. the parts of the file spawned by the file task) is pushed to the queue of this worker, and the worker takes the tasks from the back of its own queue, so the recently spawned tasks run first on the warm cache. The idle worker takes the oldest task from the front of the other queue. The tasks are coarse-grained (milliseconds and more), so every queue is protected by its own mutex.
+*/
+class witmotion_task_pool
+{
+private:
+    struct worker_queue
+    {
+        std::mutex guard;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued; ///< Tasks in the queues
+    std::atomic<size_t> pending; ///< Tasks in the queues and running
+    std::atomic<size_t> next; ///< Round-robin queue for the tasks submitted from outside
+    std::atomic<uint64_t> stolen;
+    bool stopping;
+    std::mutex idle_guard;
+    std::condition_variable idle;
+    std::condition_variable finished;
+    void Run(const size_t index);
+    bool Take(const size_t index, std::function<void()>& task);
+public:
+    /*!
+      \param threads - number of worker threads, `0` means hardware concurrency
+     */
+    explicit witmotion_task_pool(const size_t threads = 0);
+    ~witmotion_task_pool(); ///< Waits for all the tasks and stops the workers
+    size_t Threads() const;
+    void Submit(std::function<void()> task); ///< Can be called from any thread including the tasks themselves
+    void Wait(); ///< Blocks until all the submitted tasks, and the tasks submitted by them, are completed
+    uint64_t Stolen() const; ///< Number of the tasks taken from the queues of the other workers
+};
+
+}
+#endif
@@ -0,0 +1,45 @@
+/*!
+    \file trace.h
+    \brief Static tracepoints of the acquisition path
+    \author Andrey Vukolov andrey.vukolov@elettra.eu
+
+    This header file contains the macros placing the USDT (SystemTap SDT) probes of the provider `witmotion` into the reader, the parser and the configuration path. The probes are compiled in only when the library is built with `-DENABLE_TRACEPOINTS=ON` (requires `sys/sdt.h`, package `systemtap-sdt-dev` on Debian-based distributions). Otherwise the macros expand to nothing and their arguments are not evaluated. A compiled-in probe is a single `nop` instruction until a tracer attaches to it, so the probes are left in the production builds and are used on the live systems by `perf`, `bpftrace` or SystemTap without rebuilding, e.g.:
+    ```sh
+    bpftrace -e 'usdt:/usr/lib/libwitmotion-uart.so:witmotion:read_start { @start[tid] = nsecs; }
+                 usdt:/usr/lib/libwitmotion-uart.so:witmotion:read_end /@start[tid]/ { @read = hist(nsecs - @start[tid]); delete(@start[tid]); }'
+    ```
+
+    \section trace-probes Probes
+    | Probe | Arguments | Location |
+    |-------|-----------|----------|
+    | `read_start` | | Entry of the timer or `readyRead` driven read |
+    | `read_available` | bytes available | After `bytesAvailable()` |
+    | `read_chunk` | bytes read | After every port read, before the chunk is parsed |
+    | `read_end` | bytes read in total | After the parsing and the delivery of the packets to the sink or the signal |
+    | `packet` | packet ID | Packet assembled by the reader, before the delivery |
+    | `deliver` | packet ID | Packet received by the controller from the signal or the sink |
+    | `crc_failure` | packet ID, received checksum, computed checksum | Packet dropped by the parser |
+    | `resync` | byte following the header | Header followed by an unregistered packet ID |
+    | `config_start` | commands queued | Entry of the configuration task |
+    | `config_write` | register address, bytes written | After every configuration command is written and flushed |
+    | `config_end` | `1` on error | Configuration task completed |
+    | `error` | description (C string) | Error reported to the controller |
+*/
+
+#ifndef WITMOTION_TRACE_PROBES
+#define WITMOTION_TRACE_PROBES
+
+#if defined(WITMOTION_TRACEPOINTS)
+#include <sys/sdt.h>
+#define WITMOTION_TRACE(probe) DTRACE_PROBE(witmotion, probe)
+#define WITMOTION_TRACE1(probe, a) DTRACE_PROBE1(witmotion, probe, a)
+#define WITMOTION_TRACE2(probe, a, b) DTRACE_PROBE2(witmotion, probe, a, b)
+#define WITMOTION_TRACE3(probe, a, b, c) DTRACE_PROBE3(witmotion, probe, a, b, c)
+#else
+#define WITMOTION_TRACE(probe)
+#define WITMOTION_TRACE1(probe, a)
+#define WITMOTION_TRACE2(probe, a, b)
+#define WITMOTION_TRACE3(probe, a, b, c)
+#endif
+
+#endif
@@ -339,6 +339,20 @@ struct witmotion_config_packet
     }setting; ///< 2-byte internal data storage array represented as C-style memory union. The values should be formulated byte-by-byte referring to the actual sensor's documentation.
 };
 
+/*!
+  \brief Abstract interface for direct (synchronous) packet consumers.
+
+  The object implementing this interface can be installed into the reader via \ref QBaseSerialWitmotionSensorReader::SetPacketSink or into the controller via \ref QAbstractWitmotionSensorController::SetPacketSink. In this case the packets are delivered by plain virtual call from the reader thread, bypassing the queued Qt signal delivery which allocates an event object per packet.
+  \note The implementation is called from the reader thread, so it should not block and should not allocate memory to keep the acquisition path allocation-free.
+  \note Only the sink path is free of the steady-state allocations, as checked by `witmotion-alloc-check`. The applications receiving the packets through the \ref QAbstractWitmotionSensorController::Acquired signal, e.g. the `wt901-control`, `jy901-control` and `wt31n-control` tools, still allocate one queued event per packet.
+*/
+class witmotion_packet_sink
+{
+public:
+    virtual ~witmotion_packet_sink() {}
+    virtual void Consume(const witmotion_datapacket& packet) = 0; ///< Called once per every acquired (and validated, if requested) packet
+};
+
 /*!
   \brief Abstract base class to program convenience classes for the sensors.
 
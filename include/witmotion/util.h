@@ -28,6 +28,42 @@ public:
     size_t& operator[](const witmotion_packet_id id);
 };
 
+/*!
+  \brief Fixed-capacity FIFO queue for the configuration packets.
+
+  Replaces the dynamically allocated list in the reader, so queueing of the configuration commands performs no heap allocation. The queue is not thread-safe and it is intended to be used from the reader thread only.
+*/
+class witmotion_config_queue
+{
+public:
+    static const size_t capacity = 64; ///< Maximal number of the configuration packets pending
+private:
+    witmotion_config_packet array[capacity];
+    size_t head;
+    size_t length;
+public:
+    witmotion_config_queue();
+    bool push(const witmotion_config_packet& packet); ///< \return `false` if the queue is full and the packet is dropped
+    bool pop(witmotion_config_packet& packet); ///< \return `false` if the queue is empty
+    size_t size() const;
+    bool empty() const;
+    void clear();
+};
+
+/*!
+  \brief Configuration commands applied by the reader as a whole.
+
+  The reader writes all the commands of the sequence without polling the port in between, so the sensor is never left half-configured by the interleaved reads or the other commands. The sequence is either queued entirely or rejected, see \ref QBaseSerialWitmotionSensorReader::SendConfigSequence.
+*/
+struct witmotion_config_sequence
+{
+    static const size_t capacity = 8; ///< Maximal number of the commands in the sequence
+    witmotion_config_packet packets[capacity];
+    size_t length;
+    uint32_t delay; ///< Pause after every command, ms, the sensor ignores the commands following too closely
+    QSerialPort::BaudRate baud; ///< Port baud rate set by the \ref ridPortBaudRate command of the sequence, recorded by the controller; the reader switches the port by the command itself
+};
+
 /*!
  \brief Converts the frequency value in Hertz to subsequent Witmotion opcode.
 
@@ -43,10 +79,49 @@ public:
  */
 uint8_t witmotion_output_frequency(const int hertz);
 
+/*!
+ \brief Converts the Witmotion output frequency opcode (see \ref witmotion_output_frequency) to the frequency in Hertz.
+
+ \return Output frequency, Hz, zero for the shutdown, the single-shot and the unknown opcodes
+ */
+double witmotion_output_frequency_hz(const uint8_t code);
+
 uint8_t witmotion_baud_rate(const QSerialPort::BaudRate rate);
 
+/*!
+ \brief Converts the Witmotion baud rate opcode (see \ref witmotion_baud_rate) to the port baud rate.
+
+ \return Port baud rate, \ref QSerialPort::UnknownBaud for the unsupported opcodes. The opcode `0x00` is converted to 2400 baud
+ */
+QSerialPort::BaudRate witmotion_port_baud_rate(const uint8_t code);
+
+/*!
+ \brief Computes the poll interval of the timer-driven reader for the given link load.
+
+ Every poll reads at most 128 bytes, so the interval is chosen to read half of it per poll at the expected byte rate, leaving the headroom for the bursts, but not longer than the latency budget. The byte rate is the output of `types` packet types at `frequency` if both are known, otherwise the observed byte rate with the 25% margin, otherwise the link capacity. The rate never exceeds the link capacity of `baud / 10` bytes per second.
+ \param baud - port baud rate
+ \param frequency - sensor output frequency, Hz, zero if unknown
+ \param types - number of the packet types per output cycle, zero if unknown
+ \param observed - observed byte rate, bytes per second, zero if unknown
+ \param budget - latency budget, ms
+ \return Poll interval, ms, at least 1
+ */
+uint32_t witmotion_poll_interval(const uint32_t baud,
+                                 const double frequency,
+                                 const uint32_t types,
+                                 const double observed,
+                                 const uint32_t budget);
+
 bool id_registered(const size_t id);
 
+/*!
+ \brief Calculates the protocol checksum for the data packet.
+
+ \param packet - data packet, the \ref witmotion_datapacket.crc field is ignored
+ \return Sum of header, ID and 8 data bytes truncated to 8 bits
+ */
+uint8_t packet_crc(const witmotion_datapacket& packet);
+
 /* COMPONENT DECODERS */
 float decode_acceleration(const int16_t* value);
 float decode_angular_velocity(const int16_t* value);
@@ -110,16 +185,30 @@ void decode_gps_accuracy(const witmotion_datapacket& packet,
                          float& vertical_accuracy);
 
 /* MISCELLANEOUS UTILITIES */
+/*!
+ \brief Standard deviation of the stored samples.
+
+ Single-pass Welford accumulation in double precision. For the long acquisition sessions prefer \ref witmotion_running_statistics which does not require the samples to be stored.
+ */
 template<typename T> T variance(const std::vector<T>& array)
 {
-    T sum = std::accumulate(array.begin(), array.end(), 0.f);
-    T mean = sum / static_cast<T>(array.size());
-    T sq_dif = 0.f;
+    double mean = 0.0;
+    double m2 = 0.0;
+    size_t n = 0;
     for(auto i = array.begin(); i != array.end(); i++)
-        sq_dif += std::pow((*i) - mean, 2);
-    sq_dif /= (array.size() > 1) ? static_cast<T>(array.size() - 1) : 1.f;
-    return std::sqrt(sq_dif);
+    {
+        double value = static_cast<double>(*i);
+        double delta = value - mean;
+        n++;
+        mean += delta / static_cast<double>(n);
+        m2 += delta * (value - mean);
+    }
+    m2 /= (n > 1) ? static_cast<double>(n - 1) : 1.0;
+    return static_cast<T>(std::sqrt(m2));
 }
 
 }
+
+Q_DECLARE_METATYPE(witmotion::witmotion_config_sequence); ///< \private
+
 #endif
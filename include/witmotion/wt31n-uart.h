@@ -31,7 +31,8 @@ public:
     virtual void SetPollingRate(const uint32_t hz);
     QWitmotionWT31NSensor(const QString device,
                           const QSerialPort::BaudRate rate,
-                          const uint32_t polling_period = 50);
+                          const uint32_t polling_period = 50,
+                          QThread* shared_engine = nullptr);
 };
 
 }
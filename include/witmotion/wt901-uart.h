@@ -55,7 +55,8 @@ public:
     virtual void ConfirmConfiguration();
     QWitmotionWT901Sensor(const QString device,
                           const QSerialPort::BaudRate rate,
-                          const uint32_t polling_period = 50);
+                          const uint32_t polling_period = 50,
+                          QThread* shared_engine = nullptr);
 };
 
 }
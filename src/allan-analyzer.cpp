@@ -0,0 +1,125 @@
+#include "witmotion/parser.h"
+#include "witmotion/frame.h"
+#include "witmotion/allan.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QString>
+#include <QStringList>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace witmotion;
+
+int main(int argc, char** args)
+{
+    QCoreApplication app(argc, args);
+    app.setApplicationVersion(QString(library_version().c_str()));
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WITMOTION OFFLINE ALLAN DEVIATION ANALYZER");
+    parser.addHelpOption();
+    QCommandLineOption FileOption(QStringList() << "f" << "file",
+                                  "Raw byte stream captured from the sensor port",
+                                  "capture.bin");
+    parser.addOption(FileOption);
+    QCommandLineOption RateOption(QStringList() << "r" << "rate",
+                                  "Sensor output frequency used during the capture, Hz",
+                                  "1 - 200 Hz",
+                                  "10");
+    parser.addOption(RateOption);
+    QCommandLineOption ThreadsOption(QStringList() << "t" << "threads",
+                                     "Number of worker threads, 0 means hardware concurrency",
+                                     "count",
+                                     "0");
+    parser.addOption(ThreadsOption);
+    QCommandLineOption ValidateOption("validate",
+                                      "Accept only valid datapackets");
+    parser.addOption(ValidateOption);
+    parser.process(app);
+
+    if(!parser.isSet(FileOption))
+    {
+        std::cout << "ERROR: Capture file is not specified" << std::endl;
+        return 1;
+    }
+    std::string filename = parser.value(FileOption).toStdString();
+    double rate = parser.value(RateOption).toDouble();
+    if(rate <= 0.0)
+    {
+        std::cout << "ERROR: Invalid output frequency specified" << std::endl;
+        return 1;
+    }
+    std::ifstream capture(filename, std::ios::binary);
+    if(!capture.is_open())
+    {
+        std::cout << "ERROR: Cannot open capture file " << filename << std::endl;
+        return 1;
+    }
+
+    // Channels: accelerations X-Y-Z, angular velocities X-Y-Z
+    std::vector<std::vector<double>> channels(6);
+    witmotion_packet_parser packet_parser(parser.isSet(ValidateOption));
+    witmotion_frame_assembler frames;
+    witmotion_frame frame;
+    int64_t index = 0;
+    auto store = [&channels](const witmotion_frame& completed)
+    {
+        if(completed.Has(pidAcceleration))
+            for(size_t i = 0; i < 3; i++)
+                channels[i].push_back(completed.acceleration[i]);
+        if(completed.Has(pidAngularVelocity))
+            for(size_t i = 0; i < 3; i++)
+                channels[i + 3].push_back(completed.angular_velocity[i]);
+    };
+    std::vector<char> buffer(65536);
+    while(capture)
+    {
+        capture.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        packet_parser.Feed(reinterpret_cast<const uint8_t*>(buffer.data()),
+                           static_cast<size_t>(capture.gcount()),
+                           [&frames, &frame, &index, &store](const witmotion_datapacket& packet)
+        {
+            if(frames.Push(packet, index++, frame))
+                store(frame);
+        });
+    }
+    if(frames.Flush(frame))
+        store(frame);
+
+    witmotion_parser_statistics statistics = packet_parser.Statistics();
+    std::cout << "Decoded " << statistics.packets << " packets from " << statistics.bytes << " bytes, "
+              << statistics.crc_failures << " CRC failures, "
+              << statistics.resyncs << " resynchronizations" << std::endl
+              << std::endl;
+
+    std::vector<std::vector<witmotion_allan_point>> curves = allan_deviation(channels,
+                                                                             1.0 / rate,
+                                                                             parser.value(ThreadsOption).toUInt());
+    static const char* titles[] = {
+        "Accelerations, axis X",
+        "Accelerations, axis Y",
+        "Accelerations, axis Z",
+        "Angular velocities, axis X",
+        "Angular velocities, axis Y",
+        "Angular velocities, axis Z"
+    };
+    std::cout.precision(7);
+    std::cout << std::fixed;
+    for(size_t i = 0; i < channels.size(); i++)
+    {
+        witmotion_noise_parameters noise = allan_noise_parameters(curves[i]);
+        std::cout << titles[i] << " (total for " << channels[i].size() << " measurements):" << std::endl
+                  << "\ttau, s\t\tADEV\t\tterms" << std::endl;
+        for(auto j = curves[i].begin(); j != curves[i].end(); j++)
+            std::cout << "\t" << j->tau << "\t" << j->deviation << "\t" << j->terms << std::endl;
+        std::cout << "\tRandom walk: " << noise.random_walk
+                  << ", bias instability: " << noise.bias_instability << " at " << noise.bias_instability_tau << " s"
+                  << ", rate random walk: " << noise.rate_random_walk << std::endl
+                  << std::endl;
+    }
+    return 0;
+}
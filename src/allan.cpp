@@ -0,0 +1,236 @@
+#include "witmotion/allan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace witmotion
+{
+
+witmotion_allan_variance::witmotion_allan_variance(const size_t max_octaves,
+                                                   const size_t overlapped):
+    octaves(max_octaves),
+    overlapped_octaves(std::min(overlapped, max_octaves)),
+    levels(max_octaves),
+    phase((static_cast<size_t>(1) << overlapped_octaves) + 1),
+    overlapped_squares(overlapped_octaves),
+    overlapped_terms(overlapped_octaves)
+{
+    Reset();
+}
+
+void witmotion_allan_variance::PushCluster(const size_t level, const double average)
+{
+    if(level >= octaves)
+        return;
+    cluster_level& current = levels[level];
+    if(current.has_previous)
+    {
+        double difference = average - current.previous;
+        current.squares += difference * difference;
+        current.terms++;
+    }
+    current.previous = average;
+    current.has_previous = true;
+    if(current.has_pending)
+    {
+        current.has_pending = false;
+        PushCluster(level + 1, 0.5 * (current.pending + average));
+    }
+    else
+    {
+        current.pending = average;
+        current.has_pending = true;
+    }
+}
+
+void witmotion_allan_variance::Push(const double value)
+{
+    // The first sample is used as an offset for the integration, so the integrated
+    // phase stays small on static recordings. Allan variance is offset-invariant.
+    if(count == 0)
+        offset = value;
+    count++;
+    integral += value - offset;
+    phase_head = (phase_head + 1) % phase.size();
+    phase[phase_head] = integral;
+    for(size_t k = 0; k < overlapped_octaves; k++)
+    {
+        uint64_t m = static_cast<uint64_t>(1) << k;
+        if(count < 2 * m)
+            break;
+        double middle = phase[(phase_head + phase.size() - m) % phase.size()];
+        double first = phase[(phase_head + phase.size() - 2 * m) % phase.size()];
+        double difference = (integral - 2.0 * middle + first) / static_cast<double>(m);
+        overlapped_squares[k] += difference * difference;
+        overlapped_terms[k]++;
+    }
+    PushCluster(0, value - offset);
+}
+
+void witmotion_allan_variance::Reset()
+{
+    for(auto i = levels.begin(); i != levels.end(); i++)
+        *i = cluster_level{0.0, false, 0.0, false, 0.0, 0};
+    std::fill(phase.begin(), phase.end(), 0.0);
+    std::fill(overlapped_squares.begin(), overlapped_squares.end(), 0.0);
+    std::fill(overlapped_terms.begin(), overlapped_terms.end(), 0);
+    phase_head = 0;
+    integral = 0.0;
+    offset = 0.0;
+    count = 0;
+}
+
+uint64_t witmotion_allan_variance::Count() const
+{
+    return count;
+}
+
+std::vector<witmotion_allan_point> witmotion_allan_variance::Deviation(const double sample_period) const
+{
+    std::vector<witmotion_allan_point> curve;
+    for(size_t k = 0; k < octaves; k++)
+    {
+        double squares;
+        uint64_t terms;
+        if(k < overlapped_octaves)
+        {
+            squares = overlapped_squares[k];
+            terms = overlapped_terms[k];
+        }
+        else
+        {
+            squares = levels[k].squares;
+            terms = levels[k].terms;
+        }
+        if(terms == 0)
+            continue;
+        witmotion_allan_point point;
+        point.tau = sample_period * static_cast<double>(static_cast<uint64_t>(1) << k);
+        point.deviation = std::sqrt(squares / (2.0 * static_cast<double>(terms)));
+        point.terms = terms;
+        curve.push_back(point);
+    }
+    return curve;
+}
+
+void witmotion_frame_allan::Push(const witmotion_frame &frame)
+{
+    if(frame.Has(pidAcceleration))
+        for(size_t i = 0; i < 3; i++)
+            acceleration[i].Push(frame.acceleration[i]);
+    if(frame.Has(pidAngularVelocity))
+        for(size_t i = 0; i < 3; i++)
+            angular_velocity[i].Push(frame.angular_velocity[i]);
+}
+
+void witmotion_frame_allan::Reset()
+{
+    for(size_t i = 0; i < 3; i++)
+    {
+        acceleration[i].Reset();
+        angular_velocity[i].Reset();
+    }
+}
+
+std::vector<witmotion_allan_point> allan_deviation(const std::vector<double> &samples,
+                                                   const double sample_period)
+{
+    std::vector<witmotion_allan_point> curve;
+    size_t n = samples.size();
+    if(n < 2)
+        return curve;
+    std::vector<double> phase(n + 1);
+    phase[0] = 0.0;
+    for(size_t i = 0; i < n; i++)
+        phase[i + 1] = phase[i] + (samples[i] - samples[0]);
+    for(size_t m = 1; 2 * m <= n; m *= 2)
+    {
+        double squares = 0.0;
+        size_t terms = n + 1 - 2 * m;
+        for(size_t i = 0; i < terms; i++)
+        {
+            double difference = phase[i + 2 * m] - 2.0 * phase[i + m] + phase[i];
+            squares += difference * difference;
+        }
+        witmotion_allan_point point;
+        point.tau = sample_period * static_cast<double>(m);
+        point.deviation = std::sqrt(squares / (2.0 * static_cast<double>(m) * static_cast<double>(m) * static_cast<double>(terms)));
+        point.terms = terms;
+        curve.push_back(point);
+    }
+    return curve;
+}
+
+std::vector<std::vector<witmotion_allan_point>> allan_deviation(const std::vector<std::vector<double>> &channels,
+                                                                const double sample_period,
+                                                                const size_t threads)
+{
+    std::vector<std::vector<witmotion_allan_point>> curves(channels.size());
+    size_t workers = (threads > 0) ? threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+    workers = std::min(workers, channels.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&channels, &curves, &next, sample_period]()
+    {
+        for(size_t i = next++; i < channels.size(); i = next++)
+            curves[i] = allan_deviation(channels[i], sample_period);
+    };
+    std::vector<std::thread> pool;
+    for(size_t i = 1; i < workers; i++)
+        pool.emplace_back(worker);
+    worker();
+    for(auto i = pool.begin(); i != pool.end(); i++)
+        i->join();
+    return curves;
+}
+
+witmotion_noise_parameters allan_noise_parameters(const std::vector<witmotion_allan_point> &curve)
+{
+    static const double slope_tolerance = 0.25;
+    witmotion_noise_parameters result{0.0, 0.0, 0.0, 0.0};
+    if(curve.empty())
+        return result;
+    size_t minimum = 0;
+    for(size_t i = 1; i < curve.size(); i++)
+        if(curve[i].deviation < curve[minimum].deviation)
+            minimum = i;
+    result.bias_instability = curve[minimum].deviation / 0.664;
+    result.bias_instability_tau = curve[minimum].tau;
+    if(curve.size() < 2)
+        return result;
+    // Log-log slope at every point, averaged over the adjacent segments
+    std::vector<double> segments(curve.size() - 1);
+    for(size_t i = 0; i + 1 < curve.size(); i++)
+        segments[i] = std::log(curve[i + 1].deviation / curve[i].deviation) / std::log(curve[i + 1].tau / curve[i].tau);
+    auto slope = [&segments](const size_t i)
+    {
+        if(i == 0)
+            return segments.front();
+        if(i == segments.size())
+            return segments.back();
+        return 0.5 * (segments[i - 1] + segments[i]);
+    };
+    double best = slope_tolerance;
+    for(size_t i = 0; i <= minimum; i++)
+    {
+        double error = std::abs(slope(i) + 0.5);
+        if(error < best)
+        {
+            best = error;
+            result.random_walk = curve[i].deviation * std::sqrt(curve[i].tau);
+        }
+    }
+    best = slope_tolerance;
+    for(size_t i = minimum; i < curve.size(); i++)
+    {
+        double error = std::abs(slope(i) - 0.5);
+        if(error < best)
+        {
+            best = error;
+            result.rate_random_walk = curve[i].deviation * std::sqrt(3.0 / curve[i].tau);
+        }
+    }
+    return result;
+}
+
+}
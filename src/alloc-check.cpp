@@ -0,0 +1,356 @@
+/*
+    Allocation-counting harness for the steady-state acquisition path.
+
+    Replaces the global operator new (and, on glibc, malloc family) to count heap
+    allocations per thread, then writes a synthetic packet stream into the master side
+    of the pseudo-terminal. The controller reads the slave side through the real
+    QBaseSerialWitmotionSensorReader::ReadData path: the serial port reads, the parser,
+    the controller packet filter and the direct packet sink running the decoders and the
+    frame assembler with the online covariance. The configuration queue is checked
+    separately. After the warm-up pass no allocation is allowed in the reader thread:
+    the application returns a non-zero exit code if any steady-state allocation is
+    registered or the stream is not delivered completely. The delivery through the queued
+    Acquired signal, used by the control tools, is not covered: it allocates an event per packet.
+*/
+#include "witmotion/wt901-uart.h"
+#include "witmotion/parser.h"
+#include "witmotion/frame.h"
+#include "witmotion/statistics.h"
+
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Counted per thread, so the writer and the main event loop do not affect the reader
+static thread_local uint64_t new_count = 0;
+static thread_local uint64_t malloc_count = 0;
+
+#ifdef __GLIBC__
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size)
+{
+    malloc_count++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    malloc_count++;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    malloc_count++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+}
+#define RAW_ALLOCATE(size) __libc_malloc(size)
+#define RAW_FREE(ptr) __libc_free(ptr)
+#else
+#define RAW_ALLOCATE(size) std::malloc(size)
+#define RAW_FREE(ptr) std::free(ptr)
+#endif
+
+void* operator new(size_t size)
+{
+    new_count++;
+    void* ptr = RAW_ALLOCATE((size > 0) ? size : 1);
+    if(ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    RAW_FREE(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    RAW_FREE(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    RAW_FREE(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    RAW_FREE(ptr);
+}
+
+using namespace witmotion;
+
+/* Called from the reader thread only. Every packet publishes the allocation counters
+   of the reader thread, so the main thread samples them between the passes */
+class DecodingSink: public witmotion_packet_sink
+{
+public:
+    std::atomic<uint64_t> packets;
+    std::atomic<uint64_t> reader_new;
+    std::atomic<uint64_t> reader_malloc;
+    double checksum;
+    witmotion_frame_assembler frames;
+    witmotion_frame_covariance covariance;
+    DecodingSink():
+        packets(0),
+        reader_new(0),
+        reader_malloc(0),
+        checksum(0.0)
+    {}
+    virtual void Consume(const witmotion_datapacket& packet)
+    {
+        float x = 0.f, y = 0.f, z = 0.f, w = 0.f;
+        switch(static_cast<witmotion_packet_id>(packet.id_byte))
+        {
+        case pidAcceleration:
+            decode_accelerations(packet, x, y, z, w);
+            break;
+        case pidAngularVelocity:
+            decode_angular_velocities(packet, x, y, z, w);
+            break;
+        case pidAngles:
+            decode_angles(packet, x, y, z, w);
+            break;
+        case pidMagnetometer:
+            decode_magnetometer(packet, x, y, z, w);
+            break;
+        case pidOrientation:
+            decode_orientation(packet, x, y, z, w);
+            break;
+        default:
+            break;
+        }
+        checksum += x + y + z + w;
+        witmotion_frame frame;
+        uint64_t count = packets.load(std::memory_order_relaxed);
+        if(frames.Push(packet, static_cast<int64_t>(count), frame))
+            covariance.Push(frame);
+        reader_new.store(new_count, std::memory_order_relaxed);
+        reader_malloc.store(malloc_count, std::memory_order_relaxed);
+        packets.store(count + 1, std::memory_order_release);
+    }
+};
+
+static void append_packet(std::vector<uint8_t>& stream,
+                          const witmotion_packet_id id,
+                          const int16_t seed,
+                          const bool corrupt)
+{
+    witmotion_datapacket packet;
+    packet.header_byte = WITMOTION_HEADER_BYTE;
+    packet.id_byte = id;
+    for(size_t i = 0; i < 4; i++)
+        packet.datastore.raw_cells[i] = static_cast<int16_t>(seed * (i + 1));
+    packet.crc = packet_crc(packet) + (corrupt ? 1 : 0);
+    // The structure is padded, so the wire representation is composed byte-by-byte
+    stream.push_back(packet.header_byte);
+    stream.push_back(packet.id_byte);
+    stream.insert(stream.end(), packet.datastore.raw, packet.datastore.raw + 8);
+    stream.push_back(packet.crc);
+}
+
+static bool write_stream(const int master, const std::vector<uint8_t>& stream)
+{
+    size_t offset = 0;
+    while(offset < stream.size())
+    {
+        ssize_t written = write(master, stream.data() + offset, stream.size() - offset);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        offset += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Waits until the sink receives `expected` packets, or, if `expected` is zero, until the delivery stalls for the settle time
+static uint64_t await_delivery(const DecodingSink& sink, const uint64_t expected)
+{
+    static const auto SETTLE = std::chrono::milliseconds(300);
+    static const auto TIMEOUT = std::chrono::seconds(10);
+    auto started = std::chrono::steady_clock::now();
+    auto changed = started;
+    uint64_t last = sink.packets.load(std::memory_order_acquire);
+    for(;;)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        uint64_t current = sink.packets.load(std::memory_order_acquire);
+        auto now = std::chrono::steady_clock::now();
+        if((expected > 0) && (current >= expected))
+            return current;
+        if(current != last)
+        {
+            last = current;
+            changed = now;
+        }
+        else if((expected == 0) && (now - changed >= SETTLE))
+            return current;
+        if(now - started >= TIMEOUT)
+            return current;
+    }
+}
+
+int main(int argc, char** args)
+{
+    QCoreApplication app(argc, args);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WITMOTION STEADY-STATE ALLOCATION CHECK");
+    parser.addHelpOption();
+    QCommandLineOption IterationsOption(QStringList() << "n" << "iterations",
+                                        "Number of passes over the synthetic stream",
+                                        "count",
+                                        "20");
+    parser.addOption(IterationsOption);
+    parser.process(app);
+    uint32_t iterations = parser.value(IterationsOption).toUInt();
+    if(iterations == 0)
+        iterations = 20;
+
+    // Synthetic stream: every WT901 packet type, with resync garbage and broken CRC packets
+    static const witmotion_packet_id ids[] = {
+        pidAcceleration,
+        pidAngularVelocity,
+        pidAngles,
+        pidMagnetometer,
+        pidOrientation,
+        pidRTC,
+        pidDataPortStatus
+    };
+    std::vector<uint8_t> stream;
+    stream.reserve(4096 * 11);
+    for(int16_t i = 0; i < 512; i++)
+    {
+        for(size_t j = 0; j < sizeof(ids) / sizeof(witmotion_packet_id); j++)
+            append_packet(stream, ids[j], i, (i % 97) == 0);
+        if((i % 31) == 0)
+        {
+            stream.push_back(WITMOTION_HEADER_BYTE);
+            stream.push_back(0x7F);
+        }
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+    {
+        std::cout << "ERROR: Cannot create the pseudo-terminal: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    std::string slave(ptsname(master));
+
+    int status = 0;
+    {
+        // Declared first, so the sink outlives the controller whose destructor stops the reader thread
+        DecodingSink sink;
+        wt901::QWitmotionWT901Sensor sensor(QString(slave.c_str()), QSerialPort::Baud115200);
+        sensor.SetValidation(true);
+        // The stream is written in bursts, the pauses between the passes are not errors
+        sensor.SetSensorTimeout(60000);
+        sensor.SetEventDriven(true);
+        sensor.SetPacketSink(&sink);
+        sensor.Start();
+        // The port is opened in the reader thread, the bytes written before are discarded
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        // Warm-up: the buffers of the port and the assembler reach the steady size, the delivered packet count is learnt
+        if(!write_stream(master, stream))
+        {
+            std::cout << "ERROR: Cannot write the pseudo-terminal: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        uint64_t per_pass = await_delivery(sink, 0);
+        if(per_pass == 0)
+        {
+            std::cout << "FAILED: no packets delivered through the reader" << std::endl;
+            return 1;
+        }
+        uint64_t new_base = sink.reader_new.load(std::memory_order_relaxed);
+        uint64_t malloc_base = sink.reader_malloc.load(std::memory_order_relaxed);
+        uint64_t delivered = per_pass;
+        for(uint32_t i = 0; (i < iterations) && (delivered == per_pass * (i + 1)); i++)
+        {
+            if(!write_stream(master, stream))
+            {
+                std::cout << "ERROR: Cannot write the pseudo-terminal: " << std::strerror(errno) << std::endl;
+                return 1;
+            }
+            delivered = await_delivery(sink, per_pass * (i + 2));
+        }
+        uint64_t new_steady = sink.reader_new.load(std::memory_order_relaxed) - new_base;
+        uint64_t malloc_steady = sink.reader_malloc.load(std::memory_order_relaxed) - malloc_base;
+
+        // The configuration commands pass the preallocated queue
+        witmotion_config_queue configuration;
+        witmotion_config_packet config_packet;
+        config_packet.header_byte = WITMOTION_CONFIG_HEADER;
+        config_packet.key_byte = WITMOTION_CONFIG_KEY;
+        config_packet.address_byte = ridOutputFrequency;
+        config_packet.setting.bin = 0;
+        configuration.push(config_packet);
+        configuration.pop(config_packet);
+        uint64_t config_new = new_count;
+        uint64_t config_malloc = malloc_count;
+        for(uint32_t i = 0; i < iterations; i++)
+        {
+            configuration.push(config_packet);
+            configuration.pop(config_packet);
+        }
+        config_new = new_count - config_new;
+        config_malloc = malloc_count - config_malloc;
+
+        std::cout << "Bytes written:\t\t" << stream.size() * (iterations + 1) << "\n"
+                  << "Packets expected:\t" << per_pass * (iterations + 1) << "\n"
+                  << "Packets delivered:\t" << delivered << "\n"
+                  << "Steady-state operator new calls:\t" << new_steady << " (reader), " << config_new << " (configuration)\n"
+                  << "Steady-state malloc calls:\t\t" << malloc_steady << " (reader), " << config_malloc << " (configuration)\n";
+        if(delivered != per_pass * (iterations + 1))
+        {
+            std::cout << "FAILED: the stream is not delivered completely" << std::endl;
+            status = 1;
+        }
+        else if((new_steady > 0) || (malloc_steady > 0) || (config_new > 0) || (config_malloc > 0))
+        {
+            std::cout << "FAILED: heap allocation detected on the acquisition path" << std::endl;
+            status = 1;
+        }
+        else
+            std::cout << "PASSED: no heap allocation on the acquisition path" << std::endl;
+    }
+    close(master);
+    return status;
+}
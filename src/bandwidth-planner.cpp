@@ -0,0 +1,202 @@
+/*
+    UART bandwidth planner: computes the link load of the measurement set
+    and the output frequency, chooses the minimal baud rate carrying it with
+    the headroom, warns about the saturation and optionally applies the
+    whole configuration to the sensor in one sequence.
+*/
+
+#include "witmotion/wt31n-uart.h"
+#include "witmotion/jy901-uart.h"
+#include "witmotion/bandwidth.h"
+
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <set>
+
+int main(int argc, char** args)
+{
+    QCoreApplication app(argc, args);
+    app.setApplicationVersion(QString(witmotion::library_version().c_str()));
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WITMOTION UART BANDWIDTH PLANNER");
+    parser.addHelpOption();
+    QCommandLineOption TypeOption(QStringList() << "t" << "type",
+                                  "Sensor type",
+                                  "WT31N/WT901/JY901",
+                                  "WT901");
+    parser.addOption(TypeOption);
+    QCommandLineOption MeasurementsOption(QStringList() << "m" << "measurements",
+                                          "Measurements to enable, comma-separated list: rtc, acceleration, velocity, angles, magnetometer, status, altimeter, orientation. The factory set by default",
+                                          "acceleration,angles,...",
+                                          "");
+    parser.addOption(MeasurementsOption);
+    QCommandLineOption FrequencyOption(QStringList() << "f" << "frequency",
+                                       "Output frequency, Hz",
+                                       "1 - 200 Hz",
+                                       "10");
+    parser.addOption(FrequencyOption);
+    QCommandLineOption HeadroomOption("headroom",
+                                      "Fraction of the link capacity left free",
+                                      "%",
+                                      "20");
+    parser.addOption(HeadroomOption);
+    QCommandLineOption ApplyOption("apply",
+                                   "Apply the planned measurement set, output frequency and baud rate to the sensor and save them");
+    parser.addOption(ApplyOption);
+    QCommandLineOption DeviceNameOption(QStringList() << "d" << "device",
+                                        "Port serial device name, without \'/dev\', for --apply",
+                                        "ttyUSB0",
+                                        "ttyUSB0");
+    parser.addOption(DeviceNameOption);
+    QCommandLineOption BaudRateOption(QStringList() << "b" << "baudrate",
+                                      "Current baud rate of the sensor, for --apply",
+                                      "2400 to 115200",
+                                      "9600");
+    parser.addOption(BaudRateOption);
+    parser.process(app);
+
+    QString type = parser.value(TypeOption).toUpper();
+    witmotion::witmotion_device_class device_class;
+    if(!witmotion::witmotion_device_class_from_name(type.toStdString(), device_class))
+    {
+        std::cout << "ERROR: Unknown sensor type " << type.toStdString() << std::endl;
+        return 1;
+    }
+
+    std::set<witmotion::witmotion_packet_id> types = witmotion::witmotion_bandwidth_planner::DefaultPacketTypes(device_class);
+    if(!parser.value(MeasurementsOption).trimmed().isEmpty())
+    {
+        types.clear();
+        #if QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
+        QStringList arglist = parser.value(MeasurementsOption).trimmed().split(",", QString::SkipEmptyParts);
+        #else
+        QStringList arglist = parser.value(MeasurementsOption).trimmed().split(",", Qt::SkipEmptyParts);
+        #endif
+        for(auto i = arglist.begin(); i != arglist.end(); i++)
+        {
+            witmotion::witmotion_packet_id id;
+            if(!witmotion::witmotion_measurement_from_name((*i).trimmed().toStdString(), id))
+            {
+                std::cout << "ERROR: cannot interpret measurement name " << (*i).toStdString() << std::endl;
+                return 1;
+            }
+            types.insert(id);
+        }
+    }
+
+    int32_t frequency = parser.value(FrequencyOption).toInt();
+    witmotion::witmotion_bandwidth_planner planner(device_class, parser.value(HeadroomOption).toDouble() / 100.0);
+    witmotion::witmotion_bandwidth_plan plan;
+    if(!planner.Plan(types, frequency, plan))
+    {
+        std::cout << "ERROR: " << planner.Error() << std::endl;
+        return 1;
+    }
+
+    std::cout << type.toStdString() << ": " << plan.types << " packet types at "
+              << witmotion::witmotion_output_frequency_hz(witmotion::witmotion_output_frequency(frequency)) << " Hz need "
+              << plan.load << " bytes/s, " << planner.Headroom() * 100.0 << "% headroom" << std::endl << std::endl;
+    char line[128];
+    std::snprintf(line, sizeof(line), "%10s %14s %14s %16s\n", "baud", "capacity, B/s", "utilization, %", "max frequency, Hz");
+    std::cout << line;
+    const std::vector<uint32_t>& rates = witmotion::witmotion_bandwidth_planner::BaudRates(device_class);
+    for(auto i = rates.begin(); i != rates.end(); i++)
+    {
+        witmotion::witmotion_bandwidth_plan row;
+        planner.Check(types, frequency, *i, row);
+        std::snprintf(line, sizeof(line), "%10u %14u %14.1f %16d %s\n",
+                      *i,
+                      *i / 10,
+                      row.utilization * 100.0,
+                      row.max_frequency,
+                      row.saturated ? "saturated" : (row.sufficient ? ((*i == plan.baud) ? "<- minimal" : "") : "no headroom"));
+        std::cout << line;
+    }
+    std::cout << std::endl;
+    if(plan.saturated)
+        std::cout << "WARNING: The output exceeds the link capacity even at " << plan.baud << " baud, the sensor will reduce it. "
+                  << "Reduce the measurement set or the output frequency";
+    else if(!plan.sufficient)
+        std::cout << "WARNING: The output fits " << plan.baud << " baud without the requested headroom";
+    else
+        std::cout << "Minimal baud rate: " << plan.baud;
+    if(plan.max_frequency > 0)
+        std::cout << ", the highest output frequency with the headroom at " << plan.baud << " baud is "
+                  << witmotion::witmotion_output_frequency_hz(witmotion::witmotion_output_frequency(plan.max_frequency)) << " Hz";
+    std::cout << std::endl;
+
+    if(!parser.isSet(ApplyOption))
+        return 0;
+    if(plan.saturated)
+    {
+        std::cout << "ERROR: The saturated configuration is not applied" << std::endl;
+        return 1;
+    }
+
+    uint32_t current_baud = parser.value(BaudRateOption).toUInt();
+    QSerialPort::BaudRate rate = static_cast<QSerialPort::BaudRate>(current_baud);
+    QString device = parser.value(DeviceNameOption);
+    std::unique_ptr<witmotion::QAbstractWitmotionSensorController> sensor;
+    if(device_class == witmotion::dcWT31N)
+        sensor.reset(new witmotion::wt31n::QWitmotionWT31NSensor(device, rate));
+    else if(device_class == witmotion::dcJY901)
+        sensor.reset(new witmotion::jy901::QWitmotionJY901Sensor(device, rate));
+    else
+        sensor.reset(new witmotion::wt901::QWitmotionWT901Sensor(device, rate));
+    // The current output may be slower than the default timeout, and the reads pause while the sequence is written
+    sensor->SetSensorTimeout(0);
+    sensor->SetValidation(true);
+    QObject::connect(sensor.get(), &witmotion::QAbstractWitmotionSensorController::ErrorOccurred, [](const QString description)
+    {
+        std::cout << "ERROR: " << description.toStdString() << std::endl;
+        QCoreApplication::exit(1);
+    });
+    witmotion::witmotion_config_sequence sequence = planner.Sequence(plan, current_baud);
+    double planned_hz = witmotion::witmotion_output_frequency_hz(witmotion::witmotion_output_frequency(frequency));
+    // Five output periods, at least 2 s, for the first valid packet at the new configuration
+    int verification = static_cast<int>((planned_hz > 0.0) ? std::max(2000.0, 5000.0 / planned_hz) : 2000.0);
+    bool configured = false;
+    QObject::connect(sensor.get(), &witmotion::QAbstractWitmotionSensorController::Configured, [&configured, &plan, verification]()
+    {
+        configured = true;
+        std::cout << "Configuration written, waiting for the data at " << plan.baud << " baud" << std::endl;
+        QTimer::singleShot(verification, []()
+        {
+            std::cout << "ERROR: No valid packet received after the reconfiguration, check the sensor" << std::endl;
+            QCoreApplication::exit(1);
+        });
+    });
+    QObject::connect(sensor.get(), &witmotion::QAbstractWitmotionSensorController::Acquired, [&configured](const witmotion::witmotion_datapacket&)
+    {
+        if(configured)
+            QCoreApplication::exit(0);
+    });
+    // The sequence is sent once the reader has opened the port
+    QTimer::singleShot(1000, [&sensor, &sequence]()
+    {
+        sensor->ApplyConfiguration(sequence);
+    });
+    QTimer::singleShot(static_cast<int>(3000 + sequence.length * sequence.delay), [&configured]()
+    {
+        if(configured)
+            return;
+        std::cout << "ERROR: The configuration sequence has not completed" << std::endl;
+        QCoreApplication::exit(1);
+    });
+    std::cout << "Applying " << sequence.length << " configuration commands to /dev/" << device.toStdString()
+              << " at " << current_baud << " baud" << std::endl;
+    sensor->Start();
+    int result = app.exec();
+    sensor.reset();
+    if(result == 0)
+        std::cout << "Reconfiguration completed, the sensor works at " << plan.baud << " baud now" << std::endl;
+    return result;
+}
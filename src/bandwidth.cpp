@@ -0,0 +1,227 @@
+#include "witmotion/bandwidth.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+namespace witmotion
+{
+
+namespace
+{
+
+const std::vector<uint32_t> wt31n_baud_rates = {9600, 115200};
+const std::vector<uint32_t> wt901_baud_rates = {2400, 4800, 9600, 19200, 38400, 57600, 115200};
+const std::vector<int32_t> wt31n_frequencies = {10, 100};
+const std::vector<int32_t> wt901_frequencies = {-10, -2, 1, 2, 5, 10, 20, 50, 100, 125, 200};
+const std::set<witmotion_packet_id> wt31n_types = {pidAcceleration, pidAngles};
+const std::set<witmotion_packet_id> wt901_types = {pidRTC, pidAcceleration, pidAngularVelocity, pidAngles, pidMagnetometer, pidDataPortStatus, pidOrientation};
+const std::set<witmotion_packet_id> jy901_types = {pidRTC, pidAcceleration, pidAngularVelocity, pidAngles, pidMagnetometer, pidDataPortStatus, pidAltimeter, pidOrientation};
+const std::set<witmotion_packet_id> wt901_default_types = {pidAcceleration, pidAngularVelocity, pidAngles, pidMagnetometer};
+const std::set<witmotion_packet_id> jy901_default_types = {pidAcceleration, pidAngularVelocity, pidAngles, pidMagnetometer, pidAltimeter};
+
+const uint32_t sequence_delay = 200; // ms between the commands
+
+double output_rate(const int32_t frequency)
+{
+    return witmotion_output_frequency_hz(witmotion_output_frequency(frequency));
+}
+
+witmotion_config_packet config_packet(const witmotion_config_register_id address, const uint8_t low, const uint8_t high)
+{
+    witmotion_config_packet packet;
+    packet.header_byte = WITMOTION_CONFIG_HEADER;
+    packet.key_byte = WITMOTION_CONFIG_KEY;
+    packet.address_byte = address;
+    packet.setting.raw[0] = low;
+    packet.setting.raw[1] = high;
+    return packet;
+}
+
+}
+
+bool witmotion_device_class_from_name(const std::string &name, witmotion_device_class &device_class)
+{
+    std::string upper(name);
+    std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    if(upper == "WT31N")
+        device_class = dcWT31N;
+    else if(upper == "WT901")
+        device_class = dcWT901;
+    else if(upper == "JY901")
+        device_class = dcJY901;
+    else
+        return false;
+    return true;
+}
+
+bool witmotion_measurement_from_name(const std::string &name, witmotion_packet_id &id)
+{
+    std::string upper(name);
+    std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    auto contains = [&upper](const char* part) { return upper.find(part) != std::string::npos; };
+    if(contains("ACCEL"))
+        id = pidAcceleration;
+    else if(contains("VELOCIT"))
+        id = pidAngularVelocity;
+    else if(contains("EULER") || contains("ANGLE"))
+        id = pidAngles;
+    else if(contains("MAGNET"))
+        id = pidMagnetometer;
+    else if(contains("RTC") || contains("CLOCK") || contains("TIME"))
+        id = pidRTC;
+    else if(contains("ORIENTATION") || contains("QUATERNION"))
+        id = pidOrientation;
+    else if(contains("PORT") || contains("STATUS"))
+        id = pidDataPortStatus;
+    else if(contains("ALTI") || contains("BARO"))
+        id = pidAltimeter;
+    else
+        return false;
+    return true;
+}
+
+witmotion_bandwidth_planner::witmotion_bandwidth_planner(const witmotion_device_class device_class, const double headroom_fraction):
+    device(device_class),
+    headroom(WITMOTION_BANDWIDTH_DEFAULT_HEADROOM)
+{
+    SetHeadroom(headroom_fraction);
+}
+
+const std::vector<uint32_t> &witmotion_bandwidth_planner::BaudRates(const witmotion_device_class device_class)
+{
+    return (device_class == dcWT31N) ? wt31n_baud_rates : wt901_baud_rates;
+}
+
+const std::vector<int32_t> &witmotion_bandwidth_planner::Frequencies(const witmotion_device_class device_class)
+{
+    return (device_class == dcWT31N) ? wt31n_frequencies : wt901_frequencies;
+}
+
+const std::set<witmotion_packet_id> &witmotion_bandwidth_planner::PacketTypes(const witmotion_device_class device_class)
+{
+    switch(device_class)
+    {
+    case dcWT31N:
+        return wt31n_types;
+    case dcJY901:
+        return jy901_types;
+    case dcWT901:
+    default:
+        return wt901_types;
+    }
+}
+
+const std::set<witmotion_packet_id> &witmotion_bandwidth_planner::DefaultPacketTypes(const witmotion_device_class device_class)
+{
+    switch(device_class)
+    {
+    case dcWT31N:
+        return wt31n_types;
+    case dcJY901:
+        return jy901_default_types;
+    case dcWT901:
+    default:
+        return wt901_default_types;
+    }
+}
+
+void witmotion_bandwidth_planner::SetHeadroom(const double fraction)
+{
+    headroom = (fraction < 0.0) ? 0.0 : ((fraction > 1.0) ? 1.0 : fraction);
+}
+
+double witmotion_bandwidth_planner::Headroom() const
+{
+    return headroom;
+}
+
+bool witmotion_bandwidth_planner::Check(const std::set<witmotion_packet_id> &types, const int32_t frequency, const uint32_t baud, witmotion_bandwidth_plan &plan)
+{
+    const std::set<witmotion_packet_id>& supported = PacketTypes(device);
+    plan.measurements = 0;
+    for(auto i = types.begin(); i != types.end(); i++)
+    {
+        if(supported.find(*i) == supported.end())
+        {
+            char description[64];
+            std::snprintf(description, sizeof(description), "Packet type 0x%02X is not supported by the device", static_cast<unsigned int>(*i));
+            error = description;
+            return false;
+        }
+        plan.measurements |= static_cast<uint16_t>(1 << (*i - pidRTC));
+    }
+    // The shutdown and the single-shot output produce no steady load
+    const std::vector<int32_t>& frequencies = Frequencies(device);
+    bool periodic = false;
+    for(auto i = frequencies.begin(); i != frequencies.end(); i++)
+        periodic |= (*i == frequency);
+    if(!periodic && ((device == dcWT31N) || ((frequency != 0) && (frequency != -1))))
+    {
+        error = "Output frequency " + std::to_string(frequency) + " is not supported by the device";
+        return false;
+    }
+    if(baud == 0)
+    {
+        error = "Zero baud rate";
+        return false;
+    }
+    // WT31N always outputs its whole fixed set
+    plan.types = (device == dcWT31N) ? wt31n_types.size() : types.size();
+    plan.frequency = frequency;
+    plan.load = 11.0 * static_cast<double>(plan.types) * output_rate(frequency);
+    plan.baud = baud;
+    double capacity = static_cast<double>(baud) / 10.0;
+    plan.utilization = plan.load / capacity;
+    plan.sufficient = (plan.utilization <= 1.0 - headroom);
+    plan.saturated = (plan.load > capacity);
+    plan.max_frequency = 0;
+    for(auto i = frequencies.begin(); i != frequencies.end(); i++)
+        if(11.0 * static_cast<double>(plan.types) * output_rate(*i) <= capacity * (1.0 - headroom))
+            plan.max_frequency = *i;
+    return true;
+}
+
+bool witmotion_bandwidth_planner::Plan(const std::set<witmotion_packet_id> &types, const int32_t frequency, witmotion_bandwidth_plan &plan)
+{
+    const std::vector<uint32_t>& rates = BaudRates(device);
+    for(auto i = rates.begin(); i != rates.end(); i++)
+    {
+        if(!Check(types, frequency, *i, plan))
+            return false;
+        if(plan.sufficient)
+            return true;
+    }
+    // Not carried by any baud rate, the plan keeps the fastest one
+    return true;
+}
+
+witmotion_config_sequence witmotion_bandwidth_planner::Sequence(const witmotion_bandwidth_plan &plan, const uint32_t current_baud) const
+{
+    witmotion_config_sequence sequence;
+    sequence.length = 0;
+    sequence.delay = sequence_delay;
+    sequence.baud = static_cast<QSerialPort::BaudRate>(plan.baud);
+    if(device != dcWT31N)
+    {
+        sequence.packets[sequence.length++] = config_packet(ridUnlockConfiguration, 0x88, 0xB5);
+        sequence.packets[sequence.length++] = config_packet(ridOutputValueSet,
+                                                            static_cast<uint8_t>(plan.measurements & 0xFF),
+                                                            static_cast<uint8_t>(plan.measurements >> 8));
+    }
+    sequence.packets[sequence.length++] = config_packet(ridOutputFrequency, witmotion_output_frequency(plan.frequency), 0x00);
+    // The baud rate goes last but the save, so the port is switched once and the save reaches the sensor at the new rate
+    if(plan.baud != current_baud)
+        sequence.packets[sequence.length++] = config_packet(ridPortBaudRate,
+                                                            witmotion_baud_rate(static_cast<QSerialPort::BaudRate>(plan.baud)),
+                                                            0x00);
+    sequence.packets[sequence.length++] = config_packet(ridSaveSettings, 0x00, 0x00);
+    return sequence;
+}
+
+std::string witmotion_bandwidth_planner::Error() const
+{
+    return error;
+}
+
+}
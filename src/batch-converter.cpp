@@ -0,0 +1,537 @@
+#include "witmotion/parser.h"
+#include "witmotion/frame.h"
+#include "witmotion/codec.h"
+#include "witmotion/export.h"
+#include "witmotion/task-pool.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace witmotion;
+
+namespace
+{
+
+static const size_t READ_SIZE = 1 << 20;
+// The window searched for the packet boundary after the nominal split offset
+static const size_t SPLIT_WINDOW = 65536;
+
+struct conversion_options
+{
+    std::string output;
+    witmotion_export_format format;
+    uint64_t split_bytes;
+    int64_t period; ///< Frame period for the captures without timestamps, nanoseconds
+    bool validate;
+};
+
+/* One input file. The file task splits it into parts, the parts are decoded in parallel
+   and committed to the exporter strictly in order by the first worker finding the next part ready */
+struct conversion_file
+{
+    std::string input;
+    std::string output;
+    uint64_t size;
+    int fd;
+    std::unique_ptr<witmotion_recording_reader> recording;
+    bool timestamps;
+    int leader; ///< ID of the packet starting the frame, -1 if unknown
+    std::vector<uint64_t> bounds; ///< Part boundaries: byte offsets, or block indices for the recordings
+    std::unique_ptr<witmotion_frame_exporter> exporter;
+    std::mutex guard;
+    std::vector<witmotion_frame_columns> parts;
+    std::vector<bool> decoded;
+    size_t committed;
+    bool writing;
+    bool failed;
+    uint64_t frames;
+    witmotion_parser_statistics statistics;
+    std::string error;
+};
+
+std::string stem(const std::string& name)
+{
+    size_t dot = name.rfind('.');
+    return ((dot == std::string::npos) || (dot == 0)) ? name : name.substr(0, dot);
+}
+
+bool exported_file(const std::string& name)
+{
+    static const char* extensions[] = {".csv", ".npy", ".npz", ".wmc"};
+    for(size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+    {
+        size_t length = std::strlen(extensions[i]);
+        if((name.size() > length) && (name.compare(name.size() - length, length, extensions[i]) == 0))
+            return true;
+    }
+    return false;
+}
+
+ssize_t read_at(const int fd, uint8_t* data, const size_t size, const uint64_t offset)
+{
+    size_t done = 0;
+    while(done < size)
+    {
+        ssize_t result = pread(fd, data + done, size - done, static_cast<off_t>(offset + done));
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        if(result == 0)
+            break;
+        done += static_cast<size_t>(result);
+    }
+    return static_cast<ssize_t>(done);
+}
+
+void fail(conversion_file& file, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(file.guard);
+    if(!file.failed)
+        file.error = message;
+    file.failed = true;
+}
+
+// The type of the packet completing the first frame is the first type of every output cycle
+int find_leader(const std::vector<witmotion_datapacket>& packets)
+{
+    witmotion_frame_assembler frames;
+    witmotion_frame frame;
+    for(auto i = packets.begin(); i != packets.end(); i++)
+        if(frames.Push(*i, 0, frame))
+            return i->id_byte;
+    return -1;
+}
+
+/* Finds the start of the leader packet after the nominal offset: the header byte, the leader ID,
+   the valid checksum and the next header byte, so the parser of the part starts in sync */
+uint64_t find_split(const conversion_file& file, const uint64_t nominal)
+{
+    std::vector<uint8_t> window(SPLIT_WINDOW);
+    ssize_t length = read_at(file.fd, window.data(), window.size(), nominal);
+    for(ssize_t i = 0; i + 12 <= length; i++)
+    {
+        if((window[i] != WITMOTION_HEADER_BYTE) || (window[i + 1] != file.leader) || (window[i + 11] != WITMOTION_HEADER_BYTE))
+            continue;
+        uint8_t sum = 0;
+        for(ssize_t j = 0; j < 10; j++)
+            sum += window[i + j];
+        if(sum == window[i + 10])
+            return nominal + static_cast<uint64_t>(i);
+    }
+    return 0;
+}
+
+bool prepare_capture(conversion_file& file, const conversion_options& options)
+{
+    file.bounds.push_back(0);
+    if(file.size > options.split_bytes)
+    {
+        std::vector<uint8_t> head(SPLIT_WINDOW);
+        ssize_t length = read_at(file.fd, head.data(), head.size(), 0);
+        std::vector<witmotion_datapacket> packets;
+        witmotion_packet_parser packet_parser(true);
+        packet_parser.Feed(head.data(), static_cast<size_t>(std::max<ssize_t>(length, 0)), [&packets](const witmotion_datapacket& packet)
+        {
+            packets.push_back(packet);
+        });
+        file.leader = find_leader(packets);
+        for(uint64_t nominal = options.split_bytes; (file.leader >= 0) && (nominal < file.size); nominal += options.split_bytes)
+        {
+            uint64_t split = find_split(file, nominal);
+            if((split > file.bounds.back()) && (split < file.size))
+                file.bounds.push_back(split);
+        }
+    }
+    file.bounds.push_back(file.size);
+    return true;
+}
+
+bool prepare_recording(conversion_file& file, const conversion_options& options)
+{
+    file.recording.reset(new witmotion_recording_reader(file.input));
+    if(!file.recording->Open())
+    {
+        file.error = file.recording->Error();
+        return false;
+    }
+    file.timestamps = file.recording->Timestamps();
+    const std::vector<witmotion_recording_block>& blocks = file.recording->Blocks();
+    file.bounds.push_back(0);
+    if((file.size > options.split_bytes) && !blocks.empty())
+    {
+        std::vector<witmotion_datapacket> packets;
+        if(file.recording->Read(0, packets))
+            file.leader = find_leader(packets);
+        uint64_t part_size = 0;
+        for(size_t i = 0; (file.leader >= 0) && (i + 1 < blocks.size()); i++)
+        {
+            part_size += blocks[i].size;
+            if(part_size >= options.split_bytes)
+            {
+                file.bounds.push_back(i + 1);
+                part_size = 0;
+            }
+        }
+    }
+    file.bounds.push_back(blocks.size());
+    return true;
+}
+
+void decode_capture_part(conversion_file& file, const size_t part, const conversion_options& options, witmotion_frame_columns& columns)
+{
+    witmotion_packet_parser packet_parser(options.validate);
+    witmotion_frame_assembler frames;
+    witmotion_frame frame;
+    std::vector<uint8_t> buffer(READ_SIZE);
+    for(uint64_t offset = file.bounds[part]; offset < file.bounds[part + 1]; )
+    {
+        size_t size = static_cast<size_t>(std::min<uint64_t>(buffer.size(), file.bounds[part + 1] - offset));
+        ssize_t length = read_at(file.fd, buffer.data(), size, offset);
+        if(length <= 0)
+        {
+            fail(file, std::string("Cannot read ") + file.input + ": " + std::strerror(errno));
+            break;
+        }
+        packet_parser.Feed(buffer.data(), static_cast<size_t>(length), [&frames, &frame, &columns](const witmotion_datapacket& packet)
+        {
+            if(frames.Push(packet, 0, frame))
+                columns.Append(frame);
+        });
+        offset += static_cast<uint64_t>(length);
+    }
+    if(frames.Flush(frame))
+        columns.Append(frame);
+    const witmotion_parser_statistics& statistics = packet_parser.Statistics();
+    std::lock_guard<std::mutex> lock(file.guard);
+    file.statistics.bytes += statistics.bytes;
+    file.statistics.packets += statistics.packets;
+    file.statistics.crc_failures += statistics.crc_failures;
+    file.statistics.resyncs += statistics.resyncs;
+}
+
+void decode_recording_part(conversion_file& file, const size_t part, witmotion_frame_columns& columns)
+{
+    witmotion_frame_assembler frames;
+    witmotion_frame frame;
+    std::vector<witmotion_datapacket> packets;
+    std::vector<int64_t> timestamps;
+    size_t last = file.recording->Blocks().size();
+    bool started = (part == 0);
+    uint64_t count = 0;
+    for(size_t block = static_cast<size_t>(file.bounds[part]); block < last; block++)
+    {
+        if(!file.recording->Read(block, packets, &timestamps))
+        {
+            fail(file, file.input + ": block " + std::to_string(block) + " is damaged");
+            break;
+        }
+        bool beyond = (block >= file.bounds[part + 1]);
+        size_t i = 0;
+        for(; i < packets.size(); i++)
+        {
+            // The packets before the first leader belong to the previous part, the ones after the end are taken up to the next leader
+            if(packets[i].id_byte == file.leader)
+            {
+                if(beyond)
+                    break;
+                started = true;
+            }
+            if(!started)
+                continue;
+            count++;
+            if(frames.Push(packets[i], timestamps[i], frame))
+                columns.Append(frame);
+        }
+        if(beyond && (i < packets.size()))
+            break;
+    }
+    if(frames.Flush(frame))
+        columns.Append(frame);
+    std::lock_guard<std::mutex> lock(file.guard);
+    file.statistics.packets += count;
+}
+
+// Writes the decoded parts in order, only one worker writes the file at a time
+void commit(conversion_file& file, const size_t part, witmotion_frame_columns& columns, const conversion_options& options)
+{
+    {
+        std::lock_guard<std::mutex> lock(file.guard);
+        std::swap(file.parts[part], columns);
+        file.decoded[part] = true;
+        if(file.writing)
+            return;
+        file.writing = true;
+    }
+    bool completed = false;
+    for(;;)
+    {
+        witmotion_frame_columns chunk;
+        {
+            std::lock_guard<std::mutex> lock(file.guard);
+            if((file.committed == file.parts.size()) || !file.decoded[file.committed])
+            {
+                file.writing = false;
+                completed = (file.committed == file.parts.size());
+                break;
+            }
+            std::swap(chunk, file.parts[file.committed++]);
+        }
+        if(!file.timestamps)
+        {
+            uint8_t* timestamps = chunk.Column(0);
+            for(size_t i = 0; i < chunk.Rows(); i++)
+            {
+                int64_t timestamp = static_cast<int64_t>(file.frames + i) * options.period;
+                std::memcpy(timestamps + i * sizeof(timestamp), &timestamp, sizeof(timestamp));
+            }
+        }
+        file.frames += chunk.Rows();
+        if(!file.exporter->Write(chunk))
+            fail(file, file.exporter->Error());
+    }
+    if(completed && !file.exporter->Close())
+        fail(file, file.exporter->Error());
+}
+
+void convert(witmotion_task_pool& pool, conversion_file& file, const conversion_options& options)
+{
+    file.fd = open(file.input.c_str(), O_RDONLY | O_CLOEXEC);
+    if(file.fd < 0)
+    {
+        fail(file, std::string("Cannot open ") + file.input + ": " + std::strerror(errno));
+        return;
+    }
+    uint32_t magic = 0;
+    bool recording = (read_at(file.fd, reinterpret_cast<uint8_t*>(&magic), sizeof(magic), 0) == sizeof(magic)) &&
+                     (magic == WITMOTION_RECORDING_MAGIC);
+    if(!(recording ? prepare_recording(file, options) : prepare_capture(file, options)))
+    {
+        file.failed = true;
+        return;
+    }
+    file.exporter = create_frame_exporter(options.format, file.output);
+    if(!file.exporter->Open())
+    {
+        fail(file, file.exporter->Error());
+        return;
+    }
+    size_t count = file.bounds.size() - 1;
+    file.parts.resize(count);
+    file.decoded.assign(count, false);
+    if(count == 0)
+    {
+        file.exporter->Close();
+        return;
+    }
+    // Submitted in the reverse order: the worker takes its own tasks from the back, the thieves take the rest from the front
+    for(size_t part = count; part-- > 1; )
+    {
+        pool.Submit([&file, part, &options]()
+        {
+            witmotion_frame_columns columns;
+            if(file.recording)
+                decode_recording_part(file, part, columns);
+            else
+                decode_capture_part(file, part, options, columns);
+            commit(file, part, columns, options);
+        });
+    }
+    witmotion_frame_columns columns;
+    if(file.recording)
+        decode_recording_part(file, 0, columns);
+    else
+        decode_capture_part(file, 0, options, columns);
+    commit(file, 0, columns, options);
+}
+
+}
+
+int main(int argc, char** args)
+{
+    QCoreApplication app(argc, args);
+    app.setApplicationVersion(QString(library_version().c_str()));
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WITMOTION OFFLINE BATCH CONVERTER");
+    parser.addHelpOption();
+    QCommandLineOption InputOption(QStringList() << "i" << "input",
+                                   "Directory of the raw captures and the compressed recordings",
+                                   "directory");
+    parser.addOption(InputOption);
+    QCommandLineOption OutputOption(QStringList() << "o" << "output",
+                                    "Output directory, created if it does not exist",
+                                    "directory");
+    parser.addOption(OutputOption);
+    QCommandLineOption FormatOption(QStringList() << "F" << "format",
+                                    "Output format: CSV, NPY (directory of .npy files per input), NPZ or COLUMNAR",
+                                    "CSV/NPY/NPZ/COLUMNAR",
+                                    "CSV");
+    parser.addOption(FormatOption);
+    QCommandLineOption ThreadsOption(QStringList() << "t" << "threads",
+                                     "Number of worker threads, 0 means hardware concurrency",
+                                     "count",
+                                     "0");
+    parser.addOption(ThreadsOption);
+    QCommandLineOption SplitOption("split",
+                                   "Files larger than this are split into parts converted in parallel, MiB",
+                                   "MiB",
+                                   "64");
+    parser.addOption(SplitOption);
+    QCommandLineOption RateOption(QStringList() << "r" << "rate",
+                                  "Sensor output frequency used to timestamp the captures without timestamps, Hz",
+                                  "1 - 200 Hz",
+                                  "10");
+    parser.addOption(RateOption);
+    QCommandLineOption ValidateOption("validate",
+                                      "Accept only valid datapackets");
+    parser.addOption(ValidateOption);
+    parser.process(app);
+
+    if(!parser.isSet(InputOption) || !parser.isSet(OutputOption))
+    {
+        std::cout << "ERROR: Input and output directories should be specified" << std::endl;
+        return 1;
+    }
+    conversion_options options;
+    options.output = parser.value(OutputOption).toStdString();
+    options.validate = parser.isSet(ValidateOption);
+    std::string format = parser.value(FormatOption).toUpper().toStdString();
+    if(format == "CSV")
+        options.format = exportCSV;
+    else if(format == "NPY")
+        options.format = exportNumPy;
+    else if(format == "NPZ")
+        options.format = exportNumPyArchive;
+    else if(format == "COLUMNAR")
+        options.format = exportColumnar;
+    else
+    {
+        std::cout << "ERROR: Unknown output format " << format << std::endl;
+        return 1;
+    }
+    options.split_bytes = static_cast<uint64_t>(parser.value(SplitOption).toUInt()) << 20;
+    double rate = parser.value(RateOption).toDouble();
+    if((options.split_bytes == 0) || (rate <= 0.0))
+    {
+        std::cout << "ERROR: Invalid split size or output frequency specified" << std::endl;
+        return 1;
+    }
+    options.period = static_cast<int64_t>(1e9 / rate);
+    if((mkdir(options.output.c_str(), 0755) != 0) && (errno != EEXIST))
+    {
+        std::cout << "ERROR: Cannot create output directory " << options.output << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::string input = parser.value(InputOption).toStdString();
+    DIR* directory = opendir(input.c_str());
+    if(directory == nullptr)
+    {
+        std::cout << "ERROR: Cannot open input directory " << input << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    std::vector<std::unique_ptr<conversion_file>> files;
+    for(dirent* entry = readdir(directory); entry != nullptr; entry = readdir(directory))
+    {
+        std::string name(entry->d_name);
+        std::string path = input + "/" + name;
+        struct stat status;
+        if((stat(path.c_str(), &status) != 0) || !S_ISREG(status.st_mode) || exported_file(name))
+            continue;
+        std::unique_ptr<conversion_file> file(new conversion_file);
+        file->input = path;
+        file->output = options.output + "/" + stem(name);
+        if(options.format == exportCSV)
+            file->output += ".csv";
+        else if(options.format == exportNumPyArchive)
+            file->output += ".npz";
+        else if(options.format == exportColumnar)
+            file->output += ".wmc";
+        file->size = static_cast<uint64_t>(status.st_size);
+        file->fd = -1;
+        file->timestamps = false;
+        file->leader = -1;
+        file->committed = 0;
+        file->writing = false;
+        file->failed = false;
+        file->frames = 0;
+        file->statistics = witmotion_parser_statistics{0, 0, 0, 0};
+        files.push_back(std::move(file));
+    }
+    closedir(directory);
+    if(files.empty())
+    {
+        std::cout << "ERROR: No input files found in " << input << std::endl;
+        return 1;
+    }
+    // The largest files are started first, so the tail of the run is filled with the small ones
+    std::sort(files.begin(), files.end(), [](const std::unique_ptr<conversion_file>& a, const std::unique_ptr<conversion_file>& b)
+    {
+        return a->size > b->size;
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    witmotion_task_pool pool(parser.value(ThreadsOption).toUInt());
+    for(auto i = files.begin(); i != files.end(); i++)
+    {
+        conversion_file* file = i->get();
+        pool.Submit([&pool, file, &options]()
+        {
+            convert(pool, *file, options);
+        });
+    }
+    pool.Wait();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t total_bytes = 0;
+    uint64_t total_frames = 0;
+    size_t failures = 0;
+    for(auto i = files.begin(); i != files.end(); i++)
+    {
+        conversion_file& file = **i;
+        if(file.fd >= 0)
+            close(file.fd);
+        if(file.failed)
+        {
+            std::cout << "ERROR: " << file.input << ": " << file.error << std::endl;
+            failures++;
+            continue;
+        }
+        total_bytes += file.size;
+        total_frames += file.frames;
+        std::cout << file.input << " -> " << file.output << ": "
+                  << file.statistics.packets << " packets, " << file.frames << " frames in "
+                  << (file.bounds.size() - 1) << " parts";
+        if(!file.recording)
+            std::cout << ", " << file.statistics.crc_failures << " CRC failures, "
+                      << file.statistics.resyncs << " resynchronizations";
+        std::cout << std::endl;
+    }
+    std::cout.precision(3);
+    std::cout << std::fixed << std::endl
+              << "Converted " << files.size() - failures << " of " << files.size() << " files, "
+              << total_frames << " frames from " << total_bytes << " bytes in " << elapsed << " s, "
+              << total_bytes / elapsed / 1e6 << " MB/s on " << pool.Threads() << " threads, "
+              << pool.Stolen() << " tasks stolen" << std::endl;
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,375 @@
+/*
+    Microbenchmarks of the acquisition and decoding path.
+
+    Every benchmark processes the fixed synthetic data generated from the constant seed,
+    so the results are comparable between the builds. The iteration count of the sample
+    is calibrated to last not less than the requested time, the reported value is the
+    median of the samples and the spread is the distance between the fastest and the
+    slowest sample relative to the median. The packet parser is fed by 128-byte chunks as
+    in QBaseSerialWitmotionSensorReader::ReadData, on the clean stream and on the stream
+    with the resync garbage and broken checksums.
+*/
+#include "witmotion/wt901-uart.h"
+#include "witmotion/parser.h"
+#include "witmotion/frame.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace witmotion;
+
+namespace
+{
+
+// Accumulates the benchmark outputs, so the measured code cannot be eliminated
+volatile double benchmark_sink = 0.0;
+
+struct benchmark
+{
+    std::string name;
+    size_t items; ///< Packets (or IDs, values) processed by one call of the body
+    size_t bytes; ///< Input bytes processed by one call of the body
+    std::function<void()> body;
+};
+
+struct benchmark_result
+{
+    double ns_per_item;
+    double spread;
+};
+
+void append_packet(std::vector<uint8_t>& stream, const witmotion_datapacket& packet)
+{
+    // The structure is padded, so the wire representation is composed byte-by-byte
+    stream.push_back(packet.header_byte);
+    stream.push_back(packet.id_byte);
+    stream.insert(stream.end(), packet.datastore.raw, packet.datastore.raw + 8);
+    stream.push_back(packet.crc);
+}
+
+std::vector<witmotion_datapacket> make_packets(const witmotion_packet_id id, const size_t count, std::mt19937& generator)
+{
+    std::uniform_int_distribution<int> cell(-32768, 32767);
+    std::vector<witmotion_datapacket> packets(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        packets[i].header_byte = WITMOTION_HEADER_BYTE;
+        packets[i].id_byte = id;
+        for(size_t j = 0; j < 4; j++)
+            packets[i].datastore.raw_cells[j] = static_cast<int16_t>(cell(generator));
+        packets[i].crc = packet_crc(packets[i]);
+    }
+    return packets;
+}
+
+// WT901 output cycle; the noisy stream has the unregistered IDs and the broken checksums in between
+std::vector<uint8_t> make_stream(const size_t cycles, const bool noisy, std::mt19937& generator)
+{
+    static const witmotion_packet_id ids[] = {
+        pidAcceleration,
+        pidAngularVelocity,
+        pidAngles,
+        pidMagnetometer,
+        pidOrientation
+    };
+    std::uniform_int_distribution<int> cell(-32768, 32767);
+    std::uniform_int_distribution<int> noise(0, 99);
+    std::vector<uint8_t> stream;
+    stream.reserve(cycles * 6 * 11);
+    for(size_t i = 0; i < cycles; i++)
+    {
+        for(size_t j = 0; j < sizeof(ids) / sizeof(ids[0]); j++)
+        {
+            witmotion_datapacket packet;
+            packet.header_byte = WITMOTION_HEADER_BYTE;
+            packet.id_byte = ids[j];
+            for(size_t k = 0; k < 4; k++)
+                packet.datastore.raw_cells[k] = static_cast<int16_t>(cell(generator));
+            packet.crc = packet_crc(packet);
+            if(noisy && (noise(generator) < 2))
+                packet.crc++;
+            append_packet(stream, packet);
+            if(noisy && (noise(generator) < 5))
+            {
+                stream.push_back(WITMOTION_HEADER_BYTE);
+                stream.push_back(static_cast<uint8_t>(0x60 + noise(generator)));
+                stream.push_back(static_cast<uint8_t>(noise(generator)));
+            }
+        }
+    }
+    return stream;
+}
+
+benchmark_result run(const benchmark& bench, const size_t samples, const double min_time)
+{
+    typedef std::chrono::steady_clock clock;
+    bench.body(); // warm-up
+    size_t iterations = 1;
+    for(;;)
+    {
+        clock::time_point start = clock::now();
+        for(size_t i = 0; i < iterations; i++)
+            bench.body();
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        if(elapsed >= min_time)
+            break;
+        iterations *= (elapsed > min_time / 10.0) ? 2 : 10;
+    }
+    std::vector<double> times(samples);
+    for(size_t s = 0; s < samples; s++)
+    {
+        clock::time_point start = clock::now();
+        for(size_t i = 0; i < iterations; i++)
+            bench.body();
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        times[s] = elapsed * 1e9 / static_cast<double>(iterations * bench.items);
+    }
+    std::sort(times.begin(), times.end());
+    benchmark_result result;
+    result.ns_per_item = times[samples / 2];
+    result.spread = (times.back() - times.front()) / result.ns_per_item;
+    return result;
+}
+
+template<typename Decoder> benchmark decoder_benchmark(const std::string& name,
+                                                       const std::vector<witmotion_datapacket>& packets,
+                                                       Decoder decoder)
+{
+    return benchmark{name, packets.size(), 11 * packets.size(), [&packets, decoder]()
+    {
+        double sum = 0.0;
+        for(auto i = packets.begin(); i != packets.end(); i++)
+            sum += decoder(*i);
+        benchmark_sink = benchmark_sink + sum;
+    }};
+}
+
+class counting_sink: public witmotion_packet_sink
+{
+public:
+    uint64_t packets;
+    counting_sink():
+        packets(0)
+    {}
+    virtual void Consume(const witmotion_datapacket& packet)
+    {
+        packets += packet.id_byte;
+    }
+};
+
+}
+
+int main(int argc, char** args)
+{
+    QCoreApplication app(argc, args);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WITMOTION MICROBENCHMARKS");
+    parser.addHelpOption();
+    QCommandLineOption SamplesOption(QStringList() << "n" << "samples",
+                                     "Number of the measured samples per benchmark, the median is reported",
+                                     "count",
+                                     "9");
+    parser.addOption(SamplesOption);
+    QCommandLineOption TimeOption(QStringList() << "t" << "time",
+                                  "Minimal duration of one sample, ms",
+                                  "ms",
+                                  "50");
+    parser.addOption(TimeOption);
+    QCommandLineOption FilterOption(QStringList() << "f" << "filter",
+                                    "Run only the benchmarks containing the substring in the name",
+                                    "name");
+    parser.addOption(FilterOption);
+    QCommandLineOption CSVOption("csv",
+                                 "Print the results as comma-separated values for the automatic comparison");
+    parser.addOption(CSVOption);
+    parser.process(app);
+    size_t samples = std::max<size_t>(1, parser.value(SamplesOption).toUInt());
+    double min_time = std::max<uint32_t>(1, parser.value(TimeOption).toUInt()) / 1000.0;
+    std::string filter = parser.value(FilterOption).toStdString();
+
+    std::mt19937 generator(20200101);
+    const std::vector<uint8_t> clean_stream = make_stream(4096, false, generator);
+    const std::vector<uint8_t> noisy_stream = make_stream(4096, true, generator);
+    const std::vector<witmotion_datapacket> accelerations = make_packets(pidAcceleration, 4096, generator);
+    const std::vector<witmotion_datapacket> random_packets = make_packets(pidAngles, 4096, generator);
+    std::vector<uint8_t> id_bytes(4096);
+    for(size_t i = 0; i < id_bytes.size(); i++)
+        id_bytes[i] = static_cast<uint8_t>(generator());
+    std::vector<float> values(65536);
+    std::normal_distribution<float> normal(0.f, 1.f);
+    for(auto i = values.begin(); i != values.end(); i++)
+        *i = normal(generator);
+
+    witmotion_packet_parser packet_parser(false);
+    witmotion_packet_parser validating_parser(true);
+    auto parse = [](witmotion_packet_parser& state, const std::vector<uint8_t>& stream)
+    {
+        uint64_t delivered = 0;
+        for(size_t offset = 0; offset < stream.size(); offset += 128)
+            state.Feed(stream.data() + offset, std::min<size_t>(128, stream.size() - offset), [&delivered](const witmotion_datapacket& packet)
+            {
+                delivered += packet.id_byte;
+            });
+        benchmark_sink = benchmark_sink + static_cast<double>(delivered);
+    };
+
+    wt901::QWitmotionWT901Sensor sensor("ttyBENCHMARK", QSerialPort::Baud115200);
+    uint64_t direct_count = 0;
+    uint64_t queued_count = 0;
+    QObject receiver;
+    QObject::connect(&sensor, &QAbstractWitmotionSensorController::Acquired, [&direct_count](const witmotion_datapacket& packet)
+    {
+        direct_count += packet.id_byte;
+    });
+    counting_sink sink;
+
+    std::vector<benchmark> benchmarks;
+    // The parser cost is reported per valid packet of the stream, the throughput per stream byte
+    size_t clean_packets = clean_stream.size() / 11;
+    size_t noisy_packets = 5 * 4096;
+    benchmarks.push_back(benchmark{"parser/clean", clean_packets, clean_stream.size(), [&]() { parse(packet_parser, clean_stream); }});
+    benchmarks.push_back(benchmark{"parser/clean-validate", clean_packets, clean_stream.size(), [&]() { parse(validating_parser, clean_stream); }});
+    benchmarks.push_back(benchmark{"parser/noisy", noisy_packets, noisy_stream.size(), [&]() { parse(packet_parser, noisy_stream); }});
+    benchmarks.push_back(benchmark{"parser/noisy-validate", noisy_packets, noisy_stream.size(), [&]() { parse(validating_parser, noisy_stream); }});
+    benchmarks.push_back(benchmark{"util/id_registered", id_bytes.size(), id_bytes.size(), [&]()
+    {
+        size_t count = 0;
+        for(auto i = id_bytes.begin(); i != id_bytes.end(); i++)
+            count += id_registered(*i) ? 1 : 0;
+        benchmark_sink = benchmark_sink + static_cast<double>(count);
+    }});
+    benchmarks.push_back(decoder_benchmark("util/packet_crc", random_packets, [](const witmotion_datapacket& packet)
+    {
+        return static_cast<double>(packet_crc(packet));
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/accelerations", accelerations, [](const witmotion_datapacket& packet)
+    {
+        float x, y, z, t;
+        decode_accelerations(packet, x, y, z, t);
+        return static_cast<double>(x + y + z + t);
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/angular_velocities", accelerations, [](const witmotion_datapacket& packet)
+    {
+        float x, y, z, t;
+        decode_angular_velocities(packet, x, y, z, t);
+        return static_cast<double>(x + y + z + t);
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/angles", random_packets, [](const witmotion_datapacket& packet)
+    {
+        float x, y, z, t;
+        decode_angles(packet, x, y, z, t);
+        return static_cast<double>(x + y + z + t);
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/magnetometer", random_packets, [](const witmotion_datapacket& packet)
+    {
+        float x, y, z, t;
+        decode_magnetometer(packet, x, y, z, t);
+        return static_cast<double>(x + y + z + t);
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/orientation", random_packets, [](const witmotion_datapacket& packet)
+    {
+        float x, y, z, w;
+        decode_orientation(packet, x, y, z, w);
+        return static_cast<double>(x + y + z + w);
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/altimeter", random_packets, [](const witmotion_datapacket& packet)
+    {
+        double pressure, altitude;
+        decode_altimeter(packet, pressure, altitude);
+        return pressure + altitude;
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/gps", random_packets, [](const witmotion_datapacket& packet)
+    {
+        double longitude_deg, longitude_min, latitude_deg, latitude_min;
+        decode_gps(packet, longitude_deg, longitude_min, latitude_deg, latitude_min);
+        return longitude_deg + longitude_min + latitude_deg + latitude_min;
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/gps_ground_speed", random_packets, [](const witmotion_datapacket& packet)
+    {
+        float altitude, angular_velocity;
+        double ground_speed;
+        decode_gps_ground_speed(packet, altitude, angular_velocity, ground_speed);
+        return altitude + angular_velocity + ground_speed;
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/gps_accuracy", random_packets, [](const witmotion_datapacket& packet)
+    {
+        size_t satellites;
+        float east, north, up;
+        decode_gps_accuracy(packet, satellites, east, north, up);
+        return static_cast<double>(satellites) + east + north + up;
+    }));
+    benchmarks.push_back(decoder_benchmark("decode/realtime_clock", random_packets, [](const witmotion_datapacket& packet)
+    {
+        uint8_t year, month, day, hour, minute, second;
+        uint16_t millisecond;
+        decode_realtime_clock(packet, year, month, day, hour, minute, second, millisecond);
+        return static_cast<double>(year + month + day + hour + minute + second + millisecond);
+    }));
+    benchmarks.push_back(decoder_benchmark("frame/assembler", accelerations, [](const witmotion_datapacket& packet)
+    {
+        static witmotion_frame_assembler frames;
+        static int64_t timestamp = 0;
+        witmotion_frame frame;
+        return frames.Push(packet, timestamp++, frame) ? static_cast<double>(frame.acceleration[0]) : 0.0;
+    }));
+    benchmarks.push_back(benchmark{"util/variance", values.size(), values.size() * sizeof(float), [&]()
+    {
+        benchmark_sink = benchmark_sink + variance(values);
+    }});
+    benchmarks.push_back(benchmark{"controller/signal-direct", accelerations.size(), 11 * accelerations.size(), [&]()
+    {
+        for(auto i = accelerations.begin(); i != accelerations.end(); i++)
+            sensor.Packet(*i);
+    }});
+    benchmarks.push_back(benchmark{"controller/signal-queued", accelerations.size(), 11 * accelerations.size(), [&]()
+    {
+        QMetaObject::Connection connection = QObject::connect(&sensor, &QAbstractWitmotionSensorController::Acquired, &receiver,
+                                                              [&queued_count](const witmotion_datapacket& packet)
+        {
+            queued_count += packet.id_byte;
+        }, Qt::QueuedConnection);
+        for(auto i = accelerations.begin(); i != accelerations.end(); i++)
+            sensor.Packet(*i);
+        QCoreApplication::processEvents();
+        QObject::disconnect(connection);
+    }});
+    benchmarks.push_back(benchmark{"controller/packet-sink", accelerations.size(), 11 * accelerations.size(), [&]()
+    {
+        for(auto i = accelerations.begin(); i != accelerations.end(); i++)
+            sensor.Consume(*i);
+    }});
+    sensor.SetPacketSink(&sink);
+
+    bool csv = parser.isSet(CSVOption);
+    if(csv)
+        std::cout << "benchmark,ns_per_packet,packets_per_s,mb_per_s,spread" << std::endl;
+    else
+        std::printf("%-28s %12s %14s %10s %8s\n", "benchmark", "ns/packet", "packets/s", "MB/s", "spread");
+    for(auto i = benchmarks.begin(); i != benchmarks.end(); i++)
+    {
+        if(!filter.empty() && (i->name.find(filter) == std::string::npos))
+            continue;
+        benchmark_result result = run(*i, samples, min_time);
+        double rate = 1e9 / result.ns_per_item;
+        double throughput = rate * static_cast<double>(i->bytes) / static_cast<double>(i->items) / 1e6;
+        if(csv)
+            std::printf("%s,%.4f,%.1f,%.3f,%.4f\n", i->name.c_str(), result.ns_per_item, rate, throughput, result.spread);
+        else
+            std::printf("%-28s %12.3f %14.0f %10.2f %7.1f%%\n", i->name.c_str(), result.ns_per_item, rate, throughput, 100.0 * result.spread);
+        std::fflush(stdout);
+    }
+    if(!csv)
+        std::cout << std::endl << "util/id_registered is measured per ID byte, util/variance per value" << std::endl;
+    benchmark_sink = benchmark_sink + static_cast<double>(direct_count + queued_count + sink.packets);
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include "witmotion/cadence.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace witmotion
+{
+
+witmotion_cadence_estimator::witmotion_cadence_estimator(const double rate, const double threshold):
+    configured_rate(rate),
+    gap_threshold(threshold)
+{
+    Reset();
+}
+
+void witmotion_cadence_estimator::SetExpectedRate(const double rate)
+{
+    configured_rate = rate;
+}
+
+void witmotion_cadence_estimator::SetGapThreshold(const double periods)
+{
+    gap_threshold = periods;
+}
+
+void witmotion_cadence_estimator::Reset()
+{
+    for(size_t i = 0; i < WITMOTION_CADENCE_PACKET_TYPES; i++)
+    {
+        std::memset(&types[i], 0, sizeof(type_state));
+        position[i] = -1;
+    }
+    order_length = 0;
+    candidate_length = 0;
+    learned_length = 0;
+    confirmations = 0;
+    previous = -1;
+}
+
+double witmotion_cadence_estimator::ExpectedRate(const size_t index) const
+{
+    if(configured_rate > 0.0)
+        return configured_rate;
+    const type_state& type = types[index];
+    if((type.received < 2) || (type.last <= type.first))
+        return 0.0;
+    return static_cast<double>(type.received - 1) * 1e9 / static_cast<double>(type.last - type.first);
+}
+
+void witmotion_cadence_estimator::Lock()
+{
+    for(size_t i = 0; i < WITMOTION_CADENCE_PACKET_TYPES; i++)
+        position[i] = -1;
+    for(size_t i = 0; i < learned_length; i++)
+    {
+        order[i] = learned[i];
+        position[learned[i]] = static_cast<int>(i);
+    }
+    order_length = learned_length;
+}
+
+void witmotion_cadence_estimator::Learn(const size_t index)
+{
+    size_t found = 0;
+    while((found < candidate_length) && (candidate[found] != index))
+        found++;
+    if(found == candidate_length)
+    {
+        candidate[candidate_length++] = static_cast<uint8_t>(index);
+        return;
+    }
+    if(found == 0)
+    {
+        // The cycle is closed by its first packet type, which starts the next one
+        if((learned_length == candidate_length) && (std::memcmp(learned, candidate, candidate_length) == 0))
+            confirmations++;
+        else
+        {
+            std::memcpy(learned, candidate, candidate_length);
+            learned_length = candidate_length;
+            confirmations = 1;
+        }
+        if(confirmations >= 3)
+        {
+            Lock();
+            previous = position[index];
+            return;
+        }
+    }
+    else
+    {
+        learned_length = 0;
+        confirmations = 0;
+    }
+    candidate[0] = static_cast<uint8_t>(index);
+    candidate_length = 1;
+}
+
+void witmotion_cadence_estimator::Push(const witmotion_datapacket &packet, const int64_t timestamp)
+{
+    size_t index = static_cast<size_t>(packet.id_byte - pidRTC);
+    if(index >= WITMOTION_CADENCE_PACKET_TYPES)
+        return;
+    type_state& type = types[index];
+    if(type.received > 0)
+    {
+        int64_t gap = timestamp - type.last;
+        if(gap > type.max_gap)
+            type.max_gap = gap;
+        double rate = ExpectedRate(index);
+        if((rate > 0.0) && (static_cast<double>(gap) > gap_threshold * 1e9 / rate))
+            type.gaps++;
+        if(std::memcmp(type.payload, packet.datastore.raw, sizeof(type.payload)) == 0)
+            type.duplicated++;
+    }
+    else
+        type.first = timestamp;
+    std::memcpy(type.payload, packet.datastore.raw, sizeof(type.payload));
+    type.last = timestamp;
+    type.received++;
+
+    if(order_length == 0)
+    {
+        Learn(index);
+        return;
+    }
+    if(position[index] < 0)
+    {
+        // The new packet type has been enabled, the cycle is learned again
+        order_length = 0;
+        candidate_length = 0;
+        learned_length = 0;
+        confirmations = 0;
+        previous = -1;
+        Learn(index);
+        return;
+    }
+    int current = position[index];
+    if(previous >= 0)
+    {
+        int length = static_cast<int>(order_length);
+        int skipped = (current - previous - 1 + length) % length;
+        for(int i = 1; i <= skipped; i++)
+            types[order[(previous + i) % length]].skipped++;
+    }
+    previous = current;
+}
+
+witmotion_cadence_report witmotion_cadence_estimator::Statistics() const
+{
+    witmotion_cadence_report report;
+    report.cycle_length = order_length;
+    for(size_t i = 0; i < WITMOTION_CADENCE_PACKET_TYPES; i++)
+    {
+        const type_state& type = types[i];
+        witmotion_cadence_statistics& statistics = report.types[i];
+        statistics.received = type.received;
+        statistics.missing = type.skipped;
+        statistics.duplicated = type.duplicated;
+        statistics.gaps = type.gaps;
+        statistics.max_gap = type.max_gap;
+        statistics.expected_rate = ExpectedRate(i);
+        statistics.effective_rate = ((type.received >= 2) && (type.last > type.first)) ?
+                    static_cast<double>(type.received - 1) * 1e9 / static_cast<double>(type.last - type.first) : 0.0;
+        if((configured_rate > 0.0) && (type.received > 0))
+        {
+            uint64_t expected = static_cast<uint64_t>(std::llround(static_cast<double>(type.last - type.first) * configured_rate / 1e9)) + 1;
+            if((expected > type.received) && (expected - type.received > statistics.missing))
+                statistics.missing = expected - type.received;
+        }
+    }
+    return report;
+}
+
+void witmotion_cadence_estimator::Report(std::ostream &out) const
+{
+    witmotion_cadence_report report = Statistics();
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-6s %10s %13s %13s %10s %8s %10s %8s %12s\n",
+                  "ID", "received", "expected, Hz", "effective, Hz", "missing", "loss, %", "duplicated", "gaps", "max gap, ms");
+    out << line;
+    for(size_t i = 0; i < WITMOTION_CADENCE_PACKET_TYPES; i++)
+    {
+        const witmotion_cadence_statistics& type = report.types[i];
+        if(type.received == 0)
+            continue;
+        std::snprintf(line, sizeof(line), "0x%02X   %10llu %13.2f %13.2f %10llu %8.3f %10llu %8llu %12.3f\n",
+                      static_cast<unsigned int>(pidRTC + i),
+                      static_cast<unsigned long long>(type.received),
+                      type.expected_rate,
+                      type.effective_rate,
+                      static_cast<unsigned long long>(type.missing),
+                      100.0 * static_cast<double>(type.missing) / static_cast<double>(type.received + type.missing),
+                      static_cast<unsigned long long>(type.duplicated),
+                      static_cast<unsigned long long>(type.gaps),
+                      static_cast<double>(type.max_gap) / 1e6);
+        out << line;
+    }
+    if(report.cycle_length == 0)
+        out << "Output cycle not learned, the loss is estimated by the expected rate only" << std::endl;
+}
+
+}
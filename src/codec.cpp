@@ -0,0 +1,683 @@
+#include "witmotion/codec.h"
+#include "witmotion/util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace witmotion
+{
+
+namespace
+{
+
+static const uint8_t CODEC_ESCAPE_TAG = 0xFF;
+static const uint8_t CODEC_CRC_FLAG = 0x10;
+static const size_t CODEC_PACKET_SIZE = 11;
+static const size_t CODEC_FAST_WINDOW = 16; ///< The longest packet record (tag, control, 4 x 2 bytes, CRC) with the slack for the 2-byte loads
+
+void put_u16(uint8_t* data, const uint16_t value)
+{
+    data[0] = static_cast<uint8_t>(value);
+    data[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put_u32(uint8_t* data, const uint32_t value)
+{
+    for(size_t i = 0; i < 4; i++)
+        data[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+void put_u64(uint8_t* data, const uint64_t value)
+{
+    for(size_t i = 0; i < 8; i++)
+        data[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint16_t get_u16(const uint8_t* data)
+{
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+uint32_t get_u32(const uint8_t* data)
+{
+    uint32_t value = 0;
+    for(size_t i = 0; i < 4; i++)
+        value |= static_cast<uint32_t>(data[i]) << (8 * i);
+    return value;
+}
+
+uint64_t get_u64(const uint8_t* data)
+{
+    uint64_t value = 0;
+    for(size_t i = 0; i < 8; i++)
+        value |= static_cast<uint64_t>(data[i]) << (8 * i);
+    return value;
+}
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The cell deltas wrap around modulo 2^16, so every zigzag-mapped delta fits into 2 bytes
+uint16_t zigzag16(const uint16_t delta)
+{
+    int16_t value = static_cast<int16_t>(delta);
+    return static_cast<uint16_t>((static_cast<uint16_t>(value) << 1) ^ static_cast<uint16_t>(value >> 15));
+}
+
+uint16_t unzigzag16(const uint16_t value)
+{
+    return static_cast<uint16_t>((value >> 1) ^ (0 - (value & 1)));
+}
+
+uint64_t zigzag64(const int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag64(const uint64_t value)
+{
+    return static_cast<int64_t>((value >> 1) ^ (0 - (value & 1)));
+}
+
+void write_header(uint8_t* data, const bool timestamps, const uint32_t block_packets)
+{
+    put_u32(data, WITMOTION_RECORDING_MAGIC);
+    put_u16(data + 4, WITMOTION_RECORDING_VERSION);
+    put_u16(data + 6, timestamps ? 1 : 0);
+    put_u32(data + 8, block_packets);
+    put_u32(data + 12, 0);
+}
+
+void write_index_entry(uint8_t* data, const witmotion_recording_block& block)
+{
+    put_u64(data, block.offset);
+    put_u64(data + 8, block.first_packet);
+    put_u64(data + 16, static_cast<uint64_t>(block.first_timestamp));
+    put_u32(data + 24, block.packets);
+    put_u32(data + 28, block.size);
+}
+
+void read_index_entry(const uint8_t* data, witmotion_recording_block& block)
+{
+    block.offset = get_u64(data);
+    block.first_packet = get_u64(data + 8);
+    block.first_timestamp = static_cast<int64_t>(get_u64(data + 16));
+    block.packets = get_u32(data + 24);
+    block.size = get_u32(data + 28);
+}
+
+bool read_exactly(const int fd, uint8_t* data, const size_t size, const uint64_t offset)
+{
+    size_t received = 0;
+    while(received < size)
+    {
+        ssize_t result = pread(fd, data + received, size - received, static_cast<off_t>(offset + received));
+        if(result < 0 && errno == EINTR)
+            continue;
+        if(result <= 0)
+            return false;
+        received += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+// Byte offsets of the four deltas and the record length for every control byte value
+struct control_layout
+{
+    uint8_t offsets[256][4];
+    uint8_t lengths[256];
+    uint16_t masks[256][4];
+    control_layout()
+    {
+        for(size_t control = 0; control < 256; control++)
+        {
+            uint8_t offset = 0;
+            for(size_t i = 0; i < 4; i++)
+            {
+                size_t length = (control >> (2 * i)) & 0x03;
+                offsets[control][i] = offset;
+                masks[control][i] = (length == 0) ? 0x0000 : ((length == 1) ? 0x00FF : 0xFFFF);
+                offset = static_cast<uint8_t>(offset + length);
+            }
+            lengths[control] = offset;
+        }
+    }
+};
+
+const control_layout layout;
+
+/* Decodes the cells of one packet and returns the sum of the decoded bytes for the CRC.
+   In the fast mode the deltas are loaded independently by the offsets from the layout
+   table, which requires CODEC_FAST_WINDOW readable bytes. */
+template<bool fast> bool decode_cells(const uint8_t*& input,
+                                      const uint8_t* end,
+                                      const uint8_t control,
+                                      uint16_t* previous,
+                                      witmotion_datapacket& packet,
+                                      uint32_t& sum)
+{
+    const uint8_t* data = input;
+    uint16_t cells[4];
+    sum = 0;
+    // The length 3 is never produced by the encoder, both paths reject it so the corrupt input decodes alike
+    if((control & (control >> 1) & 0x55) != 0)
+        return false;
+    if(!fast && (static_cast<size_t>(end - data) < layout.lengths[control]))
+        return false; // Truncated record
+    for(size_t i = 0; i < 4; i++)
+    {
+        const uint8_t* delta = data + layout.offsets[control][i];
+        uint16_t value;
+        if(fast)
+            value = static_cast<uint16_t>((delta[0] | (delta[1] << 8)) & layout.masks[control][i]);
+        else
+        {
+            value = (layout.masks[control][i] != 0) ? delta[0] : 0;
+            if(layout.masks[control][i] == 0xFFFF)
+                value = static_cast<uint16_t>(value | (delta[1] << 8));
+        }
+        cells[i] = static_cast<uint16_t>(previous[i] + unzigzag16(value));
+        previous[i] = cells[i];
+        sum += (cells[i] & 0xFF) + (cells[i] >> 8);
+    }
+    // The cells are kept in the host order, as \ref witmotion_datapacket `raw_cells`
+    std::memcpy(packet.datastore.raw, cells, sizeof(cells));
+    input = data + layout.lengths[control];
+    return true;
+}
+
+}
+
+witmotion_packet_block_encoder::witmotion_packet_block_encoder(const bool store_timestamps,
+                                                               const size_t reserve):
+    timestamps(store_timestamps)
+{
+    // Worst case: escaped packet and 10-byte timestamp difference
+    payload.reserve(reserve * (1 + CODEC_PACKET_SIZE + (store_timestamps ? 10 : 0)));
+    Reset();
+}
+
+void witmotion_packet_block_encoder::Reset()
+{
+    std::memset(previous, 0, sizeof(previous));
+    first_timestamp = 0;
+    previous_timestamp = 0;
+    previous_interval = 0;
+    count = 0;
+    payload.clear();
+}
+
+void witmotion_packet_block_encoder::Push(const witmotion_datapacket &packet, const int64_t timestamp)
+{
+    if(count == 0)
+    {
+        first_timestamp = timestamp;
+        previous_timestamp = timestamp;
+    }
+    size_t position = payload.size();
+    payload.resize(position + 1 + CODEC_PACKET_SIZE + 10);
+    uint8_t* output = &payload[position];
+    size_t length;
+    // The registered IDs are contiguous, the type index is stored in 4 bits of the tag
+    if((packet.header_byte != WITMOTION_HEADER_BYTE) || (packet.id_byte < pidRTC) || (packet.id_byte > pidGPSAccuracy))
+    {
+        output[0] = CODEC_ESCAPE_TAG;
+        output[1] = packet.header_byte;
+        output[2] = packet.id_byte;
+        std::memcpy(output + 3, packet.datastore.raw, 8);
+        output[11] = packet.crc;
+        length = 1 + CODEC_PACKET_SIZE;
+    }
+    else
+    {
+        size_t type = packet.id_byte - pidRTC;
+        bool crc_stored = (packet_crc(packet) != packet.crc);
+        uint8_t control = 0;
+        length = 2;
+        uint16_t cells[4];
+        std::memcpy(cells, packet.datastore.raw, sizeof(cells));
+        for(size_t i = 0; i < 4; i++)
+        {
+            uint16_t cell = cells[i];
+            uint16_t delta = zigzag16(static_cast<uint16_t>(cell - static_cast<uint16_t>(previous[type][i])));
+            previous[type][i] = static_cast<int16_t>(cell);
+            size_t bytes = (delta == 0) ? 0 : ((delta < 0x100) ? 1 : 2);
+            control = static_cast<uint8_t>(control | (bytes << (2 * i)));
+            output[length] = static_cast<uint8_t>(delta);
+            output[length + 1] = static_cast<uint8_t>(delta >> 8);
+            length += bytes;
+        }
+        output[0] = static_cast<uint8_t>(type | (crc_stored ? CODEC_CRC_FLAG : 0));
+        output[1] = control;
+        if(crc_stored)
+            output[length++] = packet.crc;
+    }
+    if(timestamps)
+    {
+        int64_t interval = timestamp - previous_timestamp;
+        uint64_t value = zigzag64(interval - previous_interval);
+        previous_timestamp = timestamp;
+        previous_interval = interval;
+        do
+        {
+            uint8_t byte = static_cast<uint8_t>(value & 0x7F);
+            value >>= 7;
+            output[length++] = static_cast<uint8_t>(byte | ((value != 0) ? 0x80 : 0));
+        }
+        while(value != 0);
+    }
+    payload.resize(position + length);
+    count++;
+}
+
+size_t witmotion_packet_block_encoder::Count() const
+{
+    return count;
+}
+
+int64_t witmotion_packet_block_encoder::FirstTimestamp() const
+{
+    return first_timestamp;
+}
+
+const std::vector<uint8_t>& witmotion_packet_block_encoder::Payload() const
+{
+    return payload;
+}
+
+bool decode_packet_block(const uint8_t *payload,
+                         const size_t size,
+                         const size_t count,
+                         const int64_t first_timestamp,
+                         const bool store_timestamps,
+                         witmotion_datapacket *packets,
+                         int64_t *timestamps)
+{
+    uint16_t previous[16][4];
+    std::memset(previous, 0, sizeof(previous));
+    const uint8_t* input = payload;
+    const uint8_t* end = payload + size;
+    int64_t timestamp = first_timestamp;
+    int64_t interval = 0;
+    for(size_t n = 0; n < count; n++)
+    {
+        if(input >= end)
+            return false;
+        witmotion_datapacket& packet = packets[n];
+        uint8_t tag = *input++;
+        if(tag == CODEC_ESCAPE_TAG)
+        {
+            if(static_cast<size_t>(end - input) < CODEC_PACKET_SIZE)
+                return false;
+            packet.header_byte = input[0];
+            packet.id_byte = input[1];
+            std::memcpy(packet.datastore.raw, input + 2, 8);
+            packet.crc = input[10];
+            input += CODEC_PACKET_SIZE;
+        }
+        else
+        {
+            size_t type = tag & 0x0F;
+            if((type >= 11) || (input >= end))
+                return false;
+            uint8_t control = *input++;
+            packet.header_byte = WITMOTION_HEADER_BYTE;
+            packet.id_byte = static_cast<uint8_t>(pidRTC + type);
+            uint32_t sum;
+            bool decoded = (static_cast<size_t>(end - input) >= CODEC_FAST_WINDOW) ?
+                        decode_cells<true>(input, end, control, previous[type], packet, sum) :
+                        decode_cells<false>(input, end, control, previous[type], packet, sum);
+            if(!decoded)
+                return false;
+            if(tag & CODEC_CRC_FLAG)
+            {
+                if(input >= end)
+                    return false;
+                packet.crc = *input++;
+            }
+            else
+                packet.crc = static_cast<uint8_t>(WITMOTION_HEADER_BYTE + packet.id_byte + sum);
+        }
+        if(store_timestamps)
+        {
+            uint64_t value = 0;
+            size_t shift = 0;
+            uint8_t byte;
+            do
+            {
+                if((input >= end) || (shift > 63))
+                    return false;
+                byte = *input++;
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                shift += 7;
+            }
+            while(byte & 0x80);
+            interval += unzigzag64(value);
+            timestamp += interval;
+        }
+        if(timestamps != nullptr)
+            timestamps[n] = store_timestamps ? timestamp : 0;
+    }
+    return input == end;
+}
+
+witmotion_recording_writer::witmotion_recording_writer(const std::string &file,
+                                                       const bool store_timestamps,
+                                                       const size_t block_size):
+    filename(file),
+    timestamps(store_timestamps),
+    block_packets((block_size > 0) ? block_size : 1),
+    fd(-1),
+    offset(0),
+    packets(0),
+    encoder(store_timestamps, block_packets)
+{}
+
+witmotion_recording_writer::~witmotion_recording_writer()
+{
+    Close();
+}
+
+bool witmotion_recording_writer::WriteAll(const uint8_t *data, const size_t size)
+{
+    size_t written = 0;
+    while(written < size)
+    {
+        ssize_t result = write(fd, data + written, size - written);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            error = std::string("Cannot write recording file ") + filename + ": " + std::strerror(errno);
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    offset += size;
+    return true;
+}
+
+bool witmotion_recording_writer::Open()
+{
+    Close();
+    fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        error = std::string("Cannot create recording file ") + filename + ": " + std::strerror(errno);
+        return false;
+    }
+    error.clear();
+    offset = 0;
+    packets = 0;
+    index.clear();
+    encoder.Reset();
+    uint8_t header[WITMOTION_RECORDING_HEADER_SIZE];
+    write_header(header, timestamps, static_cast<uint32_t>(block_packets));
+    if(!WriteAll(header, sizeof(header)))
+    {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool witmotion_recording_writer::WriteBlock()
+{
+    const std::vector<uint8_t>& payload = encoder.Payload();
+    witmotion_recording_block block;
+    block.offset = offset;
+    block.first_packet = packets - encoder.Count();
+    block.first_timestamp = encoder.FirstTimestamp();
+    block.packets = static_cast<uint32_t>(encoder.Count());
+    block.size = static_cast<uint32_t>(WITMOTION_RECORDING_BLOCK_HEADER_SIZE + payload.size());
+    output.resize(block.size);
+    put_u32(&output[0], block.packets);
+    put_u32(&output[4], static_cast<uint32_t>(payload.size()));
+    put_u64(&output[8], static_cast<uint64_t>(block.first_timestamp));
+    std::memcpy(&output[WITMOTION_RECORDING_BLOCK_HEADER_SIZE], payload.data(), payload.size());
+    encoder.Reset();
+    if(!WriteAll(output.data(), output.size()))
+        return false;
+    index.push_back(block);
+    return true;
+}
+
+bool witmotion_recording_writer::Close()
+{
+    if(fd < 0)
+        return false;
+    bool result = (encoder.Count() == 0) || WriteBlock();
+    output.resize(index.size() * WITMOTION_RECORDING_INDEX_ENTRY_SIZE + WITMOTION_RECORDING_FOOTER_SIZE);
+    for(size_t i = 0; i < index.size(); i++)
+        write_index_entry(&output[i * WITMOTION_RECORDING_INDEX_ENTRY_SIZE], index[i]);
+    uint8_t* footer = &output[index.size() * WITMOTION_RECORDING_INDEX_ENTRY_SIZE];
+    put_u64(footer, offset);
+    put_u32(footer + 8, static_cast<uint32_t>(index.size()));
+    put_u32(footer + 12, WITMOTION_RECORDING_INDEX_MAGIC);
+    result = result && WriteAll(output.data(), output.size());
+    close(fd);
+    fd = -1;
+    return result;
+}
+
+bool witmotion_recording_writer::IsOpen() const
+{
+    return fd >= 0;
+}
+
+const std::string& witmotion_recording_writer::Error() const
+{
+    return error;
+}
+
+void witmotion_recording_writer::Consume(const witmotion_datapacket &packet)
+{
+    Push(packet, timestamps ? steady_timestamp() : 0);
+}
+
+bool witmotion_recording_writer::Push(const witmotion_datapacket &packet, const int64_t timestamp)
+{
+    if(fd < 0)
+        return false;
+    encoder.Push(packet, timestamp);
+    packets++;
+    if(encoder.Count() < block_packets)
+        return true;
+    return WriteBlock();
+}
+
+uint64_t witmotion_recording_writer::Packets() const
+{
+    return packets;
+}
+
+uint64_t witmotion_recording_writer::Bytes() const
+{
+    return offset;
+}
+
+witmotion_recording_reader::witmotion_recording_reader(const std::string &file):
+    filename(file),
+    fd(-1),
+    timestamps(false),
+    recovered(false),
+    packets(0)
+{}
+
+witmotion_recording_reader::~witmotion_recording_reader()
+{
+    Close();
+}
+
+bool witmotion_recording_reader::Open()
+{
+    Close();
+    fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        error = std::string("Cannot open recording file ") + filename + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    uint8_t header[WITMOTION_RECORDING_HEADER_SIZE];
+    if((fstat(fd, &status) != 0) ||
+       !read_exactly(fd, header, sizeof(header), 0) ||
+       (get_u32(header) != WITMOTION_RECORDING_MAGIC))
+        error = std::string("File ") + filename + " is not a recording";
+    else if(get_u16(header + 4) != WITMOTION_RECORDING_VERSION)
+        error = std::string("Recording ") + filename + " has unsupported version";
+    else
+    {
+        timestamps = (get_u16(header + 6) & 1) != 0;
+        uint64_t size = static_cast<uint64_t>(status.st_size);
+        recovered = !ReadIndex(size);
+        if(recovered && !RecoverIndex(size))
+            error = std::string("Recording ") + filename + " is damaged";
+    }
+    if(!error.empty())
+    {
+        Close();
+        return false;
+    }
+    packets = index.empty() ? 0 : index.back().first_packet + index.back().packets;
+    return true;
+}
+
+bool witmotion_recording_reader::ReadIndex(const uint64_t file_size)
+{
+    uint8_t footer[WITMOTION_RECORDING_FOOTER_SIZE];
+    if((file_size < WITMOTION_RECORDING_HEADER_SIZE + WITMOTION_RECORDING_FOOTER_SIZE) ||
+       !read_exactly(fd, footer, sizeof(footer), file_size - WITMOTION_RECORDING_FOOTER_SIZE) ||
+       (get_u32(footer + 12) != WITMOTION_RECORDING_INDEX_MAGIC))
+        return false;
+    uint64_t index_offset = get_u64(footer);
+    uint64_t entries = get_u32(footer + 8);
+    if(index_offset + entries * WITMOTION_RECORDING_INDEX_ENTRY_SIZE + WITMOTION_RECORDING_FOOTER_SIZE != file_size)
+        return false;
+    std::vector<uint8_t> data(static_cast<size_t>(entries * WITMOTION_RECORDING_INDEX_ENTRY_SIZE));
+    if(!read_exactly(fd, data.data(), data.size(), index_offset))
+        return false;
+    index.resize(static_cast<size_t>(entries));
+    uint64_t expected_offset = WITMOTION_RECORDING_HEADER_SIZE;
+    uint64_t expected_packet = 0;
+    for(size_t i = 0; i < index.size(); i++)
+    {
+        read_index_entry(&data[i * WITMOTION_RECORDING_INDEX_ENTRY_SIZE], index[i]);
+        if((index[i].offset != expected_offset) || (index[i].first_packet != expected_packet))
+        {
+            index.clear();
+            return false;
+        }
+        expected_offset += index[i].size;
+        expected_packet += index[i].packets;
+    }
+    return expected_offset == index_offset;
+}
+
+bool witmotion_recording_reader::RecoverIndex(const uint64_t file_size)
+{
+    index.clear();
+    uint64_t offset = WITMOTION_RECORDING_HEADER_SIZE;
+    uint64_t first_packet = 0;
+    uint8_t header[WITMOTION_RECORDING_BLOCK_HEADER_SIZE];
+    // The incomplete last block, the index and the footer are skipped
+    while(offset + WITMOTION_RECORDING_BLOCK_HEADER_SIZE <= file_size)
+    {
+        if(!read_exactly(fd, header, sizeof(header), offset))
+            return false;
+        witmotion_recording_block block;
+        block.offset = offset;
+        block.first_packet = first_packet;
+        block.packets = get_u32(header);
+        block.first_timestamp = static_cast<int64_t>(get_u64(header + 8));
+        uint64_t size = WITMOTION_RECORDING_BLOCK_HEADER_SIZE + static_cast<uint64_t>(get_u32(header + 4));
+        if((block.packets == 0) || (offset + size > file_size) || (size > UINT32_MAX))
+            break;
+        block.size = static_cast<uint32_t>(size);
+        index.push_back(block);
+        offset += size;
+        first_packet += block.packets;
+    }
+    return true;
+}
+
+void witmotion_recording_reader::Close()
+{
+    if(fd >= 0)
+        close(fd);
+    fd = -1;
+    index.clear();
+    packets = 0;
+}
+
+const std::string& witmotion_recording_reader::Error() const
+{
+    return error;
+}
+
+bool witmotion_recording_reader::Timestamps() const
+{
+    return timestamps;
+}
+
+bool witmotion_recording_reader::Recovered() const
+{
+    return recovered;
+}
+
+uint64_t witmotion_recording_reader::Packets() const
+{
+    return packets;
+}
+
+const std::vector<witmotion_recording_block>& witmotion_recording_reader::Blocks() const
+{
+    return index;
+}
+
+size_t witmotion_recording_reader::Find(const uint64_t packet) const
+{
+    if(packet >= packets)
+        return index.size();
+    auto block = std::upper_bound(index.begin(), index.end(), packet,
+                                  [](const uint64_t value, const witmotion_recording_block& entry)
+    {
+        return value < entry.first_packet;
+    });
+    return static_cast<size_t>(block - index.begin()) - 1;
+}
+
+bool witmotion_recording_reader::Read(const size_t block,
+                                      std::vector<witmotion_datapacket> &decoded,
+                                      std::vector<int64_t> *decoded_timestamps) const
+{
+    if((fd < 0) || (block >= index.size()))
+        return false;
+    const witmotion_recording_block& entry = index[block];
+    std::vector<uint8_t> data(entry.size);
+    if(!read_exactly(fd, data.data(), data.size(), entry.offset) ||
+       (get_u32(&data[0]) != entry.packets) ||
+       (WITMOTION_RECORDING_BLOCK_HEADER_SIZE + get_u32(&data[4]) != entry.size))
+        return false;
+    decoded.resize(entry.packets);
+    if(decoded_timestamps != nullptr)
+        decoded_timestamps->resize(entry.packets);
+    return decode_packet_block(&data[WITMOTION_RECORDING_BLOCK_HEADER_SIZE],
+                               entry.size - WITMOTION_RECORDING_BLOCK_HEADER_SIZE,
+                               entry.packets,
+                               static_cast<int64_t>(get_u64(&data[8])),
+                               timestamps,
+                               decoded.data(),
+                               (decoded_timestamps != nullptr) ? decoded_timestamps->data() : nullptr);
+}
+
+}
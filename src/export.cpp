@@ -0,0 +1,677 @@
+#include "witmotion/export.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace witmotion
+{
+
+namespace
+{
+
+static const size_t CSV_OUTPUT_SIZE = 1 << 20;
+static const size_t CSV_FIELD_LIMIT = 32;
+static const size_t ZIP_COPY_SIZE = 1 << 20;
+// The array header including the magic string, the `.npy` format requires the multiple of 64 bytes
+static const size_t NPY_HEADER_SIZE = 128;
+
+static const witmotion_export_column columns_table[WITMOTION_EXPORT_COLUMNS] = {
+    {"timestamp", 'i', 8},
+    {"mask", 'u', 4},
+    {"acceleration_x", 'f', 4},
+    {"acceleration_y", 'f', 4},
+    {"acceleration_z", 'f', 4},
+    {"angular_velocity_x", 'f', 4},
+    {"angular_velocity_y", 'f', 4},
+    {"angular_velocity_z", 'f', 4},
+    {"roll", 'f', 4},
+    {"pitch", 'f', 4},
+    {"yaw", 'f', 4},
+    {"magnetic_field_x", 'f', 4},
+    {"magnetic_field_y", 'f', 4},
+    {"magnetic_field_z", 'f', 4},
+    {"orientation_x", 'f', 4},
+    {"orientation_y", 'f', 4},
+    {"orientation_z", 'f', 4},
+    {"orientation_w", 'f', 4},
+    {"temperature", 'f', 4},
+    {"pressure", 'f', 8},
+    {"altitude", 'f', 8}
+};
+
+// Offsets of the column values in the frame, in the order of the table above
+static const size_t column_offsets[WITMOTION_EXPORT_COLUMNS] = {
+    offsetof(witmotion_frame, timestamp),
+    offsetof(witmotion_frame, mask),
+    offsetof(witmotion_frame, acceleration),
+    offsetof(witmotion_frame, acceleration) + sizeof(float),
+    offsetof(witmotion_frame, acceleration) + 2 * sizeof(float),
+    offsetof(witmotion_frame, angular_velocity),
+    offsetof(witmotion_frame, angular_velocity) + sizeof(float),
+    offsetof(witmotion_frame, angular_velocity) + 2 * sizeof(float),
+    offsetof(witmotion_frame, angles),
+    offsetof(witmotion_frame, angles) + sizeof(float),
+    offsetof(witmotion_frame, angles) + 2 * sizeof(float),
+    offsetof(witmotion_frame, magnetic_field),
+    offsetof(witmotion_frame, magnetic_field) + sizeof(float),
+    offsetof(witmotion_frame, magnetic_field) + 2 * sizeof(float),
+    offsetof(witmotion_frame, orientation),
+    offsetof(witmotion_frame, orientation) + sizeof(float),
+    offsetof(witmotion_frame, orientation) + 2 * sizeof(float),
+    offsetof(witmotion_frame, orientation) + 3 * sizeof(float),
+    offsetof(witmotion_frame, temperature),
+    offsetof(witmotion_frame, pressure),
+    offsetof(witmotion_frame, altitude)
+};
+
+bool write_all(const int fd, const void* data, const size_t size)
+{
+    const uint8_t* head = static_cast<const uint8_t*>(data);
+    size_t offset = 0;
+    while(offset < size)
+    {
+        ssize_t result = write(fd, head + offset, size - offset);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        offset += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+int format_value(char* field, const witmotion_export_column& column, const uint8_t* value)
+{
+    if(column.kind == 'i')
+    {
+        int64_t number;
+        std::memcpy(&number, value, sizeof(number));
+        return std::snprintf(field, CSV_FIELD_LIMIT, "%lld", static_cast<long long>(number));
+    }
+    if(column.kind == 'u')
+    {
+        uint32_t number;
+        std::memcpy(&number, value, sizeof(number));
+        return std::snprintf(field, CSV_FIELD_LIMIT, "%u", number);
+    }
+    if(column.size == sizeof(float))
+    {
+        float number;
+        std::memcpy(&number, value, sizeof(number));
+        return std::snprintf(field, CSV_FIELD_LIMIT, "%.7g", number);
+    }
+    double number;
+    std::memcpy(&number, value, sizeof(number));
+    return std::snprintf(field, CSV_FIELD_LIMIT, "%.10g", number);
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, const size_t size)
+{
+    static const std::vector<uint32_t> table = []()
+    {
+        std::vector<uint32_t> result(256);
+        for(uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t value = i;
+            for(size_t bit = 0; bit < 8; bit++)
+                value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+            result[i] = value;
+        }
+        return result;
+    }();
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+template<typename T> void put_le(std::vector<uint8_t>& output, const T value)
+{
+    for(size_t i = 0; i < sizeof(T); i++)
+        output.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+}
+
+struct zip_member
+{
+    std::string name;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t crc;
+};
+
+/* Appends the file to the stored (uncompressed) ZIP64 archive. The sizes are known in advance,
+   the CRC is computed while copying and patched into the local header */
+bool append_zip_member(const int archive, uint64_t& offset, const std::string& source, zip_member& member)
+{
+    int fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    struct stat status;
+    if(fstat(fd, &status) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    member.offset = offset;
+    member.size = static_cast<uint64_t>(status.st_size);
+    member.crc = 0;
+    std::vector<uint8_t> header;
+    put_le<uint32_t>(header, 0x04034B50);
+    put_le<uint16_t>(header, 45); // Version 4.5 is required for ZIP64
+    put_le<uint16_t>(header, 0); // Flags
+    put_le<uint16_t>(header, 0); // Stored
+    put_le<uint16_t>(header, 0); // Time
+    put_le<uint16_t>(header, 0x21); // Date, 1980-01-01
+    put_le<uint32_t>(header, 0); // CRC, patched after the data
+    put_le<uint32_t>(header, 0xFFFFFFFF);
+    put_le<uint32_t>(header, 0xFFFFFFFF);
+    put_le<uint16_t>(header, static_cast<uint16_t>(member.name.size()));
+    put_le<uint16_t>(header, 20);
+    header.insert(header.end(), member.name.begin(), member.name.end());
+    put_le<uint16_t>(header, 0x0001); // ZIP64 extended information
+    put_le<uint16_t>(header, 16);
+    put_le<uint64_t>(header, member.size);
+    put_le<uint64_t>(header, member.size);
+    bool result = write_all(archive, header.data(), header.size());
+    std::vector<uint8_t> buffer(ZIP_COPY_SIZE);
+    uint64_t copied = 0;
+    while(result && (copied < member.size))
+    {
+        ssize_t length = read(fd, buffer.data(), buffer.size());
+        if((length < 0) && (errno == EINTR))
+            continue;
+        if(length <= 0)
+        {
+            result = false;
+            break;
+        }
+        member.crc = crc32_update(member.crc, buffer.data(), static_cast<size_t>(length));
+        result = write_all(archive, buffer.data(), static_cast<size_t>(length));
+        copied += static_cast<uint64_t>(length);
+    }
+    close(fd);
+    std::vector<uint8_t> crc;
+    put_le<uint32_t>(crc, member.crc);
+    result = result && (pwrite(archive, crc.data(), crc.size(), static_cast<off_t>(member.offset + 14)) == 4);
+    offset += header.size() + member.size;
+    return result;
+}
+
+bool write_zip_directory(const int archive, const uint64_t offset, const std::vector<zip_member>& members)
+{
+    std::vector<uint8_t> directory;
+    for(auto i = members.begin(); i != members.end(); i++)
+    {
+        put_le<uint32_t>(directory, 0x02014B50);
+        put_le<uint16_t>(directory, 45);
+        put_le<uint16_t>(directory, 45);
+        put_le<uint16_t>(directory, 0);
+        put_le<uint16_t>(directory, 0);
+        put_le<uint16_t>(directory, 0);
+        put_le<uint16_t>(directory, 0x21);
+        put_le<uint32_t>(directory, i->crc);
+        put_le<uint32_t>(directory, 0xFFFFFFFF);
+        put_le<uint32_t>(directory, 0xFFFFFFFF);
+        put_le<uint16_t>(directory, static_cast<uint16_t>(i->name.size()));
+        put_le<uint16_t>(directory, 28);
+        put_le<uint16_t>(directory, 0); // Comment
+        put_le<uint16_t>(directory, 0); // Disk
+        put_le<uint16_t>(directory, 0); // Internal attributes
+        put_le<uint32_t>(directory, 0); // External attributes
+        put_le<uint32_t>(directory, 0xFFFFFFFF);
+        directory.insert(directory.end(), i->name.begin(), i->name.end());
+        put_le<uint16_t>(directory, 0x0001);
+        put_le<uint16_t>(directory, 24);
+        put_le<uint64_t>(directory, i->size);
+        put_le<uint64_t>(directory, i->size);
+        put_le<uint64_t>(directory, i->offset);
+    }
+    uint64_t directory_size = directory.size();
+    uint64_t end_offset = offset + directory_size;
+    // ZIP64 end of central directory record and locator
+    put_le<uint32_t>(directory, 0x06064B50);
+    put_le<uint64_t>(directory, 44);
+    put_le<uint16_t>(directory, 45);
+    put_le<uint16_t>(directory, 45);
+    put_le<uint32_t>(directory, 0);
+    put_le<uint32_t>(directory, 0);
+    put_le<uint64_t>(directory, members.size());
+    put_le<uint64_t>(directory, members.size());
+    put_le<uint64_t>(directory, directory_size);
+    put_le<uint64_t>(directory, offset);
+    put_le<uint32_t>(directory, 0x07064B50);
+    put_le<uint32_t>(directory, 0);
+    put_le<uint64_t>(directory, end_offset);
+    put_le<uint32_t>(directory, 1);
+    // End of central directory record referring to the ZIP64 one
+    put_le<uint32_t>(directory, 0x06054B50);
+    put_le<uint16_t>(directory, 0);
+    put_le<uint16_t>(directory, 0);
+    put_le<uint16_t>(directory, 0xFFFF);
+    put_le<uint16_t>(directory, 0xFFFF);
+    put_le<uint32_t>(directory, 0xFFFFFFFF);
+    put_le<uint32_t>(directory, 0xFFFFFFFF);
+    put_le<uint16_t>(directory, 0);
+    return write_all(archive, directory.data(), directory.size());
+}
+
+std::string npy_header(const witmotion_export_column& column, const uint64_t rows)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    static const char byte_order = '>';
+#else
+    static const char byte_order = '<';
+#endif
+    char dictionary[NPY_HEADER_SIZE];
+    int length = std::snprintf(dictionary, sizeof(dictionary), "{'descr': '%c%c%zu', 'fortran_order': False, 'shape': (%llu,), }",
+                               byte_order, column.kind, column.size, static_cast<unsigned long long>(rows));
+    std::string header("\x93NUMPY\x01\x00", 8);
+    header.push_back(static_cast<char>((NPY_HEADER_SIZE - 10) & 0xFF));
+    header.push_back(static_cast<char>((NPY_HEADER_SIZE - 10) >> 8));
+    header.append(dictionary, static_cast<size_t>(length));
+    header.resize(NPY_HEADER_SIZE - 1, ' ');
+    header.push_back('\n');
+    return header;
+}
+
+}
+
+const witmotion_export_column* export_columns()
+{
+    return columns_table;
+}
+
+witmotion_frame_columns::witmotion_frame_columns(const size_t reserve):
+    rows(0),
+    columns(WITMOTION_EXPORT_COLUMNS)
+{
+    for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+        columns[i].reserve(reserve * columns_table[i].size);
+}
+
+void witmotion_frame_columns::Append(const witmotion_frame &frame)
+{
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(&frame);
+    for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+        columns[i].insert(columns[i].end(), source + column_offsets[i], source + column_offsets[i] + columns_table[i].size);
+    rows++;
+}
+
+void witmotion_frame_columns::Clear()
+{
+    for(auto i = columns.begin(); i != columns.end(); i++)
+        i->clear();
+    rows = 0;
+}
+
+size_t witmotion_frame_columns::Rows() const
+{
+    return rows;
+}
+
+const uint8_t* witmotion_frame_columns::Column(const size_t index) const
+{
+    return columns[index].data();
+}
+
+uint8_t* witmotion_frame_columns::Column(const size_t index)
+{
+    return columns[index].data();
+}
+
+witmotion_frame_exporter::witmotion_frame_exporter(const std::string &output, const size_t chunk):
+    path(output),
+    rows(0),
+    chunk_rows((chunk > 0) ? chunk : 1),
+    buffer(chunk_rows)
+{}
+
+bool witmotion_frame_exporter::Fail(const std::string &message)
+{
+    error = message + ": " + std::strerror(errno);
+    return false;
+}
+
+bool witmotion_frame_exporter::Close()
+{
+    if(!IsOpen())
+        return error.empty();
+    bool result = Flush();
+    return Finish() && result;
+}
+
+const std::string& witmotion_frame_exporter::Error() const
+{
+    return error;
+}
+
+void witmotion_frame_exporter::Consume(const witmotion_frame &frame)
+{
+    buffer.Append(frame);
+    rows++;
+    if(buffer.Rows() >= chunk_rows)
+        Flush();
+}
+
+bool witmotion_frame_exporter::Write(const witmotion_frame_columns &chunk)
+{
+    if(!Flush())
+        return false;
+    if(chunk.Rows() == 0)
+        return true;
+    rows += chunk.Rows();
+    return WriteColumns(chunk);
+}
+
+bool witmotion_frame_exporter::Flush()
+{
+    if(!IsOpen())
+        return false;
+    if(buffer.Rows() == 0)
+        return true;
+    bool result = WriteColumns(buffer);
+    buffer.Clear();
+    return result;
+}
+
+uint64_t witmotion_frame_exporter::Rows() const
+{
+    return rows;
+}
+
+witmotion_csv_exporter::witmotion_csv_exporter(const std::string &file, const size_t chunk):
+    witmotion_frame_exporter(file, chunk),
+    fd(-1)
+{
+    output.reserve(CSV_OUTPUT_SIZE);
+}
+
+witmotion_csv_exporter::~witmotion_csv_exporter()
+{
+    Close();
+}
+
+bool witmotion_csv_exporter::Open()
+{
+    Close();
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+        return Fail(std::string("Cannot create CSV file ") + path);
+    error.clear();
+    rows = 0;
+    std::string header;
+    for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+    {
+        header += columns_table[i].name;
+        header.push_back((i + 1 < WITMOTION_EXPORT_COLUMNS) ? ',' : '\n');
+    }
+    if(!write_all(fd, header.data(), header.size()))
+    {
+        Fail(std::string("Cannot write CSV file ") + path);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool witmotion_csv_exporter::IsOpen() const
+{
+    return fd >= 0;
+}
+
+bool witmotion_csv_exporter::WriteColumns(const witmotion_frame_columns &chunk)
+{
+    char field[CSV_FIELD_LIMIT];
+    for(size_t row = 0; row < chunk.Rows(); row++)
+    {
+        if(output.size() + WITMOTION_EXPORT_COLUMNS * CSV_FIELD_LIMIT > CSV_OUTPUT_SIZE)
+        {
+            if(!write_all(fd, output.data(), output.size()))
+                return Fail(std::string("Cannot write CSV file ") + path);
+            output.clear();
+        }
+        for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+        {
+            int length = format_value(field, columns_table[i], chunk.Column(i) + row * columns_table[i].size);
+            output.insert(output.end(), field, field + std::min<size_t>(static_cast<size_t>(length), CSV_FIELD_LIMIT - 1));
+            output.push_back((i + 1 < WITMOTION_EXPORT_COLUMNS) ? ',' : '\n');
+        }
+    }
+    bool result = write_all(fd, output.data(), output.size());
+    output.clear();
+    return result || Fail(std::string("Cannot write CSV file ") + path);
+}
+
+bool witmotion_csv_exporter::Finish()
+{
+    bool result = (close(fd) == 0) || Fail(std::string("Cannot close CSV file ") + path);
+    fd = -1;
+    return result;
+}
+
+witmotion_npy_exporter::witmotion_npy_exporter(const std::string &directory, const size_t chunk):
+    witmotion_frame_exporter(directory, chunk)
+{}
+
+witmotion_npy_exporter::~witmotion_npy_exporter()
+{
+    Close();
+}
+
+bool witmotion_npy_exporter::Open()
+{
+    Close();
+    error.clear();
+    rows = 0;
+    if((mkdir(path.c_str(), 0755) != 0) && (errno != EEXIST))
+        return Fail(std::string("Cannot create directory ") + path);
+    for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+    {
+        std::string filename = path + "/" + columns_table[i].name + ".npy";
+        int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        std::string header = npy_header(columns_table[i], 0);
+        if((fd < 0) || !write_all(fd, header.data(), header.size()))
+        {
+            Fail(std::string("Cannot create NumPy file ") + filename);
+            if(fd >= 0)
+                close(fd);
+            for(auto j = files.begin(); j != files.end(); j++)
+                close(*j);
+            files.clear();
+            return false;
+        }
+        files.push_back(fd);
+    }
+    return true;
+}
+
+bool witmotion_npy_exporter::IsOpen() const
+{
+    return !files.empty();
+}
+
+bool witmotion_npy_exporter::WriteColumns(const witmotion_frame_columns &chunk)
+{
+    for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+        if(!write_all(files[i], chunk.Column(i), chunk.Rows() * columns_table[i].size))
+            return Fail(std::string("Cannot write NumPy file ") + path + "/" + columns_table[i].name + ".npy");
+    return true;
+}
+
+bool witmotion_npy_exporter::Finish()
+{
+    bool result = true;
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        // The header has the fixed size, the shape is patched in place
+        std::string header = npy_header(columns_table[i], rows);
+        if(pwrite(files[i], header.data(), header.size(), 0) != static_cast<ssize_t>(header.size()))
+            result = Fail(std::string("Cannot update NumPy file ") + path + "/" + columns_table[i].name + ".npy");
+        if(close(files[i]) != 0)
+            result = Fail(std::string("Cannot close NumPy file ") + path + "/" + columns_table[i].name + ".npy");
+    }
+    files.clear();
+    return result;
+}
+
+witmotion_npz_exporter::witmotion_npz_exporter(const std::string &file, const size_t chunk):
+    witmotion_frame_exporter(file, chunk),
+    staging(file + ".parts", chunk),
+    staging_directory(file + ".parts")
+{}
+
+witmotion_npz_exporter::~witmotion_npz_exporter()
+{
+    Close();
+}
+
+bool witmotion_npz_exporter::Open()
+{
+    Close();
+    error.clear();
+    rows = 0;
+    if(!staging.Open())
+    {
+        error = staging.Error();
+        return false;
+    }
+    return true;
+}
+
+bool witmotion_npz_exporter::IsOpen() const
+{
+    return staging.IsOpen();
+}
+
+bool witmotion_npz_exporter::WriteColumns(const witmotion_frame_columns &chunk)
+{
+    if(staging.Write(chunk))
+        return true;
+    error = staging.Error();
+    return false;
+}
+
+bool witmotion_npz_exporter::Finish()
+{
+    if(!staging.Close())
+    {
+        error = staging.Error();
+        return false;
+    }
+    int archive = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(archive < 0)
+        return Fail(std::string("Cannot create NumPy archive ") + path);
+    std::vector<zip_member> members(WITMOTION_EXPORT_COLUMNS);
+    uint64_t offset = 0;
+    bool result = true;
+    for(size_t i = 0; result && (i < WITMOTION_EXPORT_COLUMNS); i++)
+    {
+        members[i].name = std::string(columns_table[i].name) + ".npy";
+        result = append_zip_member(archive, offset, staging_directory + "/" + members[i].name, members[i]);
+    }
+    result = result && write_zip_directory(archive, offset, members);
+    if(!result)
+        Fail(std::string("Cannot write NumPy archive ") + path);
+    if(close(archive) != 0)
+        result = Fail(std::string("Cannot close NumPy archive ") + path);
+    if(result)
+    {
+        for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+            unlink((staging_directory + "/" + members[i].name).c_str());
+        rmdir(staging_directory.c_str());
+    }
+    return result;
+}
+
+witmotion_columnar_exporter::witmotion_columnar_exporter(const std::string &file, const size_t chunk):
+    witmotion_frame_exporter(file, chunk),
+    fd(-1)
+{}
+
+witmotion_columnar_exporter::~witmotion_columnar_exporter()
+{
+    Close();
+}
+
+bool witmotion_columnar_exporter::Open()
+{
+    Close();
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+        return Fail(std::string("Cannot create columnar file ") + path);
+    error.clear();
+    rows = 0;
+    output.clear();
+    const uint32_t magic = WITMOTION_COLUMNAR_MAGIC;
+    const uint16_t version = WITMOTION_COLUMNAR_VERSION;
+    const uint16_t count = static_cast<uint16_t>(WITMOTION_EXPORT_COLUMNS);
+    output.insert(output.end(), reinterpret_cast<const uint8_t*>(&magic), reinterpret_cast<const uint8_t*>(&magic) + 4);
+    output.insert(output.end(), reinterpret_cast<const uint8_t*>(&version), reinterpret_cast<const uint8_t*>(&version) + 2);
+    output.insert(output.end(), reinterpret_cast<const uint8_t*>(&count), reinterpret_cast<const uint8_t*>(&count) + 2);
+    for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+    {
+        size_t length = std::strlen(columns_table[i].name);
+        output.push_back(static_cast<uint8_t>(columns_table[i].kind));
+        output.push_back(static_cast<uint8_t>(columns_table[i].size));
+        output.push_back(static_cast<uint8_t>(length));
+        output.insert(output.end(), columns_table[i].name, columns_table[i].name + length);
+    }
+    if(!write_all(fd, output.data(), output.size()))
+    {
+        Fail(std::string("Cannot write columnar file ") + path);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool witmotion_columnar_exporter::IsOpen() const
+{
+    return fd >= 0;
+}
+
+bool witmotion_columnar_exporter::WriteColumns(const witmotion_frame_columns &chunk)
+{
+    const uint32_t header[2] = {static_cast<uint32_t>(chunk.Rows()), 0};
+    output.assign(reinterpret_cast<const uint8_t*>(header), reinterpret_cast<const uint8_t*>(header) + sizeof(header));
+    for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+        output.insert(output.end(), chunk.Column(i), chunk.Column(i) + chunk.Rows() * columns_table[i].size);
+    return write_all(fd, output.data(), output.size()) || Fail(std::string("Cannot write columnar file ") + path);
+}
+
+bool witmotion_columnar_exporter::Finish()
+{
+    bool result = (close(fd) == 0) || Fail(std::string("Cannot close columnar file ") + path);
+    fd = -1;
+    return result;
+}
+
+std::unique_ptr<witmotion_frame_exporter> create_frame_exporter(const witmotion_export_format format,
+                                                                const std::string &output,
+                                                                const size_t chunk)
+{
+    switch(format)
+    {
+    case exportNumPy:
+        return std::unique_ptr<witmotion_frame_exporter>(new witmotion_npy_exporter(output, chunk));
+    case exportNumPyArchive:
+        return std::unique_ptr<witmotion_frame_exporter>(new witmotion_npz_exporter(output, chunk));
+    case exportColumnar:
+        return std::unique_ptr<witmotion_frame_exporter>(new witmotion_columnar_exporter(output, chunk));
+    default:
+        return std::unique_ptr<witmotion_frame_exporter>(new witmotion_csv_exporter(output, chunk));
+    }
+}
+
+}
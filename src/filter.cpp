@@ -0,0 +1,226 @@
+#include "witmotion/filter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace witmotion
+{
+
+std::vector<float> design_fir(const size_t taps,
+                              const double cutoff,
+                              const witmotion_filter_type type)
+{
+    size_t count = (taps > 0) ? taps : 1;
+    // Spectral inversion requires the symmetric filter with the central tap
+    if((type == filterHighPass) && (count % 2 == 0))
+        count++;
+    std::vector<double> response(count);
+    double middle = 0.5 * static_cast<double>(count - 1);
+    double sum = 0.0;
+    for(size_t n = 0; n < count; n++)
+    {
+        double x = static_cast<double>(n) - middle;
+        double sinc = (x == 0.0) ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+        double window = (count > 1) ?
+                    0.42 - 0.5 * std::cos(2.0 * M_PI * static_cast<double>(n) / static_cast<double>(count - 1))
+                    + 0.08 * std::cos(4.0 * M_PI * static_cast<double>(n) / static_cast<double>(count - 1)) :
+                    1.0;
+        response[n] = sinc * window;
+        sum += response[n];
+    }
+    std::vector<float> coefficients(count);
+    for(size_t n = 0; n < count; n++)
+    {
+        double value = (sum != 0.0) ? response[n] / sum : response[n];
+        if(type == filterHighPass)
+            value = -value + ((n == count / 2) ? 1.0 : 0.0);
+        coefficients[n] = static_cast<float>(value);
+    }
+    return coefficients;
+}
+
+std::vector<witmotion_biquad> design_butterworth(const size_t order,
+                                                 const double cutoff,
+                                                 const witmotion_filter_type type)
+{
+    std::vector<witmotion_biquad> cascade;
+    if(order % 2 == 1)
+    {
+        // The real pole of the odd order, first-order section obtained by the bilinear transform
+        double k = std::tan(M_PI * cutoff);
+        witmotion_biquad section;
+        if(type == filterHighPass)
+        {
+            section.b0 = static_cast<float>(1.0 / (1.0 + k));
+            section.b1 = -section.b0;
+        }
+        else
+        {
+            section.b0 = static_cast<float>(k / (1.0 + k));
+            section.b1 = section.b0;
+        }
+        section.b2 = 0.f;
+        section.a1 = static_cast<float>((k - 1.0) / (k + 1.0));
+        section.a2 = 0.f;
+        cascade.push_back(section);
+    }
+    double w0 = 2.0 * M_PI * cutoff;
+    double cosine = std::cos(w0);
+    for(size_t k = 0; k < order / 2; k++)
+    {
+        // Pole pair quality factors of the Butterworth prototype: the poles are spaced by pi/N,
+        // symmetric around the real axis for the even order and including it for the odd one
+        double angle = (order % 2 == 0) ?
+                    M_PI * static_cast<double>(2 * k + 1) / static_cast<double>(2 * order) :
+                    M_PI * static_cast<double>(k + 1) / static_cast<double>(order);
+        double q = 1.0 / (2.0 * std::cos(angle));
+        double alpha = std::sin(w0) / (2.0 * q);
+        double a0 = 1.0 + alpha;
+        double b0, b1;
+        if(type == filterHighPass)
+        {
+            b0 = 0.5 * (1.0 + cosine);
+            b1 = -(1.0 + cosine);
+        }
+        else
+        {
+            b0 = 0.5 * (1.0 - cosine);
+            b1 = 1.0 - cosine;
+        }
+        witmotion_biquad section;
+        section.b0 = static_cast<float>(b0 / a0);
+        section.b1 = static_cast<float>(b1 / a0);
+        section.b2 = static_cast<float>(b0 / a0);
+        section.a1 = static_cast<float>(-2.0 * cosine / a0);
+        section.a2 = static_cast<float>((1.0 - alpha) / a0);
+        cascade.push_back(section);
+    }
+    return cascade;
+}
+
+witmotion_fir_bank::witmotion_fir_bank(const std::vector<float> &taps,
+                                       const size_t count,
+                                       const size_t factor):
+    coefficients(taps.empty() ? std::vector<float>(1, 1.f) : taps),
+    channels(count),
+    decimation((factor > 0) ? factor : 1),
+    history(2 * coefficients.size() * count)
+{
+    Reset();
+}
+
+size_t witmotion_fir_bank::Channels() const
+{
+    return channels;
+}
+
+size_t witmotion_fir_bank::Decimation() const
+{
+    return decimation;
+}
+
+bool witmotion_fir_bank::Push(const float *input, float *output)
+{
+    const size_t taps = coefficients.size();
+    // Every row is written twice, so the last `taps` rows are always contiguous
+    std::copy(input, input + channels, history.begin() + position * channels);
+    std::copy(input, input + channels, history.begin() + (position + taps) * channels);
+    size_t newest = position + taps;
+    position = (position + 1) % taps;
+    if(++phase < decimation)
+        return false;
+    phase = 0;
+    float* __restrict__ result = output;
+    const float* __restrict__ row = &history[newest * channels];
+    const float h0 = coefficients[0];
+    for(size_t c = 0; c < channels; c++)
+        result[c] = h0 * row[c];
+    for(size_t k = 1; k < taps; k++)
+    {
+        const float h = coefficients[k];
+        row = &history[(newest - k) * channels];
+        for(size_t c = 0; c < channels; c++)
+            result[c] += h * row[c];
+    }
+    return true;
+}
+
+size_t witmotion_fir_bank::Process(const float *input, const size_t rows, float *output)
+{
+    size_t produced = 0;
+    for(size_t i = 0; i < rows; i++)
+        if(Push(input + i * channels, output + produced * channels))
+            produced++;
+    return produced;
+}
+
+void witmotion_fir_bank::Reset()
+{
+    std::fill(history.begin(), history.end(), 0.f);
+    position = 0;
+    phase = 0;
+}
+
+witmotion_iir_bank::witmotion_iir_bank(const std::vector<witmotion_biquad> &cascade,
+                                       const size_t count,
+                                       const size_t factor):
+    sections(cascade),
+    channels(count),
+    decimation((factor > 0) ? factor : 1),
+    state(2 * cascade.size() * count),
+    buffer(count)
+{
+    Reset();
+}
+
+size_t witmotion_iir_bank::Channels() const
+{
+    return channels;
+}
+
+size_t witmotion_iir_bank::Decimation() const
+{
+    return decimation;
+}
+
+bool witmotion_iir_bank::Push(const float *input, float *output)
+{
+    float* __restrict__ x = buffer.data();
+    std::copy(input, input + channels, x);
+    for(size_t s = 0; s < sections.size(); s++)
+    {
+        const witmotion_biquad section = sections[s];
+        float* __restrict__ z1 = &state[2 * s * channels];
+        float* __restrict__ z2 = z1 + channels;
+        for(size_t c = 0; c < channels; c++)
+        {
+            float y = section.b0 * x[c] + z1[c];
+            z1[c] = section.b1 * x[c] - section.a1 * y + z2[c];
+            z2[c] = section.b2 * x[c] - section.a2 * y;
+            x[c] = y;
+        }
+    }
+    if(++phase < decimation)
+        return false;
+    phase = 0;
+    std::copy(x, x + channels, output);
+    return true;
+}
+
+size_t witmotion_iir_bank::Process(const float *input, const size_t rows, float *output)
+{
+    size_t produced = 0;
+    for(size_t i = 0; i < rows; i++)
+        if(Push(input + i * channels, output + produced * channels))
+            produced++;
+    return produced;
+}
+
+void witmotion_iir_bank::Reset()
+{
+    std::fill(state.begin(), state.end(), 0.f);
+    std::fill(buffer.begin(), buffer.end(), 0.f);
+    phase = 0;
+}
+
+}
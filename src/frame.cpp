@@ -0,0 +1,83 @@
+#include "witmotion/frame.h"
+
+namespace witmotion
+{
+
+bool witmotion_frame::Has(const witmotion_packet_id id) const
+{
+    return (mask & Bit(id)) != 0;
+}
+
+uint32_t witmotion_frame::Bit(const witmotion_packet_id id)
+{
+    return static_cast<uint32_t>(1) << (static_cast<uint32_t>(id) - static_cast<uint32_t>(pidRTC));
+}
+
+witmotion_frame_assembler::witmotion_frame_assembler()
+{
+    Reset();
+}
+
+bool witmotion_frame_assembler::Push(const witmotion_datapacket &packet,
+                                     const int64_t timestamp,
+                                     witmotion_frame &completed)
+{
+    witmotion_packet_id id = static_cast<witmotion_packet_id>(packet.id_byte);
+    if(!id_registered(id))
+        return false;
+    bool result = false;
+    if(current.Has(id))
+    {
+        completed = current;
+        current.mask = 0;
+        result = true;
+    }
+    if(current.mask == 0)
+        current.timestamp = timestamp;
+    float t;
+    switch(id)
+    {
+    case pidAcceleration:
+        decode_accelerations(packet, current.acceleration[0], current.acceleration[1], current.acceleration[2], t);
+        current.temperature = t;
+        break;
+    case pidAngularVelocity:
+        decode_angular_velocities(packet, current.angular_velocity[0], current.angular_velocity[1], current.angular_velocity[2], t);
+        current.temperature = t;
+        break;
+    case pidAngles:
+        decode_angles(packet, current.angles[0], current.angles[1], current.angles[2], t);
+        current.temperature = t;
+        break;
+    case pidMagnetometer:
+        decode_magnetometer(packet, current.magnetic_field[0], current.magnetic_field[1], current.magnetic_field[2], t);
+        current.temperature = t;
+        break;
+    case pidOrientation:
+        decode_orientation(packet, current.orientation[0], current.orientation[1], current.orientation[2], current.orientation[3]);
+        break;
+    case pidAltimeter:
+        decode_altimeter(packet, current.pressure, current.altitude);
+        break;
+    default:
+        break;
+    }
+    current.mask |= witmotion_frame::Bit(id);
+    return result;
+}
+
+bool witmotion_frame_assembler::Flush(witmotion_frame &completed)
+{
+    if(current.mask == 0)
+        return false;
+    completed = current;
+    current.mask = 0;
+    return true;
+}
+
+void witmotion_frame_assembler::Reset()
+{
+    current = witmotion_frame(); // value-initialization zeroes all the fields
+}
+
+}
@@ -0,0 +1,367 @@
+#include "witmotion/fusion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace witmotion
+{
+
+static const float degrees_to_radians = static_cast<float>(M_PI / 180.0);
+
+// Returns zero for the zero vector. The division is not guarded by a branch, so
+// the loops over the sensors stay free of the control flow and can be vectorized.
+static inline float inverse_norm(const float norm)
+{
+    float valid = (norm > 0.f) ? 1.f : 0.f;
+    return valid / std::sqrt(norm + (1.f - valid));
+}
+
+static inline float inverse_norm(const float x, const float y, const float z)
+{
+    return inverse_norm(x * x + y * y + z * z);
+}
+
+static inline float inverse_norm(const float w, const float x, const float y, const float z)
+{
+    return inverse_norm(w * w + x * x + y * y + z * z);
+}
+
+// The kernels are templated on the magnetometer presence, so the 6-axis update does not
+// read the magnetometer arrays. With zero magnetic field the 9-axis equations reduce to
+// the 6-axis ones, which allows to process the whole batch with the same loop.
+template<bool magnetic> static void madgwick_kernel(const witmotion_fusion_input& input,
+                                                   const size_t sensors,
+                                                   const float beta,
+                                                   const float dt,
+                                                   float* __restrict__ Q0,
+                                                   float* __restrict__ Q1,
+                                                   float* __restrict__ Q2,
+                                                   float* __restrict__ Q3)
+{
+    const float* __restrict__ GX = input.angular_velocity[0];
+    const float* __restrict__ GY = input.angular_velocity[1];
+    const float* __restrict__ GZ = input.angular_velocity[2];
+    const float* __restrict__ AX = input.acceleration[0];
+    const float* __restrict__ AY = input.acceleration[1];
+    const float* __restrict__ AZ = input.acceleration[2];
+    const float* __restrict__ MX = input.magnetic_field[0];
+    const float* __restrict__ MY = input.magnetic_field[1];
+    const float* __restrict__ MZ = input.magnetic_field[2];
+    for(size_t i = 0; i < sensors; i++)
+    {
+        float q0 = Q0[i], q1 = Q1[i], q2 = Q2[i], q3 = Q3[i];
+        float gx = GX[i] * degrees_to_radians;
+        float gy = GY[i] * degrees_to_radians;
+        float gz = GZ[i] * degrees_to_radians;
+        float ax = AX[i];
+        float ay = AY[i];
+        float az = AZ[i];
+        float mx = magnetic ? MX[i] : 0.f;
+        float my = magnetic ? MY[i] : 0.f;
+        float mz = magnetic ? MZ[i] : 0.f;
+
+        // Rate of change of the quaternion from the gyroscope
+        float qdot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+        float qdot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+        float qdot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+        float qdot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+        float norm = inverse_norm(ax, ay, az);
+        float valid = (norm > 0.f) ? 1.f : 0.f;
+        ax *= norm;
+        ay *= norm;
+        az *= norm;
+        norm = inverse_norm(mx, my, mz);
+        mx *= norm;
+        my *= norm;
+        mz *= norm;
+
+        float _2q0mx = 2.f * q0 * mx;
+        float _2q0my = 2.f * q0 * my;
+        float _2q0mz = 2.f * q0 * mz;
+        float _2q1mx = 2.f * q1 * mx;
+        float _2q0 = 2.f * q0;
+        float _2q1 = 2.f * q1;
+        float _2q2 = 2.f * q2;
+        float _2q3 = 2.f * q3;
+        float _2q0q2 = 2.f * q0 * q2;
+        float _2q2q3 = 2.f * q2 * q3;
+        float q0q0 = q0 * q0;
+        float q0q1 = q0 * q1;
+        float q0q2 = q0 * q2;
+        float q0q3 = q0 * q3;
+        float q1q1 = q1 * q1;
+        float q1q2 = q1 * q2;
+        float q1q3 = q1 * q3;
+        float q2q2 = q2 * q2;
+        float q2q3 = q2 * q3;
+        float q3q3 = q3 * q3;
+
+        // Reference direction of the Earth magnetic field
+        float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+        float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+        float _2bx = std::sqrt(hx * hx + hy * hy);
+        float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+        float _4bx = 2.f * _2bx;
+        float _4bz = 2.f * _2bz;
+
+        // Gradient descent corrective step
+        float fax = 2.f * q1q3 - _2q0q2 - ax;
+        float fay = 2.f * q0q1 + _2q2q3 - ay;
+        float faz = 1.f - 2.f * q1q1 - 2.f * q2q2 - az;
+        float fmx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+        float fmy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+        float fmz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+        float s0 = -_2q2 * fax + _2q1 * fay - _2bz * q2 * fmx + (-_2bx * q3 + _2bz * q1) * fmy + _2bx * q2 * fmz;
+        float s1 = _2q3 * fax + _2q0 * fay - 2.f * _2q1 * faz + _2bz * q3 * fmx + (_2bx * q2 + _2bz * q0) * fmy + (_2bx * q3 - _4bz * q1) * fmz;
+        float s2 = -_2q0 * fax + _2q3 * fay - 2.f * _2q2 * faz + (-_4bx * q2 - _2bz * q0) * fmx + (_2bx * q1 + _2bz * q3) * fmy + (_2bx * q0 - _4bz * q2) * fmz;
+        float s3 = _2q1 * fax + _2q2 * fay + (-_4bx * q3 + _2bz * q1) * fmx + (-_2bx * q0 + _2bz * q2) * fmy + _2bx * q1 * fmz;
+        norm = inverse_norm(s0, s1, s2, s3) * beta * valid;
+        qdot0 -= s0 * norm;
+        qdot1 -= s1 * norm;
+        qdot2 -= s2 * norm;
+        qdot3 -= s3 * norm;
+
+        q0 += qdot0 * dt;
+        q1 += qdot1 * dt;
+        q2 += qdot2 * dt;
+        q3 += qdot3 * dt;
+        norm = inverse_norm(q0, q1, q2, q3);
+        Q0[i] = q0 * norm;
+        Q1[i] = q1 * norm;
+        Q2[i] = q2 * norm;
+        Q3[i] = q3 * norm;
+    }
+}
+
+template<bool magnetic> static void mahony_kernel(const witmotion_fusion_input& input,
+                                                 const size_t sensors,
+                                                 const float kp,
+                                                 const float ki,
+                                                 const float dt,
+                                                 float* __restrict__ Q0,
+                                                 float* __restrict__ Q1,
+                                                 float* __restrict__ Q2,
+                                                 float* __restrict__ Q3,
+                                                 float* __restrict__ IX,
+                                                 float* __restrict__ IY,
+                                                 float* __restrict__ IZ)
+{
+    const float* __restrict__ GX = input.angular_velocity[0];
+    const float* __restrict__ GY = input.angular_velocity[1];
+    const float* __restrict__ GZ = input.angular_velocity[2];
+    const float* __restrict__ AX = input.acceleration[0];
+    const float* __restrict__ AY = input.acceleration[1];
+    const float* __restrict__ AZ = input.acceleration[2];
+    const float* __restrict__ MX = input.magnetic_field[0];
+    const float* __restrict__ MY = input.magnetic_field[1];
+    const float* __restrict__ MZ = input.magnetic_field[2];
+    const float integral_gain = (ki > 0.f) ? 2.f * ki * dt : 0.f;
+    const float integral_enabled = (ki > 0.f) ? 1.f : 0.f;
+    for(size_t i = 0; i < sensors; i++)
+    {
+        float q0 = Q0[i], q1 = Q1[i], q2 = Q2[i], q3 = Q3[i];
+        float gx = GX[i] * degrees_to_radians;
+        float gy = GY[i] * degrees_to_radians;
+        float gz = GZ[i] * degrees_to_radians;
+        float ax = AX[i];
+        float ay = AY[i];
+        float az = AZ[i];
+        float mx = magnetic ? MX[i] : 0.f;
+        float my = magnetic ? MY[i] : 0.f;
+        float mz = magnetic ? MZ[i] : 0.f;
+
+        float norm = inverse_norm(ax, ay, az);
+        float valid = (norm > 0.f) ? 1.f : 0.f;
+        ax *= norm;
+        ay *= norm;
+        az *= norm;
+        norm = inverse_norm(mx, my, mz);
+        mx *= norm;
+        my *= norm;
+        mz *= norm;
+
+        float q0q0 = q0 * q0;
+        float q0q1 = q0 * q1;
+        float q0q2 = q0 * q2;
+        float q0q3 = q0 * q3;
+        float q1q1 = q1 * q1;
+        float q1q2 = q1 * q2;
+        float q1q3 = q1 * q3;
+        float q2q2 = q2 * q2;
+        float q2q3 = q2 * q3;
+        float q3q3 = q3 * q3;
+
+        // Reference direction of the Earth magnetic field
+        float hx = 2.f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+        float hy = 2.f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+        float bx = std::sqrt(hx * hx + hy * hy);
+        float bz = 2.f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+        // Estimated direction of gravity and magnetic field
+        float halfvx = q1q3 - q0q2;
+        float halfvy = q0q1 + q2q3;
+        float halfvz = q0q0 - 0.5f + q3q3;
+        float halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+        float halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+        float halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+        // Error is the cross product between the estimated and the measured directions
+        float halfex = ((ay * halfvz - az * halfvy) + (my * halfwz - mz * halfwy)) * valid;
+        float halfey = ((az * halfvx - ax * halfvz) + (mz * halfwx - mx * halfwz)) * valid;
+        float halfez = ((ax * halfvy - ay * halfvx) + (mx * halfwy - my * halfwx)) * valid;
+
+        IX[i] = (IX[i] + integral_gain * halfex) * integral_enabled;
+        IY[i] = (IY[i] + integral_gain * halfey) * integral_enabled;
+        IZ[i] = (IZ[i] + integral_gain * halfez) * integral_enabled;
+        gx += IX[i] + 2.f * kp * halfex;
+        gy += IY[i] + 2.f * kp * halfey;
+        gz += IZ[i] + 2.f * kp * halfez;
+
+        gx *= 0.5f * dt;
+        gy *= 0.5f * dt;
+        gz *= 0.5f * dt;
+        float qa = q0, qb = q1, qc = q2;
+        q0 += -qb * gx - qc * gy - q3 * gz;
+        q1 += qa * gx + qc * gz - q3 * gy;
+        q2 += qa * gy - qb * gz + q3 * gx;
+        q3 += qa * gz + qb * gy - qc * gx;
+        norm = inverse_norm(q0, q1, q2, q3);
+        Q0[i] = q0 * norm;
+        Q1[i] = q1 * norm;
+        Q2[i] = q2 * norm;
+        Q3[i] = q3 * norm;
+    }
+}
+
+witmotion_orientation_fusion::witmotion_orientation_fusion(const witmotion_fusion_algorithm fusion,
+                                                           const size_t count):
+    algorithm(fusion),
+    sensors(count),
+    beta(0.1f),
+    kp(0.5f),
+    ki(0.f),
+    profiling(true),
+    q0(count),
+    q1(count),
+    q2(count),
+    q3(count),
+    integral_x(count),
+    integral_y(count),
+    integral_z(count)
+{
+    Reset();
+}
+
+size_t witmotion_orientation_fusion::Sensors() const
+{
+    return sensors;
+}
+
+void witmotion_orientation_fusion::SetMadgwickGain(const float gain)
+{
+    beta = gain;
+}
+
+void witmotion_orientation_fusion::SetMahonyGains(const float proportional, const float integral)
+{
+    kp = proportional;
+    ki = integral;
+}
+
+void witmotion_orientation_fusion::SetProfiling(const bool enabled)
+{
+    profiling = enabled;
+}
+
+void witmotion_orientation_fusion::UpdateMadgwick(const witmotion_fusion_input &input, const float dt)
+{
+    if(input.magnetic_field[0] != nullptr)
+        madgwick_kernel<true>(input, sensors, beta, dt, q0.data(), q1.data(), q2.data(), q3.data());
+    else
+        madgwick_kernel<false>(input, sensors, beta, dt, q0.data(), q1.data(), q2.data(), q3.data());
+}
+
+void witmotion_orientation_fusion::UpdateMahony(const witmotion_fusion_input &input, const float dt)
+{
+    if(input.magnetic_field[0] != nullptr)
+        mahony_kernel<true>(input, sensors, kp, ki, dt,
+                            q0.data(), q1.data(), q2.data(), q3.data(),
+                            integral_x.data(), integral_y.data(), integral_z.data());
+    else
+        mahony_kernel<false>(input, sensors, kp, ki, dt,
+                             q0.data(), q1.data(), q2.data(), q3.data(),
+                             integral_x.data(), integral_y.data(), integral_z.data());
+}
+
+void witmotion_orientation_fusion::Update(const witmotion_fusion_input &input, const float dt)
+{
+    if(sensors == 0)
+        return;
+    std::chrono::steady_clock::time_point start;
+    if(profiling)
+        start = std::chrono::steady_clock::now();
+    switch(algorithm)
+    {
+    case fusionMahony:
+        UpdateMahony(input, dt);
+        break;
+    case fusionMadgwick:
+    default:
+        UpdateMadgwick(input, dt);
+        break;
+    }
+    if(profiling)
+    {
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        cost.Push(elapsed.count() / static_cast<double>(sensors));
+    }
+}
+
+bool witmotion_orientation_fusion::Update(const witmotion_frame &frame, const float dt)
+{
+    if(!frame.Has(pidAcceleration) || !frame.Has(pidAngularVelocity) || sensors == 0)
+        return false;
+    // Single-sensor batch: every array of the structure-of-arrays input has one element
+    witmotion_fusion_input input;
+    bool magnetic = frame.Has(pidMagnetometer);
+    for(size_t i = 0; i < 3; i++)
+    {
+        input.acceleration[i] = frame.acceleration + i;
+        input.angular_velocity[i] = frame.angular_velocity + i;
+        input.magnetic_field[i] = magnetic ? (frame.magnetic_field + i) : nullptr;
+    }
+    size_t count = sensors;
+    sensors = 1;
+    Update(input, dt);
+    sensors = count;
+    return true;
+}
+
+void witmotion_orientation_fusion::Orientation(const size_t sensor, float &x, float &y, float &z, float &w) const
+{
+    x = q1[sensor];
+    y = q2[sensor];
+    z = q3[sensor];
+    w = q0[sensor];
+}
+
+void witmotion_orientation_fusion::Reset()
+{
+    std::fill(q0.begin(), q0.end(), 1.f);
+    std::fill(q1.begin(), q1.end(), 0.f);
+    std::fill(q2.begin(), q2.end(), 0.f);
+    std::fill(q3.begin(), q3.end(), 0.f);
+    std::fill(integral_x.begin(), integral_x.end(), 0.f);
+    std::fill(integral_y.begin(), integral_y.end(), 0.f);
+    std::fill(integral_z.begin(), integral_z.end(), 0.f);
+    cost.Reset();
+}
+
+const witmotion_running_statistics& witmotion_orientation_fusion::Cost() const
+{
+    return cost;
+}
+
+}
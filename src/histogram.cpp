@@ -0,0 +1,194 @@
+#include "witmotion/histogram.h"
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace witmotion
+{
+
+witmotion_hdr_histogram::witmotion_hdr_histogram():
+    count(0),
+    sum(0),
+    min_value(std::numeric_limits<int64_t>::max()),
+    max_value(0)
+{
+    for(size_t i = 0; i < WITMOTION_HISTOGRAM_BUCKETS; i++)
+        counts[i].store(0, std::memory_order_relaxed);
+}
+
+size_t witmotion_hdr_histogram::Index(const int64_t value)
+{
+    static const uint64_t sub_buckets = 1ULL << WITMOTION_HISTOGRAM_SUB_BITS;
+    uint64_t v = (value > 0) ? static_cast<uint64_t>(value) : 0;
+    if(v < sub_buckets)
+        return static_cast<size_t>(v);
+    size_t magnitude = static_cast<size_t>(63 - __builtin_clzll(v));
+    if(magnitude >= WITMOTION_HISTOGRAM_MAX_BITS)
+        return WITMOTION_HISTOGRAM_BUCKETS - 1;
+    // The power of two [2^m, 2^(m+1)) is split into the sub-buckets of 2^(m-5)
+    size_t shift = magnitude - WITMOTION_HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << WITMOTION_HISTOGRAM_SUB_BITS) + static_cast<size_t>((v >> shift) - sub_buckets);
+}
+
+int64_t witmotion_hdr_histogram::UpperBound(const size_t index)
+{
+    static const size_t sub_buckets = static_cast<size_t>(1) << WITMOTION_HISTOGRAM_SUB_BITS;
+    if(index < sub_buckets)
+        return static_cast<int64_t>(index);
+    size_t shift = (index >> WITMOTION_HISTOGRAM_SUB_BITS) - 1;
+    uint64_t lower = static_cast<uint64_t>(sub_buckets + (index & (sub_buckets - 1))) << shift;
+    return static_cast<int64_t>(lower + (1ULL << shift) - 1);
+}
+
+void witmotion_hdr_histogram::Record(const int64_t value)
+{
+    // Single writer: the plain increments of the relaxed atomics avoid the locked instructions
+    int64_t v = (value > 0) ? value : 0;
+    std::atomic<uint64_t>& bucket = counts[Index(v)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + static_cast<uint64_t>(v), std::memory_order_relaxed);
+    if(v < min_value.load(std::memory_order_relaxed))
+        min_value.store(v, std::memory_order_relaxed);
+    if(v > max_value.load(std::memory_order_relaxed))
+        max_value.store(v, std::memory_order_relaxed);
+}
+
+void witmotion_hdr_histogram::Reset()
+{
+    for(size_t i = 0; i < WITMOTION_HISTOGRAM_BUCKETS; i++)
+        counts[i].store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    min_value.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+    max_value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t witmotion_hdr_histogram::Count() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+double witmotion_hdr_histogram::Mean() const
+{
+    uint64_t n = count.load(std::memory_order_relaxed);
+    return (n > 0) ? static_cast<double>(sum.load(std::memory_order_relaxed)) / static_cast<double>(n) : 0.0;
+}
+
+int64_t witmotion_hdr_histogram::Min() const
+{
+    return (count.load(std::memory_order_relaxed) > 0) ? min_value.load(std::memory_order_relaxed) : 0;
+}
+
+int64_t witmotion_hdr_histogram::Max() const
+{
+    return max_value.load(std::memory_order_relaxed);
+}
+
+int64_t witmotion_hdr_histogram::Percentile(const double fraction) const
+{
+    // The buckets are summed instead of taking the count, so the live query is consistent with itself
+    uint64_t total = 0;
+    for(size_t i = 0; i < WITMOTION_HISTOGRAM_BUCKETS; i++)
+        total += counts[i].load(std::memory_order_relaxed);
+    if(total == 0)
+        return 0;
+    double clamped = (fraction < 0.0) ? 0.0 : ((fraction > 1.0) ? 1.0 : fraction);
+    uint64_t target = static_cast<uint64_t>(std::ceil(clamped * static_cast<double>(total)));
+    if(target == 0)
+        target = 1;
+    uint64_t cumulative = 0;
+    for(size_t i = 0; i < WITMOTION_HISTOGRAM_BUCKETS; i++)
+    {
+        cumulative += counts[i].load(std::memory_order_relaxed);
+        if(cumulative >= target)
+        {
+            int64_t bound = UpperBound(i);
+            int64_t maximum = Max();
+            return (bound < maximum) ? bound : maximum;
+        }
+    }
+    return Max();
+}
+
+uint64_t witmotion_hdr_histogram::CountBelow(const int64_t value) const
+{
+    uint64_t total = 0;
+    size_t end = Index(value);
+    for(size_t i = 0; i < end; i++)
+        total += counts[i].load(std::memory_order_relaxed);
+    return total;
+}
+
+witmotion_packet_timing::witmotion_packet_timing():
+    arrived(0),
+    delivered(0)
+{
+    for(size_t i = 0; i < WITMOTION_TIMING_PACKET_TYPES; i++)
+        last_arrival[i] = 0;
+    for(size_t i = 0; i < WITMOTION_TIMING_RING; i++)
+        ring[i].store(0, std::memory_order_relaxed);
+}
+
+void witmotion_packet_timing::Arrival(const uint8_t id, const int64_t timestamp)
+{
+    uint64_t sequence = arrived.load(std::memory_order_relaxed);
+    ring[sequence % WITMOTION_TIMING_RING].store(timestamp, std::memory_order_relaxed);
+    arrived.store(sequence + 1, std::memory_order_release);
+    size_t index = static_cast<size_t>(id - pidRTC);
+    if(index >= WITMOTION_TIMING_PACKET_TYPES)
+        return;
+    if(last_arrival[index] != 0)
+        interarrival[index].Record(timestamp - last_arrival[index]);
+    last_arrival[index] = timestamp;
+}
+
+void witmotion_packet_timing::Delivery(const uint8_t id, const int64_t timestamp)
+{
+    uint64_t sequence = delivered++;
+    if((sequence >= arrived.load(std::memory_order_acquire)))
+        return;
+    int64_t read = ring[sequence % WITMOTION_TIMING_RING].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // The slot is valid if the reader has not wrapped around the ring meanwhile. The slot is
+    // written before the counter is advanced, so at the distance of the full ring it may be being overwritten
+    if(arrived.load(std::memory_order_relaxed) - sequence >= WITMOTION_TIMING_RING)
+        return;
+    size_t index = static_cast<size_t>(id - pidRTC);
+    if(index < WITMOTION_TIMING_PACKET_TYPES)
+        latency[index].Record(timestamp - read);
+}
+
+double witmotion_packet_timing::Rate(const uint8_t id) const
+{
+    size_t index = static_cast<size_t>(id - pidRTC);
+    if(index >= WITMOTION_TIMING_PACKET_TYPES)
+        return 0.0;
+    double mean = interarrival[index].Mean();
+    return (mean > 0.0) ? 1e9 / mean : 0.0;
+}
+
+void witmotion_packet_timing::Report(std::ostream &out) const
+{
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-6s %10s %10s | %-35s | %-26s\n",
+                  "ID", "packets", "rate, Hz", "inter-arrival p50/p99/p99.9/max, ms", "latency p50/p99/max, ms");
+    out << line;
+    for(size_t i = 0; i < WITMOTION_TIMING_PACKET_TYPES; i++)
+    {
+        const witmotion_hdr_histogram& gaps = interarrival[i];
+        const witmotion_hdr_histogram& delays = latency[i];
+        if((gaps.Count() == 0) && (delays.Count() == 0))
+            continue;
+        std::snprintf(line, sizeof(line), "0x%02X   %10llu %10.2f | %8.3f %8.3f %8.3f %8.3f | %8.3f %8.3f %8.3f\n",
+                      static_cast<unsigned int>(pidRTC + i),
+                      static_cast<unsigned long long>(gaps.Count() + 1),
+                      Rate(static_cast<uint8_t>(pidRTC + i)),
+                      gaps.Percentile(0.5) / 1e6, gaps.Percentile(0.99) / 1e6, gaps.Percentile(0.999) / 1e6, gaps.Max() / 1e6,
+                      delays.Percentile(0.5) / 1e6, delays.Percentile(0.99) / 1e6, delays.Max() / 1e6);
+        out << line;
+    }
+}
+
+}
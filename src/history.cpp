@@ -0,0 +1,139 @@
+#include "witmotion/history.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace witmotion
+{
+
+witmotion_frame_history::witmotion_frame_history(const size_t capacity):
+    ring((capacity > 1) ? capacity : 2),
+    head(0)
+{}
+
+size_t witmotion_frame_history::Capacity() const
+{
+    return ring.size();
+}
+
+uint64_t witmotion_frame_history::Appended() const
+{
+    return head.load(std::memory_order_acquire);
+}
+
+const witmotion_frame& witmotion_frame_history::At(const uint64_t sequence) const
+{
+    return ring[sequence % ring.size()];
+}
+
+void witmotion_frame_history::Append(const witmotion_frame &frame)
+{
+    uint64_t sequence = head.load(std::memory_order_relaxed);
+    ring[sequence % ring.size()] = frame;
+    head.store(sequence + 1, std::memory_order_release);
+}
+
+void witmotion_frame_history::Consume(const witmotion_frame &frame)
+{
+    Append(frame);
+}
+
+uint64_t witmotion_frame_history::LowerBound(uint64_t begin, uint64_t end, const int64_t timestamp) const
+{
+    while(begin < end)
+    {
+        uint64_t middle = begin + (end - begin) / 2;
+        if(At(middle).timestamp < timestamp)
+            begin = middle + 1;
+        else
+            end = middle;
+    }
+    return begin;
+}
+
+uint64_t witmotion_frame_history::UpperBound(uint64_t begin, uint64_t end, const int64_t timestamp) const
+{
+    while(begin < end)
+    {
+        uint64_t middle = begin + (end - begin) / 2;
+        if(At(middle).timestamp <= timestamp)
+            begin = middle + 1;
+        else
+            end = middle;
+    }
+    return begin;
+}
+
+witmotion_history_range witmotion_frame_history::View(const uint64_t begin, const uint64_t end) const
+{
+    witmotion_history_range range;
+    range.first = begin;
+    range.count = (end > begin) ? end - begin : 0;
+    range.spans[0] = witmotion_history_span{nullptr, 0};
+    range.spans[1] = witmotion_history_span{nullptr, 0};
+    if(range.count == 0)
+        return range;
+    size_t offset = static_cast<size_t>(begin % ring.size());
+    size_t contiguous = std::min(static_cast<size_t>(range.count), ring.size() - offset);
+    range.spans[0] = witmotion_history_span{&ring[offset], contiguous};
+    if(contiguous < range.count)
+        range.spans[1] = witmotion_history_span{&ring[0], static_cast<size_t>(range.count) - contiguous};
+    return range;
+}
+
+witmotion_history_range witmotion_frame_history::Range(const int64_t from, const int64_t to) const
+{
+    uint64_t end = head.load(std::memory_order_acquire);
+    // The oldest slot is excluded: it is the one overwritten by the next append
+    uint64_t begin = (end >= ring.size()) ? end - ring.size() + 1 : 0;
+    uint64_t lower = LowerBound(begin, end, from);
+    uint64_t upper = UpperBound(lower, end, to);
+    return View(lower, upper);
+}
+
+witmotion_history_range witmotion_frame_history::Latest(const int64_t duration) const
+{
+    uint64_t end = head.load(std::memory_order_acquire);
+    if(end == 0)
+        return View(0, 0);
+    int64_t newest = At(end - 1).timestamp;
+    int64_t window = std::max<int64_t>(duration, 0);
+    int64_t from = (newest < std::numeric_limits<int64_t>::min() + window) ?
+                std::numeric_limits<int64_t>::min() :
+                newest - window;
+    return Range(from, std::numeric_limits<int64_t>::max());
+}
+
+bool witmotion_frame_history::Valid(const witmotion_history_range &range) const
+{
+    // The reads of the frames should not be reordered after the check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t end = head.load(std::memory_order_relaxed);
+    // The writer may already be writing the frame `end`, which replaces the frame `end - Capacity()`
+    return (range.count == 0) || (range.first + ring.size() > end);
+}
+
+bool witmotion_frame_history::Copy(const int64_t from,
+                                   const int64_t to,
+                                   std::vector<witmotion_frame> &frames,
+                                   const size_t attempts) const
+{
+    for(size_t attempt = 0; attempt < std::max<size_t>(attempts, 1); attempt++)
+    {
+        witmotion_history_range range = Range(from, to);
+        frames.clear();
+        for(size_t i = 0; i < 2; i++)
+            frames.insert(frames.end(), range.spans[i].data, range.spans[i].data + range.spans[i].size);
+        if(Valid(range))
+            return true;
+    }
+    frames.clear();
+    return false;
+}
+
+void witmotion_frame_history::Reset()
+{
+    head.store(0, std::memory_order_release);
+}
+
+}
@@ -55,8 +55,9 @@ void QWitmotionJY901Sensor::SetMeasurements(const bool realtime_clock,
 
 QWitmotionJY901Sensor::QWitmotionJY901Sensor(const QString device,
                                              const QSerialPort::BaudRate rate,
-                                             const uint32_t polling_period):
-    witmotion::wt901::QWitmotionWT901Sensor(device, rate, polling_period)
+                                             const uint32_t polling_period,
+                                             QThread* shared_engine):
+    witmotion::wt901::QWitmotionWT901Sensor(device, rate, polling_period, shared_engine)
 {
 
 }
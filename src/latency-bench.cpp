@@ -0,0 +1,269 @@
+/*
+    End-to-end latency benchmark of the acquisition path.
+
+    The writer thread emulates the sensor: it writes the acceleration packets carrying the
+    steady_clock send time in the data cells into the master side of the pseudo-terminal at
+    the constant rate. The controller reads the slave side through QBaseSerialWitmotionSensorReader
+    and the latency is measured at the delivery: in the slot connected to the Acquired signal
+    of QAbstractWitmotionSensorController, or in the packet sink called from the reader thread.
+    Every reader mode (timer polling at the given intervals and the event-driven reading) is
+    measured with both delivery paths. The CPU usage of the process excluding the writer thread
+    is reported relative to one core.
+*/
+#include "witmotion/wt901-uart.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QEventLoop>
+#include <QTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace witmotion;
+
+namespace
+{
+
+// The packets sent before the reader is started and settled are not measured
+static const int64_t WARMUP_NS = 500000000;
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double cpu_seconds(const int who)
+{
+    struct rusage usage;
+    getrusage(who, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+struct latency_configuration
+{
+    std::string name;
+    uint32_t interval; ///< Poll interval, ms
+    bool event_driven;
+    bool sink;
+};
+
+/* Stores the latencies into the preallocated array, so the measurement does not allocate.
+   Only one thread records: the main one for the signal, the reader one for the sink */
+class latency_recorder: public witmotion_packet_sink
+{
+public:
+    int64_t start;
+    std::vector<int64_t> latencies;
+    size_t count;
+    uint64_t received;
+    explicit latency_recorder(const size_t capacity):
+        start(0),
+        latencies(capacity),
+        count(0),
+        received(0)
+    {}
+    void Record(const witmotion_datapacket& packet)
+    {
+        int64_t now = steady_timestamp();
+        int64_t sent;
+        std::memcpy(&sent, packet.datastore.raw, sizeof(sent));
+        received++;
+        if((sent >= start) && (count < latencies.size()))
+            latencies[count++] = now - sent;
+    }
+    virtual void Consume(const witmotion_datapacket& packet)
+    {
+        Record(packet);
+    }
+};
+
+/* Writes the timestamped packets at the constant rate by absolute deadlines, so the writer
+   delays do not accumulate. The CPU time of the thread is excluded from the report */
+void write_packets(const int master, const double rate, const int64_t stop, std::atomic<uint64_t>& sent, double& cpu)
+{
+    witmotion_datapacket packet;
+    packet.header_byte = WITMOTION_HEADER_BYTE;
+    packet.id_byte = pidAcceleration;
+    uint8_t wire[11];
+    int64_t period = static_cast<int64_t>(1e9 / rate);
+    int64_t deadline = steady_timestamp();
+    while(deadline < stop)
+    {
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadline)));
+        int64_t now = steady_timestamp();
+        std::memcpy(packet.datastore.raw, &now, sizeof(now));
+        packet.crc = packet_crc(packet);
+        wire[0] = packet.header_byte;
+        wire[1] = packet.id_byte;
+        std::memcpy(wire + 2, packet.datastore.raw, 8);
+        wire[10] = packet.crc;
+        if(write(master, wire, sizeof(wire)) == static_cast<ssize_t>(sizeof(wire)))
+            sent++;
+        deadline += period;
+    }
+    cpu = cpu_seconds(RUSAGE_THREAD);
+}
+
+double percentile(const std::vector<int64_t>& sorted, const size_t count, const double fraction)
+{
+    if(count == 0)
+        return 0.0;
+    size_t index = std::min(count - 1, static_cast<size_t>(fraction * static_cast<double>(count)));
+    return static_cast<double>(sorted[index]) / 1e3;
+}
+
+// Histogram of the power of two microsecond buckets
+void print_histogram(const std::vector<int64_t>& sorted, const size_t count)
+{
+    size_t index = 0;
+    int64_t upper = 1000;
+    while(index < count)
+    {
+        size_t first = index;
+        while((index < count) && (sorted[index] < upper))
+            index++;
+        if(index > first)
+            std::printf("    < %10lld us %9llu %6.2f%%\n",
+                        static_cast<long long>(upper / 1000),
+                        static_cast<unsigned long long>(index - first),
+                        100.0 * static_cast<double>(index - first) / static_cast<double>(count));
+        upper *= 2;
+    }
+}
+
+}
+
+int main(int argc, char** args)
+{
+    QCoreApplication app(argc, args);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WITMOTION END-TO-END LATENCY BENCHMARK");
+    parser.addHelpOption();
+    QCommandLineOption IntervalsOption(QStringList() << "i" << "intervals",
+                                       "Comma-separated poll intervals of the timer-driven reader, ms",
+                                       "ms,ms,...",
+                                       "1,5,10,20,50");
+    parser.addOption(IntervalsOption);
+    QCommandLineOption RateOption(QStringList() << "r" << "rate",
+                                  "Packets written per second",
+                                  "Hz",
+                                  "200");
+    parser.addOption(RateOption);
+    QCommandLineOption DurationOption(QStringList() << "d" << "duration",
+                                      "Measurement duration per configuration, s",
+                                      "s",
+                                      "5");
+    parser.addOption(DurationOption);
+    QCommandLineOption CSVOption("csv",
+                                 "Print the results as comma-separated values");
+    parser.addOption(CSVOption);
+    QCommandLineOption HistogramOption("histogram",
+                                       "Print the latency histogram for every configuration");
+    parser.addOption(HistogramOption);
+    parser.process(app);
+    double rate = parser.value(RateOption).toDouble();
+    double duration = parser.value(DurationOption).toDouble();
+    if((rate <= 0.0) || (duration <= 0.0))
+    {
+        std::cout << "ERROR: Invalid rate or duration specified" << std::endl;
+        return 1;
+    }
+
+    std::vector<latency_configuration> configurations;
+    QStringList intervals = parser.value(IntervalsOption).split(",");
+    for(auto i = intervals.begin(); i != intervals.end(); i++)
+    {
+        uint32_t interval = i->trimmed().toUInt();
+        if(interval == 0)
+            continue;
+        std::string name = "poll " + std::to_string(interval) + " ms";
+        configurations.push_back(latency_configuration{name + ", signal", interval, false, false});
+        configurations.push_back(latency_configuration{name + ", sink", interval, false, true});
+    }
+    configurations.push_back(latency_configuration{"event-driven, signal", 50, true, false});
+    configurations.push_back(latency_configuration{"event-driven, sink", 50, true, true});
+
+    bool csv = parser.isSet(CSVOption);
+    if(csv)
+        std::cout << "configuration,sent,received,p50_us,p99_us,p99_9_us,max_us,cpu_percent" << std::endl;
+    else
+        std::printf("%-26s %9s %9s %10s %10s %10s %10s %7s\n",
+                    "configuration", "sent", "received", "p50, us", "p99, us", "p99.9, us", "max, us", "CPU, %");
+    for(auto configuration = configurations.begin(); configuration != configurations.end(); configuration++)
+    {
+        int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+        {
+            std::cout << "ERROR: Cannot create the pseudo-terminal: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        std::string slave(ptsname(master));
+        // Outlives the controller, whose destructor stops the reader delivering into it
+        latency_recorder recorder(static_cast<size_t>(rate * (duration + 1.0)));
+        {
+            wt901::QWitmotionWT901Sensor sensor(QString(slave.c_str()), QSerialPort::Baud115200, configuration->interval);
+            // The intervals between the packets may exceed the timeout derived from the short poll interval
+            sensor.SetSensorTimeout(static_cast<uint32_t>(std::max(1000.0, 10000.0 / rate)));
+            sensor.SetEventDriven(configuration->event_driven);
+            if(configuration->sink)
+                sensor.SetPacketSink(&recorder);
+            else
+                QObject::connect(&sensor, &QAbstractWitmotionSensorController::Acquired, &app, [&recorder](const witmotion_datapacket& packet)
+                {
+                    recorder.Record(packet);
+                });
+            sensor.Start();
+
+            int64_t now = steady_timestamp();
+            recorder.start = now + WARMUP_NS;
+            int64_t stop = recorder.start + static_cast<int64_t>(duration * 1e9);
+            std::atomic<uint64_t> sent(0);
+            double writer_cpu = 0.0;
+            std::thread writer(write_packets, master, rate, stop, std::ref(sent), std::ref(writer_cpu));
+            double cpu_start = cpu_seconds(RUSAGE_SELF);
+            QEventLoop loop;
+            // The measurement starts after the warm-up, the delivery of the last packets is awaited for 100 ms
+            QTimer::singleShot(static_cast<int>((stop - now) / 1000000 + 100), &loop, &QEventLoop::quit);
+            loop.exec();
+            writer.join();
+            double cpu = cpu_seconds(RUSAGE_SELF) - cpu_start - writer_cpu;
+            double wall = static_cast<double>(steady_timestamp() - now) / 1e9;
+
+            std::vector<int64_t>& latencies = recorder.latencies;
+            std::sort(latencies.begin(), latencies.begin() + static_cast<std::ptrdiff_t>(recorder.count));
+            double maximum = (recorder.count > 0) ? static_cast<double>(latencies[recorder.count - 1]) / 1e3 : 0.0;
+            if(csv)
+                std::printf("%s,%llu,%llu,%.1f,%.1f,%.1f,%.1f,%.2f\n", configuration->name.c_str(),
+                            static_cast<unsigned long long>(sent.load()), static_cast<unsigned long long>(recorder.received),
+                            percentile(latencies, recorder.count, 0.5), percentile(latencies, recorder.count, 0.99),
+                            percentile(latencies, recorder.count, 0.999), maximum, 100.0 * cpu / wall);
+            else
+                std::printf("%-26s %9llu %9llu %10.1f %10.1f %10.1f %10.1f %7.2f\n", configuration->name.c_str(),
+                            static_cast<unsigned long long>(sent.load()), static_cast<unsigned long long>(recorder.received),
+                            percentile(latencies, recorder.count, 0.5), percentile(latencies, recorder.count, 0.99),
+                            percentile(latencies, recorder.count, 0.999), maximum, 100.0 * cpu / wall);
+            if(parser.isSet(HistogramOption) && !csv)
+                print_histogram(latencies, recorder.count);
+            std::fflush(stdout);
+        }
+        close(master);
+    }
+    return 0;
+}
@@ -0,0 +1,367 @@
+#include "witmotion/log-writer.h"
+#include "witmotion/util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace witmotion
+{
+
+namespace
+{
+
+// The longest formatted line is far below this limit
+static const size_t LOG_LINE_LIMIT = 256;
+static const size_t LOG_OUTPUT_SIZE = 1 << 20;
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int format_packet(char* line,
+                  const uint64_t index,
+                  const double seconds,
+                  const witmotion_datapacket& packet)
+{
+    float x, y, z, w, t;
+    double pressure, altitude;
+    double longitude_deg, longitude_min, latitude_deg, latitude_min, ground_speed;
+    size_t satellites;
+    uint8_t year, month, day, hour, minute, second;
+    uint16_t millisecond;
+    unsigned long long number = static_cast<unsigned long long>(index);
+    switch(static_cast<witmotion_packet_id>(packet.id_byte))
+    {
+    case pidRTC:
+        decode_realtime_clock(packet, year, month, day, hour, minute, second, millisecond);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tUptime / Timestamp: %u-%u-%u %u:%u:%u.%u at %.6f s\n",
+                             number, year, month, day, hour, minute, second, millisecond, seconds);
+    case pidAcceleration:
+        decode_accelerations(packet, x, y, z, t);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tAccelerations [X|Y|Z]:\t[ %.5f | %.5f | %.5f ], temp %.5f degrees at %.6f s\n",
+                             number, x, y, z, t, seconds);
+    case pidAngularVelocity:
+        decode_angular_velocities(packet, x, y, z, t);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tAngular velocities [X|Y|Z]:\t[ %.5f | %.5f | %.5f ], temp %.5f degrees at %.6f s\n",
+                             number, x, y, z, t, seconds);
+    case pidAngles:
+        decode_angles(packet, x, y, z, t);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tEuler angles [R|P|Y]:\t[ %.5f | %.5f | %.5f ], temp %.5f degrees at %.6f s\n",
+                             number, x, y, z, t, seconds);
+    case pidMagnetometer:
+        decode_magnetometer(packet, x, y, z, t);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tMagnetic field [X|Y|Z]:\t[ %.5f | %.5f | %.5f ], temp %.5f degrees at %.6f s\n",
+                             number, x, y, z, t, seconds);
+    case pidDataPortStatus:
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tData port status string: 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x at %.6f s\n",
+                             number,
+                             packet.datastore.raw[0], packet.datastore.raw[1], packet.datastore.raw[2], packet.datastore.raw[3],
+                             packet.datastore.raw[4], packet.datastore.raw[5], packet.datastore.raw[6], packet.datastore.raw[7],
+                             seconds);
+    case pidAltimeter:
+        decode_altimeter(packet, pressure, altitude);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tAltimeter: pressure %.5f Pa, altitude %.5f m at %.6f s\n",
+                             number, pressure, altitude, seconds);
+    case pidGPSCoordinates:
+        decode_gps(packet, longitude_deg, longitude_min, latitude_deg, latitude_min);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tGPS: longitude %.0f deg %.5f min, latitude %.0f deg %.5f min at %.6f s\n",
+                             number, longitude_deg, longitude_min, latitude_deg, latitude_min, seconds);
+    case pidGPSGroundSpeed:
+        decode_gps_ground_speed(packet, x, y, ground_speed);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tGPS: ground speed %.5f, altitude %.5f m, angular velocity %.5f at %.6f s\n",
+                             number, ground_speed, x, y, seconds);
+    case pidOrientation:
+        decode_orientation(packet, x, y, z, w);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tOrientation quaternion [X|Y|Z|W]:\t[ %.5f | %.5f | %.5f | %.5f ] at %.6f s\n",
+                             number, x, y, z, w, seconds);
+    case pidGPSAccuracy:
+        decode_gps_accuracy(packet, satellites, x, y, z);
+        return std::snprintf(line, LOG_LINE_LIMIT, "%llu\tGPS accuracy: %zu satellites, [E|N|U]:\t[ %.5f | %.5f | %.5f ] at %.6f s\n",
+                             number, satellites, x, y, z, seconds);
+    default:
+        return 0;
+    }
+}
+
+}
+
+witmotion_log_writer::witmotion_log_writer(const std::string &file,
+                                           const witmotion_log_format log_format,
+                                           const size_t block_size,
+                                           const uint32_t flush_ms,
+                                           const uint32_t sync_ms):
+    filename(file),
+    format(log_format),
+    flush_interval((flush_ms > 0) ? flush_ms : 1),
+    sync_interval(sync_ms),
+    fd(-1),
+    active(0),
+    flush_requested(false),
+    running(false),
+    written(0),
+    dropped(0),
+    failed(false),
+    lines(0),
+    origin(0)
+{
+    for(size_t i = 0; i < 2; i++)
+    {
+        blocks[i].resize((block_size > 0) ? block_size : 1);
+        filled[i] = 0;
+        ready[i] = false;
+    }
+    output.reserve(LOG_OUTPUT_SIZE);
+}
+
+witmotion_log_writer::~witmotion_log_writer()
+{
+    Close();
+}
+
+bool witmotion_log_writer::Open(const std::string &preamble)
+{
+    Close();
+    if((format == logNumPy) || (format == logNumPyArchive))
+    {
+        exporter = create_frame_exporter((format == logNumPy) ? exportNumPy : exportNumPyArchive, filename);
+        if(!exporter->Open())
+        {
+            error = exporter->Error();
+            exporter.reset();
+            return false;
+        }
+        frames.Reset();
+    }
+    else
+    {
+        fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0)
+        {
+            error = std::string("Cannot create log file ") + filename + ": " + std::strerror(errno);
+            return false;
+        }
+    }
+    error.clear();
+    failed = false;
+    written = 0;
+    dropped = 0;
+    lines = 0;
+    origin = 0;
+    active = 0;
+    flush_requested = false;
+    for(size_t i = 0; i < 2; i++)
+    {
+        filled[i] = 0;
+        ready[i] = false;
+    }
+    output.clear();
+    if(format == logText)
+    {
+        output.insert(output.end(), preamble.begin(), preamble.end());
+        if(!Flush())
+        {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+    running = true;
+    worker = std::thread(&witmotion_log_writer::Run, this);
+    return true;
+}
+
+void witmotion_log_writer::Close()
+{
+    if(!IsOpen())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(wakeup_guard);
+        running = false;
+    }
+    wakeup.notify_one();
+    if(worker.joinable())
+        worker.join();
+    // Every handed over block is written by the thread, only the active one remains
+    Write(active);
+    filled[active] = 0;
+    if(exporter)
+    {
+        witmotion_frame frame;
+        if(frames.Flush(frame))
+            exporter->Consume(frame);
+        if(!exporter->Close() && !failed.exchange(true))
+            error = exporter->Error();
+        exporter.reset();
+        return;
+    }
+    if(sync_interval > 0)
+        fdatasync(fd);
+    close(fd);
+    fd = -1;
+}
+
+bool witmotion_log_writer::IsOpen() const
+{
+    return (fd >= 0) || exporter;
+}
+
+const std::string& witmotion_log_writer::Error() const
+{
+    return error;
+}
+
+uint64_t witmotion_log_writer::Written() const
+{
+    return written.load(std::memory_order_relaxed);
+}
+
+uint64_t witmotion_log_writer::Dropped() const
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void witmotion_log_writer::Consume(const witmotion_datapacket &packet)
+{
+    Push(packet, steady_timestamp());
+}
+
+bool witmotion_log_writer::Push(const witmotion_datapacket &packet, const int64_t timestamp)
+{
+    if(!IsOpen())
+        return false;
+    if(filled[active] == blocks[active].size())
+    {
+        Handover();
+        if(filled[active] == blocks[active].size())
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    record& slot = blocks[active][filled[active]++];
+    slot.timestamp = timestamp;
+    slot.packet = packet;
+    if((filled[active] == blocks[active].size()) || flush_requested.load(std::memory_order_relaxed))
+        Handover();
+    return true;
+}
+
+void witmotion_log_writer::Handover()
+{
+    size_t other = active ^ 1;
+    if(ready[other].load(std::memory_order_acquire))
+        return; // The writer thread is still busy with the previous block
+    flush_requested.store(false, std::memory_order_relaxed);
+    ready[active].store(true, std::memory_order_release);
+    active = other;
+    // Notified without locking: the lost wake-up is recovered by the flush interval timeout
+    wakeup.notify_one();
+}
+
+void witmotion_log_writer::Run()
+{
+    size_t next = 0;
+    std::chrono::steady_clock::time_point last_sync = std::chrono::steady_clock::now();
+    for(;;)
+    {
+        if(ready[next].load(std::memory_order_acquire))
+        {
+            Write(next);
+            filled[next] = 0;
+            ready[next].store(false, std::memory_order_release);
+            next ^= 1;
+            if((sync_interval > 0) && (fd >= 0))
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if(now - last_sync >= std::chrono::milliseconds(sync_interval))
+                {
+                    fdatasync(fd);
+                    last_sync = now;
+                }
+            }
+            continue;
+        }
+        if(!running)
+            break;
+        {
+            std::unique_lock<std::mutex> lock(wakeup_guard);
+            wakeup.wait_for(lock, std::chrono::milliseconds(flush_interval), [this, next]()
+            {
+                return ready[next].load(std::memory_order_acquire) || !running;
+            });
+        }
+        // The producer hands the partially filled block over on the next packet
+        if(!ready[next].load(std::memory_order_acquire))
+            flush_requested.store(true, std::memory_order_relaxed);
+    }
+}
+
+void witmotion_log_writer::Write(const size_t block)
+{
+    size_t count = filled[block];
+    const record* records = blocks[block].data();
+    for(size_t i = 0; i < count; i++)
+    {
+        if(output.size() + LOG_LINE_LIMIT > LOG_OUTPUT_SIZE)
+            Flush();
+        const witmotion_datapacket& packet = records[i].packet;
+        if(exporter)
+        {
+            witmotion_frame frame;
+            if(lines++ == 0)
+                origin = records[i].timestamp;
+            if(frames.Push(packet, records[i].timestamp - origin, frame))
+                exporter->Consume(frame);
+        }
+        else if(format == logBinary)
+        {
+            // The structure is padded, the wire representation is composed byte-by-byte
+            output.push_back(static_cast<char>(packet.header_byte));
+            output.push_back(static_cast<char>(packet.id_byte));
+            output.insert(output.end(), packet.datastore.raw, packet.datastore.raw + 8);
+            output.push_back(static_cast<char>(packet.crc));
+        }
+        else
+        {
+            char line[LOG_LINE_LIMIT];
+            if(lines == 0)
+                origin = records[i].timestamp;
+            int length = format_packet(line, ++lines, static_cast<double>(records[i].timestamp - origin) / 1e9, packet);
+            if(length > 0)
+                output.insert(output.end(), line, line + std::min<size_t>(static_cast<size_t>(length), LOG_LINE_LIMIT - 1));
+        }
+    }
+    Flush();
+    if(exporter && !exporter->Error().empty() && !failed.exchange(true))
+        error = exporter->Error();
+    written.fetch_add(count, std::memory_order_relaxed);
+}
+
+bool witmotion_log_writer::Flush()
+{
+    size_t offset = 0;
+    while(offset < output.size())
+    {
+        ssize_t result = write(fd, output.data() + offset, output.size() - offset);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            if(!failed.exchange(true))
+                error = std::string("Cannot write log file ") + filename + ": " + std::strerror(errno);
+            break;
+        }
+        offset += static_cast<size_t>(result);
+    }
+    output.clear();
+    return !failed;
+}
+
+}
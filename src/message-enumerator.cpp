@@ -1,7 +1,77 @@
 #include "witmotion/message-enumerator.h"
+#include "witmotion/codec.h"
+#include "witmotion/task-pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 using namespace witmotion;
 
+namespace
+{
+
+static const int64_t RATE_WINDOW = 1000000000; ///< ns
+static const size_t GAP_OCTAVES = 16; ///< Inter-arrival histogram from 2^20 ns (about 1 ms) to 2^36 ns (about 69 s)
+static const size_t GAP_FIRST_OCTAVE = 20;
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void append(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void append(std::string& out, const char* format, ...)
+{
+    char line[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = std::vsnprintf(line, sizeof(line), format, arguments);
+    va_end(arguments);
+    if(length > 0)
+        out.append(line, std::min(static_cast<size_t>(length), sizeof(line) - 1));
+}
+
+/* One character per octave of the inter-arrival time, scaled to the fullest octave */
+void append_gap_histogram(std::string& out, const witmotion_hdr_histogram& histogram)
+{
+    static const char levels[] = " .:-=+*#";
+    uint64_t octaves[GAP_OCTAVES];
+    uint64_t fullest = 0;
+    uint64_t below = histogram.CountBelow(static_cast<int64_t>(1) << GAP_FIRST_OCTAVE);
+    for(size_t i = 0; i < GAP_OCTAVES; i++)
+    {
+        uint64_t next = histogram.CountBelow(static_cast<int64_t>(1) << (GAP_FIRST_OCTAVE + i + 1));
+        octaves[i] = next - below;
+        below = next;
+        fullest = std::max(fullest, octaves[i]);
+    }
+    out += '|';
+    for(size_t i = 0; i < GAP_OCTAVES; i++)
+    {
+        size_t level = 0;
+        if(octaves[i] > 0)
+            level = 1 + static_cast<size_t>((octaves[i] * 6) / fullest);
+        out += levels[level];
+    }
+    out += '|';
+}
+
+}
+
 void QGeneralSensorController::BuildLog()
 {
     log << QString()
@@ -30,6 +100,94 @@ void QGeneralSensorController::BuildLog()
     unknown_print += " ] ";
     log << unknown_print;
     log << "Total messages: " + QString::number(packets) << QString();
+    if(!live)
+        return;
+    witmotion_metrics_snapshot total = metrics->Snapshot();
+    double seconds = static_cast<double>(steady_timestamp() - live_started) / 1e9;
+    uint64_t checked = packets + total.crc_failures;
+    log << "Bytes: " + QString::number(total.bytes)
+           + ", link utilization " + QString::number(100.0 * static_cast<double>(total.bytes) / seconds / (static_cast<double>(port_rate) / 10.0), 'f', 1)
+           + "% at " + QString::number(port_rate) + " baud";
+    log << "CRC failures: " + QString::number(total.crc_failures)
+           + " (" + QString::number((checked > 0) ? 100.0 * static_cast<double>(total.crc_failures) / static_cast<double>(checked) : 0.0, 'f', 3)
+           + "%), resyncs: " + QString::number(total.resyncs) << QString();
+    std::stringstream report;
+    timing->Report(report);
+    std::string line;
+    while(std::getline(report, line))
+        log << QString::fromStdString(line);
+}
+
+void QGeneralSensorController::Render(const int64_t now, const witmotion_metrics_snapshot &current)
+{
+    const witmotion_metrics_snapshot& previous = history.front().second;
+    double window = static_cast<double>(now - history.front().first) / 1e9;
+    if(window <= 0.0)
+        window = 1.0;
+    double capacity = static_cast<double>(port_rate) / 10.0;
+    double byte_rate = static_cast<double>(current.bytes - previous.bytes) / window;
+    uint64_t window_packets = 0;
+    uint64_t total_packets = 0;
+    for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+    {
+        window_packets += current.packets[i] - previous.packets[i];
+        total_packets += current.packets[i];
+    }
+    uint64_t window_failures = current.crc_failures - previous.crc_failures;
+    uint64_t window_checked = window_packets + window_failures;
+    uint64_t total_checked = total_packets + current.crc_failures;
+    screen.clear();
+    // Cursor home and clear, so the terminal redraws the screen in place
+    screen += "\x1b[H\x1b[J";
+    append(screen, "WITMOTION UART MESSAGE ENUMERATOR: /dev/%s at %u baud, %.1f s\n\n",
+           port_name.toStdString().c_str(),
+           static_cast<unsigned int>(port_rate),
+           static_cast<double>(now - live_started) / 1e9);
+    append(screen, "Link:    %9.0f B/s of %.0f B/s, %5.1f%% utilization, backlog %lld B, %.0f reads/s\n",
+           byte_rate,
+           capacity,
+           100.0 * byte_rate / capacity,
+           static_cast<long long>(current.backlog),
+           static_cast<double>(current.reads - previous.reads) / window);
+    append(screen, "Parser:  %9llu packets, CRC failures %llu (%.3f%%, %.3f%% last second), resyncs %llu\n\n",
+           static_cast<unsigned long long>(total_packets),
+           static_cast<unsigned long long>(current.crc_failures),
+           (total_checked > 0) ? 100.0 * static_cast<double>(current.crc_failures) / static_cast<double>(total_checked) : 0.0,
+           (window_checked > 0) ? 100.0 * static_cast<double>(window_failures) / static_cast<double>(window_checked) : 0.0,
+           static_cast<unsigned long long>(current.resyncs));
+    append(screen, "%-4s  %-34s %10s %8s %8s %6s %9s %9s %9s  %s\n",
+           "ID", "Description", "Count", "Hz", "B/s", "Link%", "gap p50", "gap p99", "gap max", "gap, 1 ms..65 s by octaves");
+    for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+    {
+        if(current.packets[i] == 0)
+            continue;
+        uint8_t id = static_cast<uint8_t>(pidRTC + i);
+        auto description = witmotion_packet_descriptions.find(id);
+        double rate = static_cast<double>(current.packets[i] - previous.packets[i]) / window;
+        const witmotion_hdr_histogram& gaps = timing->interarrival[i];
+        append(screen, "0x%02X  %-34.34s %10llu %8.1f %8.0f %6.1f %9.2f %9.2f %9.2f  ",
+               static_cast<unsigned int>(id),
+               (description != witmotion_packet_descriptions.end()) ? description->second.c_str() : "",
+               static_cast<unsigned long long>(current.packets[i]),
+               rate,
+               rate * 11.0,
+               100.0 * rate * 11.0 / capacity,
+               static_cast<double>(gaps.Percentile(0.5)) / 1e6,
+               static_cast<double>(gaps.Percentile(0.99)) / 1e6,
+               static_cast<double>(gaps.Max()) / 1e6);
+        append_gap_histogram(screen, gaps);
+        screen += '\n';
+    }
+    screen += "\nInter-arrival times in ms, measured at the port reads. Press Ctrl+C to stop\n";
+    // One write per refresh, the terminal never shows the partial screen
+    size_t written = 0;
+    while(written < screen.size())
+    {
+        ssize_t result = ::write(STDOUT_FILENO, screen.data() + written, screen.size() - written);
+        if(result <= 0)
+            break;
+        written += static_cast<size_t>(result);
+    }
 }
 
 QGeneralSensorController::QGeneralSensorController(const QString port, const QSerialPort::BaudRate rate):
@@ -41,7 +199,10 @@ QGeneralSensorController::QGeneralSensorController(const QString port, const QSe
     ttyout(stdout),
     unknown_ids(0),
     log_set(false),
-    logfile(nullptr)
+    logfile(nullptr),
+    live(false),
+    live_started(0),
+    refresh_timer(nullptr)
 {
     reader = new QBaseSerialWitmotionSensorReader(port_name, port_rate);
     reader->moveToThread(&reader_thread);
@@ -57,6 +218,20 @@ QGeneralSensorController::~QGeneralSensorController()
     reader_thread.quit();
     reader_thread.wait(10000);
 
+    if(live)
+    {
+        refresh_timer->stop();
+        // The live census is counted by the reader
+        witmotion_metrics_snapshot total = metrics->Snapshot();
+        for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+        {
+            // The report lists the packet types actually seen, as the non-live census does
+            if(total.packets[i] == 0)
+                continue;
+            counts[static_cast<witmotion_packet_id>(pidRTC + i)] = total.packets[i];
+            packets += total.packets[i];
+        }
+    }
     BuildLog();
     for(auto i = log.begin(); i != log.end(); i++)
         ttyout << *i << ENDL;
@@ -74,6 +249,8 @@ QGeneralSensorController::~QGeneralSensorController()
 
 void QGeneralSensorController::Start()
 {
+    if(live)
+        refresh_timer->start();
     emit RunReader();
 }
 
@@ -99,6 +276,41 @@ void QGeneralSensorController::SetTimeout(uint32_t ms)
     reader->SetSensorTimeout(ms);
 }
 
+void QGeneralSensorController::SetLive(const uint32_t refresh_ms)
+{
+    live = true;
+    metrics.reset(new witmotion_sensor_metrics(port_name.toStdString()));
+    timing.reset(new witmotion_packet_timing());
+    screen.reserve(4096);
+    reader->SetEventDriven(true);
+    reader->ValidatePackets(true);
+    reader->SetMetrics(metrics.get());
+    reader->SetTiming(timing.get());
+    reader->SetPacketSink(this);
+    live_started = steady_timestamp();
+    history.push_back(std::make_pair(live_started, metrics->Snapshot()));
+    refresh_timer = new QTimer(this);
+    refresh_timer->setInterval(static_cast<int>(refresh_ms));
+    connect(refresh_timer, &QTimer::timeout, this, &QGeneralSensorController::Refresh);
+}
+
+void QGeneralSensorController::Consume(const witmotion_datapacket &packet)
+{
+    // Called in the reader thread, the live census is taken from the metrics instead
+    (void) packet;
+}
+
+void QGeneralSensorController::Refresh()
+{
+    int64_t now = steady_timestamp();
+    witmotion_metrics_snapshot current = metrics->Snapshot();
+    // The oldest snapshot kept is the newest one at least a second old
+    while((history.size() > 1) && (now - history[1].first >= RATE_WINDOW))
+        history.pop_front();
+    Render(now, current);
+    history.push_back(std::make_pair(now, current));
+}
+
 void QGeneralSensorController::Packet(const witmotion_datapacket &packet)
 {
     ++packets;
@@ -118,6 +330,568 @@ void QGeneralSensorController::Error(const QString &description)
     QCoreApplication::exit(1);
 }
 
+namespace
+{
+
+static const size_t READ_SIZE = 1 << 20;
+static const size_t PACKET_SIZE = 11;
+static const size_t STABLE_CYCLES = 3; ///< Output cycles with the new measurement set before it is reported as the configuration change
+static const size_t RATE_CYCLES = 16; ///< Output cycles per rate estimate, the timestamped recordings only
+static const uint64_t MERGE_PACKETS = 8; ///< Damaged regions separated by fewer valid packets are reported as one
+
+enum timeline_kind
+{
+    tkConfiguration,
+    tkResync, ///< The damaged region where the parser lost the packet boundary
+    tkCorrupted ///< The damaged region of the packets failing the CRC check only
+};
+
+struct timeline_event
+{
+    timeline_kind kind;
+    uint64_t offset; ///< Byte offset in the capture, packet number in the recording
+    uint64_t packet; ///< Valid packets before the event
+    int64_t timestamp; ///< ns since the first packet, -1 if unknown
+    uint64_t length; ///< Damaged bytes in the capture, packets in the recording
+    uint64_t crc_failures;
+    uint64_t resyncs;
+    std::string description;
+};
+
+struct census_file
+{
+    std::string input;
+    uint64_t size;
+    bool recording;
+    bool timestamps;
+    uint64_t counts[WITMOTION_METRICS_PACKET_TYPES]; ///< Indexed by the packet ID minus \ref pidRTC
+    uint64_t packets;
+    uint64_t crc_failures;
+    uint64_t resyncs;
+    uint64_t damaged;
+    int64_t duration; ///< ns between the first and the last packet, -1 if unknown
+    std::set<uint8_t> unknown;
+    std::vector<timeline_event> timeline;
+    bool failed;
+    std::string error;
+};
+
+std::string measurement_set(const uint16_t mask)
+{
+    std::string result;
+    for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+        if(mask & (1 << i))
+            append(result, "%s0x%02X", result.empty() ? "" : " ", static_cast<unsigned int>(pidRTC + i));
+    return result;
+}
+
+/* Builds the census and the timeline of one file from the valid packets and the damaged regions between them.
+   The sensor outputs every enabled packet type once per cycle in the fixed order, so the cycle ends at the first repeated type */
+class census_scanner
+{
+private:
+    census_file& file;
+    uint64_t position;
+    uint64_t valid;
+    int64_t first_timestamp;
+    int64_t last_timestamp;
+    uint16_t cycle;
+    bool cycle_damaged;
+    uint64_t cycle_offset;
+    uint64_t cycle_packet;
+    int64_t cycle_time;
+    bool stable_known;
+    uint16_t stable;
+    uint16_t candidate;
+    size_t candidate_cycles;
+    timeline_event change;
+    size_t window_cycles;
+    int64_t window_start;
+    double stable_rate;
+    bool rate_pending;
+    timeline_event rate_change;
+    bool damage_open;
+    uint64_t since_damage;
+    timeline_event damage;
+
+    timeline_event Event(const timeline_kind kind, const uint64_t offset, const int64_t timestamp) const
+    {
+        timeline_event event;
+        event.kind = kind;
+        event.offset = offset;
+        event.packet = valid;
+        event.timestamp = (timestamp >= 0) ? timestamp - first_timestamp : -1;
+        event.length = 0;
+        event.crc_failures = 0;
+        event.resyncs = 0;
+        return event;
+    }
+    void CloseDamage()
+    {
+        if(!damage_open)
+            return;
+        damage.kind = (damage.resyncs > 0) ? tkResync : tkCorrupted;
+        file.timeline.push_back(damage);
+        damage_open = false;
+    }
+    void Rate(const double rate)
+    {
+        if(stable_rate <= 0.0)
+        {
+            stable_rate = rate;
+            return;
+        }
+        if(std::fabs(rate - stable_rate) <= 0.25 * stable_rate)
+        {
+            rate_pending = false;
+            return;
+        }
+        // Two windows in a row, so the single delayed burst of the USB-serial adapter is not reported
+        if(!rate_pending)
+        {
+            rate_pending = true;
+            rate_change = Event(tkConfiguration, cycle_offset, cycle_time);
+            return;
+        }
+        append(rate_change.description, "output rate %.1f -> %.1f Hz", stable_rate, rate);
+        file.timeline.push_back(rate_change);
+        stable_rate = rate;
+        rate_pending = false;
+    }
+    void CompleteCycle(const int64_t next_time)
+    {
+        if(!cycle_damaged)
+        {
+            if(!stable_known)
+            {
+                stable = cycle;
+                stable_known = true;
+            }
+            else if(cycle == stable)
+                candidate_cycles = 0;
+            else
+            {
+                if((candidate_cycles == 0) || (candidate != cycle))
+                {
+                    candidate = cycle;
+                    candidate_cycles = 0;
+                    change = Event(tkConfiguration, cycle_offset, cycle_time);
+                }
+                if(++candidate_cycles >= STABLE_CYCLES)
+                {
+                    change.description = "measurements " + measurement_set(stable) + " -> " + measurement_set(candidate);
+                    file.timeline.push_back(change);
+                    stable = candidate;
+                    candidate_cycles = 0;
+                    window_cycles = 0;
+                    stable_rate = 0.0;
+                    rate_pending = false;
+                }
+            }
+        }
+        if(next_time >= 0)
+        {
+            if(window_cycles == 0)
+                window_start = cycle_time;
+            if((++window_cycles == RATE_CYCLES) && (next_time > window_start))
+            {
+                window_cycles = 0;
+                Rate(static_cast<double>(RATE_CYCLES) * 1e9 / static_cast<double>(next_time - window_start));
+            }
+        }
+    }
+public:
+    explicit census_scanner(census_file& target):
+        file(target),
+        position(0),
+        valid(0),
+        first_timestamp(-1),
+        last_timestamp(-1),
+        cycle(0),
+        cycle_damaged(false),
+        cycle_offset(0),
+        cycle_packet(0),
+        cycle_time(-1),
+        stable_known(false),
+        stable(0),
+        candidate(0),
+        candidate_cycles(0),
+        window_cycles(0),
+        window_start(0),
+        stable_rate(0.0),
+        rate_pending(false),
+        damage_open(false),
+        since_damage(0)
+    {}
+    void Packet(const uint8_t id, const uint64_t offset, const int64_t timestamp)
+    {
+        if((timestamp >= 0) && (first_timestamp < 0))
+            first_timestamp = timestamp;
+        last_timestamp = timestamp;
+        size_t index = static_cast<size_t>(id - pidRTC);
+        file.counts[index]++;
+        file.packets++;
+        if(damage_open && (++since_damage >= MERGE_PACKETS))
+            CloseDamage();
+        uint16_t bit = static_cast<uint16_t>(1 << index);
+        if(cycle & bit)
+        {
+            CompleteCycle(timestamp);
+            cycle = 0;
+            cycle_damaged = false;
+        }
+        if(cycle == 0)
+        {
+            cycle_offset = offset;
+            cycle_packet = valid;
+            cycle_time = timestamp;
+        }
+        cycle |= bit;
+        valid++;
+    }
+    void Damage(const uint64_t offset, const uint64_t length, const uint64_t crc_failures, const uint64_t resyncs)
+    {
+        file.crc_failures += crc_failures;
+        file.resyncs += resyncs;
+        file.damaged += length;
+        cycle_damaged = true;
+        if(!damage_open)
+        {
+            damage = Event(tkCorrupted, offset, last_timestamp);
+            damage_open = true;
+        }
+        damage.length = offset + length - damage.offset;
+        damage.crc_failures += crc_failures;
+        damage.resyncs += resyncs;
+        since_damage = 0;
+    }
+    void Finish()
+    {
+        CloseDamage();
+        file.duration = (first_timestamp >= 0) ? last_timestamp - first_timestamp : -1;
+        // The configuration changes are found after the cycles confirming them
+        std::stable_sort(file.timeline.begin(), file.timeline.end(), [](const timeline_event& a, const timeline_event& b)
+        {
+            return a.offset < b.offset;
+        });
+    }
+};
+
+void scan_capture(census_file& file, const int fd)
+{
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    witmotion_packet_parser packet_parser(true);
+    census_scanner scanner(file);
+    std::vector<uint8_t> buffer(READ_SIZE);
+    witmotion_parser_statistics seen{0, 0, 0, 0};
+    uint64_t expected = 0; // End of the last valid packet
+    bool started = false;
+    auto handler = [&packet_parser, &scanner, &seen, &expected, &started](const witmotion_datapacket& packet)
+    {
+        uint64_t start = packet_parser.PacketEnd() - PACKET_SIZE;
+        const witmotion_parser_statistics& statistics = packet_parser.Statistics();
+        uint64_t crc_failures = statistics.crc_failures - seen.crc_failures;
+        uint64_t resyncs = statistics.resyncs - seen.resyncs;
+        // The partial packet at the beginning of the capture is not the damage
+        if(((start > expected) && (started || (start - expected >= PACKET_SIZE))) || (crc_failures > 0) || (resyncs > 0))
+            scanner.Damage(expected, start - expected, crc_failures, resyncs);
+        seen = statistics;
+        expected = packet_parser.PacketEnd();
+        started = true;
+        scanner.Packet(packet.id_byte, start, -1);
+    };
+    for(;;)
+    {
+        ssize_t length = read(fd, buffer.data(), buffer.size());
+        if(length < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            file.failed = true;
+            file.error = std::string("Cannot read ") + file.input + ": " + std::strerror(errno);
+            break;
+        }
+        if(length == 0)
+            break;
+        packet_parser.Feed(buffer.data(), static_cast<size_t>(length), handler);
+    }
+    const witmotion_parser_statistics& statistics = packet_parser.Statistics();
+    uint64_t crc_failures = statistics.crc_failures - seen.crc_failures;
+    uint64_t resyncs = statistics.resyncs - seen.resyncs;
+    if((statistics.bytes - expected >= PACKET_SIZE) || (crc_failures > 0) || (resyncs > 0))
+        scanner.Damage(expected, statistics.bytes - expected, crc_failures, resyncs);
+    scanner.Finish();
+}
+
+void scan_recording(census_file& file)
+{
+    witmotion_recording_reader reader(file.input);
+    if(!reader.Open())
+    {
+        file.failed = true;
+        file.error = reader.Error();
+        return;
+    }
+    file.timestamps = reader.Timestamps();
+    census_scanner scanner(file);
+    std::vector<witmotion_datapacket> packets;
+    std::vector<int64_t> timestamps;
+    const std::vector<witmotion_recording_block>& blocks = reader.Blocks();
+    for(size_t block = 0; block < blocks.size(); block++)
+    {
+        // The damaged block is the corrupted region, the following blocks are decoded independently
+        if(!reader.Read(block, packets, &timestamps))
+        {
+            scanner.Damage(blocks[block].first_packet, blocks[block].packets, 0, 0);
+            continue;
+        }
+        for(size_t i = 0; i < packets.size(); i++)
+        {
+            const witmotion_datapacket& packet = packets[i];
+            uint64_t number = blocks[block].first_packet + i;
+            if((packet.header_byte != WITMOTION_HEADER_BYTE) || !id_registered(packet.id_byte))
+            {
+                file.unknown.insert(packet.id_byte);
+                scanner.Damage(number, 1, 0, 1);
+            }
+            else if(packet_crc(packet) != packet.crc)
+                scanner.Damage(number, 1, 1, 0);
+            else
+                scanner.Packet(packet.id_byte, number, file.timestamps ? timestamps[i] : -1);
+        }
+    }
+    scanner.Finish();
+}
+
+void scan(census_file& file)
+{
+    int fd = open(file.input.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        file.failed = true;
+        file.error = std::string("Cannot open ") + file.input + ": " + std::strerror(errno);
+        return;
+    }
+    uint32_t magic = 0;
+    file.recording = (pread(fd, &magic, sizeof(magic), 0) == sizeof(magic)) && (magic == WITMOTION_RECORDING_MAGIC);
+    if(file.recording)
+        scan_recording(file);
+    else
+        scan_capture(file, fd);
+    close(fd);
+}
+
+void append_census(std::string& out, const uint64_t* counts, const uint64_t packets, const int64_t duration)
+{
+    out += (duration > 0) ? "ID\tQty\tHz\tDescription\n\n" : "ID\tQty\tDescription\n\n";
+    for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+    {
+        if(counts[i] == 0)
+            continue;
+        uint8_t id = static_cast<uint8_t>(pidRTC + i);
+        auto description = witmotion_packet_descriptions.find(id);
+        append(out, "0x%02x\t%llu\t", static_cast<unsigned int>(id), static_cast<unsigned long long>(counts[i]));
+        if(duration > 0)
+            append(out, "%.2f\t", static_cast<double>(counts[i]) * 1e9 / static_cast<double>(duration));
+        out += (description != witmotion_packet_descriptions.end()) ? description->second : std::string();
+        out += '\n';
+    }
+    append(out, "\nTotal messages: %llu\n", static_cast<unsigned long long>(packets));
+}
+
+void append_report(std::string& out, const census_file& file, const size_t events)
+{
+    const char* unit = file.recording ? "packet" : "byte";
+    append(out, "%s: %s, %llu bytes\n\n",
+           file.input.c_str(),
+           file.recording ? (file.timestamps ? "recording with timestamps" : "recording") : "raw capture",
+           static_cast<unsigned long long>(file.size));
+    if(file.failed)
+    {
+        out += "ERROR: " + file.error + "\n\n";
+        return;
+    }
+    append_census(out, file.counts, file.packets, file.duration);
+    uint64_t checked = file.packets + file.crc_failures;
+    append(out, "CRC failures: %llu (%.3f%%), resyncs: %llu, damaged: %llu %ss",
+           static_cast<unsigned long long>(file.crc_failures),
+           (checked > 0) ? 100.0 * static_cast<double>(file.crc_failures) / static_cast<double>(checked) : 0.0,
+           static_cast<unsigned long long>(file.resyncs),
+           static_cast<unsigned long long>(file.damaged),
+           unit);
+    if(!file.unknown.empty())
+    {
+        out += ", unknown IDs [";
+        for(auto i = file.unknown.begin(); i != file.unknown.end(); i++)
+            append(out, " 0x%02x", static_cast<unsigned int>(*i));
+        out += " ]";
+    }
+    out += "\n\n";
+    if(file.timeline.empty())
+    {
+        out += "Timeline: no configuration changes, resyncs or corrupted regions\n\n";
+        return;
+    }
+    append(out, "Timeline, %zu events:\n", file.timeline.size());
+    for(size_t i = 0; (i < file.timeline.size()) && (i < events); i++)
+    {
+        const timeline_event& event = file.timeline[i];
+        append(out, "  %s %llu, packet %llu", unit, static_cast<unsigned long long>(event.offset), static_cast<unsigned long long>(event.packet));
+        if(event.timestamp >= 0)
+            append(out, ", %.3f s", static_cast<double>(event.timestamp) / 1e9);
+        if(event.kind == tkConfiguration)
+            out += ": CONFIGURATION " + event.description + "\n";
+        else
+            append(out, ": %s %llu %ss, %llu CRC failures, %llu resyncs\n",
+                   (event.kind == tkResync) ? "RESYNC" : "CORRUPTED",
+                   static_cast<unsigned long long>(event.length),
+                   unit,
+                   static_cast<unsigned long long>(event.crc_failures),
+                   static_cast<unsigned long long>(event.resyncs));
+    }
+    if(file.timeline.size() > events)
+        append(out, "  ... %zu more events\n", file.timeline.size() - events);
+    out += '\n';
+}
+
+bool collect_inputs(const QStringList& inputs, std::vector<std::unique_ptr<census_file>>& files)
+{
+    std::vector<std::string> paths;
+    for(auto i = inputs.begin(); i != inputs.end(); i++)
+    {
+        std::string input = i->toStdString();
+        struct stat status;
+        if(stat(input.c_str(), &status) != 0)
+        {
+            std::cout << "ERROR: Cannot access " << input << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if(!S_ISDIR(status.st_mode))
+        {
+            paths.push_back(input);
+            continue;
+        }
+        DIR* directory = opendir(input.c_str());
+        if(directory == nullptr)
+        {
+            std::cout << "ERROR: Cannot open input directory " << input << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        for(dirent* entry = readdir(directory); entry != nullptr; entry = readdir(directory))
+        {
+            std::string path = input + "/" + entry->d_name;
+            if((entry->d_name[0] != '.') && (stat(path.c_str(), &status) == 0) && S_ISREG(status.st_mode))
+                paths.push_back(path);
+        }
+        closedir(directory);
+    }
+    std::sort(paths.begin(), paths.end());
+    for(auto i = paths.begin(); i != paths.end(); i++)
+    {
+        struct stat status;
+        std::unique_ptr<census_file> file(new census_file());
+        file->input = *i;
+        file->size = (stat(i->c_str(), &status) == 0) ? static_cast<uint64_t>(status.st_size) : 0;
+        file->recording = false;
+        file->timestamps = false;
+        for(size_t j = 0; j < WITMOTION_METRICS_PACKET_TYPES; j++)
+            file->counts[j] = 0;
+        file->packets = 0;
+        file->crc_failures = 0;
+        file->resyncs = 0;
+        file->damaged = 0;
+        file->duration = -1;
+        file->failed = false;
+        files.push_back(std::move(file));
+    }
+    return true;
+}
+
+/* The files are scanned in parallel, each by one task: the timeline of the file is sequential */
+int run_offline(const QStringList& inputs, const size_t threads, const size_t events, const QString& log_name)
+{
+    std::vector<std::unique_ptr<census_file>> files;
+    if(!collect_inputs(inputs, files))
+        return 1;
+    if(files.empty())
+    {
+        std::cout << "ERROR: No input files found" << std::endl;
+        return 1;
+    }
+    // The largest files are started first, so the tail of the run is filled with the small ones
+    std::vector<census_file*> order;
+    for(auto i = files.begin(); i != files.end(); i++)
+        order.push_back(i->get());
+    std::sort(order.begin(), order.end(), [](const census_file* a, const census_file* b)
+    {
+        return a->size > b->size;
+    });
+    auto start = std::chrono::steady_clock::now();
+    witmotion_task_pool pool(threads);
+    for(auto i = order.begin(); i != order.end(); i++)
+    {
+        census_file* file = *i;
+        pool.Submit([file]()
+        {
+            scan(*file);
+        });
+    }
+    pool.Wait();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string report;
+    report += "\nWITMOTION UART MESSAGE ENUMERATOR BY TWDRAGON\n\n";
+    uint64_t counts[WITMOTION_METRICS_PACKET_TYPES] = {};
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t crc_failures = 0;
+    uint64_t resyncs = 0;
+    size_t failures = 0;
+    for(auto i = files.begin(); i != files.end(); i++)
+    {
+        const census_file& file = **i;
+        append_report(report, file, events);
+        if(file.failed)
+        {
+            failures++;
+            continue;
+        }
+        for(size_t j = 0; j < WITMOTION_METRICS_PACKET_TYPES; j++)
+            counts[j] += file.counts[j];
+        packets += file.packets;
+        bytes += file.size;
+        crc_failures += file.crc_failures;
+        resyncs += file.resyncs;
+    }
+    if(files.size() > 1)
+    {
+        append(report, "All %zu files:\n\n", files.size() - failures);
+        append_census(report, counts, packets, -1);
+        append(report, "CRC failures: %llu, resyncs: %llu\n\n",
+               static_cast<unsigned long long>(crc_failures),
+               static_cast<unsigned long long>(resyncs));
+    }
+    append(report, "Scanned %zu of %zu files, %llu bytes in %.3f s, %.1f MB/s on %zu threads\n",
+           files.size() - failures,
+           files.size(),
+           static_cast<unsigned long long>(bytes),
+           elapsed,
+           static_cast<double>(bytes) / elapsed / 1e6,
+           pool.Threads());
+    std::cout << report << std::flush;
+    if(!log_name.isEmpty())
+    {
+        std::ofstream log(log_name.toStdString(), std::ios::out | std::ios::trunc);
+        if(log << report)
+            std::cout << "Log file written to " << log_name.toStdString() << std::endl;
+        else
+            std::cout << "ERROR: cannot write logfile " << log_name.toStdString() << std::endl;
+    }
+    return (failures == 0) ? 0 : 1;
+}
+
+}
+
 void handle_shutdown(int s)
 {
     // avoid compiler complains ...
@@ -128,8 +902,6 @@ void handle_shutdown(int s)
 
 int main(int argc, char** args)
 {
-    std::cout << "Press Ctrl+C to stop enumeration and see the report" << std::endl;
-
     struct sigaction sigIntHandler;
     sigIntHandler.sa_handler = handle_shutdown;
     sigemptyset(&sigIntHandler.sa_mask);
@@ -159,9 +931,39 @@ int main(int argc, char** args)
     parser.addOption(BaudRateOption);
     parser.addOption(DeviceNameOption);
     parser.addOption(FileNameOption);
+    QCommandLineOption LiveOption(QStringList() << "l" << "live",
+                                  "Live census: per-ID rates, link utilization, CRC failures and inter-arrival histograms refreshed on the screen");
+    QCommandLineOption RefreshOption(QStringList() << "r" << "refresh",
+                                     "Screen refresh rate in the live mode (Hz)",
+                                     "rate",
+                                     "4");
     parser.addOption(IntervalOption);
+    parser.addOption(LiveOption);
+    parser.addOption(RefreshOption);
+    QCommandLineOption InputOption(QStringList() << "i" << "input",
+                                   "Raw capture, compressed recording or directory of them, analysed offline instead of the port. Can be repeated",
+                                   "path");
+    QCommandLineOption ThreadsOption(QStringList() << "t" << "threads",
+                                     "Number of the worker threads for the offline analysis, 0 means hardware concurrency",
+                                     "count",
+                                     "0");
+    QCommandLineOption EventsOption("events",
+                                    "Maximal number of the timeline events printed per file in the offline analysis",
+                                    "count",
+                                    "100");
+    parser.addOption(InputOption);
+    parser.addOption(ThreadsOption);
+    parser.addOption(EventsOption);
     parser.process(app);
 
+    if(parser.isSet(InputOption))
+        return run_offline(parser.values(InputOption),
+                           parser.value(ThreadsOption).toUInt(),
+                           parser.value(EventsOption).toUInt(),
+                           parser.isSet(FileNameOption) ? parser.value(FileNameOption) : QString());
+
+    std::cout << "Press Ctrl+C to stop enumeration and see the report" << std::endl;
+
     QGeneralSensorController controller(parser.value(DeviceNameOption),
                                         static_cast<QSerialPort::BaudRate>(parser.value(BaudRateOption).toInt()));
     controller.setParent(dynamic_cast<QObject*>(&app));
@@ -169,6 +971,16 @@ int main(int argc, char** args)
         controller.SetLog(parser.value(FileNameOption));
     if(parser.isSet(IntervalOption))
         controller.SetInterval(parser.value(IntervalOption).toUInt());
+    if(parser.isSet(LiveOption))
+    {
+        uint32_t refresh = parser.value(RefreshOption).toUInt();
+        if((refresh == 0) || (refresh > 50))
+        {
+            std::cout << "ERROR: The refresh rate should be from 1 to 50 Hz" << std::endl;
+            return 1;
+        }
+        controller.SetLive(1000 / refresh);
+    }
     controller.Start();
 
     return app.exec();
@@ -0,0 +1,258 @@
+#include "witmotion/metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace witmotion
+{
+
+namespace
+{
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool write_all(const int fd, const char* data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Label values escape the backslash, the double quote and the line feed
+std::string label(const std::string& value)
+{
+    std::string result;
+    for(auto i = value.begin(); i != value.end(); i++)
+    {
+        if(*i == '\\' || *i == '\"')
+            result.push_back('\\');
+        if(*i == '\n')
+            result.append("\\n");
+        else
+            result.push_back(*i);
+    }
+    return result;
+}
+
+void family(std::string& output, const char* name, const char* type, const char* help)
+{
+    output.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    output.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void sample(std::string& output, const char* name, const std::string& labels, const double value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", value);
+    output.append(name).append("{").append(labels).append("} ").append(text).append("\n");
+}
+
+void sample(std::string& output, const char* name, const std::string& labels, const uint64_t value)
+{
+    output.append(name).append("{").append(labels).append("} ").append(std::to_string(value)).append("\n");
+}
+
+struct counter_family
+{
+    const char* name;
+    const char* help;
+    uint64_t witmotion_metrics_snapshot::* value;
+};
+
+static const counter_family counters[] =
+{
+    {"witmotion_bytes_total", "Bytes read from the port", &witmotion_metrics_snapshot::bytes},
+    {"witmotion_reads_total", "Port reads returning data", &witmotion_metrics_snapshot::reads},
+    {"witmotion_crc_failures_total", "Packets dropped because of the checksum mismatch", &witmotion_metrics_snapshot::crc_failures},
+    {"witmotion_resyncs_total", "Header bytes followed by an unregistered packet ID", &witmotion_metrics_snapshot::resyncs},
+    {"witmotion_unregistered_packets_total", "Packets not supported by the device class", &witmotion_metrics_snapshot::unregistered},
+    {"witmotion_timeouts_total", "Data timeouts reported by the reader", &witmotion_metrics_snapshot::timeouts},
+    {"witmotion_errors_total", "Errors reported by the reader", &witmotion_metrics_snapshot::errors},
+    {"witmotion_port_opens_total", "Port openings, including the reconnections", &witmotion_metrics_snapshot::port_opens},
+    {"witmotion_config_writes_total", "Configuration commands sent to the sensor", &witmotion_metrics_snapshot::config_writes}
+};
+
+}
+
+witmotion_sensor_metrics::witmotion_sensor_metrics(const std::string &sensor):
+    name(sensor),
+    bytes(0),
+    reads(0),
+    crc_failures(0),
+    resyncs(0),
+    unregistered(0),
+    timeouts(0),
+    errors(0),
+    port_opens(0),
+    config_writes(0),
+    backlog(0),
+    poll_interval(0),
+    last_data(0),
+    read_duration_sum(0)
+{
+    for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+        packets[i].store(0, std::memory_order_relaxed);
+    for(size_t i = 0; i < WITMOTION_METRICS_BUCKETS; i++)
+        read_duration[i].store(0, std::memory_order_relaxed);
+}
+
+const std::string &witmotion_sensor_metrics::Name() const
+{
+    return name;
+}
+
+void witmotion_sensor_metrics::ReadDuration(const int64_t duration)
+{
+    // The bucket i counts the durations up to and including 2^i us, as the Prometheus `le` bound
+    uint64_t us = (duration > 0) ? (static_cast<uint64_t>(duration) + 999) / 1000 : 0;
+    size_t bucket = (us <= 1) ? 0 : static_cast<size_t>(64 - __builtin_clzll(us - 1));
+    if(bucket >= WITMOTION_METRICS_BUCKETS)
+        bucket = WITMOTION_METRICS_BUCKETS - 1;
+    read_duration[bucket].fetch_add(1, std::memory_order_relaxed);
+    read_duration_sum.fetch_add((duration > 0) ? static_cast<uint64_t>(duration) : 0, std::memory_order_relaxed);
+}
+
+witmotion_metrics_snapshot witmotion_sensor_metrics::Snapshot() const
+{
+    witmotion_metrics_snapshot snapshot;
+    snapshot.bytes = bytes.load(std::memory_order_relaxed);
+    snapshot.reads = reads.load(std::memory_order_relaxed);
+    for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+        snapshot.packets[i] = packets[i].load(std::memory_order_relaxed);
+    snapshot.crc_failures = crc_failures.load(std::memory_order_relaxed);
+    snapshot.resyncs = resyncs.load(std::memory_order_relaxed);
+    snapshot.unregistered = unregistered.load(std::memory_order_relaxed);
+    snapshot.timeouts = timeouts.load(std::memory_order_relaxed);
+    snapshot.errors = errors.load(std::memory_order_relaxed);
+    snapshot.port_opens = port_opens.load(std::memory_order_relaxed);
+    snapshot.config_writes = config_writes.load(std::memory_order_relaxed);
+    snapshot.backlog = backlog.load(std::memory_order_relaxed);
+    snapshot.poll_interval = poll_interval.load(std::memory_order_relaxed);
+    snapshot.last_data = last_data.load(std::memory_order_relaxed);
+    for(size_t i = 0; i < WITMOTION_METRICS_BUCKETS; i++)
+        snapshot.read_duration[i] = read_duration[i].load(std::memory_order_relaxed);
+    snapshot.read_duration_sum = read_duration_sum.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+witmotion_sensor_metrics *witmotion_metrics_registry::Sensor(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(guard);
+    for(auto i = sensors.begin(); i != sensors.end(); i++)
+        if((*i)->Name() == name)
+            return i->get();
+    sensors.emplace_back(new witmotion_sensor_metrics(name));
+    return sensors.back().get();
+}
+
+std::string witmotion_metrics_registry::Format()
+{
+    std::vector<std::string> labels;
+    std::vector<witmotion_metrics_snapshot> snapshots;
+    {
+        std::lock_guard<std::mutex> lock(guard);
+        for(auto i = sensors.begin(); i != sensors.end(); i++)
+        {
+            labels.push_back("sensor=\"" + label((*i)->Name()) + "\"");
+            snapshots.push_back((*i)->Snapshot());
+        }
+    }
+    int64_t now = steady_timestamp();
+    std::string output;
+    output.reserve(4096 * (snapshots.size() + 1));
+    for(size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++)
+    {
+        family(output, counters[c].name, "counter", counters[c].help);
+        for(size_t s = 0; s < snapshots.size(); s++)
+            sample(output, counters[c].name, labels[s], snapshots[s].*(counters[c].value));
+    }
+    family(output, "witmotion_packets_total", "counter", "Packets delivered by the parser");
+    for(size_t s = 0; s < snapshots.size(); s++)
+        for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+        {
+            char id[16];
+            std::snprintf(id, sizeof(id), ",id=\"0x%02X\"", static_cast<unsigned int>(pidRTC + i));
+            sample(output, "witmotion_packets_total", labels[s] + id, snapshots[s].packets[i]);
+        }
+    family(output, "witmotion_backlog_bytes", "gauge", "Bytes pending in the port buffer at the last read");
+    for(size_t s = 0; s < snapshots.size(); s++)
+        sample(output, "witmotion_backlog_bytes", labels[s], static_cast<double>(snapshots[s].backlog));
+    family(output, "witmotion_poll_interval_seconds", "gauge", "Poll interval of the reader");
+    for(size_t s = 0; s < snapshots.size(); s++)
+        sample(output, "witmotion_poll_interval_seconds", labels[s], static_cast<double>(snapshots[s].poll_interval) / 1e3);
+    family(output, "witmotion_data_age_seconds", "gauge", "Time since the last read returning data");
+    for(size_t s = 0; s < snapshots.size(); s++)
+        if(snapshots[s].last_data != 0)
+            sample(output, "witmotion_data_age_seconds", labels[s], static_cast<double>(now - snapshots[s].last_data) / 1e9);
+    family(output, "witmotion_read_duration_seconds", "histogram", "Duration of the read, parsing and delivery per poll");
+    for(size_t s = 0; s < snapshots.size(); s++)
+    {
+        uint64_t cumulative = 0;
+        for(size_t i = 0; i < WITMOTION_METRICS_BUCKETS; i++)
+        {
+            cumulative += snapshots[s].read_duration[i];
+            char bound[40];
+            if(i + 1 < WITMOTION_METRICS_BUCKETS)
+                std::snprintf(bound, sizeof(bound), ",le=\"%.9g\"", static_cast<double>(1ULL << i) / 1e6);
+            else
+                std::snprintf(bound, sizeof(bound), ",le=\"+Inf\"");
+            sample(output, "witmotion_read_duration_seconds_bucket", labels[s] + bound, cumulative);
+        }
+        sample(output, "witmotion_read_duration_seconds_sum", labels[s], static_cast<double>(snapshots[s].read_duration_sum) / 1e9);
+        sample(output, "witmotion_read_duration_seconds_count", labels[s], cumulative);
+    }
+    return output;
+}
+
+bool witmotion_metrics_registry::WriteTextfile(const std::string &file)
+{
+    std::string output = Format();
+    std::string temporary = file + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        error = "Cannot create " + temporary + ": " + std::strerror(errno);
+        return false;
+    }
+    if(!write_all(fd, output.data(), output.size()))
+    {
+        error = "Cannot write " + temporary + ": " + std::strerror(errno);
+        close(fd);
+        unlink(temporary.c_str());
+        return false;
+    }
+    close(fd);
+    if(rename(temporary.c_str(), file.c_str()) != 0)
+    {
+        error = "Cannot replace " + file + ": " + std::strerror(errno);
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+const std::string &witmotion_metrics_registry::Error() const
+{
+    return error;
+}
+
+}
@@ -0,0 +1,34 @@
+#include "witmotion/parser.h"
+
+namespace witmotion
+{
+
+witmotion_packet_parser::witmotion_packet_parser(const bool validation):
+    read_state(rsClear),
+    read_cell(pidRTC),
+    validate(validation),
+    statistics{0, 0, 0, 0},
+    packet_end(0)
+{}
+
+void witmotion_packet_parser::SetValidation(const bool value)
+{
+    validate = value;
+}
+
+void witmotion_packet_parser::Reset()
+{
+    read_state = rsClear;
+}
+
+const witmotion_parser_statistics &witmotion_packet_parser::Statistics() const
+{
+    return statistics;
+}
+
+uint64_t witmotion_packet_parser::PacketEnd() const
+{
+    return packet_end;
+}
+
+}
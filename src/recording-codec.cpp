@@ -0,0 +1,240 @@
+#include "witmotion/parser.h"
+#include "witmotion/codec.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QString>
+#include <QStringList>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef WITMOTION_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace witmotion;
+
+namespace
+{
+
+struct encoded_block
+{
+    size_t first;
+    size_t count;
+    int64_t first_timestamp;
+    std::vector<uint8_t> payload;
+};
+
+double seconds_since(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void write_packet(std::ostream& out, const witmotion_datapacket& packet)
+{
+    // The structure is padded, the wire representation is composed byte-by-byte
+    char data[11];
+    data[0] = static_cast<char>(packet.header_byte);
+    data[1] = static_cast<char>(packet.id_byte);
+    std::memcpy(data + 2, packet.datastore.raw, 8);
+    data[10] = static_cast<char>(packet.crc);
+    out.write(data, sizeof(data));
+}
+
+int decode_recording(const std::string& input, const std::string& output)
+{
+    witmotion_recording_reader reader(input);
+    if(!reader.Open())
+    {
+        std::cout << "ERROR: " << reader.Error() << std::endl;
+        return 1;
+    }
+    if(reader.Recovered())
+        std::cout << "WARNING: Block index is missing, recovered " << reader.Blocks().size() << " complete blocks" << std::endl;
+    std::ofstream capture(output, std::ios::binary | std::ios::trunc);
+    if(!capture.is_open())
+    {
+        std::cout << "ERROR: Cannot create capture file " << output << std::endl;
+        return 1;
+    }
+    std::vector<witmotion_datapacket> packets;
+    for(size_t i = 0; i < reader.Blocks().size(); i++)
+    {
+        if(!reader.Read(i, packets))
+        {
+            std::cout << "ERROR: Block " << i << " is damaged" << std::endl;
+            return 1;
+        }
+        for(auto packet = packets.begin(); packet != packets.end(); packet++)
+            write_packet(capture, *packet);
+    }
+    std::cout << "Decoded " << reader.Packets() << " packets into " << output << std::endl;
+    return 0;
+}
+
+}
+
+int main(int argc, char** args)
+{
+    QCoreApplication app(argc, args);
+    app.setApplicationVersion(QString(library_version().c_str()));
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WITMOTION RECORDING CODEC");
+    parser.addHelpOption();
+    QCommandLineOption FileOption(QStringList() << "f" << "file",
+                                  "Raw byte stream captured from the sensor port, or the recording with --decode",
+                                  "capture.bin");
+    parser.addOption(FileOption);
+    QCommandLineOption OutputOption(QStringList() << "o" << "output",
+                                    "Output file: the recording, or the raw capture with --decode. Without it only the compression report is produced",
+                                    "capture.wmr");
+    parser.addOption(OutputOption);
+    QCommandLineOption BlockOption(QStringList() << "b" << "block",
+                                   "Number of packets per block",
+                                   "packets",
+                                   "4096");
+    parser.addOption(BlockOption);
+    QCommandLineOption DecodeOption("decode",
+                                    "Decode the recording back into the raw capture");
+    parser.addOption(DecodeOption);
+    QCommandLineOption ValidateOption("validate",
+                                      "Accept only valid datapackets");
+    parser.addOption(ValidateOption);
+    parser.process(app);
+
+    if(!parser.isSet(FileOption))
+    {
+        std::cout << "ERROR: Input file is not specified" << std::endl;
+        return 1;
+    }
+    std::string filename = parser.value(FileOption).toStdString();
+    if(parser.isSet(DecodeOption))
+    {
+        if(!parser.isSet(OutputOption))
+        {
+            std::cout << "ERROR: Output file is not specified" << std::endl;
+            return 1;
+        }
+        return decode_recording(filename, parser.value(OutputOption).toStdString());
+    }
+    size_t block_packets = parser.value(BlockOption).toUInt();
+    if(block_packets == 0)
+    {
+        std::cout << "ERROR: Invalid block size specified" << std::endl;
+        return 1;
+    }
+
+    std::ifstream capture(filename, std::ios::binary);
+    if(!capture.is_open())
+    {
+        std::cout << "ERROR: Cannot open capture file " << filename << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> raw((std::istreambuf_iterator<char>(capture)), std::istreambuf_iterator<char>());
+    std::vector<witmotion_datapacket> packets;
+    packets.reserve(raw.size() / 11);
+    witmotion_packet_parser packet_parser(parser.isSet(ValidateOption));
+    packet_parser.Feed(raw.data(), raw.size(), [&packets](const witmotion_datapacket& packet)
+    {
+        packets.push_back(packet);
+    });
+    if(packets.empty())
+    {
+        std::cout << "ERROR: No packets found in " << filename << std::endl;
+        return 1;
+    }
+    std::cout << "Parsed " << packets.size() << " packets from " << raw.size() << " bytes, "
+              << packet_parser.Statistics().resyncs << " resynchronizations" << std::endl << std::endl;
+
+    // Encoding into memory, to measure the codec alone
+    std::vector<encoded_block> blocks;
+    witmotion_packet_block_encoder encoder(false, block_packets);
+    size_t encoded_size = WITMOTION_RECORDING_HEADER_SIZE + WITMOTION_RECORDING_FOOTER_SIZE;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t first = 0; first < packets.size(); first += block_packets)
+    {
+        size_t count = std::min(block_packets, packets.size() - first);
+        encoder.Reset();
+        for(size_t i = first; i < first + count; i++)
+            encoder.Push(packets[i]);
+        blocks.push_back(encoded_block{first, count, encoder.FirstTimestamp(), encoder.Payload()});
+        encoded_size += WITMOTION_RECORDING_BLOCK_HEADER_SIZE + WITMOTION_RECORDING_INDEX_ENTRY_SIZE + encoder.Payload().size();
+    }
+    double encode_time = seconds_since(start);
+
+    std::vector<witmotion_datapacket> decoded(packets.size());
+    start = std::chrono::steady_clock::now();
+    bool valid = true;
+    for(auto i = blocks.begin(); i != blocks.end(); i++)
+        valid = valid && decode_packet_block(i->payload.data(), i->payload.size(), i->count, i->first_timestamp,
+                                             false, &decoded[i->first], nullptr);
+    double decode_time = seconds_since(start);
+    for(size_t i = 0; valid && i < packets.size(); i++)
+        valid = (packets[i].header_byte == decoded[i].header_byte) &&
+                (packets[i].id_byte == decoded[i].id_byte) &&
+                (std::memcmp(packets[i].datastore.raw, decoded[i].datastore.raw, 8) == 0) &&
+                (packets[i].crc == decoded[i].crc);
+    if(!valid)
+    {
+        std::cout << "ERROR: Round trip verification failed" << std::endl;
+        return 1;
+    }
+
+    double packet_bytes = 11.0 * packets.size();
+    std::cout.precision(3);
+    std::cout << std::fixed
+              << "Raw packets:\t" << static_cast<size_t>(packet_bytes) << " bytes" << std::endl
+              << "Recording:\t" << encoded_size << " bytes, ratio " << packet_bytes / encoded_size
+              << ", " << 8.0 * encoded_size / packets.size() << " bits per packet" << std::endl
+              << "\tencode " << packet_bytes / encode_time / 1e6 << " MB/s, "
+              << encode_time * 1e9 / packets.size() << " ns/packet" << std::endl
+              << "\tdecode " << packet_bytes / decode_time / 1e6 << " MB/s, "
+              << decode_time * 1e9 / packets.size() << " ns/packet, round trip verified" << std::endl;
+#ifdef WITMOTION_HAVE_ZLIB
+    // gzip -6 applied to the capture: compress2 wraps the deflate stream into the 6-byte zlib container,
+    // the gzip one takes 18 bytes, so 12 bytes are added
+    std::vector<uint8_t> wire(static_cast<size_t>(packet_bytes));
+    for(size_t i = 0; i < packets.size(); i++)
+    {
+        wire[11 * i] = packets[i].header_byte;
+        wire[11 * i + 1] = packets[i].id_byte;
+        std::memcpy(&wire[11 * i + 2], packets[i].datastore.raw, 8);
+        wire[11 * i + 10] = packets[i].crc;
+    }
+    uLongf deflated_size = compressBound(static_cast<uLong>(wire.size()));
+    std::vector<uint8_t> deflated(deflated_size);
+    start = std::chrono::steady_clock::now();
+    int status = compress2(deflated.data(), &deflated_size, wire.data(), static_cast<uLong>(wire.size()), 6);
+    double deflate_time = seconds_since(start);
+    if(status == Z_OK)
+        std::cout << "gzip -6:\t" << deflated_size + 12 << " bytes, ratio " << packet_bytes / (deflated_size + 12)
+                  << ", " << 8.0 * (deflated_size + 12) / packets.size() << " bits per packet" << std::endl
+                  << "\tencode " << packet_bytes / deflate_time / 1e6 << " MB/s" << std::endl;
+#else
+    std::cout << "gzip comparison is not available, the tool is built without zlib" << std::endl;
+#endif
+    std::cout << std::endl;
+
+    if(parser.isSet(OutputOption))
+    {
+        std::string output = parser.value(OutputOption).toStdString();
+        witmotion_recording_writer writer(output, false, block_packets);
+        bool written = writer.Open();
+        for(auto i = packets.begin(); written && i != packets.end(); i++)
+            written = writer.Push(*i);
+        written = writer.Close() && written;
+        if(!written)
+        {
+            std::cout << "ERROR: " << writer.Error() << std::endl;
+            return 1;
+        }
+        std::cout << "Recording written to " << output << std::endl;
+    }
+    return 0;
+}
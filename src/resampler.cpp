@@ -0,0 +1,380 @@
+#include "witmotion/resampler.h"
+#include "witmotion/util.h"
+
+#include <chrono>
+#include <cmath>
+
+namespace witmotion
+{
+
+static int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void slerp(const double* from, const double* to, const double alpha, double* result)
+{
+    double target[4] = {to[0], to[1], to[2], to[3]};
+    double cosine = from[0] * to[0] + from[1] * to[1] + from[2] * to[2] + from[3] * to[3];
+    // q and -q represent the same rotation, the shortest path is selected
+    if(cosine < 0.0)
+    {
+        cosine = -cosine;
+        for(size_t i = 0; i < 4; i++)
+            target[i] = -target[i];
+    }
+    double a = 1.0 - alpha;
+    double b = alpha;
+    if(cosine < 0.9995)
+    {
+        double theta = std::acos(cosine);
+        double sine = std::sin(theta);
+        a = std::sin((1.0 - alpha) * theta) / sine;
+        b = std::sin(alpha * theta) / sine;
+    }
+    double norm = 0.0;
+    for(size_t i = 0; i < 4; i++)
+    {
+        result[i] = a * from[i] + b * target[i];
+        norm += result[i] * result[i];
+    }
+    // Linear fallback for the close quaternions requires renormalization
+    norm = (norm > 0.0) ? 1.0 / std::sqrt(norm) : 0.0;
+    for(size_t i = 0; i < 4; i++)
+        result[i] *= norm;
+}
+
+witmotion_resampler::witmotion_resampler(const int64_t delay,
+                                         const size_t depth):
+    latency(delay)
+{
+    for(size_t i = 0; i < chCount; i++)
+        channels[i].ring.resize((depth > 1) ? depth : 2);
+    Reset();
+}
+
+int64_t witmotion_resampler::Latency() const
+{
+    std::lock_guard<std::mutex> lock(guard);
+    return latency;
+}
+
+void witmotion_resampler::SetLatency(const int64_t delay)
+{
+    std::lock_guard<std::mutex> lock(guard);
+    latency = delay;
+}
+
+void witmotion_resampler::Store(const channel_id id,
+                                const int64_t timestamp,
+                                const double *value,
+                                const size_t count)
+{
+    channel& current = channels[id];
+    current.head = (current.head + 1) % current.ring.size();
+    if(current.size < current.ring.size())
+        current.size++;
+    sample& stored = current.ring[current.head];
+    stored.timestamp = timestamp;
+    for(size_t i = 0; i < count; i++)
+        stored.value[i] = value[i];
+}
+
+void witmotion_resampler::Push(const witmotion_datapacket &packet, const int64_t timestamp)
+{
+    float x, y, z, w;
+    double values[4];
+    std::lock_guard<std::mutex> lock(guard);
+    switch(static_cast<witmotion_packet_id>(packet.id_byte))
+    {
+    case pidAcceleration:
+        decode_accelerations(packet, x, y, z, w);
+        values[0] = x; values[1] = y; values[2] = z;
+        Store(chAcceleration, timestamp, values, 3);
+        break;
+    case pidAngularVelocity:
+        decode_angular_velocities(packet, x, y, z, w);
+        values[0] = x; values[1] = y; values[2] = z;
+        Store(chAngularVelocity, timestamp, values, 3);
+        break;
+    case pidAngles:
+        decode_angles(packet, x, y, z, w);
+        values[0] = x; values[1] = y; values[2] = z;
+        Store(chAngles, timestamp, values, 3);
+        break;
+    case pidMagnetometer:
+        decode_magnetometer(packet, x, y, z, w);
+        values[0] = x; values[1] = y; values[2] = z;
+        Store(chMagnetometer, timestamp, values, 3);
+        break;
+    case pidOrientation:
+        decode_orientation(packet, x, y, z, w);
+        values[0] = x; values[1] = y; values[2] = z; values[3] = w;
+        Store(chOrientation, timestamp, values, 4);
+        return;
+    case pidAltimeter:
+        decode_altimeter(packet, values[0], values[1]);
+        Store(chAltimeter, timestamp, values, 2);
+        return;
+    default:
+        return;
+    }
+    // Temperature is transmitted along with all the 3-axis measurements
+    values[0] = w;
+    Store(chTemperature, timestamp, values, 1);
+}
+
+void witmotion_resampler::Push(const witmotion_datapacket &packet)
+{
+    Push(packet, steady_timestamp());
+}
+
+bool witmotion_resampler::Interpolate(const channel_id id, const int64_t timestamp, double *value)
+{
+    static const size_t components[chCount] = {3, 3, 3, 3, 4, 1, 2};
+    const channel& current = channels[id];
+    if(current.size == 0)
+        return false;
+    const size_t count = components[id];
+    const size_t depth = current.ring.size();
+    const sample* newer = &current.ring[current.head];
+    if(timestamp >= newer->timestamp)
+    {
+        if(timestamp > newer->timestamp)
+            underruns++;
+        for(size_t i = 0; i < count; i++)
+            value[i] = newer->value[i];
+        return true;
+    }
+    const sample* older = nullptr;
+    for(size_t k = 1; k < current.size; k++)
+    {
+        const sample* candidate = &current.ring[(current.head + depth - k) % depth];
+        if(candidate->timestamp <= timestamp)
+        {
+            older = candidate;
+            break;
+        }
+        newer = candidate;
+    }
+    if(older == nullptr)
+    {
+        overruns++;
+        for(size_t i = 0; i < count; i++)
+            value[i] = newer->value[i];
+        return true;
+    }
+    int64_t span = newer->timestamp - older->timestamp;
+    double alpha = (span > 0) ? static_cast<double>(timestamp - older->timestamp) / static_cast<double>(span) : 0.0;
+    switch(id)
+    {
+    case chOrientation:
+        slerp(older->value, newer->value, alpha, value);
+        break;
+    case chAngles:
+        // Shortest arc, the angles are wrapped to [-180, 180) degrees
+        for(size_t i = 0; i < count; i++)
+        {
+            double difference = std::remainder(newer->value[i] - older->value[i], 360.0);
+            value[i] = std::remainder(older->value[i] + alpha * difference, 360.0);
+        }
+        break;
+    default:
+        for(size_t i = 0; i < count; i++)
+            value[i] = older->value[i] + alpha * (newer->value[i] - older->value[i]);
+        break;
+    }
+    return true;
+}
+
+bool witmotion_resampler::Sample(const int64_t timestamp, witmotion_frame &frame)
+{
+    double values[4];
+    std::lock_guard<std::mutex> lock(guard);
+    frame.timestamp = timestamp - latency;
+    frame.mask = 0;
+    if(Interpolate(chAcceleration, frame.timestamp, values))
+    {
+        for(size_t i = 0; i < 3; i++)
+            frame.acceleration[i] = static_cast<float>(values[i]);
+        frame.mask |= witmotion_frame::Bit(pidAcceleration);
+    }
+    if(Interpolate(chAngularVelocity, frame.timestamp, values))
+    {
+        for(size_t i = 0; i < 3; i++)
+            frame.angular_velocity[i] = static_cast<float>(values[i]);
+        frame.mask |= witmotion_frame::Bit(pidAngularVelocity);
+    }
+    if(Interpolate(chAngles, frame.timestamp, values))
+    {
+        for(size_t i = 0; i < 3; i++)
+            frame.angles[i] = static_cast<float>(values[i]);
+        frame.mask |= witmotion_frame::Bit(pidAngles);
+    }
+    if(Interpolate(chMagnetometer, frame.timestamp, values))
+    {
+        for(size_t i = 0; i < 3; i++)
+            frame.magnetic_field[i] = static_cast<float>(values[i]);
+        frame.mask |= witmotion_frame::Bit(pidMagnetometer);
+    }
+    if(Interpolate(chOrientation, frame.timestamp, values))
+    {
+        for(size_t i = 0; i < 4; i++)
+            frame.orientation[i] = static_cast<float>(values[i]);
+        frame.mask |= witmotion_frame::Bit(pidOrientation);
+    }
+    if(Interpolate(chAltimeter, frame.timestamp, values))
+    {
+        frame.pressure = values[0];
+        frame.altitude = values[1];
+        frame.mask |= witmotion_frame::Bit(pidAltimeter);
+    }
+    if(Interpolate(chTemperature, frame.timestamp, values))
+        frame.temperature = static_cast<float>(values[0]);
+    return frame.mask != 0;
+}
+
+uint64_t witmotion_resampler::Underruns() const
+{
+    std::lock_guard<std::mutex> lock(guard);
+    return underruns;
+}
+
+uint64_t witmotion_resampler::Overruns() const
+{
+    std::lock_guard<std::mutex> lock(guard);
+    return overruns;
+}
+
+void witmotion_resampler::Reset()
+{
+    std::lock_guard<std::mutex> lock(guard);
+    for(size_t i = 0; i < chCount; i++)
+    {
+        channels[i].head = 0;
+        channels[i].size = 0;
+    }
+    underruns = 0;
+    overruns = 0;
+}
+
+witmotion_resampling_clock::witmotion_resampling_clock(witmotion_resampler *source,
+                                                       witmotion_frame_sink *consumer,
+                                                       const int64_t interval):
+    resampler(source),
+    sink(consumer),
+    period((interval > 0) ? interval : 1),
+    running(false),
+    ticks(0),
+    missed(0)
+{}
+
+witmotion_resampling_clock::~witmotion_resampling_clock()
+{
+    Stop();
+}
+
+witmotion_frame_queue::witmotion_frame_queue(const size_t depth):
+    capacity((depth > 0) ? depth : 1),
+    dropped(0)
+{
+    frames.reserve(capacity);
+}
+
+void witmotion_frame_queue::Consume(const witmotion_frame &frame)
+{
+    std::lock_guard<std::mutex> lock(guard);
+    if(frames.size() >= capacity)
+    {
+        dropped++;
+        return;
+    }
+    frames.push_back(frame);
+}
+
+void witmotion_frame_queue::Take(std::vector<witmotion_frame> &taken)
+{
+    taken.clear();
+    taken.reserve(capacity);
+    std::lock_guard<std::mutex> lock(guard);
+    std::swap(frames, taken);
+}
+
+uint64_t witmotion_frame_queue::Dropped() const
+{
+    std::lock_guard<std::mutex> lock(guard);
+    return dropped;
+}
+
+void witmotion_resampling_clock::Run()
+{
+    const std::chrono::nanoseconds interval(period);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + interval;
+    witmotion_frame frame = witmotion_frame();
+    while(running)
+    {
+        std::this_thread::sleep_until(deadline);
+        int64_t lateness = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - deadline).count();
+        if(lateness >= period)
+        {
+            int64_t skipped = lateness / period;
+            missed += static_cast<uint64_t>(skipped);
+            deadline += interval * skipped;
+            lateness -= skipped * period;
+        }
+        {
+            std::lock_guard<std::mutex> lock(jitter_guard);
+            jitter.Push(static_cast<double>(lateness));
+        }
+        if(resampler->Sample(std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count(), frame))
+        {
+            if(sink != nullptr)
+                sink->Consume(frame);
+            ticks++;
+        }
+        deadline += interval;
+    }
+}
+
+void witmotion_resampling_clock::Start()
+{
+    if(running)
+        return;
+    running = true;
+    worker = std::thread(&witmotion_resampling_clock::Run, this);
+}
+
+void witmotion_resampling_clock::Stop()
+{
+    running = false;
+    if(worker.joinable())
+        worker.join();
+}
+
+bool witmotion_resampling_clock::Running() const
+{
+    return running;
+}
+
+int64_t witmotion_resampling_clock::Period() const
+{
+    return period;
+}
+
+uint64_t witmotion_resampling_clock::Ticks() const
+{
+    return ticks;
+}
+
+uint64_t witmotion_resampling_clock::Missed() const
+{
+    return missed;
+}
+
+witmotion_running_statistics witmotion_resampling_clock::Jitter() const
+{
+    std::lock_guard<std::mutex> lock(jitter_guard);
+    return jitter;
+}
+
+}
@@ -1,16 +1,33 @@
 #include "witmotion/serial.h"
+#include "witmotion/trace.h"
+#include <algorithm>
+#include <chrono>
 #include <exception>
 #include <unistd.h>
 
 namespace witmotion
 {
 
+namespace
+{
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
 void QBaseSerialWitmotionSensorReader::ReadData()
 {
     if(configuring)
         return;
+    WITMOTION_TRACE(read_start);
+    int64_t started = (metrics != nullptr) ? steady_timestamp() : 0;
     qint64 bytes_read;
+    qint64 bytes_total = 0;
     qint64 bytes_avail = witmotion_port->bytesAvailable();
+    WITMOTION_TRACE1(read_available, bytes_avail);
     // If no bytes available for longer than "timeout_ms" period, then raise error
     // Ignore if timeout_ms is zero.
     if((bytes_avail <= 0) && (timeout_ms > 0)) // either zero bytes available, or stream error (bytesAvailable == -1)
@@ -18,95 +35,260 @@ void QBaseSerialWitmotionSensorReader::ReadData()
         timeout_counter += return_interval;
         if(timeout_counter >= timeout_ms)
         {
+            if(metrics != nullptr)
+                metrics->timeouts.fetch_add(1, std::memory_order_relaxed);
             emit Error("Timed out waiting for data, please check device connection and baudrate!");
         }
     }
     if(bytes_avail > 0)
     {
         timeout_counter = 0;
-        bytes_read = witmotion_port->read(reinterpret_cast<char*>(raw_data), 128);
-        for(qint64 i = 0; i < bytes_read; i++)
+        // The event-driven reader drains the port, since `readyRead` is not repeated for the data left unread
+        do
         {
-            uint8_t current_byte = raw_data[i];
-            if(read_state == rsClear)
-            {
-                read_state = (current_byte == WITMOTION_HEADER_BYTE) ? rsUnknown : rsClear;
-            }
-            else if(read_state == rsUnknown)
+            bytes_read = witmotion_port->read(reinterpret_cast<char*>(raw_data), 128);
+            if(bytes_read <= 0)
+                break;
+            WITMOTION_TRACE1(read_chunk, bytes_read);
+            bytes_total += bytes_read;
+            int64_t read_time = (timing != nullptr) ? steady_timestamp() : 0;
+            parser.Feed(raw_data, static_cast<size_t>(bytes_read), [this, read_time](const witmotion_datapacket& packet)
             {
-                if(id_registered(current_byte))
-                {
-                    read_cell = static_cast<witmotion_packet_id>(current_byte);
-                    counts[read_cell] = 0;
-                    packets[read_cell].header_byte = WITMOTION_HEADER_BYTE;
-                    packets[read_cell].id_byte = read_cell;
-                    read_state = rsRead;
-                }
+                WITMOTION_TRACE1(packet, packet.id_byte);
+                if(timing != nullptr)
+                    timing->Arrival(packet.id_byte, read_time);
+                if(metrics != nullptr)
+                    metrics->Packet(packet.id_byte);
+                // Direct delivery bypasses the queued signal which allocates an event per packet
+                if(packet_sink != nullptr)
+                    packet_sink->Consume(packet);
                 else
-                    read_state = rsClear;
-            }
-            else
-            {
-                if(counts[read_cell] == 8)
-                {
-                    packets[read_cell].crc = current_byte;
-                    uint8_t current_crc = packets[read_cell].header_byte + packets[read_cell].id_byte;
-                    for(uint8_t i = 0; i < 8; i++)
-                        current_crc += packets[read_cell].datastore.raw[i];
-                    if(!validate || (current_crc == packets[read_cell].crc))
-                        emit Acquired(packets[read_cell]);
-                    read_state = rsClear;
-                }
-                else
-                    packets[read_cell].datastore.raw[counts[read_cell]++] = current_byte;
-            }
+                    emit Acquired(packet);
+            });
         }
+        while(event_driven && (witmotion_port->bytesAvailable() > 0));
+        if(metrics != nullptr)
+            ReportMetrics(started, witmotion_port->bytesAvailable());
     }
+    if(latency_budget > 0)
+    {
+        window_bytes += static_cast<uint64_t>(bytes_total);
+        int64_t now = steady_timestamp();
+        if(now - window_start >= 1000000000)
+        {
+            observed_rate = static_cast<double>(window_bytes) * 1e9 / static_cast<double>(now - window_start);
+            window_bytes = 0;
+            window_start = now;
+            if((output_frequency <= 0.0) || (output_types == 0))
+                AdaptPollInterval(false);
+        }
+    }
+    WITMOTION_TRACE1(read_end, bytes_total);
+}
+
+void QBaseSerialWitmotionSensorReader::AdaptPollInterval(const bool forced)
+{
+    if((latency_budget == 0) || (poll_timer == nullptr))
+        return;
+    uint32_t interval = witmotion_poll_interval(static_cast<uint32_t>(port_rate),
+                                                output_frequency,
+                                                output_types,
+                                                observed_rate,
+                                                AdaptiveIntervalBound());
+    // The observed rate fluctuates, so it changes the interval by more than a quarter only
+    if(!forced && (interval * 4 > return_interval * 3) && (interval * 4 < return_interval * 5))
+        return;
+    if(!user_defined_timeout)
+    {
+        uint32_t periods = (output_frequency > 0.0) ? static_cast<uint32_t>(3000.0 / output_frequency) : 1000;
+        timeout_ms = std::max(3 * interval, periods);
+    }
+    if(interval == return_interval)
+        return;
+    return_interval = interval;
+    poll_timer->setInterval(static_cast<int>(return_interval));
+    if(metrics != nullptr)
+        metrics->poll_interval.store(return_interval, std::memory_order_relaxed);
+    ttyout << "Adjusting poll interval to " << return_interval << " ms" << ENDL;
+}
+
+void QBaseSerialWitmotionSensorReader::ReportMetrics(const int64_t started, const qint64 backlog)
+{
+    // The parser counters are accumulated per poll, so only the packet counter is touched per packet
+    const witmotion_parser_statistics& statistics = parser.Statistics();
+    metrics->bytes.fetch_add(statistics.bytes - reported.bytes, std::memory_order_relaxed);
+    metrics->crc_failures.fetch_add(statistics.crc_failures - reported.crc_failures, std::memory_order_relaxed);
+    metrics->resyncs.fetch_add(statistics.resyncs - reported.resyncs, std::memory_order_relaxed);
+    metrics->reads.fetch_add(1, std::memory_order_relaxed);
+    metrics->backlog.store(backlog, std::memory_order_relaxed);
+    reported = statistics;
+    int64_t now = steady_timestamp();
+    metrics->last_data.store(now, std::memory_order_relaxed);
+    metrics->ReadDuration(now - started);
+}
+
+bool QBaseSerialWitmotionSensorReader::WriteConfig(const witmotion_config_packet &packet)
+{
+    static uint8_t serial_datapacket[5];
+    serial_datapacket[0] = packet.header_byte;
+    serial_datapacket[1] = packet.key_byte;
+    serial_datapacket[2] = packet.address_byte;
+    serial_datapacket[3] = packet.setting.raw[0];
+    serial_datapacket[4] = packet.setting.raw[1];
+    quint64 written;
+    ttyout << "Sending configuration packet " << HEX << "0x" << packet.address_byte << DEC << ENDL;
+    written = witmotion_port->write(reinterpret_cast<const char*>(serial_datapacket), 5);
+    witmotion_port->waitForBytesWritten();
+    WITMOTION_TRACE2(config_write, packet.address_byte, written);
+    if(written != 5)
+        return false;
+    if(metrics != nullptr)
+        metrics->config_writes.fetch_add(1, std::memory_order_relaxed);
+    if(packet.address_byte == ridOutputFrequency)
+    {
+        output_frequency = witmotion_output_frequency_hz(packet.setting.raw[0]);
+        configured_frequency.store(output_frequency, std::memory_order_relaxed);
+    }
+    else if(packet.address_byte == ridOutputValueSet)
+    {
+        // Bit i of the setting enables the packet ID 0x50 + i
+        output_types = static_cast<uint32_t>(__builtin_popcount(packet.setting.raw[0] | ((packet.setting.raw[1] & 0x07) << 8)));
+    }
+    ttyout << "Configuration packet sent, flushing buffers..." << ENDL;
+    witmotion_port->flush();
+    if(packet.address_byte == ridPortBaudRate)
+    {
+        // The sensor answers at the new rate right after the command, the following commands, e.g. ridSaveSettings, go at it
+        QSerialPort::BaudRate rate = witmotion_port_baud_rate(packet.setting.raw[0]);
+        if(rate == QSerialPort::UnknownBaud)
+            return false;
+        port_rate = rate;
+        if(!witmotion_port->setBaudRate(port_rate))
+            return false;
+        // The bytes received at the old rate are meaningless now
+        witmotion_port->clear(QSerialPort::Input);
+        ttyout << "Port switched to " << static_cast<int32_t>(port_rate) << " baud" << ENDL;
+    }
+    return true;
+}
+
+void QBaseSerialWitmotionSensorReader::ConfigurationApplied(const bool error)
+{
+    configuring = false;
+    WITMOTION_TRACE1(config_end, error ? 1 : 0);
+    if((output_frequency > 0.0) && (output_types > 0))
+    {
+        // The sensor silently drops the output exceeding the link capacity
+        double load = 11.0 * static_cast<double>(output_types) * output_frequency;
+        double capacity = static_cast<double>(port_rate) / 10.0;
+        if(load > capacity)
+            ttyout << "WARNING: " << output_types << " packet types at " << output_frequency << " Hz need "
+                   << static_cast<uint32_t>(load) << " bytes/s, exceeding " << static_cast<uint32_t>(capacity)
+                   << " bytes/s available at " << static_cast<int32_t>(port_rate) << " baud, the output will be reduced by the sensor" << ENDL;
+    }
+    AdaptPollInterval(true);
+    if(error)
+        emit Error("Error occurred when reconfiguring sensor!");
+    else
+        emit Configured();
 }
 
 void QBaseSerialWitmotionSensorReader::Configure()
 {
-    if(configuration.empty())
+    // The single commands wait for the sequence being applied
+    if(configuration.empty() || (sequence.length > 0))
         return;
     configuring = true;
+    WITMOTION_TRACE1(config_start, configuration.size());
     ttyout << "Configuration task detected, " << configuration.size() << " commands in list, configuring sensor..." << ENDL;
     bool error = false;
-    for(auto i = configuration.begin(); i != configuration.end(); i++)
-    {
-        witmotion_config_packet packet = (*i);
-        static uint8_t serial_datapacket[5];
-        serial_datapacket[0] = packet.header_byte;
-        serial_datapacket[1] = packet.key_byte;
-        serial_datapacket[2] = packet.address_byte;
-        serial_datapacket[3] = packet.setting.raw[0];
-        serial_datapacket[4] = packet.setting.raw[1];
-        quint64 written;
-        ttyout << "Sending configuration packet " << HEX << "0x" << packet.address_byte << DEC << ENDL;
-        written = witmotion_port->write(reinterpret_cast<const char*>(serial_datapacket), 5);
-        witmotion_port->waitForBytesWritten();
-        if(written != 5)
+    witmotion_config_packet packet;
+    while(configuration.pop(packet))
+    {
+        if(!WriteConfig(packet))
         {
             error = true;
             break;
         }
-        ttyout << "Configuration packet sent, flushing buffers..." << ENDL;
-        witmotion_port->flush();
     }
     ttyout << "Configuration completed" << ENDL;
     configuration.clear();
-    configuring = false;
-    if(error)
-        emit Error("Error occurred when reconfiguring sensor!");
+    ConfigurationApplied(error);
+}
+
+void QBaseSerialWitmotionSensorReader::SendConfigSequence(const witmotion_config_sequence &value)
+{
+    if((witmotion_port == nullptr) || !witmotion_port->isOpen())
+    {
+        emit Error("Configuration sequence rejected, the port is not open!");
+        return;
+    }
+    if(sequence.length > 0)
+    {
+        emit Error("Configuration sequence rejected, the previous one is still being applied!");
+        return;
+    }
+    // The pending single commands go first, so the sequence is not interleaved with them
+    Configure();
+    configuring = true;
+    WITMOTION_TRACE1(config_start, value.length);
+    ttyout << "Applying configuration sequence of " << value.length << " commands" << ENDL;
+    sequence = value;
+    sequence_position = 0;
+    if(sequence.length == 0)
+    {
+        FinishSequence(false);
+        return;
+    }
+    // The thread may be shared by the other readers, so the delays are not slept through
+    sequence_timer->setInterval(static_cast<int>(sequence.delay));
+    ContinueSequence();
+}
+
+void QBaseSerialWitmotionSensorReader::ContinueSequence()
+{
+    if(sequence.length == 0)
+        return;
+    if((witmotion_port == nullptr) || !witmotion_port->isOpen())
+    {
+        FinishSequence(true);
+        return;
+    }
+    if(sequence_position == sequence.length)
+    {
+        FinishSequence(false);
+        return;
+    }
+    const witmotion_config_packet& packet = sequence.packets[sequence_position++];
+    if(!WriteConfig(packet))
+    {
+        FinishSequence(true);
+        return;
+    }
+    // The delay follows the last command as well, the sensor applies it before the output is read again
+    sequence_timer->start();
+}
+
+void QBaseSerialWitmotionSensorReader::FinishSequence(const bool error)
+{
+    sequence_timer->stop();
+    sequence.length = 0;
+    sequence_position = 0;
+    ttyout << "Configuration sequence " << (error ? "interrupted" : "completed") << ENDL;
+    ConfigurationApplied(error);
 }
 
 void QBaseSerialWitmotionSensorReader::SendConfig(const witmotion_config_packet &packet)
 {
-    configuration.push_back(packet);
+    if(!configuration.push(packet))
+        emit Error("Configuration queue overflow, the command is dropped!");
 }
 
-void QBaseSerialWitmotionSensorReader::SetBaudRate(const QSerialPort::BaudRate &rate)
+uint32_t QBaseSerialWitmotionSensorReader::AdaptiveIntervalBound() const
 {
-    port_rate = rate;
+    if(user_defined_return_interval && (user_return_interval < latency_budget))
+        return user_return_interval;
+    return latency_budget;
 }
 
 QBaseSerialWitmotionSensorReader::QBaseSerialWitmotionSensorReader(const QString device, const QSerialPort::BaudRate rate):
@@ -115,18 +297,39 @@ QBaseSerialWitmotionSensorReader::QBaseSerialWitmotionSensorReader(const QString
     port_rate(rate),
     last_avail(0),
     avail_rep_count(0),
-    validate(false),
     user_defined_return_interval(false),
+    user_return_interval(50),
     return_interval(50),
     user_defined_timeout(false),
     timeout_ms(150),
+    event_driven(false),
+    latency_budget(0),
+    output_frequency(0.0),
+    configured_frequency(0.0),
+    output_types(0),
+    window_bytes(0),
+    window_start(0),
+    observed_rate(0.0),
     ttyout(stdout),
     poll_timer(nullptr),
-    read_state(rsClear),
-    configuring(false)
+    parser(false),
+    packet_sink(nullptr),
+    metrics(nullptr),
+    reported{0, 0, 0, 0},
+    timing(nullptr),
+    configuring(false),
+    sequence_position(0),
+    sequence_timer(new QTimer(this))
 {
+    sequence.length = 0;
+    sequence.delay = 0;
+    sequence.baud = rate;
+    // The timer is the child of the reader, so it follows the reader to its thread
+    sequence_timer->setSingleShot(true);
+    connect(sequence_timer, &QTimer::timeout, this, &QBaseSerialWitmotionSensorReader::ContinueSequence);
     qRegisterMetaType<witmotion_datapacket>("witmotion_datapacket");
     qRegisterMetaType<witmotion_config_packet>("witmotion_config_packet");
+    qRegisterMetaType<witmotion_config_sequence>("witmotion_config_sequence");
 }
 
 QBaseSerialWitmotionSensorReader::~QBaseSerialWitmotionSensorReader()
@@ -154,6 +357,8 @@ void QBaseSerialWitmotionSensorReader::RunPoll()
         emit Error("Error opening the port!");
         return;
     }
+    if(metrics != nullptr)
+        metrics->port_opens.fetch_add(1, std::memory_order_relaxed);
     poll_timer = new QTimer(this);
     poll_timer->setTimerType(Qt::TimerType::PreciseTimer);
     if(!user_defined_return_interval)
@@ -167,15 +372,33 @@ void QBaseSerialWitmotionSensorReader::RunPoll()
     }
     timer_connection = connect(poll_timer, &QTimer::timeout, this, &QBaseSerialWitmotionSensorReader::ReadData);
     config_connection = connect(poll_timer, &QTimer::timeout, this, &QBaseSerialWitmotionSensorReader::Configure);
+    // The timer still runs the configuration and the timeout detection
+    if(event_driven)
+        read_connection = connect(witmotion_port, &QSerialPort::readyRead, this, &QBaseSerialWitmotionSensorReader::ReadData);
     timeout_counter = 0;
+    if(latency_budget > 0)
+    {
+        window_bytes = 0;
+        window_start = steady_timestamp();
+        if(AdaptiveIntervalBound() < latency_budget)
+            ttyout << "Latency budget of " << latency_budget << " ms is limited to the poll interval of " << user_return_interval << " ms" << ENDL;
+        AdaptPollInterval(true);
+    }
+    if(metrics != nullptr)
+        metrics->poll_interval.store(return_interval, std::memory_order_relaxed);
     ttyout << "Instantiating timer at " << poll_timer->interval() << " ms" << ENDL;
     poll_timer->start();
 }
 
 void QBaseSerialWitmotionSensorReader::Suspend()
 {
+    // The interrupted sequence is not reported, the reader is stopped deliberately
+    sequence_timer->stop();
+    sequence.length = 0;
+    configuring = false;
     disconnect(timer_connection);
     disconnect(config_connection);
+    disconnect(read_connection);
     if(poll_timer != nullptr)
         delete poll_timer;
     if(witmotion_port != nullptr)
@@ -188,14 +411,67 @@ void QBaseSerialWitmotionSensorReader::Suspend()
     witmotion_port = nullptr;
 }
 
+void QBaseSerialWitmotionSensorReader::Shutdown()
+{
+    sequence_timer->stop();
+    sequence.length = 0;
+    disconnect(timer_connection);
+    disconnect(config_connection);
+    disconnect(read_connection);
+    if(poll_timer != nullptr)
+        delete poll_timer;
+    if(witmotion_port != nullptr)
+    {
+        witmotion_port->close();
+        delete witmotion_port;
+    }
+    poll_timer = nullptr;
+    witmotion_port = nullptr;
+    packet_sink = nullptr;
+    deleteLater();
+}
+
+void QBaseSerialWitmotionSensorReader::SetEventDriven(const bool value)
+{
+    event_driven = value;
+}
+
+void QBaseSerialWitmotionSensorReader::SetMetrics(witmotion_sensor_metrics *value)
+{
+    metrics = value;
+    reported = parser.Statistics();
+}
+
+void QBaseSerialWitmotionSensorReader::SetTiming(witmotion_packet_timing *value)
+{
+    timing = value;
+}
+
+double QBaseSerialWitmotionSensorReader::ConfiguredFrequency() const
+{
+    return configured_frequency.load(std::memory_order_relaxed);
+}
+
+void QBaseSerialWitmotionSensorReader::SetLatencyBudget(const uint32_t ms)
+{
+    latency_budget = ms;
+}
+
 void QBaseSerialWitmotionSensorReader::ValidatePackets(const bool value)
 {
-    validate = value;
+    parser.SetValidation(value);
+}
+
+void QBaseSerialWitmotionSensorReader::SetPacketSink(witmotion_packet_sink *sink)
+{
+    // Should be called before RunPoll(), the sink is accessed from the reader thread without locking
+    packet_sink = sink;
 }
 
 void QBaseSerialWitmotionSensorReader::SetSensorPollInterval(const uint32_t ms)
 {
     user_defined_return_interval = true;
+    user_return_interval = ms;
     return_interval = ms;
 }
 
@@ -205,25 +481,53 @@ void QBaseSerialWitmotionSensorReader::SetSensorTimeout(const uint32_t ms)
     timeout_ms = ms;
 }
 
-QAbstractWitmotionSensorController::QAbstractWitmotionSensorController(const QString tty_name, const QSerialPort::BaudRate rate):
+QAbstractWitmotionSensorController::QAbstractWitmotionSensorController(const QString tty_name, const QSerialPort::BaudRate rate, QThread *shared_engine):
     reader_thread(dynamic_cast<QObject*>(this)),
+    engine(shared_engine),
     port_name(tty_name),
     port_rate(rate),
     reader(nullptr),
-    ttyout(stdout)
+    ttyout(stdout),
+    packet_sink(nullptr),
+    metrics(nullptr),
+    statistics_timer(nullptr),
+    timing(nullptr),
+    cadence(nullptr),
+    cadence_interval(0),
+    cadence_reported(0),
+    cadence_rate(0.0)
 {
     reader = new QBaseSerialWitmotionSensorReader(port_name, port_rate);
-    reader->moveToThread(&reader_thread);
-    connect(&reader_thread, &QThread::finished, reader, &QObject::deleteLater);
+    if(engine != nullptr)
+    {
+        reader->moveToThread(engine);
+        connect(this, &QAbstractWitmotionSensorController::StopReader, reader, &QBaseSerialWitmotionSensorReader::Shutdown, Qt::BlockingQueuedConnection);
+    }
+    else
+    {
+        reader->moveToThread(&reader_thread);
+        connect(&reader_thread, &QThread::finished, reader, &QObject::deleteLater);
+    }
     connect(this, &QAbstractWitmotionSensorController::RunReader, reader, &QAbstractWitmotionSensorReader::RunPoll);
+    // The reader thread may be shared by the other sensors, so the port and the timers are never touched from here
+    connect(this, &QAbstractWitmotionSensorController::SuspendReader, reader, &QBaseSerialWitmotionSensorReader::Suspend, Qt::QueuedConnection);
     connect(reader, &QAbstractWitmotionSensorReader::Acquired, this, &QAbstractWitmotionSensorController::Packet);
     connect(reader, &QAbstractWitmotionSensorReader::Error, this, &QAbstractWitmotionSensorController::Error);
+    connect(reader, &QBaseSerialWitmotionSensorReader::Configured, this, &QAbstractWitmotionSensorController::Configured);
     connect(this, &QAbstractWitmotionSensorController::SendConfig, reader, &QAbstractWitmotionSensorReader::SendConfig);
-    reader_thread.start();
+    connect(this, &QAbstractWitmotionSensorController::SendConfigSequence, reader, &QBaseSerialWitmotionSensorReader::SendConfigSequence);
+    if(engine == nullptr)
+        reader_thread.start();
 }
 
 QAbstractWitmotionSensorController::~QAbstractWitmotionSensorController()
 {
+    if(engine != nullptr)
+    {
+        // The other readers keep running, so only this one is stopped before the sinks go away
+        emit StopReader();
+        return;
+    }
     reader_thread.quit();
     reader_thread.wait(10000);
 }
@@ -233,21 +537,134 @@ void QAbstractWitmotionSensorController::SetValidation(const bool validate)
     reader->ValidatePackets(validate);
 }
 
+void QAbstractWitmotionSensorController::SetEventDriven(const bool value)
+{
+    reader->SetEventDriven(value);
+}
+
+void QAbstractWitmotionSensorController::SetSensorTimeout(const uint32_t ms)
+{
+    reader->SetSensorTimeout(ms);
+}
+
+void QAbstractWitmotionSensorController::ApplyConfiguration(const witmotion_config_sequence &sequence)
+{
+    for(size_t i = 0; i < sequence.length; i++)
+        if(sequence.packets[i].address_byte == ridPortBaudRate)
+            port_rate = sequence.baud;
+    emit SendConfigSequence(sequence);
+}
+
+void QAbstractWitmotionSensorController::SetLatencyBudget(const uint32_t ms)
+{
+    reader->SetLatencyBudget(ms);
+}
+
+void QAbstractWitmotionSensorController::SetPacketSink(witmotion_packet_sink *sink)
+{
+    packet_sink = sink;
+    reader->SetPacketSink((sink != nullptr) ? this : nullptr);
+}
+
+void QAbstractWitmotionSensorController::SetMetrics(witmotion_sensor_metrics *value, const uint32_t interval)
+{
+    metrics = value;
+    reader->SetMetrics(value);
+    if(statistics_timer != nullptr)
+    {
+        delete statistics_timer;
+        statistics_timer = nullptr;
+    }
+    if((metrics == nullptr) || (interval == 0))
+        return;
+    qRegisterMetaType<witmotion_metrics_snapshot>("witmotion_metrics_snapshot");
+    statistics_timer = new QTimer(this);
+    statistics_timer->setInterval(static_cast<int>(interval));
+    connect(statistics_timer, &QTimer::timeout, this, [this]()
+    {
+        emit Statistics(metrics->Snapshot());
+    });
+    statistics_timer->start();
+}
+
+void QAbstractWitmotionSensorController::SetTiming(witmotion_packet_timing *value)
+{
+    timing = value;
+    reader->SetTiming(value);
+}
+
+void QAbstractWitmotionSensorController::SetCadence(witmotion_cadence_estimator *value, const uint32_t interval)
+{
+    cadence = value;
+    cadence_interval = static_cast<int64_t>(interval) * 1000000;
+    cadence_reported = 0;
+    if(cadence_interval > 0)
+        qRegisterMetaType<witmotion_cadence_report>("witmotion_cadence_report");
+}
+
+void QAbstractWitmotionSensorController::Deliver(const witmotion_datapacket &packet, const int64_t timestamp)
+{
+    // The frequency is written in the reader thread, the estimator is updated in the delivering one
+    double rate = reader->ConfiguredFrequency();
+    if((rate > 0.0) && (rate != cadence_rate))
+    {
+        cadence_rate = rate;
+        cadence->SetExpectedRate(rate);
+    }
+    cadence->Push(packet, timestamp);
+    if((cadence_interval > 0) && (timestamp - cadence_reported >= cadence_interval))
+    {
+        cadence_reported = timestamp;
+        emit Cadence(cadence->Statistics());
+    }
+}
+
+void QAbstractWitmotionSensorController::Consume(const witmotion_datapacket &packet)
+{
+    WITMOTION_TRACE1(deliver, packet.id_byte);
+    // Accounted before the filtering, so the delivery sequence follows the reader one
+    int64_t timestamp = ((timing != nullptr) || (cadence != nullptr)) ? steady_timestamp() : 0;
+    if(timing != nullptr)
+        timing->Delivery(packet.id_byte, timestamp);
+    const std::set<witmotion_packet_id>* registered = RegisteredPacketTypes();
+    if(registered->find(static_cast<witmotion_packet_id>(packet.id_byte)) == registered->end())
+    {
+        if(metrics != nullptr)
+            metrics->unregistered.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if(cadence != nullptr)
+        Deliver(packet, timestamp);
+    if(packet_sink != nullptr)
+        packet_sink->Consume(packet);
+}
+
 void QAbstractWitmotionSensorController::Packet(const witmotion_datapacket &packet)
 {
-    static const std::set<witmotion_packet_id>* registered = RegisteredPacketTypes();
+    WITMOTION_TRACE1(deliver, packet.id_byte);
+    int64_t timestamp = ((timing != nullptr) || (cadence != nullptr)) ? steady_timestamp() : 0;
+    if(timing != nullptr)
+        timing->Delivery(packet.id_byte, timestamp);
+    const std::set<witmotion_packet_id>* registered = RegisteredPacketTypes();
     if(registered->find(static_cast<witmotion_packet_id>(packet.id_byte)) == registered->end())
     {
+        if(metrics != nullptr)
+            metrics->unregistered.fetch_add(1, std::memory_order_relaxed);
         emit ErrorOccurred("Unregistered packet ID acquired. Please be sure that you use a proper driver class and namespace!");
         return;
     }
+    if(cadence != nullptr)
+        Deliver(packet, timestamp);
     emit Acquired(packet);
 }
 
 void QAbstractWitmotionSensorController::Error(const QString &description)
 {
+    WITMOTION_TRACE1(error, description.toLocal8Bit().constData());
+    if(metrics != nullptr)
+        metrics->errors.fetch_add(1, std::memory_order_relaxed);
     ttyout << "Internal error occurred. Suspending the reader thread. Please check the sensor!" << ENDL;
-    reader->Suspend();
+    emit SuspendReader();
     emit ErrorOccurred(description);
 }
 
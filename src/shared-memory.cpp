@@ -0,0 +1,349 @@
+#include "witmotion/shared-memory.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace witmotion
+{
+
+namespace
+{
+
+// Shared memory layout: header, latest value blocks, frame ring. Every block starts
+// on its own cache line, so the readers polling one block do not contend with the
+// publisher writing another one.
+struct alignas(64) shm_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t frame_size; ///< `sizeof(witmotion_frame)`, guards against the incompatible builds
+    uint64_t packet_size;
+    alignas(64) std::atomic<uint64_t> head;
+};
+
+struct alignas(64) shm_latest
+{
+    std::atomic<uint32_t> lock; ///< Sequence lock, odd while the block is being written
+    uint32_t reserved;
+    uint64_t updates;
+    int64_t timestamp;
+    witmotion_datapacket packet;
+};
+
+struct alignas(64) shm_slot
+{
+    std::atomic<uint64_t> stamp; ///< Frame sequence number + 1 when the slot is consistent, 0 while it is being written
+    witmotion_frame frame;
+};
+
+// A block write takes a few copies, the lock held odd for longer than that
+// means the publisher has died in the middle of the write
+const uint32_t SHM_READ_ATTEMPTS = 4096;
+
+size_t shm_size(const size_t capacity)
+{
+    return sizeof(shm_header) + WITMOTION_SHM_PACKET_TYPES * sizeof(shm_latest) + capacity * sizeof(shm_slot);
+}
+
+shm_header* header_of(void* memory)
+{
+    return static_cast<shm_header*>(memory);
+}
+
+shm_latest* latest_of(void* memory)
+{
+    return reinterpret_cast<shm_latest*>(static_cast<uint8_t*>(memory) + sizeof(shm_header));
+}
+
+shm_slot* slots_of(void* memory)
+{
+    return reinterpret_cast<shm_slot*>(static_cast<uint8_t*>(memory) + sizeof(shm_header) + WITMOTION_SHM_PACKET_TYPES * sizeof(shm_latest));
+}
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+witmotion_shm_publisher::witmotion_shm_publisher(const std::string &object,
+                                                 const size_t depth):
+    name(object),
+    capacity((depth > 0) ? depth : 1),
+    memory(nullptr),
+    size(0)
+{}
+
+witmotion_shm_publisher::~witmotion_shm_publisher()
+{
+    Close();
+}
+
+bool witmotion_shm_publisher::Open()
+{
+    Close();
+    // The stale object left by the crashed publisher is replaced, the clients still
+    // mapping it keep the old copy until they reopen
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0)
+    {
+        error = std::string("Cannot create shared memory object ") + name + ": " + std::strerror(errno);
+        return false;
+    }
+    size = shm_size(capacity);
+    if(ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        error = std::string("Cannot allocate shared memory object ") + name + ": " + std::strerror(errno);
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        error = std::string("Cannot map shared memory object ") + name + ": " + std::strerror(errno);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    memory = mapping;
+    // The object is zero-filled by ftruncate, only the header has to be set up.
+    // The magic number is written last, so the clients never accept a partially initialized object.
+    shm_header* header = header_of(memory);
+    header->version = WITMOTION_SHM_VERSION;
+    header->capacity = capacity;
+    header->frame_size = sizeof(witmotion_frame);
+    header->packet_size = sizeof(witmotion_datapacket);
+    header->head.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = WITMOTION_SHM_MAGIC;
+    frames.Reset();
+    error.clear();
+    return true;
+}
+
+void witmotion_shm_publisher::Close()
+{
+    if(memory == nullptr)
+        return;
+    munmap(memory, size);
+    shm_unlink(name.c_str());
+    memory = nullptr;
+    size = 0;
+}
+
+bool witmotion_shm_publisher::IsOpen() const
+{
+    return memory != nullptr;
+}
+
+const std::string& witmotion_shm_publisher::Error() const
+{
+    return error;
+}
+
+void witmotion_shm_publisher::Consume(const witmotion_datapacket &packet)
+{
+    Publish(packet, steady_timestamp());
+}
+
+void witmotion_shm_publisher::Publish(const witmotion_datapacket &packet, const int64_t timestamp)
+{
+    if(memory == nullptr)
+        return;
+    witmotion_packet_id id = static_cast<witmotion_packet_id>(packet.id_byte);
+    if(!id_registered(id))
+        return;
+    shm_latest& block = latest_of(memory)[packet.id_byte - pidRTC];
+    uint32_t sequence = block.lock.load(std::memory_order_relaxed);
+    block.lock.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    block.updates++;
+    block.timestamp = timestamp;
+    block.packet = packet;
+    block.lock.store(sequence + 2, std::memory_order_release);
+    witmotion_frame frame;
+    if(frames.Push(packet, timestamp, frame))
+        Publish(frame);
+}
+
+void witmotion_shm_publisher::Publish(const witmotion_frame &frame)
+{
+    if(memory == nullptr)
+        return;
+    shm_header* header = header_of(memory);
+    uint64_t sequence = header->head.load(std::memory_order_relaxed);
+    shm_slot& slot = slots_of(memory)[sequence % capacity];
+    slot.stamp.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.frame = frame;
+    slot.stamp.store(sequence + 1, std::memory_order_release);
+    header->head.store(sequence + 1, std::memory_order_release);
+}
+
+witmotion_shm_client::witmotion_shm_client(const std::string &object):
+    name(object),
+    memory(nullptr),
+    size(0),
+    capacity(0)
+{}
+
+witmotion_shm_client::~witmotion_shm_client()
+{
+    Close();
+}
+
+bool witmotion_shm_client::Open()
+{
+    Close();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+    {
+        error = std::string("Cannot open shared memory object ") + name + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if((fstat(fd, &status) != 0) || (static_cast<size_t>(status.st_size) < sizeof(shm_header)))
+    {
+        error = std::string("Invalid shared memory object ") + name;
+        close(fd);
+        return false;
+    }
+    size_t mapped = static_cast<size_t>(status.st_size);
+    void* mapping = mmap(nullptr, mapped, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        error = std::string("Cannot map shared memory object ") + name + ": " + std::strerror(errno);
+        return false;
+    }
+    const shm_header* header = header_of(mapping);
+    if(header->magic != WITMOTION_SHM_MAGIC)
+        error = std::string("Shared memory object ") + name + " is not initialized by the publisher";
+    else if(header->version != WITMOTION_SHM_VERSION ||
+            header->frame_size != sizeof(witmotion_frame) ||
+            header->packet_size != sizeof(witmotion_datapacket))
+        error = std::string("Shared memory object ") + name + " is published by the incompatible library version";
+    else if(shm_size(header->capacity) != mapped)
+        error = std::string("Shared memory object ") + name + " has inconsistent size";
+    if(!error.empty())
+    {
+        munmap(mapping, mapped);
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    memory = mapping;
+    size = mapped;
+    capacity = header->capacity;
+    return true;
+}
+
+void witmotion_shm_client::Close()
+{
+    if(memory != nullptr)
+        munmap(const_cast<void*>(memory), size);
+    memory = nullptr;
+    size = 0;
+    capacity = 0;
+    error.clear();
+}
+
+bool witmotion_shm_client::IsOpen() const
+{
+    return memory != nullptr;
+}
+
+const std::string& witmotion_shm_client::Error() const
+{
+    return error;
+}
+
+size_t witmotion_shm_client::Capacity() const
+{
+    return capacity;
+}
+
+bool witmotion_shm_client::Latest(const witmotion_packet_id id,
+                                  witmotion_datapacket &packet,
+                                  int64_t &timestamp,
+                                  uint64_t *updates) const
+{
+    if((memory == nullptr) || !id_registered(id))
+        return false;
+    const shm_latest& block = latest_of(const_cast<void*>(memory))[id - pidRTC];
+    uint64_t count = 0;
+    bool consistent = false;
+    for(uint32_t attempt = 0; !consistent && (attempt < SHM_READ_ATTEMPTS); attempt++)
+    {
+        uint32_t before = block.lock.load(std::memory_order_acquire);
+        if(before & 1)
+            continue;
+        count = block.updates;
+        timestamp = block.timestamp;
+        packet = block.packet;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        consistent = (block.lock.load(std::memory_order_relaxed) == before);
+    }
+    if(!consistent)
+        return false;
+    if(updates != nullptr)
+        *updates = count;
+    return count > 0;
+}
+
+uint64_t witmotion_shm_client::Head() const
+{
+    if(memory == nullptr)
+        return 0;
+    return header_of(const_cast<void*>(memory))->head.load(std::memory_order_acquire);
+}
+
+size_t witmotion_shm_client::Poll(uint64_t &cursor,
+                                  witmotion_frame *frames,
+                                  const size_t count,
+                                  uint64_t *lost) const
+{
+    uint64_t skipped = 0;
+    size_t written = 0;
+    if(memory != nullptr)
+    {
+        const shm_slot* ring = slots_of(const_cast<void*>(memory));
+        uint64_t head = Head();
+        if(head > capacity && cursor < head - capacity)
+        {
+            skipped += head - capacity - cursor;
+            cursor = head - capacity;
+        }
+        while(cursor < head && written < count)
+        {
+            const shm_slot& slot = ring[cursor % capacity];
+            uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+            if(stamp == cursor + 1)
+            {
+                frames[written] = slot.frame;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(slot.stamp.load(std::memory_order_relaxed) == stamp)
+                    written++;
+                else
+                    skipped++;
+            }
+            else
+                skipped++; // The slot has been overwritten by the newer frame
+            cursor++;
+        }
+    }
+    if(lost != nullptr)
+        *lost = skipped;
+    return written;
+}
+
+}
@@ -0,0 +1,124 @@
+#include "witmotion/statistics.h"
+
+#include <algorithm>
+
+namespace witmotion
+{
+
+witmotion_running_statistics::witmotion_running_statistics()
+{
+    Reset();
+}
+
+void witmotion_running_statistics::Push(const double value)
+{
+    count++;
+    double delta = value - mean;
+    mean += delta / static_cast<double>(count);
+    m2 += delta * (value - mean);
+    if(count == 1)
+    {
+        min_value = value;
+        max_value = value;
+    }
+    else
+    {
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+    }
+}
+
+void witmotion_running_statistics::Merge(const witmotion_running_statistics &other)
+{
+    if(other.count == 0)
+        return;
+    if(count == 0)
+    {
+        *this = other;
+        return;
+    }
+    uint64_t total = count + other.count;
+    double delta = other.mean - mean;
+    mean += delta * static_cast<double>(other.count) / static_cast<double>(total);
+    m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / static_cast<double>(total);
+    count = total;
+    min_value = std::min(min_value, other.min_value);
+    max_value = std::max(max_value, other.max_value);
+}
+
+void witmotion_running_statistics::Reset()
+{
+    count = 0;
+    mean = 0.0;
+    m2 = 0.0;
+    min_value = 0.0;
+    max_value = 0.0;
+}
+
+uint64_t witmotion_running_statistics::Count() const
+{
+    return count;
+}
+
+double witmotion_running_statistics::Mean() const
+{
+    return mean;
+}
+
+double witmotion_running_statistics::Variance() const
+{
+    return (count > 1) ? m2 / static_cast<double>(count - 1) : 0.0;
+}
+
+double witmotion_running_statistics::StandardDeviation() const
+{
+    return std::sqrt(Variance());
+}
+
+double witmotion_running_statistics::Min() const
+{
+    return min_value;
+}
+
+double witmotion_running_statistics::Max() const
+{
+    return max_value;
+}
+
+void witmotion_frame_covariance::Push(const witmotion_frame &frame)
+{
+    bool has_acceleration = frame.Has(pidAcceleration);
+    bool has_angular_velocity = frame.Has(pidAngularVelocity);
+    if(has_acceleration)
+        acceleration.Push(frame.acceleration);
+    if(has_angular_velocity)
+        angular_velocity.Push(frame.angular_velocity);
+    if(has_acceleration && has_angular_velocity)
+    {
+        float joint[6];
+        std::copy(frame.acceleration, frame.acceleration + 3, joint);
+        std::copy(frame.angular_velocity, frame.angular_velocity + 3, joint + 3);
+        inertial.Push(joint);
+    }
+    if(frame.Has(pidAngles))
+        angles.Push(frame.angles);
+    if(frame.Has(pidMagnetometer))
+        magnetic_field.Push(frame.magnetic_field);
+    if(frame.mask & (witmotion_frame::Bit(pidAcceleration) |
+                     witmotion_frame::Bit(pidAngularVelocity) |
+                     witmotion_frame::Bit(pidAngles) |
+                     witmotion_frame::Bit(pidMagnetometer)))
+        temperature.Push(frame.temperature);
+}
+
+void witmotion_frame_covariance::Reset()
+{
+    acceleration.Reset();
+    angular_velocity.Reset();
+    angles.Reset();
+    magnetic_field.Reset();
+    inertial.Reset();
+    temperature.Reset();
+}
+
+}
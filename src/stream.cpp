@@ -0,0 +1,627 @@
+#include "witmotion/stream.h"
+#include "witmotion/util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace witmotion
+{
+
+namespace
+{
+
+void put_u16(uint8_t* data, const uint16_t value)
+{
+    data[0] = static_cast<uint8_t>(value);
+    data[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put_u32(uint8_t* data, const uint32_t value)
+{
+    for(size_t i = 0; i < 4; i++)
+        data[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+void put_u64(uint8_t* data, const uint64_t value)
+{
+    for(size_t i = 0; i < 8; i++)
+        data[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+void put_float(uint8_t* data, const float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u32(data, bits);
+}
+
+void put_double(uint8_t* data, const double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u64(data, bits);
+}
+
+uint16_t get_u16(const uint8_t* data)
+{
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+uint32_t get_u32(const uint8_t* data)
+{
+    uint32_t value = 0;
+    for(size_t i = 0; i < 4; i++)
+        value |= static_cast<uint32_t>(data[i]) << (8 * i);
+    return value;
+}
+
+uint64_t get_u64(const uint8_t* data)
+{
+    uint64_t value = 0;
+    for(size_t i = 0; i < 8; i++)
+        value |= static_cast<uint64_t>(data[i]) << (8 * i);
+    return value;
+}
+
+float get_float(const uint8_t* data)
+{
+    uint32_t bits = get_u32(data);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+double get_double(const uint8_t* data)
+{
+    uint64_t bits = get_u64(data);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+void encode_stream_subscription(const witmotion_stream_subscription &subscription, uint8_t *data)
+{
+    data[0] = smtSubscribe;
+    data[1] = static_cast<uint8_t>(subscription.mode);
+    put_u16(data + 2, subscription.packet_mask);
+    put_u16(data + 4, subscription.sensor_mask);
+    put_u16(data + 6, subscription.batch);
+}
+
+bool decode_stream_subscription(const uint8_t *data, witmotion_stream_subscription &subscription)
+{
+    if((data[0] != smtSubscribe) || ((data[1] != smtPackets) && (data[1] != smtFrames)))
+        return false;
+    subscription.mode = static_cast<witmotion_stream_message_type>(data[1]);
+    subscription.packet_mask = get_u16(data + 2);
+    subscription.sensor_mask = get_u16(data + 4);
+    subscription.batch = std::max<uint16_t>(get_u16(data + 6), 1);
+    return true;
+}
+
+void encode_stream_packet(const uint8_t sensor, const witmotion_datapacket &packet, const int64_t timestamp, uint8_t *data)
+{
+    data[0] = sensor;
+    put_u64(data + 1, static_cast<uint64_t>(timestamp));
+    // The structure is padded, so the wire representation is composed byte-by-byte
+    data[9] = packet.header_byte;
+    data[10] = packet.id_byte;
+    std::memcpy(data + 11, packet.datastore.raw, 8);
+    data[19] = packet.crc;
+}
+
+void decode_stream_packet(const uint8_t *data, uint8_t &sensor, witmotion_datapacket &packet, int64_t &timestamp)
+{
+    sensor = data[0];
+    timestamp = static_cast<int64_t>(get_u64(data + 1));
+    packet.header_byte = data[9];
+    packet.id_byte = data[10];
+    std::memcpy(packet.datastore.raw, data + 11, 8);
+    packet.crc = data[19];
+}
+
+void encode_stream_frame(const uint8_t sensor, const witmotion_frame &frame, uint8_t *data)
+{
+    data[0] = sensor;
+    put_u64(data + 1, static_cast<uint64_t>(frame.timestamp));
+    put_u32(data + 9, frame.mask);
+    uint8_t* values = data + 13;
+    for(size_t i = 0; i < 3; i++)
+    {
+        put_float(values + 4 * i, frame.acceleration[i]);
+        put_float(values + 4 * (i + 3), frame.angular_velocity[i]);
+        put_float(values + 4 * (i + 6), frame.angles[i]);
+        put_float(values + 4 * (i + 9), frame.magnetic_field[i]);
+    }
+    for(size_t i = 0; i < 4; i++)
+        put_float(values + 4 * (i + 12), frame.orientation[i]);
+    put_float(values + 64, frame.temperature);
+    put_double(values + 68, frame.pressure);
+    put_double(values + 76, frame.altitude);
+}
+
+void decode_stream_frame(const uint8_t *data, uint8_t &sensor, witmotion_frame &frame)
+{
+    sensor = data[0];
+    frame.timestamp = static_cast<int64_t>(get_u64(data + 1));
+    frame.mask = get_u32(data + 9);
+    const uint8_t* values = data + 13;
+    for(size_t i = 0; i < 3; i++)
+    {
+        frame.acceleration[i] = get_float(values + 4 * i);
+        frame.angular_velocity[i] = get_float(values + 4 * (i + 3));
+        frame.angles[i] = get_float(values + 4 * (i + 6));
+        frame.magnetic_field[i] = get_float(values + 4 * (i + 9));
+    }
+    for(size_t i = 0; i < 4; i++)
+        frame.orientation[i] = get_float(values + 4 * (i + 12));
+    frame.temperature = get_float(values + 64);
+    frame.pressure = get_double(values + 68);
+    frame.altitude = get_double(values + 76);
+}
+
+struct witmotion_stream_server::subscriber
+{
+    int fd;
+    // Shared with the publishing threads
+    std::mutex guard;
+    bool subscribed;
+    witmotion_stream_subscription subscription;
+    std::vector<uint8_t> pending; ///< Message under construction, starts with the header placeholder
+    uint16_t pending_count;
+    uint32_t dropped;
+    std::atomic<bool> signalled;
+    // I/O thread only
+    std::vector<uint8_t> outgoing;
+    size_t sent;
+    uint8_t request[WITMOTION_STREAM_REQUEST_SIZE];
+    size_t request_size;
+    std::chrono::steady_clock::time_point last_flush;
+    void Append(const uint8_t* record, const size_t size, const size_t limit)
+    {
+        if((pending.size() + size > limit) || (pending_count == UINT16_MAX))
+        {
+            if(dropped < UINT32_MAX)
+                dropped++;
+            return;
+        }
+        pending.insert(pending.end(), record, record + size);
+        pending_count++;
+    }
+};
+
+witmotion_stream_server::witmotion_stream_server(const std::string &socket_path,
+                                                 const size_t buffer,
+                                                 const uint32_t flush_ms):
+    path(socket_path),
+    buffer_size(std::max(buffer, WITMOTION_STREAM_HEADER_SIZE + WITMOTION_STREAM_FRAME_RECORD_SIZE)),
+    flush_interval((flush_ms > 0) ? flush_ms : 1),
+    listener(-1),
+    running(false)
+{
+    wakeup[0] = -1;
+    wakeup[1] = -1;
+}
+
+witmotion_stream_server::~witmotion_stream_server()
+{
+    Close();
+}
+
+bool witmotion_stream_server::Open()
+{
+    Close();
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+    {
+        error = std::string("Socket path is too long: ") + path;
+        return false;
+    }
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listener < 0)
+    {
+        error = std::string("Cannot create socket: ") + std::strerror(errno);
+        return false;
+    }
+    unlink(path.c_str());
+    if((bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) ||
+       (listen(listener, 16) != 0))
+    {
+        error = std::string("Cannot bind socket ") + path + ": " + std::strerror(errno);
+        close(listener);
+        listener = -1;
+        return false;
+    }
+    if(pipe2(wakeup, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        error = std::string("Cannot create wake-up pipe: ") + std::strerror(errno);
+        close(listener);
+        listener = -1;
+        unlink(path.c_str());
+        return false;
+    }
+    for(size_t i = 0; i < WITMOTION_STREAM_MAX_SENSORS; i++)
+        frames[i].Reset();
+    error.clear();
+    running = true;
+    worker = std::thread(&witmotion_stream_server::Run, this);
+    return true;
+}
+
+void witmotion_stream_server::Close()
+{
+    if(listener < 0)
+        return;
+    running = false;
+    Wake();
+    if(worker.joinable())
+        worker.join();
+    {
+        std::lock_guard<std::mutex> lock(subscribers_guard);
+        for(auto i = subscribers.begin(); i != subscribers.end(); i++)
+            close((*i)->fd);
+        subscribers.clear();
+    }
+    close(listener);
+    close(wakeup[0]);
+    close(wakeup[1]);
+    listener = -1;
+    wakeup[0] = -1;
+    wakeup[1] = -1;
+    unlink(path.c_str());
+}
+
+const std::string& witmotion_stream_server::Error() const
+{
+    return error;
+}
+
+size_t witmotion_stream_server::Subscribers()
+{
+    std::lock_guard<std::mutex> lock(subscribers_guard);
+    return subscribers.size();
+}
+
+void witmotion_stream_server::Wake()
+{
+    if(wakeup[1] < 0)
+        return;
+    uint8_t byte = 0;
+    // The pipe is non-blocking: if it is full, the I/O thread is already woken up
+    ssize_t result = write(wakeup[1], &byte, 1);
+    (void) result;
+}
+
+void witmotion_stream_server::Publish(const uint8_t sensor, const witmotion_datapacket &packet, const int64_t timestamp)
+{
+    if((sensor >= WITMOTION_STREAM_MAX_SENSORS) || !id_registered(static_cast<witmotion_packet_id>(packet.id_byte)))
+        return;
+    uint8_t packet_record[WITMOTION_STREAM_PACKET_RECORD_SIZE];
+    uint8_t frame_record[WITMOTION_STREAM_FRAME_RECORD_SIZE];
+    encode_stream_packet(sensor, packet, timestamp, packet_record);
+    witmotion_frame frame;
+    bool completed = frames[sensor].Push(packet, timestamp, frame);
+    if(completed)
+        encode_stream_frame(sensor, frame, frame_record);
+    uint16_t packet_bit = static_cast<uint16_t>(1 << (packet.id_byte - pidRTC));
+    uint16_t sensor_bit = static_cast<uint16_t>(1 << sensor);
+    std::lock_guard<std::mutex> lock(subscribers_guard);
+    for(auto i = subscribers.begin(); i != subscribers.end(); i++)
+    {
+        subscriber& client = **i;
+        std::lock_guard<std::mutex> client_lock(client.guard);
+        if(!client.subscribed || !(client.subscription.sensor_mask & sensor_bit))
+            continue;
+        if(client.subscription.mode == smtPackets)
+        {
+            if(client.subscription.packet_mask & packet_bit)
+                client.Append(packet_record, WITMOTION_STREAM_PACKET_RECORD_SIZE, buffer_size);
+        }
+        else if(completed && (client.subscription.packet_mask & frame.mask))
+            client.Append(frame_record, WITMOTION_STREAM_FRAME_RECORD_SIZE, buffer_size);
+        if((client.pending_count >= client.subscription.batch) && !client.signalled.exchange(true))
+            Wake();
+    }
+}
+
+void witmotion_stream_server::Accept()
+{
+    for(;;)
+    {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+            return;
+        std::unique_ptr<subscriber> client(new subscriber());
+        client->fd = fd;
+        client->subscribed = false;
+        client->pending_count = 0;
+        client->dropped = 0;
+        client->signalled = false;
+        client->sent = 0;
+        client->request_size = 0;
+        client->last_flush = std::chrono::steady_clock::now();
+        // Both buffers are allocated once, the publishing threads do not allocate
+        client->pending.reserve(buffer_size);
+        client->outgoing.reserve(buffer_size);
+        client->pending.assign(WITMOTION_STREAM_HEADER_SIZE, 0);
+        std::lock_guard<std::mutex> lock(subscribers_guard);
+        subscribers.push_back(std::move(client));
+    }
+}
+
+bool witmotion_stream_server::Receive(subscriber &client)
+{
+    for(;;)
+    {
+        ssize_t result = recv(client.fd,
+                              client.request + client.request_size,
+                              WITMOTION_STREAM_REQUEST_SIZE - client.request_size,
+                              0);
+        if(result == 0)
+            return false;
+        if(result < 0)
+            return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+        client.request_size += static_cast<size_t>(result);
+        if(client.request_size < WITMOTION_STREAM_REQUEST_SIZE)
+            continue;
+        client.request_size = 0;
+        witmotion_stream_subscription subscription;
+        if(!decode_stream_subscription(client.request, subscription))
+            return false;
+        std::lock_guard<std::mutex> lock(client.guard);
+        if(client.subscribed && (client.subscription.mode != subscription.mode))
+        {
+            // The records of the previous mode cannot be mixed into the same message
+            client.dropped += client.pending_count;
+            client.pending.resize(WITMOTION_STREAM_HEADER_SIZE);
+            client.pending_count = 0;
+        }
+        client.subscription = subscription;
+        client.subscribed = true;
+    }
+}
+
+bool witmotion_stream_server::Send(subscriber &client, const bool flush)
+{
+    if(client.sent == client.outgoing.size())
+    {
+        client.outgoing.clear();
+        client.sent = 0;
+        if(!flush && !client.signalled)
+            return true;
+        std::lock_guard<std::mutex> lock(client.guard);
+        client.signalled = false;
+        client.last_flush = std::chrono::steady_clock::now();
+        if((client.pending_count == 0) && (client.dropped == 0))
+            return true;
+        client.pending[0] = static_cast<uint8_t>(client.subscription.mode);
+        client.pending[1] = 0;
+        put_u16(&client.pending[2], client.pending_count);
+        put_u32(&client.pending[4], client.dropped);
+        client.pending.swap(client.outgoing);
+        client.pending.assign(WITMOTION_STREAM_HEADER_SIZE, 0);
+        client.pending_count = 0;
+        client.dropped = 0;
+    }
+    while(client.sent < client.outgoing.size())
+    {
+        ssize_t result = send(client.fd,
+                              client.outgoing.data() + client.sent,
+                              client.outgoing.size() - client.sent,
+                              MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+        }
+        client.sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+void witmotion_stream_server::Run()
+{
+    std::vector<pollfd> descriptors;
+    while(running)
+    {
+        descriptors.clear();
+        descriptors.push_back(pollfd{listener, POLLIN, 0});
+        descriptors.push_back(pollfd{wakeup[0], POLLIN, 0});
+        // Only the I/O thread modifies the list, so it is read here without locking
+        for(auto i = subscribers.begin(); i != subscribers.end(); i++)
+        {
+            short events = POLLIN;
+            if((*i)->sent < (*i)->outgoing.size())
+                events |= POLLOUT;
+            descriptors.push_back(pollfd{(*i)->fd, events, 0});
+        }
+        if(poll(descriptors.data(), descriptors.size(), static_cast<int>(flush_interval)) < 0 && errno != EINTR)
+            break;
+        if(descriptors[1].revents & POLLIN)
+        {
+            uint8_t drain[64];
+            while(read(wakeup[0], drain, sizeof(drain)) > 0);
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::vector<size_t> closed;
+        for(size_t i = 0; i < subscribers.size(); i++)
+        {
+            subscriber& client = *subscribers[i];
+            short revents = descriptors[i + 2].revents;
+            bool alive = !(revents & (POLLERR | POLLNVAL));
+            if(alive && (revents & (POLLIN | POLLHUP)))
+                alive = Receive(client);
+            if(alive)
+                alive = Send(client, now - client.last_flush >= std::chrono::milliseconds(flush_interval));
+            if(!alive)
+                closed.push_back(i);
+        }
+        if(!closed.empty())
+        {
+            std::lock_guard<std::mutex> lock(subscribers_guard);
+            for(auto i = closed.rbegin(); i != closed.rend(); i++)
+            {
+                close(subscribers[*i]->fd);
+                subscribers.erase(subscribers.begin() + static_cast<std::ptrdiff_t>(*i));
+            }
+        }
+        if(descriptors[0].revents & POLLIN)
+            Accept();
+    }
+}
+
+witmotion_stream_sensor_sink::witmotion_stream_sensor_sink(witmotion_stream_server *target,
+                                                           const uint8_t index,
+                                                           witmotion_packet_sink *chained):
+    server(target),
+    sensor(index),
+    next(chained)
+{}
+
+void witmotion_stream_sensor_sink::Consume(const witmotion_datapacket &packet)
+{
+    server->Publish(sensor, packet, steady_timestamp());
+    if(next != nullptr)
+        next->Consume(packet);
+}
+
+witmotion_stream_client::witmotion_stream_client():
+    socket_fd(-1)
+{}
+
+witmotion_stream_client::~witmotion_stream_client()
+{
+    Disconnect();
+}
+
+bool witmotion_stream_client::Connect(const std::string &socket_path)
+{
+    Disconnect();
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof(address.sun_path))
+    {
+        error = std::string("Socket path is too long: ") + socket_path;
+        return false;
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(socket_fd < 0)
+    {
+        error = std::string("Cannot create socket: ") + std::strerror(errno);
+        return false;
+    }
+    if(connect(socket_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        error = std::string("Cannot connect to ") + socket_path + ": " + std::strerror(errno);
+        Disconnect();
+        return false;
+    }
+    error.clear();
+    return true;
+}
+
+bool witmotion_stream_client::Subscribe(const witmotion_stream_subscription &subscription)
+{
+    uint8_t request[WITMOTION_STREAM_REQUEST_SIZE];
+    encode_stream_subscription(subscription, request);
+    size_t written = 0;
+    while(written < sizeof(request))
+    {
+        ssize_t result = send(socket_fd, request + written, sizeof(request) - written, MSG_NOSIGNAL);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            error = std::string("Cannot send subscription request: ") + std::strerror(errno);
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+bool witmotion_stream_client::ReadExactly(uint8_t *data, const size_t size)
+{
+    size_t received = 0;
+    while(received < size)
+    {
+        ssize_t result = recv(socket_fd, data + received, size - received, 0);
+        if(result == 0)
+        {
+            error = "Connection closed by the server";
+            return false;
+        }
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            error = std::string("Cannot receive data: ") + std::strerror(errno);
+            return false;
+        }
+        received += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+bool witmotion_stream_client::Read(witmotion_stream_message_type &type,
+                                   std::vector<uint8_t> &records,
+                                   size_t &count,
+                                   uint32_t &dropped)
+{
+    uint8_t header[WITMOTION_STREAM_HEADER_SIZE];
+    if(!ReadExactly(header, sizeof(header)))
+        return false;
+    size_t record_size;
+    switch(header[0])
+    {
+    case smtPackets:
+        record_size = WITMOTION_STREAM_PACKET_RECORD_SIZE;
+        break;
+    case smtFrames:
+        record_size = WITMOTION_STREAM_FRAME_RECORD_SIZE;
+        break;
+    default:
+        error = "Protocol error: unknown message type";
+        return false;
+    }
+    type = static_cast<witmotion_stream_message_type>(header[0]);
+    count = get_u16(header + 2);
+    dropped = get_u32(header + 4);
+    records.resize(count * record_size);
+    return ReadExactly(records.data(), records.size());
+}
+
+void witmotion_stream_client::Disconnect()
+{
+    if(socket_fd >= 0)
+        close(socket_fd);
+    socket_fd = -1;
+}
+
+const std::string& witmotion_stream_client::Error() const
+{
+    return error;
+}
+
+}
@@ -0,0 +1,134 @@
+#include "witmotion/task-pool.h"
+
+#include <algorithm>
+
+namespace witmotion
+{
+
+namespace
+{
+
+// Identifies the worker thread, so the tasks spawned by a task go to the queue of its worker
+thread_local const witmotion_task_pool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}
+
+witmotion_task_pool::witmotion_task_pool(const size_t threads):
+    queued(0),
+    pending(0),
+    next(0),
+    stolen(0),
+    stopping(false)
+{
+    size_t count = (threads > 0) ? threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+    for(size_t i = 0; i < count; i++)
+        queues.emplace_back(new worker_queue);
+    for(size_t i = 0; i < count; i++)
+        workers.emplace_back(&witmotion_task_pool::Run, this, i);
+}
+
+witmotion_task_pool::~witmotion_task_pool()
+{
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(idle_guard);
+        stopping = true;
+    }
+    idle.notify_all();
+    for(auto i = workers.begin(); i != workers.end(); i++)
+        i->join();
+}
+
+size_t witmotion_task_pool::Threads() const
+{
+    return workers.size();
+}
+
+uint64_t witmotion_task_pool::Stolen() const
+{
+    return stolen.load(std::memory_order_relaxed);
+}
+
+void witmotion_task_pool::Submit(std::function<void()> task)
+{
+    size_t index = (current_pool == this) ? current_worker : (next++ % queues.size());
+    pending++;
+    {
+        // Counted under the lock and before the push, so the worker going to sleep cannot miss the task
+        std::lock_guard<std::mutex> lock(idle_guard);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->guard);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    idle.notify_one();
+}
+
+void witmotion_task_pool::Wait()
+{
+    std::unique_lock<std::mutex> lock(idle_guard);
+    finished.wait(lock, [this]()
+    {
+        return pending.load() == 0;
+    });
+}
+
+bool witmotion_task_pool::Take(const size_t index, std::function<void()> &task)
+{
+    {
+        worker_queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.guard);
+        if(!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for(size_t i = 1; i < queues.size(); i++)
+    {
+        worker_queue& victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.guard);
+        if(!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void witmotion_task_pool::Run(const size_t index)
+{
+    current_pool = this;
+    current_worker = index;
+    std::function<void()> task;
+    for(;;)
+    {
+        if(Take(index, task))
+        {
+            queued--;
+            task();
+            task = nullptr;
+            if(--pending == 0)
+            {
+                std::lock_guard<std::mutex> lock(idle_guard);
+                finished.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_guard);
+        idle.wait(lock, [this]()
+        {
+            return (queued.load() > 0) || stopping;
+        });
+        if(stopping && (queued.load() == 0))
+            break;
+    }
+}
+
+}
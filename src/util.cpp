@@ -28,6 +28,54 @@ size_t& witmotion_typed_bytecounts::operator[](const witmotion_packet_id id)
     return array[int_id];
 }
 
+witmotion_config_queue::witmotion_config_queue():
+    head(0),
+    length(0)
+{}
+
+bool witmotion_config_queue::push(const witmotion_config_packet &packet)
+{
+    if(length == capacity)
+        return false;
+    array[(head + length) % capacity] = packet;
+    length++;
+    return true;
+}
+
+bool witmotion_config_queue::pop(witmotion_config_packet &packet)
+{
+    if(length == 0)
+        return false;
+    packet = array[head];
+    head = (head + 1) % capacity;
+    length--;
+    return true;
+}
+
+size_t witmotion_config_queue::size() const
+{
+    return length;
+}
+
+bool witmotion_config_queue::empty() const
+{
+    return length == 0;
+}
+
+void witmotion_config_queue::clear()
+{
+    head = 0;
+    length = 0;
+}
+
+uint8_t packet_crc(const witmotion_datapacket &packet)
+{
+    uint8_t crc = packet.header_byte + packet.id_byte;
+    for(uint8_t i = 0; i < 8; i++)
+        crc += packet.datastore.raw[i];
+    return crc;
+}
+
 uint8_t witmotion_output_frequency(const int hertz)
 {
     switch(hertz)
@@ -62,6 +110,37 @@ uint8_t witmotion_output_frequency(const int hertz)
     }
 }
 
+double witmotion_output_frequency_hz(const uint8_t code)
+{
+    switch(code)
+    {
+    case 0x01:
+        return 0.1;
+    case 0x02:
+        return 0.5;
+    case 0x03:
+        return 1.0;
+    case 0x04:
+        return 2.0;
+    case 0x05:
+        return 5.0;
+    case 0x06:
+        return 10.0;
+    case 0x07:
+        return 20.0;
+    case 0x08:
+        return 50.0;
+    case 0x09:
+        return 100.0;
+    case 0x0A:
+        return 125.0;
+    case 0x0B:
+        return 200.0;
+    default:
+        return 0.0;
+    }
+}
+
 uint8_t witmotion_baud_rate(const QSerialPort::BaudRate rate)
 {
     switch(rate)
@@ -85,6 +164,50 @@ uint8_t witmotion_baud_rate(const QSerialPort::BaudRate rate)
     }
 }
 
+QSerialPort::BaudRate witmotion_port_baud_rate(const uint8_t code)
+{
+    switch(code)
+    {
+    case 0x00:
+        return QSerialPort::Baud2400;
+    case 0x01:
+        return QSerialPort::Baud4800;
+    case 0x02:
+        return QSerialPort::Baud9600;
+    case 0x03:
+        return QSerialPort::Baud19200;
+    case 0x04:
+        return QSerialPort::Baud38400;
+    case 0x05:
+        return QSerialPort::Baud57600;
+    case 0x06:
+        return QSerialPort::Baud115200;
+    default:
+        return QSerialPort::UnknownBaud;
+    }
+}
+
+uint32_t witmotion_poll_interval(const uint32_t baud,
+                                 const double frequency,
+                                 const uint32_t types,
+                                 const double observed,
+                                 const uint32_t budget)
+{
+    // 8N1 framing, 10 bits per byte
+    double capacity = static_cast<double>(baud) / 10.0;
+    double rate = capacity;
+    if((frequency > 0.0) && (types > 0))
+        rate = 11.0 * static_cast<double>(types) * frequency;
+    else if(observed > 0.0)
+        rate = 1.25 * observed;
+    if(rate > capacity)
+        rate = capacity;
+    double interval = (rate > 0.0) ? 64.0 * 1000.0 / rate : static_cast<double>(budget);
+    if(interval > static_cast<double>(budget))
+        interval = static_cast<double>(budget);
+    return (interval < 1.0) ? 1 : static_cast<uint32_t>(interval);
+}
+
 /* COMPONENT DECODERS */
 float decode_acceleration(const int16_t* value)
 {
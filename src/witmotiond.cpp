@@ -0,0 +1,799 @@
+#include "witmotion/wt31n-uart.h"
+#include "witmotion/jy901-uart.h"
+#include "witmotion/stream.h"
+#include "witmotion/shared-memory.h"
+#include "witmotion/metrics.h"
+#include "witmotion/histogram.h"
+#include "witmotion/log-writer.h"
+#include "witmotion/bandwidth.h"
+
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QFileInfo>
+#include <QSettings>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+
+void handle_shutdown(int s)
+{
+    (void) s;
+    QCoreApplication::exit(0);
+}
+
+volatile sig_atomic_t reload_requested = 0;
+
+void handle_reload(int s)
+{
+    (void) s;
+    reload_requested = 1;
+}
+
+namespace
+{
+
+using namespace witmotion;
+
+// The output is observed after the port is opened, for at least 5 output periods
+static const int64_t PROBE_DELAY = 1000000000;
+static const int64_t PROBE_WINDOW = 2000000000;
+
+int64_t steady_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* One sensor section of the configuration file */
+struct sensor_settings
+{
+    std::string name;
+    QString device;
+    witmotion_device_class device_class;
+    uint32_t baud;
+    uint32_t interval;
+    uint32_t latency_budget;
+    bool validate;
+    bool event_driven;
+    int index; ///< Stream sensor index, -1 until assigned
+    bool configure; ///< The measurement set and the output frequency are declared
+    std::set<witmotion_packet_id> measurements;
+    int32_t frequency;
+    bool stream;
+    std::string shm;
+    std::string capture;
+};
+
+struct daemon_settings
+{
+    std::string socket;
+    size_t buffer; ///< Per-subscriber buffer, bytes
+    uint32_t flush;
+    std::string metrics;
+    uint32_t metrics_interval; ///< s
+    std::vector<sensor_settings> sensors;
+};
+
+bool unchanged(const sensor_settings& a, const sensor_settings& b)
+{
+    return (a.name == b.name) && (a.device == b.device) && (a.device_class == b.device_class) &&
+            (a.baud == b.baud) && (a.interval == b.interval) && (a.latency_budget == b.latency_budget) &&
+            (a.validate == b.validate) && (a.event_driven == b.event_driven) && (a.index == b.index) &&
+            (a.configure == b.configure) && (a.measurements == b.measurements) && (a.frequency == b.frequency) &&
+            (a.stream == b.stream) && (a.shm == b.shm) && (a.capture == b.capture);
+}
+
+bool load_settings(const QString& file, const daemon_settings& defaults, daemon_settings& result, std::string& error)
+{
+    if(!QFileInfo(file).exists())
+    {
+        error = "Configuration file " + file.toStdString() + " not found";
+        return false;
+    }
+    QSettings ini(file, QSettings::IniFormat);
+    if(ini.status() != QSettings::NoError)
+    {
+        error = "Cannot parse configuration file " + file.toStdString();
+        return false;
+    }
+    result = defaults;
+    result.sensors.clear();
+    ini.beginGroup("daemon");
+    result.socket = ini.value("socket", QString::fromStdString(defaults.socket)).toString().toStdString();
+    result.buffer = static_cast<size_t>(ini.value("buffer", static_cast<uint>(defaults.buffer / 1024)).toUInt()) * 1024;
+    result.flush = ini.value("flush", defaults.flush).toUInt();
+    result.metrics = ini.value("metrics", QString::fromStdString(defaults.metrics)).toString().toStdString();
+    result.metrics_interval = ini.value("metrics-interval", defaults.metrics_interval).toUInt();
+    ini.endGroup();
+    if((result.buffer == 0) || (result.metrics_interval == 0))
+    {
+        error = "Zero subscriber buffer size or metrics interval";
+        return false;
+    }
+    QStringList groups = ini.childGroups();
+    for(auto i = groups.begin(); i != groups.end(); i++)
+    {
+        if(*i == "daemon")
+            continue;
+        sensor_settings sensor;
+        sensor.name = (*i).toStdString();
+        std::string prefix = "Sensor " + sensor.name + ": ";
+        ini.beginGroup(*i);
+        sensor.device = ini.value("device").toString();
+        std::string type = ini.value("type", "WT901").toString().toStdString();
+        sensor.baud = ini.value("baudrate", 9600).toUInt();
+        sensor.interval = ini.value("interval", 50).toUInt();
+        sensor.latency_budget = ini.value("latency-budget", 0).toUInt();
+        // Only the explicit interval bounds the adaptive one
+        if((sensor.latency_budget > 0) && !ini.contains("interval"))
+            sensor.interval = std::max<uint32_t>(sensor.latency_budget, 5);
+        sensor.validate = ini.value("validate", false).toBool();
+        sensor.event_driven = ini.value("event-driven", false).toBool();
+        sensor.index = ini.value("index", -1).toInt();
+        QStringList measurements = ini.value("measurements").toStringList();
+        QString frequency = ini.value("frequency").toString();
+        sensor.stream = ini.value("stream", true).toBool();
+        sensor.shm = ini.value("shm").toString().toStdString();
+        sensor.capture = ini.value("capture").toString().toStdString();
+        ini.endGroup();
+        if(sensor.device.isEmpty())
+        {
+            error = prefix + "the device is not specified";
+            return false;
+        }
+        if(!witmotion_device_class_from_name(type, sensor.device_class))
+        {
+            error = prefix + "unknown sensor type " + type;
+            return false;
+        }
+        if(sensor.interval < 5)
+        {
+            error = prefix + "the polling interval should be at least 5 ms";
+            return false;
+        }
+        if(sensor.index >= static_cast<int>(WITMOTION_STREAM_MAX_SENSORS))
+        {
+            error = prefix + "the stream index should be less than " + std::to_string(WITMOTION_STREAM_MAX_SENSORS);
+            return false;
+        }
+        sensor.configure = !measurements.isEmpty() || !frequency.isEmpty();
+        sensor.frequency = 0;
+        if(sensor.configure)
+        {
+            if(measurements.isEmpty() || frequency.isEmpty())
+            {
+                error = prefix + "the measurements and the frequency should be declared together";
+                return false;
+            }
+            for(auto j = measurements.begin(); j != measurements.end(); j++)
+            {
+                witmotion_packet_id id;
+                if(!witmotion_measurement_from_name((*j).trimmed().toStdString(), id))
+                {
+                    error = prefix + "cannot interpret measurement name " + (*j).toStdString();
+                    return false;
+                }
+                sensor.measurements.insert(id);
+            }
+            sensor.frequency = frequency.toInt();
+            witmotion_bandwidth_planner planner(sensor.device_class);
+            witmotion_bandwidth_plan plan;
+            if(!planner.Check(sensor.measurements, sensor.frequency, sensor.baud, plan))
+            {
+                error = prefix + planner.Error();
+                return false;
+            }
+        }
+        for(auto j = result.sensors.begin(); j != result.sensors.end(); j++)
+        {
+            if(j->device == sensor.device)
+            {
+                error = prefix + "the device is already used by sensor " + j->name;
+                return false;
+            }
+        }
+        result.sensors.push_back(sensor);
+    }
+    if(result.sensors.size() > WITMOTION_STREAM_MAX_SENSORS)
+    {
+        error = "At most " + std::to_string(WITMOTION_STREAM_MAX_SENSORS) + " sensors can be served";
+        return false;
+    }
+    return true;
+}
+
+/* The sensors without the explicit index keep the one they are running with, so the reload does not renumber them */
+bool assign_indices(std::vector<sensor_settings>& sensors, const std::map<std::string, int>& running, std::string& error)
+{
+    bool used[WITMOTION_STREAM_MAX_SENSORS] = {};
+    for(auto i = sensors.begin(); i != sensors.end(); i++)
+    {
+        if(i->index < 0)
+            continue;
+        if(used[i->index])
+        {
+            error = "Sensor " + i->name + ": the stream index " + std::to_string(i->index) + " is already used";
+            return false;
+        }
+        used[i->index] = true;
+    }
+    for(auto i = sensors.begin(); i != sensors.end(); i++)
+    {
+        if(i->index >= 0)
+            continue;
+        auto previous = running.find(i->name);
+        if((previous != running.end()) && !used[previous->second])
+            i->index = previous->second;
+        else
+        {
+            int free = 0;
+            while(used[free])
+                free++;
+            i->index = free;
+        }
+        used[i->index] = true;
+    }
+    return true;
+}
+
+class sink_fanout: public witmotion_packet_sink
+{
+public:
+    std::vector<witmotion_packet_sink*> targets;
+    virtual void Consume(const witmotion_datapacket& packet)
+    {
+        for(auto i = targets.begin(); i != targets.end(); i++)
+            (*i)->Consume(packet);
+    }
+};
+
+enum probe_stage
+{
+    psWaiting, ///< For the port to open and the output to start
+    psMeasuring, ///< The output is compared with the configuration at the deadline
+    psSettling, ///< The configuration has been written
+    psVerifying,
+    psDone
+};
+
+struct managed_sensor
+{
+    sensor_settings settings;
+    witmotion_sensor_metrics* metrics;
+    bool failed;
+    probe_stage stage;
+    int64_t deadline;
+    int64_t started;
+    uint64_t counts[WITMOTION_METRICS_PACKET_TYPES];
+    std::unique_ptr<witmotion_log_writer> capture;
+    std::unique_ptr<witmotion_shm_publisher> publisher;
+    std::unique_ptr<witmotion_stream_sensor_sink> stream;
+    sink_fanout sinks;
+    // Declared last, so the reader is stopped before the sinks are destroyed
+    std::unique_ptr<QAbstractWitmotionSensorController> controller;
+};
+
+struct daemon_state
+{
+    QString file;
+    daemon_settings defaults;
+    daemon_settings current;
+    QThread* engine;
+    witmotion_stream_server* server;
+    witmotion_metrics_registry* registry;
+    std::map<std::string, std::unique_ptr<managed_sensor>> sensors;
+};
+
+std::unique_ptr<managed_sensor> start_sensor(daemon_state& state, const sensor_settings& settings, std::string& error)
+{
+    std::unique_ptr<managed_sensor> sensor(new managed_sensor());
+    sensor->settings = settings;
+    sensor->metrics = state.registry->Sensor(settings.name);
+    sensor->failed = false;
+    sensor->stage = settings.configure ? psWaiting : psDone;
+    sensor->deadline = steady_timestamp() + PROBE_DELAY;
+    sensor->started = 0;
+    if(!settings.capture.empty())
+    {
+        sensor->capture.reset(new witmotion_log_writer(settings.capture, logBinary));
+        if(!sensor->capture->Open())
+        {
+            error = sensor->capture->Error();
+            return nullptr;
+        }
+        sensor->sinks.targets.push_back(sensor->capture.get());
+    }
+    if(!settings.shm.empty())
+    {
+        sensor->publisher.reset(new witmotion_shm_publisher(settings.shm));
+        if(!sensor->publisher->Open())
+        {
+            error = sensor->publisher->Error();
+            return nullptr;
+        }
+        sensor->sinks.targets.push_back(sensor->publisher.get());
+    }
+    if(settings.stream)
+    {
+        sensor->stream.reset(new witmotion_stream_sensor_sink(state.server, static_cast<uint8_t>(settings.index)));
+        sensor->sinks.targets.push_back(sensor->stream.get());
+    }
+    QSerialPort::BaudRate rate = static_cast<QSerialPort::BaudRate>(settings.baud);
+    QAbstractWitmotionSensorController* controller;
+    if(settings.device_class == dcWT31N)
+        controller = new wt31n::QWitmotionWT31NSensor(settings.device, rate, settings.interval, state.engine);
+    else if(settings.device_class == dcJY901)
+        controller = new jy901::QWitmotionJY901Sensor(settings.device, rate, settings.interval, state.engine);
+    else
+        controller = new wt901::QWitmotionWT901Sensor(settings.device, rate, settings.interval, state.engine);
+    sensor->controller.reset(controller);
+    controller->SetValidation(settings.validate);
+    controller->SetEventDriven(settings.event_driven);
+    controller->SetLatencyBudget(settings.latency_budget);
+    controller->SetMetrics(sensor->metrics);
+    if(!sensor->sinks.targets.empty())
+        controller->SetPacketSink(&sensor->sinks);
+    // The failed sensor stays stopped until the next reload, the others keep running
+    managed_sensor* handle = sensor.get();
+    QObject::connect(controller, &QAbstractWitmotionSensorController::ErrorOccurred, [handle](const QString description)
+    {
+        std::cout << "ERROR: Sensor " << handle->settings.name << ": " << description.toStdString() << std::endl;
+        handle->failed = true;
+    });
+    controller->Start();
+    return sensor;
+}
+
+bool output_matches(const managed_sensor& sensor, const int64_t now)
+{
+    const sensor_settings& settings = sensor.settings;
+    const std::set<witmotion_packet_id>& expected = (settings.device_class == dcWT31N) ?
+                witmotion_bandwidth_planner::PacketTypes(dcWT31N) : settings.measurements;
+    double frequency = witmotion_output_frequency_hz(witmotion_output_frequency(settings.frequency));
+    witmotion_bandwidth_planner planner(settings.device_class);
+    witmotion_bandwidth_plan plan;
+    planner.Check(settings.measurements, settings.frequency, settings.baud, plan);
+    // The slow output gives too few packets per window, and the saturated one is reduced by the sensor
+    bool compare_rate = (frequency >= 1.0) && !plan.saturated;
+    double seconds = static_cast<double>(now - sensor.started) / 1e9;
+    // Without the periodic output the enabled types may be silent, only the unexpected ones are detected
+    bool compare_presence = (frequency * seconds >= 1.0);
+    for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+    {
+        uint64_t received = sensor.metrics->packets[i].load(std::memory_order_relaxed) - sensor.counts[i];
+        bool enabled = (expected.find(static_cast<witmotion_packet_id>(pidRTC + i)) != expected.end());
+        if((received > 0) && !enabled)
+            return false;
+        if((received == 0) && enabled && compare_presence)
+            return false;
+        if(enabled && compare_rate && (std::fabs(static_cast<double>(received) / seconds - frequency) > 0.25 * frequency))
+            return false;
+    }
+    return true;
+}
+
+/* The device configuration is written only if the observed output differs from the declared one,
+   so the restart does not rewrite the sensor flash */
+void probe(managed_sensor& sensor)
+{
+    int64_t now = steady_timestamp();
+    if((sensor.stage == psDone) || sensor.failed || (now < sensor.deadline))
+        return;
+    const sensor_settings& settings = sensor.settings;
+    if((sensor.stage == psWaiting) || (sensor.stage == psSettling))
+    {
+        for(size_t i = 0; i < WITMOTION_METRICS_PACKET_TYPES; i++)
+            sensor.counts[i] = sensor.metrics->packets[i].load(std::memory_order_relaxed);
+        double frequency = witmotion_output_frequency_hz(witmotion_output_frequency(settings.frequency));
+        // 5 periods, up to 50 s at 0.1 Hz, so every enabled type is expected in the window
+        int64_t window = (frequency > 0.0) ? static_cast<int64_t>(5e9 / frequency) : PROBE_WINDOW;
+        sensor.started = now;
+        sensor.deadline = now + std::max(PROBE_WINDOW, window);
+        sensor.stage = (sensor.stage == psWaiting) ? psMeasuring : psVerifying;
+        return;
+    }
+    bool matches = output_matches(sensor, now);
+    if(sensor.stage == psVerifying)
+    {
+        if(matches)
+            std::cout << "Sensor " << settings.name << ": configuration applied" << std::endl;
+        else
+            std::cout << "WARNING: Sensor " << settings.name << ": the output differs from the configuration after it has been applied" << std::endl;
+        sensor.stage = psDone;
+        return;
+    }
+    if(matches)
+    {
+        std::cout << "Sensor " << settings.name << ": the output matches the configuration, the sensor is not reconfigured" << std::endl;
+        sensor.stage = psDone;
+        return;
+    }
+    witmotion_bandwidth_planner planner(settings.device_class);
+    witmotion_bandwidth_plan plan;
+    planner.Check(settings.measurements, settings.frequency, settings.baud, plan);
+    if(plan.saturated)
+        std::cout << "WARNING: Sensor " << settings.name << ": the output needs " << plan.load << " bytes/s, exceeding the link capacity at "
+                  << settings.baud << " baud, the sensor will reduce it" << std::endl;
+    witmotion_config_sequence sequence = planner.Sequence(plan, settings.baud);
+    std::cout << "Sensor " << settings.name << ": the output differs from the configuration, writing "
+              << sequence.length << " configuration commands" << std::endl;
+    sensor.controller->ApplyConfiguration(sequence);
+    sensor.deadline = now + static_cast<int64_t>(sequence.length * sequence.delay) * 1000000 + PROBE_DELAY;
+    sensor.stage = psSettling;
+}
+
+bool apply_settings(daemon_state& state, daemon_settings& next)
+{
+    std::map<std::string, int> running;
+    for(auto i = state.sensors.begin(); i != state.sensors.end(); i++)
+        running[i->first] = i->second->settings.index;
+    std::string error;
+    if(!assign_indices(next.sensors, running, error))
+    {
+        std::cout << "ERROR: " << error << std::endl;
+        return false;
+    }
+    // The removed and the changed sensors are stopped first, releasing their ports and stream indices
+    for(auto i = state.sensors.begin(); i != state.sensors.end();)
+    {
+        const sensor_settings* declared = nullptr;
+        for(auto j = next.sensors.begin(); j != next.sensors.end(); j++)
+            if(j->name == i->first)
+                declared = &(*j);
+        if((declared != nullptr) && unchanged(*declared, i->second->settings) && !i->second->failed)
+        {
+            i++;
+            continue;
+        }
+        std::cout << "Stopping sensor " << i->first << std::endl;
+        i = state.sensors.erase(i);
+    }
+    bool success = true;
+    for(auto i = next.sensors.begin(); i != next.sensors.end(); i++)
+    {
+        if(state.sensors.find(i->name) != state.sensors.end())
+            continue;
+        std::unique_ptr<managed_sensor> sensor = start_sensor(state, *i, error);
+        if(!sensor)
+        {
+            std::cout << "ERROR: Sensor " << i->name << ": " << error << std::endl;
+            success = false;
+            continue;
+        }
+        std::cout << "Sensor " << i->name << ": index " << i->index << ", /dev/" << i->device.toStdString()
+                  << " at " << i->baud << " baud" << std::endl;
+        state.sensors[i->name] = std::move(sensor);
+    }
+    state.current = next;
+    return success;
+}
+
+void configure_metrics(daemon_state& state, QTimer& timer)
+{
+    timer.stop();
+    if(state.current.metrics.empty())
+        return;
+    timer.setInterval(static_cast<int>(state.current.metrics_interval * 1000));
+    timer.start();
+    std::cout << "Writing metrics to " << state.current.metrics << " every " << state.current.metrics_interval << " s" << std::endl;
+}
+
+void reload(daemon_state& state, QTimer& metrics_timer)
+{
+    std::cout << "Reloading " << state.file.toStdString() << std::endl;
+    daemon_settings next;
+    std::string error;
+    if(!load_settings(state.file, state.defaults, next, error))
+    {
+        std::cout << "ERROR: " << error << ", keeping the running configuration" << std::endl;
+        return;
+    }
+    if((next.socket != state.current.socket) || (next.buffer != state.current.buffer) || (next.flush != state.current.flush))
+    {
+        std::cout << "WARNING: The socket settings are applied at the restart only" << std::endl;
+        next.socket = state.current.socket;
+        next.buffer = state.current.buffer;
+        next.flush = state.current.flush;
+    }
+    apply_settings(state, next);
+    configure_metrics(state, metrics_timer);
+}
+
+int run_configured(QCoreApplication& app, const QString& file, const daemon_settings& defaults)
+{
+    struct sigaction sigReloadHandler;
+    sigReloadHandler.sa_handler = handle_reload;
+    sigemptyset(&sigReloadHandler.sa_mask);
+    sigReloadHandler.sa_flags = 0;
+    sigaction(SIGHUP, &sigReloadHandler, NULL);
+
+    daemon_settings settings;
+    std::string error;
+    if(!load_settings(file, defaults, settings, error))
+    {
+        std::cout << "ERROR: " << error << std::endl;
+        return 1;
+    }
+    witmotion_stream_server server(settings.socket, settings.buffer, settings.flush);
+    if(!server.Open())
+    {
+        std::cout << "ERROR: " << server.Error() << std::endl;
+        return 1;
+    }
+    witmotion_metrics_registry registry;
+    // All the readers share one thread, the ports are multiplexed by its event loop
+    QThread engine;
+    engine.start();
+    daemon_state state;
+    state.file = file;
+    state.defaults = defaults;
+    state.engine = &engine;
+    state.server = &server;
+    state.registry = &registry;
+    int result = 1;
+    if(apply_settings(state, settings))
+    {
+        QTimer metrics_timer;
+        QObject::connect(&metrics_timer, &QTimer::timeout, [&state, &registry]()
+        {
+            if(!registry.WriteTextfile(state.current.metrics))
+                std::cout << "WARNING: " << registry.Error() << std::endl;
+        });
+        configure_metrics(state, metrics_timer);
+        // The signal handler only sets the flag, the reload runs in the main thread
+        QTimer supervisor;
+        supervisor.setInterval(250);
+        QObject::connect(&supervisor, &QTimer::timeout, [&state, &metrics_timer]()
+        {
+            if(reload_requested)
+            {
+                reload_requested = 0;
+                reload(state, metrics_timer);
+            }
+            for(auto i = state.sensors.begin(); i != state.sensors.end(); i++)
+                probe(*(i->second));
+        });
+        supervisor.start();
+        std::cout << "Serving " << state.sensors.size() << " sensor(s) at " << state.current.socket << ", send SIGHUP to reload " << file.toStdString() << std::endl;
+        result = app.exec();
+    }
+    state.sensors.clear();
+    engine.quit();
+    engine.wait();
+    if(!state.current.metrics.empty() && !registry.WriteTextfile(state.current.metrics))
+        std::cout << "WARNING: " << registry.Error() << std::endl;
+    std::cout << "Shutting down, " << server.Subscribers() << " subscriber(s) disconnected" << std::endl;
+    server.Close();
+    return result;
+}
+
+}
+
+int main(int argc, char** args)
+{
+    struct sigaction sigShutdownHandler;
+    sigShutdownHandler.sa_handler = handle_shutdown;
+    sigemptyset(&sigShutdownHandler.sa_mask);
+    sigShutdownHandler.sa_flags = 0;
+    sigaction(SIGINT, &sigShutdownHandler, NULL);
+    sigaction(SIGTERM, &sigShutdownHandler, NULL);
+
+    QCoreApplication app(argc, args);
+    app.setApplicationVersion(QString(witmotion::library_version().c_str()));
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WITMOTION SENSOR STREAMING DAEMON");
+    parser.addHelpOption();
+    QCommandLineOption ConfigOption(QStringList() << "c" << "config",
+                                    "Serve the sensors declared in the configuration file, reloaded on SIGHUP; the sensor options are ignored",
+                                    "FILE.ini",
+                                    "");
+    parser.addOption(ConfigOption);
+    QCommandLineOption SocketOption(QStringList() << "s" << "socket",
+                                    "Unix domain socket path",
+                                    "PATH",
+                                    "/tmp/witmotion.sock");
+    parser.addOption(SocketOption);
+    QCommandLineOption DeviceNameOption(QStringList() << "d" << "device",
+                                        "Port serial device name, without \'/dev\', can be repeated, the sensor index is the position in the list",
+                                        "ttyUSB0",
+                                        "ttyUSB0");
+    parser.addOption(DeviceNameOption);
+    QCommandLineOption TypeOption(QStringList() << "t" << "type",
+                                  "Sensor type",
+                                  "WT31N/WT901/JY901",
+                                  "WT901");
+    parser.addOption(TypeOption);
+    QCommandLineOption BaudRateOption(QStringList() << "b" << "baudrate",
+                                      "Baudrate to set up the port",
+                                      "2400 to 115200",
+                                      "9600");
+    parser.addOption(BaudRateOption);
+    QCommandLineOption IntervalOption(QStringList() << "i" << "interval",
+                                      "Port polling interval",
+                                      "50 ms",
+                                      "50");
+    parser.addOption(IntervalOption);
+    QCommandLineOption ValidateOption("validate",
+                                      "Accept only valid datapackets");
+    parser.addOption(ValidateOption);
+    QCommandLineOption BufferOption("buffer",
+                                    "Per-subscriber buffer size, the records exceeding it are dropped",
+                                    "KiB",
+                                    "256");
+    parser.addOption(BufferOption);
+    QCommandLineOption FlushOption("flush",
+                                   "Maximal delay of the incomplete batch",
+                                   "10 ms",
+                                   "10");
+    parser.addOption(FlushOption);
+    QCommandLineOption SharedMemoryOption("shm",
+                                          "Also publish every sensor into the POSIX shared memory object PREFIX-INDEX",
+                                          "PREFIX",
+                                          "/witmotion");
+    parser.addOption(SharedMemoryOption);
+    QCommandLineOption MetricsOption("metrics",
+                                     "Write the metrics of all the sensors to FILE in the Prometheus text format, e.g. into the textfile collector directory of node_exporter",
+                                     "FILE.prom",
+                                     "");
+    parser.addOption(MetricsOption);
+    QCommandLineOption MetricsIntervalOption("metrics-interval",
+                                             "Metrics file update interval",
+                                             "15 s",
+                                             "15");
+    parser.addOption(MetricsIntervalOption);
+    QCommandLineOption TimingOption("timing",
+                                    "Collect the per-packet-type inter-arrival and read-to-delivery latency histograms, printed at exit");
+    parser.addOption(TimingOption);
+    QCommandLineOption LatencyBudgetOption("latency-budget",
+                                           "Adapt the port polling interval to the link load and the output frequency, not exceeding the budget and the explicit --interval; 0 keeps the fixed interval",
+                                           "ms",
+                                           "0");
+    parser.addOption(LatencyBudgetOption);
+    parser.process(app);
+
+    if(parser.isSet(ConfigOption))
+    {
+        daemon_settings defaults;
+        defaults.socket = parser.value(SocketOption).toStdString();
+        defaults.buffer = static_cast<size_t>(parser.value(BufferOption).toUInt()) * 1024;
+        defaults.flush = parser.value(FlushOption).toUInt();
+        defaults.metrics = parser.value(MetricsOption).toStdString();
+        defaults.metrics_interval = parser.value(MetricsIntervalOption).toUInt();
+        return run_configured(app, parser.value(ConfigOption), defaults);
+    }
+
+    QStringList devices = parser.values(DeviceNameOption);
+    if(devices.isEmpty())
+        devices << parser.value(DeviceNameOption);
+    if(static_cast<size_t>(devices.size()) > witmotion::WITMOTION_STREAM_MAX_SENSORS)
+    {
+        std::cout << "ERROR: At most " << witmotion::WITMOTION_STREAM_MAX_SENSORS << " sensors can be served" << std::endl;
+        return 1;
+    }
+    QString type = parser.value(TypeOption).toUpper();
+    if(type != "WT31N" && type != "WT901" && type != "JY901")
+    {
+        std::cout << "ERROR: Unknown sensor type " << type.toStdString() << std::endl;
+        return 1;
+    }
+    QSerialPort::BaudRate rate = static_cast<QSerialPort::BaudRate>(parser.value(BaudRateOption).toUInt());
+    uint32_t interval = parser.value(IntervalOption).toUInt();
+    if(interval < 5)
+    {
+        std::cout << "Wrong port polling interval specified, falling back to 50 ms!" << std::endl;
+        interval = 50;
+    }
+    uint32_t latency_budget = parser.value(LatencyBudgetOption).toUInt();
+    // Only the explicit interval bounds the adaptive one
+    if((latency_budget > 0) && !parser.isSet(IntervalOption))
+        interval = latency_budget;
+
+    witmotion::witmotion_stream_server server(parser.value(SocketOption).toStdString(),
+                                              static_cast<size_t>(parser.value(BufferOption).toUInt()) * 1024,
+                                              parser.value(FlushOption).toUInt());
+    if(!server.Open())
+    {
+        std::cout << "ERROR: " << server.Error() << std::endl;
+        return 1;
+    }
+
+    witmotion::witmotion_metrics_registry metrics;
+    bool metrics_enabled = parser.isSet(MetricsOption);
+    std::vector<std::unique_ptr<witmotion::witmotion_packet_timing>> timings;
+    std::vector<std::unique_ptr<witmotion::witmotion_shm_publisher>> publishers;
+    std::vector<std::unique_ptr<witmotion::witmotion_stream_sensor_sink>> sinks;
+    std::vector<std::unique_ptr<witmotion::QAbstractWitmotionSensorController>> sensors;
+    QThread engine;
+    engine.start();
+    for(int i = 0; i < devices.size(); i++)
+    {
+        witmotion::witmotion_shm_publisher* publisher = nullptr;
+        if(parser.isSet(SharedMemoryOption))
+        {
+            std::string name = parser.value(SharedMemoryOption).toStdString() + "-" + std::to_string(i);
+            publishers.emplace_back(new witmotion::witmotion_shm_publisher(name));
+            publisher = publishers.back().get();
+            if(!publisher->Open())
+            {
+                std::cout << "ERROR: " << publisher->Error() << std::endl;
+                return 1;
+            }
+        }
+        sinks.emplace_back(new witmotion::witmotion_stream_sensor_sink(&server, static_cast<uint8_t>(i), publisher));
+        witmotion::QAbstractWitmotionSensorController* sensor;
+        if(type == "WT31N")
+            sensor = new witmotion::wt31n::QWitmotionWT31NSensor(devices[i], rate, interval, &engine);
+        else if(type == "JY901")
+            sensor = new witmotion::jy901::QWitmotionJY901Sensor(devices[i], rate, interval, &engine);
+        else
+            sensor = new witmotion::wt901::QWitmotionWT901Sensor(devices[i], rate, interval, &engine);
+        sensors.emplace_back(sensor);
+        sensor->SetValidation(parser.isSet(ValidateOption));
+        sensor->SetLatencyBudget(latency_budget);
+        sensor->SetPacketSink(sinks.back().get());
+        if(metrics_enabled)
+            sensor->SetMetrics(metrics.Sensor(devices[i].toStdString()));
+        if(parser.isSet(TimingOption))
+        {
+            timings.emplace_back(new witmotion::witmotion_packet_timing());
+            sensor->SetTiming(timings.back().get());
+        }
+        QString device = devices[i];
+        QObject::connect(sensor, &witmotion::QAbstractWitmotionSensorController::ErrorOccurred,
+                         [device](const QString description)
+        {
+            std::cout << "ERROR: " << device.toStdString() << ": " << description.toStdString() << std::endl;
+            QCoreApplication::exit(1);
+        });
+        std::cout << "Sensor " << i << ": " << type.toStdString() << " at /dev/" << device.toStdString() << std::endl;
+    }
+    QTimer metrics_timer;
+    if(metrics_enabled)
+    {
+        std::string metrics_file = parser.value(MetricsOption).toStdString();
+        uint32_t metrics_interval = parser.value(MetricsIntervalOption).toUInt();
+        if(metrics_interval == 0)
+        {
+            std::cout << "Wrong metrics interval specified, falling back to 15 s!" << std::endl;
+            metrics_interval = 15;
+        }
+        metrics_timer.setInterval(static_cast<int>(metrics_interval * 1000));
+        QObject::connect(&metrics_timer, &QTimer::timeout, [&metrics, metrics_file]()
+        {
+            if(!metrics.WriteTextfile(metrics_file))
+                std::cout << "WARNING: " << metrics.Error() << std::endl;
+        });
+        metrics_timer.start();
+        std::cout << "Writing metrics to " << metrics_file << " every " << metrics_interval << " s" << std::endl;
+    }
+    std::cout << "Serving at " << parser.value(SocketOption).toStdString() << std::endl;
+    for(auto i = sensors.begin(); i != sensors.end(); i++)
+        (*i)->Start();
+    int result = app.exec();
+    // The reader threads are stopped by the controllers before the sinks and the server are destroyed
+    sensors.clear();
+    engine.quit();
+    engine.wait();
+    // The final values are kept for the collector until the next start
+    if(metrics_enabled && !metrics.WriteTextfile(parser.value(MetricsOption).toStdString()))
+        std::cout << "WARNING: " << metrics.Error() << std::endl;
+    for(size_t i = 0; i < timings.size(); i++)
+    {
+        std::cout << "Sensor " << i << " packet timing:" << std::endl;
+        timings[i]->Report(std::cout);
+    }
+    std::cout << "Shutting down, " << server.Subscribers() << " subscriber(s) disconnected" << std::endl;
+    server.Close();
+    return result;
+}
@@ -1,15 +1,21 @@
 #include "witmotion/wt31n-uart.h"
+#include "witmotion/statistics.h"
+#include "witmotion/log-writer.h"
+#include "witmotion/histogram.h"
+#include "witmotion/cadence.h"
 
 #include <QCommandLineParser>
 #include <QCommandLineOption>
 
 #include <iostream>
+#include <memory>
 #include <iomanip>
 #include <string>
 #include <list>
 #include <chrono>
 #include <ctime>
 #include <fstream>
+#include <sstream>
 
 #include <signal.h>
 #include <stdlib.h>
@@ -17,17 +23,6 @@
 
 using namespace witmotion::wt31n;
 
-double variance(const std::vector<float>& array)
-{
-    double sum = std::accumulate(array.begin(), array.end(), 0.f);
-    double mean = sum / static_cast<double>(array.size());
-    double sq_dif = 0.f;
-    for(auto i = array.begin(); i != array.end(); i++)
-        sq_dif += std::pow((*i) - mean, 2);
-    sq_dif /= (array.size() > 1) ? static_cast<double>(array.size() - 1) : 1.f;
-    return std::sqrt(sq_dif);
-}
-
 void handle_shutdown(int s)
 {    
     // avoid compiler complains ...
@@ -75,7 +70,15 @@ int main(int argc, char** args)
                                             "10");
     QCommandLineOption CovarianceOption("covariance",
                                         "Measure spatial covariance");
-    QCommandLineOption LogOption("log", "Log acquisition to sensor.log file");
+    QCommandLineOption LogOption("log", "Log acquisition to sensor.log file (sensor.bin for BINARY, sensor directory of .npy files for NPY, sensor.npz for NPZ format)");
+    QCommandLineOption LogFormatOption("log-format",
+                                       "Log file format: decoded values, raw packets, or decoded frames as NumPy column arrays",
+                                       "TEXT/BINARY/NPY/NPZ",
+                                       "TEXT");
+    QCommandLineOption LogSyncOption("log-sync",
+                                     "Synchronize the log file to the storage periodically, 0 disables",
+                                     "ms",
+                                     "0");
     parser.addOption(BaudRateOption);
     parser.addOption(IntervalOption);
     parser.addOption(DeviceNameOption);
@@ -85,6 +88,21 @@ int main(int argc, char** args)
     parser.addOption(SetBaudRateOption);
     parser.addOption(SetPollingRateOption);
     parser.addOption(LogOption);
+    parser.addOption(LogFormatOption);
+    parser.addOption(LogSyncOption);
+    QCommandLineOption TimingOption("timing",
+                                    "Collect the per-packet-type inter-arrival and read-to-delivery latency histograms, printed at exit");
+    parser.addOption(TimingOption);
+    QCommandLineOption LatencyBudgetOption("latency-budget",
+                                           "Adapt the port polling interval to the link load and the output frequency, not exceeding the budget and the explicit --interval; 0 keeps the fixed interval",
+                                           "ms",
+                                           "0");
+    parser.addOption(LatencyBudgetOption);
+    QCommandLineOption ExpectedFrequencyOption("expected-frequency",
+                                               "Configured output frequency for the packet loss estimation, 0 learns it from the data",
+                                               "Hz",
+                                               "0");
+    parser.addOption(ExpectedFrequencyOption);
     parser.process(app);
 
     QSerialPort::BaudRate rate;
@@ -110,8 +128,21 @@ int main(int argc, char** args)
         std::cout << "Wrong port polling interval specified, falling back to 50 ms!" << std::endl;
         interval = 50;
     }
+    uint32_t latency_budget = parser.value(LatencyBudgetOption).toUInt();
+    // Only the explicit interval bounds the adaptive one
+    if((latency_budget > 0) && !parser.isSet(IntervalOption))
+        interval = latency_budget;
     QWitmotionWT31NSensor sensor(device, rate, interval);
     sensor.SetValidation(parser.isSet(ValidateOption));
+    sensor.SetLatencyBudget(latency_budget);
+    std::unique_ptr<witmotion::witmotion_packet_timing> timing;
+    if(parser.isSet(TimingOption))
+    {
+        timing.reset(new witmotion::witmotion_packet_timing());
+        sensor.SetTiming(timing.get());
+    }
+    witmotion::witmotion_cadence_estimator cadence(parser.value(ExpectedFrequencyOption).toDouble());
+    sensor.SetCadence(&cadence);
 
     // Control tasks
     bool control_set_baud = parser.isSet(SetBaudRateOption);
@@ -120,10 +151,50 @@ int main(int argc, char** args)
     bool covariance = parser.isSet(CovarianceOption);
     bool control_set_freq = parser.isSet(SetPollingRateOption);
     uint32_t new_freq = parser.value(SetPollingRateOption).toUInt();
+    bool logging = parser.isSet(LogOption);
 
     // Setting up data capturing slots: mutable/immutable C++14 lambda functions
     bool first = true;
-    std::vector<float> accels_x, accels_y, accels_z, rolls, pitches, times;
+    witmotion::witmotion_running_statistics accels_x, accels_y, accels_z, rolls, pitches, times;
+    // The log is written continuously by the background thread, the acquisition handler only copies the packets
+    QString log_format_name = parser.value(LogFormatOption).toUpper();
+    witmotion::witmotion_log_format log_format = witmotion::logText;
+    std::string log_name = "sensor.log";
+    if(log_format_name == "BINARY")
+    {
+        log_format = witmotion::logBinary;
+        log_name = "sensor.bin";
+    }
+    else if(log_format_name == "NPY")
+    {
+        log_format = witmotion::logNumPy;
+        log_name = "sensor";
+    }
+    else if(log_format_name == "NPZ")
+    {
+        log_format = witmotion::logNumPyArchive;
+        log_name = "sensor.npz";
+    }
+    witmotion::witmotion_log_writer logger(log_name,
+                                           log_format,
+                                           32768,
+                                           500,
+                                           parser.value(LogSyncOption).toUInt());
+    std::time_t timestamp_start = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    if(logging)
+    {
+        std::ostringstream preamble;
+        preamble << "WITMOTION WT31N STANDALONE SENSOR CONTROLLER/MONITOR" << std::endl << std::endl
+                 << "Device /dev/" << device.toStdString() << " opened at " << static_cast<int32_t>(rate) << " baud" << std::endl
+                 << std::endl << "Measurements:" << std::endl;
+        if(logger.Open(preamble.str()))
+            std::cout << "Writing log file to " << log_name << std::endl;
+        else
+        {
+            std::cout << "ERROR: " << logger.Error() << std::endl;
+            logging = false;
+        }
+    }
 
     QObject::connect(&sensor, &QWitmotionWT31NSensor::ErrorOccurred, [](const QString description)
     {
@@ -140,6 +211,8 @@ int main(int argc, char** args)
                      &rolls,
                      &pitches,
                      &times,
+                     &logger,
+                     logging,
                      control_set_baud,
                      control_baud_9600,
                      control_calibration,
@@ -199,33 +272,35 @@ int main(int argc, char** args)
         {
         case witmotion::pidAcceleration:
             witmotion::decode_accelerations(packet, ax, ay, az, t);
-            accels_x.push_back(ax);
-            accels_y.push_back(ay);
-            accels_z.push_back(az);
+            accels_x.Push(ax);
+            accels_y.Push(ay);
+            accels_z.Push(az);
             std::cout << packets << "\t"
                       << "Accelerations [X|Y|Z]:\t[ "
                       << ax << " | "
                       << ay << " | "
                       << az << " ]"
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         case witmotion::pidAngles:
             witmotion::decode_angles(packet, roll, pitch, yaw, t);
-            rolls.push_back(roll);
-            pitches.push_back(pitch);
+            rolls.Push(roll);
+            pitches.Push(pitch);
             std::cout << packets << "\t"
                       << "Euler angles [R|P|Y]:\t[ "
                       << roll << " | "
                       << pitch << " | "
                       << yaw << " ]"
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         default:
             break;
         }
-        times.push_back(elapsed_seconds.count());
+        times.Push(elapsed_seconds.count());
+        if(logging)
+            logger.Consume(packet);
 
         packets++;
         time_start = time_acquisition;
@@ -237,84 +312,76 @@ int main(int argc, char** args)
     int result = app.exec();
 
     std::cout << "Average sensor return rate "
-              << std::accumulate(times.begin(), times.end(), 0.f) / times.size()
+              << times.Mean()
               << " s" << std::endl << std::endl;
+    std::cout << "Effective output rate per packet type:" << std::endl;
+    cadence.Report(std::cout);
+    std::cout << std::endl;
+
+    if(timing)
+    {
+        std::cout << "Packet timing:" << std::endl;
+        timing->Report(std::cout);
+        std::cout << std::endl;
+    }
 
     if(covariance)
     {
         std::cout << "Calculating noise covariance matrices..." << std::endl
                   << std::endl
-                  << "Accelerations (total for " << accels_x.size() << " measurements): " << std::endl
-                  << "[\t" << variance(accels_x) << "\t0.00000\t0.00000" << std::endl
-                  << "\t0.00000\t" << variance(accels_y) << "\t0.00000" << std::endl
-                  << "\t0.00000\t0.00000\t" << variance(accels_z) << "\t]" << std::endl
+                  << "Accelerations (total for " << accels_x.Count() << " measurements): " << std::endl
+                  << "[\t" << accels_x.StandardDeviation() << "\t0.00000\t0.00000" << std::endl
+                  << "\t0.00000\t" << accels_y.StandardDeviation() << "\t0.00000" << std::endl
+                  << "\t0.00000\t0.00000\t" << accels_z.StandardDeviation() << "\t]" << std::endl
                   << std::endl
-                  << "Angles (total for " << pitches.size() << " measurements): " << std::endl
-                  << "[\t" << variance(rolls) << "\t0.00000\t0.00000" << std::endl
-                  << "\t0.00000\t" << variance(pitches) << "\t0.00000" << std::endl
+                  << "Angles (total for " << pitches.Count() << " measurements): " << std::endl
+                  << "[\t" << rolls.StandardDeviation() << "\t0.00000\t0.00000" << std::endl
+                  << "\t0.00000\t" << pitches.StandardDeviation() << "\t0.00000" << std::endl
                   << "\t0.00000\t0.00000\t0.00000\t]" << std::endl
                   << std::endl;
     }
 
-    if(parser.isSet(LogOption))
+    if(logging)
     {
-        std::cout << "Writing log file to sensor.log" << std::endl;
-        std::fstream logfile;
-        logfile.open("sensor.log", std::ios::out|std::ios::trunc);
-        logfile.precision(5);
-        logfile << std::fixed;
-        logfile << "WITMOTION WT31N STANDALONE SENSOR CONTROLLER/MONITOR" << std::endl << std::endl;
-        auto time_start = std::chrono::system_clock::now();
-        std::time_t timestamp_start = std::chrono::system_clock::to_time_t(time_start);
-        logfile << "Device /dev/" << device.toStdString() << " opened at " << static_cast<int32_t>(rate) << " baud" << std::endl;
-        if(accels_x.empty() || rolls.empty())
-            logfile << "Raw data storage is empty, only control operations performed" << std::endl;
-        else
+        logger.Close();
+        std::cout << "Log file " << log_name << ": " << logger.Written() << " packets written, "
+                  << logger.Dropped() << " dropped" << std::endl;
+        if(!logger.Error().empty())
+            std::cout << "ERROR: " << logger.Error() << std::endl;
+        if(log_format == witmotion::logText)
         {
-            size_t tc = 0;
-            logfile << std::endl << "Measurements (only full packets logged):" << std::endl;
-            for(size_t i = 0; i < std::min(accels_x.size(), rolls.size()); i++)
-            {
-                logfile << i + 1 << "\t"
-                        << "Accelerations [X|Y|Z]:\t[ "
-                        << accels_x[i] << " | "
-                        << accels_y[i] << " | "
-                        << accels_z[i] << " ]"
-                        << " in " << times[tc++] << " s"
+            std::fstream logfile;
+            logfile.open(log_name, std::ios::out|std::ios::app);
+            logfile.precision(5);
+            logfile << std::fixed;
+            if(logger.Written() == 0)
+                logfile << "Raw data storage is empty, only control operations performed" << std::endl;
+            else
+                logfile << std::endl
+                        << "Acquired "
+                        << logger.Written()
+                        << " packets, average reading time "
+                        << times.Mean()
+                        << " s"
                         << std::endl;
-                logfile << "\t"
-                        << "Euler angles [R|P|Y]:\t[ "
-                        << rolls[i] << " | "
-                        << pitches[i] << " | "
-                        << "0.00000 ]"
-                        << " in " << times[tc++] << " s"
+            if(covariance)
+            {
+                logfile << std::endl
+                        << "Noise covariance matrices:" << std::endl
+                        << "Accelerations (total for " << accels_x.Count() << " measurements): " << std::endl
+                        << "[\t" << accels_x.StandardDeviation() << "\t0.00000\t0.00000" << std::endl
+                        << "\t0.00000\t" << accels_y.StandardDeviation() << "\t0.00000" << std::endl
+                        << "\t0.00000\t0.00000\t" << accels_z.StandardDeviation() << "\t]" << std::endl
+                        << std::endl
+                        << "Angles (total for " << pitches.Count() << " measurements): " << std::endl
+                        << "[\t" << rolls.StandardDeviation() << "\t0.00000\t0.00000" << std::endl
+                        << "\t0.00000\t" << pitches.StandardDeviation() << "\t0.00000" << std::endl
+                        << "\t0.00000\t0.00000\t0.00000\t]" << std::endl
                         << std::endl;
             }
-            logfile << std::endl
-                    << "Acquired "
-                    << std::min(accels_x.size(), rolls.size())
-                    << " measurements, average reading time "
-                    << std::accumulate(times.begin(), times.end(), 0.f) / times.size()
-                    << " s"
-                    << std::endl;
-        }
-        if(covariance)
-        {
-            logfile << std::endl
-                    << "Noise covariance matrices:" << std::endl
-                    << "Accelerations (total for " << accels_x.size() << " measurements): " << std::endl
-                    << "[\t" << variance(accels_x) << "\t0.00000\t0.00000" << std::endl
-                    << "\t0.00000\t" << variance(accels_y) << "\t0.00000" << std::endl
-                    << "\t0.00000\t0.00000\t" << variance(accels_z) << "\t]" << std::endl
-                    << std::endl
-                    << "Angles (total for " << pitches.size() << " measurements): " << std::endl
-                    << "[\t" << variance(rolls) << "\t0.00000\t0.00000" << std::endl
-                    << "\t0.00000\t" << variance(pitches) << "\t0.00000" << std::endl
-                    << "\t0.00000\t0.00000\t0.00000\t]" << std::endl
-                    << std::endl;
+            logfile << "Acquisition performed at " << std::ctime(&timestamp_start) << std::endl;
+            logfile.close();
         }
-        logfile << "Acquisition performed at " << std::ctime(&timestamp_start) << std::endl;
-        logfile.close();
     }
 
     return result;
@@ -70,8 +70,9 @@ void QWitmotionWT31NSensor::SetPollingRate(const uint32_t hz)
 
 QWitmotionWT31NSensor::QWitmotionWT31NSensor(const QString device,
                                              const QSerialPort::BaudRate rate,
-                                             const uint32_t polling_period):
-    QAbstractWitmotionSensorController(device, rate)
+                                             const uint32_t polling_period,
+                                             QThread* shared_engine):
+    QAbstractWitmotionSensorController(device, rate, shared_engine)
 {
     ttyout << "Creating multithreaded interface for Witmotion WT31N IMU sensor connected to "
            << port_name
@@ -1,17 +1,30 @@
 #include "witmotion/wt901-uart.h"
+#include "witmotion/statistics.h"
+#include "witmotion/frame.h"
+#include "witmotion/allan.h"
+#include "witmotion/fusion.h"
+#include "witmotion/resampler.h"
+#include "witmotion/export.h"
+#include "witmotion/log-writer.h"
+#include "witmotion/histogram.h"
+#include "witmotion/cadence.h"
 
 #include <QCommandLineParser>
 #include <QCommandLineOption>
 #include <QString>
 #include <QStringList>
+#include <QTimer>
 
 #include <iostream>
+#include <memory>
 #include <iomanip>
 #include <string>
 #include <list>
 #include <chrono>
 #include <ctime>
 #include <fstream>
+#include <sstream>
+#include <vector>
 
 #include <signal.h>
 #include <stdlib.h>
@@ -19,6 +32,58 @@
 
 using namespace witmotion::wt901;
 
+template<typename Getter> void print_matrix(std::ostream& out,
+                                            const std::string& title,
+                                            const uint64_t count,
+                                            const size_t size,
+                                            Getter element)
+{
+    out << title << " (total for " << count << " measurements): " << std::endl;
+    for(size_t i = 0; i < size; i++)
+    {
+        out << ((i == 0) ? "[" : "");
+        for(size_t j = 0; j < size; j++)
+            out << "\t" << element(i, j);
+        out << ((i == size - 1) ? "\t]" : "") << std::endl;
+    }
+    out << std::endl;
+}
+
+void print_covariance(std::ostream& out,
+                      const witmotion::witmotion_frame_covariance& covariance)
+{
+    print_matrix(out, "Accelerations", covariance.acceleration.Count(), 3,
+                 [&covariance](size_t i, size_t j) { return covariance.acceleration.Covariance(i, j); });
+    print_matrix(out, "Angular velocities", covariance.angular_velocity.Count(), 3,
+                 [&covariance](size_t i, size_t j) { return covariance.angular_velocity.Covariance(i, j); });
+    print_matrix(out, "Accelerations/angular velocities cross-covariance", covariance.inertial.Count(), 3,
+                 [&covariance](size_t i, size_t j) { return covariance.inertial.Covariance(i, j + 3); });
+    print_matrix(out, "Angles", covariance.angles.Count(), 3,
+                 [&covariance](size_t i, size_t j) { return covariance.angles.Covariance(i, j); });
+    out << "Temperature (total for " << covariance.temperature.Count() << " measurements): " << std::endl
+        << "[\t" << covariance.temperature.Variance() << "\t]" << std::endl
+        << std::endl;
+    print_matrix(out, "Magnetometer", covariance.magnetic_field.Count(), 3,
+                 [&covariance](size_t i, size_t j) { return covariance.magnetic_field.Covariance(i, j); });
+}
+
+void print_allan(std::ostream& out,
+                 const std::string& title,
+                 const witmotion::witmotion_allan_variance& allan,
+                 const double period)
+{
+    std::vector<witmotion::witmotion_allan_point> curve = allan.Deviation(period);
+    witmotion::witmotion_noise_parameters noise = witmotion::allan_noise_parameters(curve);
+    out << title << " (total for " << allan.Count() << " measurements):" << std::endl
+        << "\ttau, s\t\tADEV" << std::endl;
+    for(auto i = curve.begin(); i != curve.end(); i++)
+        out << "\t" << i->tau << "\t" << i->deviation << std::endl;
+    out << "\tRandom walk: " << noise.random_walk
+        << ", bias instability: " << noise.bias_instability << " at " << noise.bias_instability_tau << " s"
+        << ", rate random walk: " << noise.rate_random_walk << std::endl
+        << std::endl;
+}
+
 void handle_shutdown(int s)
 {    
     // avoid compiler complains ...
@@ -73,8 +138,49 @@ int main(int argc, char** args)
     QCommandLineOption CovarianceOption("covariance",
                                         "Measure spatial covariance");
     parser.addOption(CovarianceOption);
-    QCommandLineOption LogOption("log", "Log acquisition to sensor.log file");
+    QCommandLineOption AllanOption("allan",
+                                   "Measure Allan deviation of accelerations and angular velocities (keep the sensor static)");
+    parser.addOption(AllanOption);
+    QCommandLineOption FusionOption("fusion",
+                                    "Calculate orientation on the host from accelerations, angular velocities and magnetic field",
+                                    "MADGWICK/MAHONY",
+                                    "MADGWICK");
+    parser.addOption(FusionOption);
+    QCommandLineOption ResampleOption("resample",
+                                      "Resample the measurements onto the uniform time grid on the dedicated timer thread and print the frames, Hz. With --log, the frames are also written to LOG-resampled.csv",
+                                      "1 - 1000 Hz",
+                                      "500");
+    parser.addOption(ResampleOption);
+    QCommandLineOption ResampleLatencyOption("resample-latency",
+                                             "Resampling latency, should exceed the packet inter-arrival time",
+                                             "20 ms",
+                                             "20");
+    parser.addOption(ResampleLatencyOption);
+    QCommandLineOption LogOption("log", "Log acquisition to sensor.log file (sensor.bin for BINARY, sensor directory of .npy files for NPY, sensor.npz for NPZ format)");
     parser.addOption(LogOption);
+    QCommandLineOption LogFormatOption("log-format",
+                                       "Log file format: decoded values, raw packets, or decoded frames as NumPy column arrays",
+                                       "TEXT/BINARY/NPY/NPZ",
+                                       "TEXT");
+    parser.addOption(LogFormatOption);
+    QCommandLineOption LogSyncOption("log-sync",
+                                     "Synchronize the log file to the storage periodically, 0 disables",
+                                     "ms",
+                                     "0");
+    parser.addOption(LogSyncOption);
+    QCommandLineOption TimingOption("timing",
+                                    "Collect the per-packet-type inter-arrival and read-to-delivery latency histograms, printed at exit");
+    parser.addOption(TimingOption);
+    QCommandLineOption LatencyBudgetOption("latency-budget",
+                                           "Adapt the port polling interval to the link load and the output frequency, not exceeding the budget and the explicit --interval; 0 keeps the fixed interval",
+                                           "ms",
+                                           "0");
+    parser.addOption(LatencyBudgetOption);
+    QCommandLineOption ExpectedFrequencyOption("expected-frequency",
+                                               "Configured output frequency for the packet loss estimation, 0 learns it from the data",
+                                               "Hz",
+                                               "0");
+    parser.addOption(ExpectedFrequencyOption);
 
     QCommandLineOption CalibrateOption("calibrate",
                                        "Run spatial calibration");
@@ -139,8 +245,21 @@ int main(int argc, char** args)
         std::cout << "Wrong port polling interval specified, falling back to 50 ms!" << std::endl;
         interval = 50;
     }
+    uint32_t latency_budget = parser.value(LatencyBudgetOption).toUInt();
+    // Only the explicit interval bounds the adaptive one
+    if((latency_budget > 0) && !parser.isSet(IntervalOption))
+        interval = latency_budget;
     QWitmotionWT901Sensor sensor(device, rate, interval);
     sensor.SetValidation(parser.isSet(ValidateOption));
+    sensor.SetLatencyBudget(latency_budget);
+    std::unique_ptr<witmotion::witmotion_packet_timing> timing;
+    if(parser.isSet(TimingOption))
+    {
+        timing.reset(new witmotion::witmotion_packet_timing());
+        sensor.SetTiming(timing.get());
+    }
+    witmotion::witmotion_cadence_estimator cadence(parser.value(ExpectedFrequencyOption).toDouble());
+    sensor.SetCadence(&cadence);
 
     // Setting up data capturing slots: mutable/immutable C++14 lambda functions
     QObject::connect(&sensor, &QWitmotionWT901Sensor::ErrorOccurred, [](const QString description)
@@ -149,51 +268,123 @@ int main(int argc, char** args)
         QCoreApplication::exit(1);
     });
 
-    std::vector<witmotion::witmotion_datapacket> acquired;
-
-    std::vector<float> accels_x,
-            accels_y,
-            accels_z,
-            vels_x,
-            vels_y,
-            vels_z,
-            rolls,
-            pitches,
-            yaws,
-            temps,
-            times,
-            mags_x,
-            mags_y,
-            mags_z,
-            quat_x,
-            quat_y,
-            quat_z,
-            quat_w;
+    // The log is written continuously by the background thread, the acquisition handler only copies the packets
+    bool logging = parser.isSet(LogOption);
+    QString log_format_name = parser.value(LogFormatOption).toUpper();
+    witmotion::witmotion_log_format log_format = witmotion::logText;
+    std::string log_name = "sensor.log";
+    if(log_format_name == "BINARY")
+    {
+        log_format = witmotion::logBinary;
+        log_name = "sensor.bin";
+    }
+    else if(log_format_name == "NPY")
+    {
+        log_format = witmotion::logNumPy;
+        log_name = "sensor";
+    }
+    else if(log_format_name == "NPZ")
+    {
+        log_format = witmotion::logNumPyArchive;
+        log_name = "sensor.npz";
+    }
+    witmotion::witmotion_log_writer logger(log_name,
+                                           log_format,
+                                           32768,
+                                           500,
+                                           parser.value(LogSyncOption).toUInt());
+    std::time_t timestamp_start = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    if(logging)
+    {
+        std::ostringstream preamble;
+        preamble << " -== WITMOTION WT901 STANDALONE SENSOR CONTROLLER/MONITOR ==-" << std::endl << std::endl
+                 << "Device /dev/" << device.toStdString() << " opened at " << static_cast<int32_t>(rate) << " baud" << std::endl
+                 << std::endl << "Acquired packets: " << std::endl;
+        if(logger.Open(preamble.str()))
+            std::cout << "Writing log file to " << log_name << std::endl;
+        else
+        {
+            std::cout << "ERROR: " << logger.Error() << std::endl;
+            logging = false;
+        }
+    }
+
+    witmotion::witmotion_running_statistics times;
+    witmotion::witmotion_frame_assembler frames;
+    witmotion::witmotion_frame_covariance covariance;
+    witmotion::witmotion_frame_allan allan;
+    witmotion::witmotion_running_statistics frame_periods;
+    int64_t last_frame = 0;
+    bool allan_enabled = parser.isSet(AllanOption);
+    bool fusion_enabled = parser.isSet(FusionOption);
+    bool resampling_enabled = parser.isSet(ResampleOption);
+    double resampling_rate = parser.value(ResampleOption).toDouble();
+    witmotion::witmotion_resampler resampler(static_cast<int64_t>(parser.value(ResampleLatencyOption).toDouble() * 1e6));
+    witmotion::witmotion_frame_queue resampled;
+    witmotion::witmotion_resampling_clock resampling_clock(&resampler,
+                                                           &resampled,
+                                                           (resampling_rate > 0.0) ? static_cast<int64_t>(1e9 / resampling_rate) : 0);
+    // The frames are printed and logged in the main thread, the timer thread only queues them
+    std::unique_ptr<witmotion::witmotion_frame_exporter> resampled_log;
+    if(resampling_enabled && logging)
+    {
+        size_t dot = log_name.rfind('.');
+        std::string resampled_log_name = ((dot == std::string::npos) ? log_name : log_name.substr(0, dot)) + "-resampled.csv";
+        resampled_log = witmotion::create_frame_exporter(witmotion::exportCSV, resampled_log_name);
+        if(resampled_log->Open())
+            std::cout << "Writing resampled frames to " << resampled_log_name << std::endl;
+        else
+        {
+            std::cout << "ERROR: " << resampled_log->Error() << std::endl;
+            resampled_log.reset();
+        }
+    }
+    std::vector<witmotion::witmotion_frame> resampled_frames;
+    int64_t resampled_start = 0;
+    auto print_resampled = [&resampled, &resampled_frames, &resampled_log, &resampled_start]()
+    {
+        resampled.Take(resampled_frames);
+        for(auto i = resampled_frames.begin(); i != resampled_frames.end(); i++)
+        {
+            if(resampled_start == 0)
+                resampled_start = i->timestamp;
+            std::cout << "Resampled frame at " << static_cast<double>(i->timestamp - resampled_start) / 1e9 << " s:";
+            if(i->Has(witmotion::pidAcceleration))
+                std::cout << " accelerations [ " << i->acceleration[0] << " | " << i->acceleration[1] << " | " << i->acceleration[2] << " ]";
+            if(i->Has(witmotion::pidAngularVelocity))
+                std::cout << " angular velocities [ " << i->angular_velocity[0] << " | " << i->angular_velocity[1] << " | " << i->angular_velocity[2] << " ]";
+            if(i->Has(witmotion::pidAngles))
+                std::cout << " angles [ " << i->angles[0] << " | " << i->angles[1] << " | " << i->angles[2] << " ]";
+            if(i->Has(witmotion::pidMagnetometer))
+                std::cout << " magnetic field [ " << i->magnetic_field[0] << " | " << i->magnetic_field[1] << " | " << i->magnetic_field[2] << " ]";
+            std::cout << "\n";
+            if(resampled_log)
+                resampled_log->Consume(*i);
+        }
+    };
+    QTimer resampled_timer;
+    resampled_timer.setInterval(100);
+    QObject::connect(&resampled_timer, &QTimer::timeout, print_resampled);
+    witmotion::witmotion_orientation_fusion fusion((parser.value(FusionOption).toUpper() == "MAHONY") ? witmotion::fusionMahony : witmotion::fusionMadgwick);
 
     std::cout.precision(5);
     std::cout << std::fixed;
 
     QObject::connect(&sensor, &QWitmotionWT901Sensor::Acquired,
                      [maintenance,
-                     &acquired,
-                     &accels_x,
-                     &accels_y,
-                     &accels_z,
-                     &vels_x,
-                     &vels_y,
-                     &vels_z,
-                     &rolls,
-                     &pitches,
-                     &yaws,
-                     &temps,
+                     &logger,
+                     logging,
                      &times,
-                     &mags_x,
-                     &mags_y,
-                     &mags_z,
-                     &quat_x,
-                     &quat_y,
-                     &quat_z,
-                     &quat_w](const witmotion::witmotion_datapacket& packet)
+                     &frames,
+                     &covariance,
+                     &allan,
+                     &frame_periods,
+                     &last_frame,
+                     allan_enabled,
+                     &fusion,
+                     fusion_enabled,
+                     &resampler,
+                     resampling_enabled](const witmotion::witmotion_datapacket& packet)
     {
         if(maintenance)
             return;
@@ -201,7 +392,6 @@ int main(int argc, char** args)
         float ax, ay, az, wx, wy, wz, roll, pitch, yaw, t, mx, my, mz, qx, qy, qz, qw;
         uint8_t year, month, day, hour, minute, second;
         uint16_t millisecond;
-        QString uptime;
         static size_t packets = 1;
         static auto time_start = std::chrono::system_clock::now();
         auto time_acquisition = std::chrono::system_clock::now();
@@ -210,9 +400,6 @@ int main(int argc, char** args)
         {
         case witmotion::pidAcceleration:
             witmotion::decode_accelerations(packet, ax, ay, az, t);
-            accels_x.push_back(ax);
-            accels_y.push_back(ay);
-            accels_z.push_back(az);
             std::cout << packets << "\t"
                       << "Accelerations [X|Y|Z]:\t[ "
                       << ax << " | "
@@ -220,13 +407,10 @@ int main(int argc, char** args)
                       << az << " ], temp "
                       << t << " degrees,"
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         case witmotion::pidAngularVelocity:
             witmotion::decode_angular_velocities(packet, wx, wy, wz, t);
-            vels_x.push_back(wx);
-            vels_y.push_back(wy);
-            vels_z.push_back(wz);
             std::cout << packets << "\t"
                       << "Angular velocities [X|Y|Z]:\t[ "
                       << wx << " | "
@@ -234,13 +418,10 @@ int main(int argc, char** args)
                       << wz << " ], temp "
                       << t << " degrees,"
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         case witmotion::pidAngles:
             witmotion::decode_angles(packet, roll, pitch, yaw, t);
-            rolls.push_back(roll);
-            pitches.push_back(pitch);
-            yaws.push_back(yaw);
             std::cout << packets << "\t"
                       << "Euler angles [R|P|Y]:\t[ "
                       << roll << " | "
@@ -248,14 +429,10 @@ int main(int argc, char** args)
                       << yaw << " ], temp "
                       << t << " degrees, "
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         case witmotion::pidMagnetometer:
             witmotion::decode_magnetometer(packet, mx, my ,mz, t);
-            mags_x.push_back(mx);
-            mags_y.push_back(my);
-            mags_z.push_back(mz);
-            temps.push_back(t);
             std::cout << packets << "\t"
                       << "Magnetic field [X|Y|Z]:\t[ "
                       << mx << " | "
@@ -263,29 +440,24 @@ int main(int argc, char** args)
                       << mz << " ], temp "
                       << t << " degrees, "
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         case witmotion::pidRTC:
             witmotion::decode_realtime_clock(packet, year, month, day, hour, minute, second, millisecond);
-            uptime = QString().setNum(year) + "-"
-                    + QString().setNum(month) + "-"
-                    + QString().setNum(day) + " "
-                    + QString().setNum(hour) + ":"
-                    + QString().setNum(minute) + ":"
-                    + QString().setNum(second) + "."
-                    + QString().setNum(millisecond);
             std::cout << packets << "\t"
                       << "Uptime / Timestamp: "
-                      << uptime.toStdString()
+                      << static_cast<uint32_t>(year) << "-"
+                      << static_cast<uint32_t>(month) << "-"
+                      << static_cast<uint32_t>(day) << " "
+                      << static_cast<uint32_t>(hour) << ":"
+                      << static_cast<uint32_t>(minute) << ":"
+                      << static_cast<uint32_t>(second) << "."
+                      << millisecond
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         case witmotion::pidOrientation:
             witmotion::decode_orientation(packet, qx, qy, qz, qw);
-            quat_x.push_back(qx);
-            quat_y.push_back(qy);
-            quat_z.push_back(qz);
-            quat_w.push_back(qw);
             std::cout << packets << "\t"
                       << "Orientation quaternion [X|Y|Z|W]:\t[ "
                       << qx << " | "
@@ -293,7 +465,7 @@ int main(int argc, char** args)
                       << qz << " | "
                       << qw << " ]"
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         case witmotion::pidDataPortStatus:
             std::cout << packets << "\t"
@@ -309,15 +481,40 @@ int main(int argc, char** args)
                       << static_cast<uint32_t>(packet.datastore.raw[7])
                       << std::dec
                       << " in " << elapsed_seconds.count() << " s"
-                      << std::endl;
+                      << "\n";
             break;
         default:
             break;
         }
-        times.push_back(elapsed_seconds.count());
+        times.Push(elapsed_seconds.count());
+        if(resampling_enabled)
+            resampler.Push(packet);
+        witmotion::witmotion_frame frame;
+        if(frames.Push(packet, std::chrono::duration_cast<std::chrono::nanoseconds>(time_acquisition.time_since_epoch()).count(), frame))
+        {
+            covariance.Push(frame);
+            float period = (last_frame != 0) ? static_cast<float>(frame.timestamp - last_frame) / 1e9f : 0.f;
+            if(last_frame != 0)
+                frame_periods.Push(period);
+            last_frame = frame.timestamp;
+            if(allan_enabled)
+                allan.Push(frame);
+            if(fusion_enabled && (period > 0.f) && fusion.Update(frame, period))
+            {
+                fusion.Orientation(0, qx, qy, qz, qw);
+                std::cout << packets << "\t"
+                          << "Host orientation quaternion [X|Y|Z|W]:\t[ "
+                          << qx << " | "
+                          << qy << " | "
+                          << qz << " | "
+                          << qw << " ]"
+                          << "\n";
+            }
+        }
 
         packets++;
-        acquired.push_back(packet);
+        if(logging)
+            logger.Consume(packet);
         time_start = time_acquisition;
     });
 
@@ -595,184 +792,99 @@ int main(int argc, char** args)
     }
 
     maintenance = false;
+    if(resampling_enabled)
+    {
+        resampling_clock.Start();
+        resampled_timer.start();
+    }
 
     int result = app.exec();
 
+    if(resampling_enabled)
+    {
+        resampling_clock.Stop();
+        resampled_timer.stop();
+        print_resampled();
+        if(resampled_log && !resampled_log->Close())
+            std::cout << "ERROR: " << resampled_log->Error() << std::endl;
+        witmotion::witmotion_running_statistics jitter = resampling_clock.Jitter();
+        std::cout << "Resampled " << resampling_clock.Ticks() << " frames at " << resampling_rate << " Hz, "
+                  << resampling_clock.Missed() << " ticks missed, "
+                  << resampled.Dropped() << " dropped, wake-up jitter "
+                  << jitter.Mean() / 1e3 << " us average, "
+                  << jitter.Max() / 1e3 << " us max" << std::endl
+                  << "Resampling latency " << resampler.Latency() / 1e6 << " ms, "
+                  << resampler.Underruns() << " underruns, "
+                  << resampler.Overruns() << " overruns" << std::endl
+                  << std::endl;
+    }
+
     std::cout << "Average sensor return rate "
-              << std::accumulate(times.begin(), times.end(), 0.f) / times.size()
+              << times.Mean()
               << " s" << std::endl << std::endl;
+    std::cout << "Effective output rate per packet type:" << std::endl;
+    cadence.Report(std::cout);
+    std::cout << std::endl;
+
+    if(timing)
+    {
+        std::cout << "Packet timing:" << std::endl;
+        timing->Report(std::cout);
+        std::cout << std::endl;
+    }
 
     if(parser.isSet(CovarianceOption))
     {
         std::cout << "Calculating noise covariance matrices..." << std::endl
-                  << std::endl
-                  << "Accelerations (total for " << accels_x.size() << " measurements): " << std::endl
-                  << "[\t" << witmotion::variance(accels_x) << "\t0.00000\t0.00000" << std::endl
-                  << "\t0.00000\t" << witmotion::variance(accels_y) << "\t0.00000" << std::endl
-                  << "\t0.00000\t0.00000\t" << witmotion::variance(accels_z) << "\t]" << std::endl
-                  << std::endl
-                  << "Angular velocities (total for " << vels_x.size() << " measurements): " << std::endl
-                  << "[\t" << witmotion::variance(vels_x) << "\t0.00000\t0.00000" << std::endl
-                  << "\t0.00000\t" << witmotion::variance(vels_y) << "\t0.00000" << std::endl
-                  << "\t0.00000\t0.00000\t" << witmotion::variance(vels_z) << "\t]" << std::endl
-                  << std::endl
-                  << "Angles (total for " << pitches.size() << " measurements): " << std::endl
-                  << "[\t" << witmotion::variance(rolls) << "\t0.00000\t0.00000" << std::endl
-                  << "\t0.00000\t" << witmotion::variance(pitches) << "\t0.00000" << std::endl
-                  << "\t0.00000\t0.00000\t" << witmotion::variance(yaws) << "\t]" << std::endl
-                  << std::endl
-                  << "Temperature (total for " << temps.size() << " measurements): " << std::endl
-                  << "[\t" << witmotion::variance(temps) << "\t]" << std::endl
-                  << std::endl
-                  << "Magnetometer (total for " << mags_x.size() << " measurements): " << std::endl
-                  << "[\t" << witmotion::variance(mags_x) << "\t00.00000\t00.00000" << std::endl
-                  << "\t00.00000\t" << witmotion::variance(mags_y) << "\t00.00000" << std::endl
-                  << "\t00.00000\t00.00000\t" << witmotion::variance(mags_z) << "\t]" << std::endl
                   << std::endl;
+        print_covariance(std::cout, covariance);
+    }
+
+    if(fusion_enabled)
+    {
+        std::cout << "Host orientation fusion cost per update (total for " << fusion.Cost().Count() << " updates): "
+                  << fusion.Cost().Mean() << " ns average, "
+                  << fusion.Cost().Min() << " ns min, "
+                  << fusion.Cost().Max() << " ns max" << std::endl
+                  << std::endl;
+    }
+
+    if(allan_enabled)
+    {
+        std::cout << "Calculating Allan deviation, average frame period " << frame_periods.Mean() << " s" << std::endl
+                  << std::endl;
+        const char* axes[] = {"X", "Y", "Z"};
+        for(size_t i = 0; i < 3; i++)
+            print_allan(std::cout, std::string("Accelerations, axis ") + axes[i], allan.acceleration[i], frame_periods.Mean());
+        for(size_t i = 0; i < 3; i++)
+            print_allan(std::cout, std::string("Angular velocities, axis ") + axes[i], allan.angular_velocity[i], frame_periods.Mean());
     }
 
-    if(parser.isSet(LogOption))
+    if(logging)
     {
-        std::cout << "Writing log file to sensor.log" << std::endl;
-        std::fstream logfile;
-        logfile.open("sensor.log", std::ios::out|std::ios::trunc);
-        logfile.precision(5);
-        logfile << std::fixed;
-        logfile << " -== WITMOTION WT901 STANDALONE SENSOR CONTROLLER/MONITOR ==-" << std::endl << std::endl;
-        auto time_start = std::chrono::system_clock::now();
-        std::time_t timestamp_start = std::chrono::system_clock::to_time_t(time_start);
-        logfile << "Device /dev/" << device.toStdString() << " opened at " << static_cast<int32_t>(rate) << " baud" << std::endl;
-        logfile << std::endl << "Acquired packets: " << std::endl;
-        if(!acquired.empty())
+        logger.Close();
+        std::cout << "Log file " << log_name << ": " << logger.Written() << " packets written, "
+                  << logger.Dropped() << " dropped" << std::endl;
+        if(!logger.Error().empty())
+            std::cout << "ERROR: " << logger.Error() << std::endl;
+        if(log_format == witmotion::logText)
         {
-            uint32_t packets = 1;
-            for(auto i = acquired.begin(); i != acquired.end(); i++)
+            std::fstream logfile;
+            logfile.open(log_name, std::ios::out|std::ios::app);
+            logfile.precision(5);
+            logfile << std::fixed;
+            logfile << std::endl;
+
+            if(parser.isSet(CovarianceOption))
             {
-                witmotion::witmotion_datapacket packet = (*i);
-                float ax, ay, az, wx, wy, wz, roll, pitch, yaw, t, mx, my, mz, qx, qy, qz, qw;
-                uint8_t year, month, day, hour, minute, second;
-                uint16_t millisecond;
-                QString uptime;
-                switch (static_cast<witmotion::witmotion_packet_id>(packet.id_byte))
-                {
-                case witmotion::pidAcceleration:
-                    witmotion::decode_accelerations(packet, ax, ay, az, t);
-                    logfile << packets << "\t"
-                            << "Accelerations [X|Y|Z]:\t[ "
-                            << ax << " | "
-                            << ay << " | "
-                            << az << " ], temp "
-                            << t << " degrees"
-                            << std::endl;
-                    break;
-                case witmotion::pidAngularVelocity:
-                    witmotion::decode_angular_velocities(packet, wx, wy, wz, t);
-                    logfile << packets << "\t"
-                            << "Angular velocities [X|Y|Z]:\t[ "
-                            << wx << " | "
-                            << wy << " | "
-                            << wz << " ], temp "
-                            << t << " degrees"
-                            << std::endl;
-                    break;
-                case witmotion::pidAngles:
-                    witmotion::decode_angles(packet, roll, pitch, yaw, t);
-                    logfile << packets << "\t"
-                            << "Euler angles [R|P|Y]:\t[ "
-                            << roll << " | "
-                            << pitch << " | "
-                            << yaw << " ], temp "
-                            << t << " degrees"
-                            << std::endl;
-                    break;
-                case witmotion::pidMagnetometer:
-                    witmotion::decode_magnetometer(packet, mx, my ,mz, t);
-                    logfile << packets << "\t"
-                            << "Magnetic field [X|Y|Z]:\t[ "
-                            << mx << " | "
-                            << my << " | "
-                            << mz << " ], temp "
-                            << t << " degrees"
-                            << std::endl;
-                    break;
-                case witmotion::pidRTC:
-                    witmotion::decode_realtime_clock(packet, year, month, day, hour, minute, second, millisecond);
-                    uptime = QString().setNum(year) + "-"
-                            + QString().setNum(month) + "-"
-                            + QString().setNum(day) + " "
-                            + QString().setNum(hour) + ":"
-                            + QString().setNum(minute) + ":"
-                            + QString().setNum(second) + "."
-                            + QString().setNum(millisecond);
-                    logfile << packets << "\t"
-                            << "Uptime / Timestamp: "
-                            << uptime.toStdString()
-                            << std::endl;
-                    break;
-                case witmotion::pidOrientation:
-                    witmotion::decode_orientation(packet, qx, qy, qz, qw);
-                    logfile << packets << "\t"
-                            << "Orientation quaternion [X|Y|Z|W]:\t[ "
-                            << qx << " | "
-                            << qy << " | "
-                            << qz << " | "
-                            << qw << " ]"
-                            << std::endl;
-                    break;
-                case witmotion::pidDataPortStatus:
-                    logfile << packets << "\t"
-                            << "Data port status string: 0x"
-                            << std::hex
-                            << static_cast<uint32_t>(packet.datastore.raw[0]) << " 0x"
-                            << static_cast<uint32_t>(packet.datastore.raw[1]) << " 0x"
-                            << static_cast<uint32_t>(packet.datastore.raw[2]) << " 0x"
-                            << static_cast<uint32_t>(packet.datastore.raw[3]) << " 0x"
-                            << static_cast<uint32_t>(packet.datastore.raw[4]) << " 0x"
-                            << static_cast<uint32_t>(packet.datastore.raw[5]) << " 0x"
-                            << static_cast<uint32_t>(packet.datastore.raw[6]) << " 0x"
-                            << static_cast<uint32_t>(packet.datastore.raw[7])
-                            << std::dec
-                            << std::endl;
-                    break;
-                default:
-                    break;
-                }
-                packets++;
+                logfile << "-= NOISE COVARIANCE MATRICES =-" << std::endl
+                        << std::endl;
+                print_covariance(logfile, covariance);
             }
-            logfile << std::endl;
-        }
 
-        if(parser.isSet(CovarianceOption))
-        {
-            logfile << "-= NOISE COVARIANCE MATRICES =-" << std::endl
-                    << std::endl
-                    << "Accelerations (total for " << accels_x.size() << " measurements): " << std::endl
-                    << "[\t" << witmotion::variance(accels_x) << "\t0.00000\t0.00000" << std::endl
-                    << "\t0.00000\t" << witmotion::variance(accels_y) << "\t0.00000" << std::endl
-                    << "\t0.00000\t0.00000\t" << witmotion::variance(accels_z) << "\t]" << std::endl
-                    << std::endl
-                    << "Angular velocities (total for " << vels_x.size() << " measurements): " << std::endl
-                    << "[\t" << witmotion::variance(vels_x) << "\t0.00000\t0.00000" << std::endl
-                    << "\t0.00000\t" << witmotion::variance(vels_y) << "\t0.00000" << std::endl
-                    << "\t0.00000\t0.00000\t" << witmotion::variance(vels_z) << "\t]" << std::endl
-                    << std::endl
-                    << "Angles (total for " << pitches.size() << " measurements): " << std::endl
-                    << "[\t" << witmotion::variance(rolls) << "\t0.00000\t0.00000" << std::endl
-                    << "\t0.00000\t" << witmotion::variance(pitches) << "\t0.00000" << std::endl
-                    << "\t0.00000\t0.00000\t" << witmotion::variance(yaws) << "\t]" << std::endl
-                    << std::endl
-                    << "Temperature (total for " << temps.size() << " measurements): " << std::endl
-                    << "[\t" << witmotion::variance(temps) << "\t]" << std::endl
-                    << std::endl
-                    << "Magnetometer (total for " << mags_x.size() << " measurements): " << std::endl
-                    << "[\t" << witmotion::variance(mags_x) << "\t00.00000\t00.00000" << std::endl
-                    << "\t00.00000\t" << witmotion::variance(mags_y) << "\t00.00000" << std::endl
-                    << "\t00.00000\t00.00000\t" << witmotion::variance(mags_z) << "\t]" << std::endl
-                      << std::endl;
+            logfile << "Acquisition performed at " << std::ctime(&timestamp_start) << std::endl;
+            logfile.close();
         }
-
-        logfile << "Acquisition performed at " << std::ctime(&timestamp_start) << std::endl;
-        logfile.close();
     }
 
     return result;
@@ -299,8 +299,9 @@ void QWitmotionWT901Sensor::SetRTC(const QDateTime datetime)
 
 QWitmotionWT901Sensor::QWitmotionWT901Sensor(const QString device,
                                              const QSerialPort::BaudRate rate,
-                                             const uint32_t polling_period):
-    QAbstractWitmotionSensorController(device, rate)
+                                             const uint32_t polling_period,
+                                             QThread* shared_engine):
+    QAbstractWitmotionSensorController(device, rate, shared_engine)
 {
     ttyout << "Creating multithreaded interface for Witmotion WT901 IMU sensor connected to "
            << port_name
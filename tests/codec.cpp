@@ -0,0 +1,218 @@
+/*
+    Checks the round trip of the compressed recordings: the packets and the timestamps
+    read back are equal to the written ones, with and without the stored timestamps,
+    and after the index and the footer are cut off as by the interrupted writer. The
+    malformed control byte is rejected by both decoding paths.
+*/
+
+#include "witmotion/codec.h"
+#include "witmotion/util.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace witmotion;
+
+namespace
+{
+
+static const size_t PACKETS = 5000;
+static const size_t BLOCK_SIZE = 256;
+
+/* The regular output cycle with the slowly varying cells, and the packets the codec stores
+   specially: the broken CRC, the unregistered ID and the unexpected header byte */
+void generate(std::vector<witmotion_datapacket>& packets, std::vector<int64_t>& timestamps)
+{
+    static const witmotion_packet_id cycle[] = {
+        pidAcceleration,
+        pidAngularVelocity,
+        pidAngles,
+        pidMagnetometer,
+        pidOrientation,
+        pidRTC
+    };
+    int64_t timestamp = 1000000000;
+    for(size_t i = 0; i < PACKETS; i++)
+    {
+        witmotion_datapacket packet;
+        std::memset(&packet, 0, sizeof(packet));
+        packet.header_byte = WITMOTION_HEADER_BYTE;
+        packet.id_byte = cycle[i % (sizeof(cycle) / sizeof(cycle[0]))];
+        for(size_t j = 0; j < 4; j++)
+            packet.datastore.raw_cells[j] = static_cast<int16_t>((i / 6) * (j + 1) + ((i % 211 == 0) ? 20000 : 0));
+        packet.crc = packet_crc(packet);
+        if(i % 53 == 0)
+            packet.crc++;
+        if(i % 97 == 0)
+            packet.id_byte = 0x7A;
+        if(i % 389 == 0)
+            packet.header_byte = 0x54;
+        // 200 Hz with the jitter and the occasional gap
+        timestamp += 5000000 + static_cast<int64_t>(i % 7) * 1000 - ((i % 500 == 0) ? 0 : 3000) + ((i % 1000 == 999) ? 50000000 : 0);
+        packets.push_back(packet);
+        timestamps.push_back(timestamp);
+    }
+}
+
+bool same_packet(const witmotion_datapacket& a, const witmotion_datapacket& b)
+{
+    return (a.header_byte == b.header_byte) &&
+           (a.id_byte == b.id_byte) &&
+           (std::memcmp(a.datastore.raw, b.datastore.raw, sizeof(a.datastore.raw)) == 0) &&
+           (a.crc == b.crc);
+}
+
+// Cuts the block index and the footer off, as if the writer has not been closed
+bool truncate_footer(const std::string& file)
+{
+    int fd = open(file.c_str(), O_RDWR | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    off_t size = lseek(fd, 0, SEEK_END);
+    uint64_t index_offset = 0;
+    bool result = (size >= static_cast<off_t>(WITMOTION_RECORDING_FOOTER_SIZE)) &&
+                  (pread(fd, &index_offset, sizeof(index_offset), size - static_cast<off_t>(WITMOTION_RECORDING_FOOTER_SIZE)) == sizeof(index_offset)) &&
+                  (index_offset < static_cast<uint64_t>(size)) &&
+                  (ftruncate(fd, static_cast<off_t>(index_offset)) == 0);
+    close(fd);
+    return result;
+}
+
+int check(const std::string& name,
+          const bool store_timestamps,
+          const bool truncated,
+          const std::vector<witmotion_datapacket>& packets,
+          const std::vector<int64_t>& timestamps)
+{
+    std::string file = "witmotion-test-codec.wmr";
+    witmotion_recording_writer writer(file, store_timestamps, BLOCK_SIZE);
+    if(!writer.Open())
+    {
+        std::printf("FAILED: %s: %s\n", name.c_str(), writer.Error().c_str());
+        return 1;
+    }
+    for(size_t i = 0; i < packets.size(); i++)
+        if(!writer.Push(packets[i], timestamps[i]))
+        {
+            std::printf("FAILED: %s: %s\n", name.c_str(), writer.Error().c_str());
+            return 1;
+        }
+    if(!writer.Close())
+    {
+        std::printf("FAILED: %s: %s\n", name.c_str(), writer.Error().c_str());
+        return 1;
+    }
+    if(truncated && !truncate_footer(file))
+    {
+        std::printf("FAILED: %s: cannot cut the footer off\n", name.c_str());
+        return 1;
+    }
+
+    int failures = 0;
+    witmotion_recording_reader reader(file);
+    if(!reader.Open())
+    {
+        std::printf("FAILED: %s: %s\n", name.c_str(), reader.Error().c_str());
+        unlink(file.c_str());
+        return 1;
+    }
+    if((reader.Recovered() != truncated) || (reader.Timestamps() != store_timestamps) || (reader.Packets() != packets.size()))
+    {
+        std::printf("FAILED: %s: %llu packets, timestamps %d, recovered %d\n", name.c_str(),
+                    static_cast<unsigned long long>(reader.Packets()), reader.Timestamps() ? 1 : 0, reader.Recovered() ? 1 : 0);
+        failures++;
+    }
+    const std::vector<witmotion_recording_block>& blocks = reader.Blocks();
+    if(blocks.size() != (packets.size() + BLOCK_SIZE - 1) / BLOCK_SIZE)
+    {
+        std::printf("FAILED: %s: %zu blocks\n", name.c_str(), blocks.size());
+        failures++;
+    }
+    std::vector<witmotion_datapacket> decoded;
+    std::vector<int64_t> decoded_timestamps;
+    size_t position = 0;
+    for(size_t i = 0; (i < blocks.size()) && (failures == 0); i++)
+    {
+        if(!reader.Read(i, decoded, &decoded_timestamps) || (blocks[i].first_packet != position) || (decoded.size() != blocks[i].packets))
+        {
+            std::printf("FAILED: %s: block %zu cannot be read\n", name.c_str(), i);
+            failures++;
+            break;
+        }
+        if(reader.Find(position) != i)
+        {
+            std::printf("FAILED: %s: packet %zu is not found in block %zu\n", name.c_str(), position, i);
+            failures++;
+        }
+        for(size_t j = 0; (j < decoded.size()) && (position < packets.size()); j++, position++)
+        {
+            int64_t expected = store_timestamps ? timestamps[position] : 0;
+            if(!same_packet(decoded[j], packets[position]) || (decoded_timestamps[j] != expected))
+            {
+                std::printf("FAILED: %s: packet %zu differs\n", name.c_str(), position);
+                failures++;
+                break;
+            }
+        }
+    }
+    if((failures == 0) && (position != packets.size()))
+    {
+        std::printf("FAILED: %s: %zu packets decoded\n", name.c_str(), position);
+        failures++;
+    }
+    reader.Close();
+    unlink(file.c_str());
+    return failures;
+}
+
+/* The reserved length 3 in the control byte is rejected whether the record is decoded by the
+   fast path (the zero delta records follow) or by the bounds-checked one (the record ends the payload) */
+int check_reserved_length()
+{
+    static const size_t ZERO_RECORDS = 8;
+    const uint8_t tag = static_cast<uint8_t>(pidAcceleration - pidRTC);
+    const std::vector<uint8_t> reserved = {tag, 0x03, 0x01, 0x02, 0x03};
+    int failures = 0;
+    for(int last = 0; last < 2; last++)
+    {
+        std::vector<uint8_t> payload;
+        if(last == 0)
+            payload.insert(payload.end(), reserved.begin(), reserved.end());
+        for(size_t i = 0; i < ZERO_RECORDS; i++)
+        {
+            payload.push_back(tag);
+            payload.push_back(0x00);
+        }
+        if(last != 0)
+            payload.insert(payload.end(), reserved.begin(), reserved.end());
+        witmotion_datapacket packets[ZERO_RECORDS + 1];
+        if(decode_packet_block(payload.data(), payload.size(), ZERO_RECORDS + 1, 0, false, packets, nullptr))
+        {
+            std::printf("FAILED: reserved length accepted by the %s path\n", (last == 0) ? "fast" : "bounds-checked");
+            failures++;
+        }
+    }
+    return failures;
+}
+
+}
+
+int main()
+{
+    std::vector<witmotion_datapacket> packets;
+    std::vector<int64_t> timestamps;
+    generate(packets, timestamps);
+    int failures = 0;
+    failures += check("packets", false, false, packets, timestamps);
+    failures += check("packets and timestamps", true, false, packets, timestamps);
+    failures += check("recovered index", true, true, packets, timestamps);
+    failures += check_reserved_length();
+    if(failures == 0)
+        std::printf("Recording round trip: OK\n");
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+/*
+    Checks the NumPy exports: every `.npy` column has the valid version 1.0 header with
+    the actual shape and holds the exported values, and the `.npz` archive has the
+    readable ZIP64 central directory pointing to the stored members with the matching CRC.
+*/
+
+#include "witmotion/export.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace witmotion;
+
+namespace
+{
+
+static const size_t ROWS = 10000;
+static const size_t CHUNK = 1536;
+
+witmotion_frame make_frame(const size_t row)
+{
+    witmotion_frame frame;
+    std::memset(&frame, 0, sizeof(frame));
+    frame.timestamp = static_cast<int64_t>(row) * 5000000;
+    frame.mask = witmotion_frame::Bit(pidAcceleration) | witmotion_frame::Bit(pidAngles);
+    for(size_t i = 0; i < 3; i++)
+    {
+        frame.acceleration[i] = static_cast<float>(row) * 0.5f + static_cast<float>(i);
+        frame.angles[i] = -static_cast<float>(row) * 0.25f;
+    }
+    frame.pressure = 101325.0 + static_cast<double>(row);
+    return frame;
+}
+
+bool read_file(const std::string& file, std::vector<uint8_t>& content)
+{
+    std::ifstream stream(file, std::ios::binary);
+    if(!stream)
+        return false;
+    content.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+template<typename T> T get_le(const std::vector<uint8_t>& data, const size_t offset)
+{
+    T value = 0;
+    for(size_t i = 0; i < sizeof(T); i++)
+        value |= static_cast<T>(static_cast<T>(data[offset + i]) << (8 * i));
+    return value;
+}
+
+uint32_t crc32(const uint8_t* data, const size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for(size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for(int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+// Expected value of the row in the column, as the raw bytes
+std::vector<uint8_t> expected_value(const size_t column, const size_t row)
+{
+    witmotion_frame frame = make_frame(row);
+    witmotion_frame_columns columns;
+    columns.Append(frame);
+    const uint8_t* value = columns.Column(column);
+    return std::vector<uint8_t>(value, value + export_columns()[column].size);
+}
+
+/* Checks the `.npy` content: magic, version 1.0, the header padded to 64 bytes and
+   terminated by the newline, the dtype and the shape, and the values of every row */
+bool check_npy(const std::string& name, const std::vector<uint8_t>& data, const size_t offset, const size_t size, const size_t column)
+{
+    const witmotion_export_column& descriptor = export_columns()[column];
+    if((size < 10) || (std::memcmp(data.data() + offset, "\x93NUMPY\x01\x00", 8) != 0))
+    {
+        std::printf("FAILED: %s: no NumPy 1.0 magic\n", name.c_str());
+        return false;
+    }
+    size_t header = 10 + get_le<uint16_t>(data, offset + 8);
+    if((header % 64 != 0) || (header > size) || (data[offset + header - 1] != '\n'))
+    {
+        std::printf("FAILED: %s: malformed header of %zu bytes\n", name.c_str(), header);
+        return false;
+    }
+    std::string dictionary(reinterpret_cast<const char*>(data.data() + offset + 10), header - 10);
+    std::string descr = std::string("'descr': '<") + descriptor.kind + std::to_string(descriptor.size) + "'";
+    std::string shape = "'shape': (" + std::to_string(ROWS) + ",)";
+    if((dictionary.find(descr) == std::string::npos) ||
+       (dictionary.find("'fortran_order': False") == std::string::npos) ||
+       (dictionary.find(shape) == std::string::npos))
+    {
+        std::printf("FAILED: %s: unexpected header %s\n", name.c_str(), dictionary.c_str());
+        return false;
+    }
+    if(size != header + ROWS * descriptor.size)
+    {
+        std::printf("FAILED: %s: %zu bytes instead of %zu\n", name.c_str(), size, header + ROWS * descriptor.size);
+        return false;
+    }
+    for(size_t row = 0; row < ROWS; row += 7)
+    {
+        std::vector<uint8_t> expected = expected_value(column, row);
+        if(std::memcmp(data.data() + offset + header + row * descriptor.size, expected.data(), expected.size()) != 0)
+        {
+            std::printf("FAILED: %s: row %zu differs\n", name.c_str(), row);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool export_frames(witmotion_frame_exporter& exporter)
+{
+    if(!exporter.Open())
+    {
+        std::printf("FAILED: %s\n", exporter.Error().c_str());
+        return false;
+    }
+    for(size_t row = 0; row < ROWS; row++)
+        exporter.Consume(make_frame(row));
+    if(!exporter.Close() || (exporter.Rows() != ROWS))
+    {
+        std::printf("FAILED: %s\n", exporter.Error().c_str());
+        return false;
+    }
+    return true;
+}
+
+int check_npy_directory()
+{
+    std::string directory = "witmotion-test-export-npy";
+    witmotion_npy_exporter exporter(directory, CHUNK);
+    if(!export_frames(exporter))
+        return 1;
+    int failures = 0;
+    for(size_t i = 0; i < WITMOTION_EXPORT_COLUMNS; i++)
+    {
+        std::string file = directory + "/" + export_columns()[i].name + ".npy";
+        std::vector<uint8_t> data;
+        if(!read_file(file, data))
+        {
+            std::printf("FAILED: %s is not written\n", file.c_str());
+            failures++;
+            continue;
+        }
+        if(!check_npy(file, data, 0, data.size(), i))
+            failures++;
+        unlink(file.c_str());
+    }
+    rmdir(directory.c_str());
+    return failures;
+}
+
+/* Walks the archive from the end: the end of central directory record, the ZIP64 locator,
+   the ZIP64 end of central directory record, then every central directory entry with its
+   ZIP64 sizes and offset, and the local header and the data of the member */
+int check_npz_archive()
+{
+    std::string file = "witmotion-test-export.npz";
+    witmotion_npz_exporter exporter(file, CHUNK);
+    if(!export_frames(exporter))
+        return 1;
+    std::vector<uint8_t> data;
+    if(!read_file(file, data) || (data.size() < 22 + 20 + 56))
+    {
+        std::printf("FAILED: %s is not written\n", file.c_str());
+        return 1;
+    }
+    unlink(file.c_str());
+    struct stat status;
+    if(stat((file + ".parts").c_str(), &status) == 0)
+    {
+        std::printf("FAILED: staging directory of %s is not removed\n", file.c_str());
+        return 1;
+    }
+    size_t end = data.size() - 22;
+    size_t locator = end - 20;
+    if((get_le<uint32_t>(data, end) != 0x06054B50) || (get_le<uint32_t>(data, locator) != 0x07064B50))
+    {
+        std::printf("FAILED: %s: no end of central directory or ZIP64 locator\n", file.c_str());
+        return 1;
+    }
+    uint64_t end64 = get_le<uint64_t>(data, locator + 8);
+    if((end64 + 56 > locator) || (get_le<uint32_t>(data, end64) != 0x06064B50))
+    {
+        std::printf("FAILED: %s: no ZIP64 end of central directory\n", file.c_str());
+        return 1;
+    }
+    uint64_t entries = get_le<uint64_t>(data, end64 + 32);
+    uint64_t directory_size = get_le<uint64_t>(data, end64 + 40);
+    uint64_t directory = get_le<uint64_t>(data, end64 + 48);
+    if((entries != WITMOTION_EXPORT_COLUMNS) || (directory + directory_size != end64))
+    {
+        std::printf("FAILED: %s: %llu entries, central directory at %llu\n", file.c_str(),
+                    static_cast<unsigned long long>(entries), static_cast<unsigned long long>(directory));
+        return 1;
+    }
+    int failures = 0;
+    size_t position = static_cast<size_t>(directory);
+    for(size_t i = 0; (i < entries) && (failures == 0); i++)
+    {
+        if((position + 46 > end64) || (get_le<uint32_t>(data, position) != 0x02014B50))
+        {
+            std::printf("FAILED: %s: central directory entry %zu is malformed\n", file.c_str(), i);
+            failures++;
+            break;
+        }
+        uint32_t crc = get_le<uint32_t>(data, position + 16);
+        size_t name_length = get_le<uint16_t>(data, position + 28);
+        size_t extra_length = get_le<uint16_t>(data, position + 30);
+        size_t comment_length = get_le<uint16_t>(data, position + 32);
+        std::string name(reinterpret_cast<const char*>(data.data() + position + 46), name_length);
+        size_t extra = position + 46 + name_length;
+        if((extra_length < 28) || (get_le<uint16_t>(data, extra) != 0x0001) ||
+           (get_le<uint32_t>(data, position + 20) != 0xFFFFFFFF) || (get_le<uint32_t>(data, position + 42) != 0xFFFFFFFF))
+        {
+            std::printf("FAILED: %s: %s has no ZIP64 extended information\n", file.c_str(), name.c_str());
+            failures++;
+            break;
+        }
+        uint64_t size = get_le<uint64_t>(data, extra + 4);
+        uint64_t local = get_le<uint64_t>(data, extra + 20);
+        std::string expected_name = std::string(export_columns()[i].name) + ".npy";
+        if((name != expected_name) || (local + 30 > directory) || (get_le<uint32_t>(data, local) != 0x04034B50) ||
+           (get_le<uint16_t>(data, local + 8) != 0))
+        {
+            std::printf("FAILED: %s: %s has no stored local header\n", file.c_str(), name.c_str());
+            failures++;
+            break;
+        }
+        size_t member = local + 30 + get_le<uint16_t>(data, local + 26) + get_le<uint16_t>(data, local + 28);
+        if((member + size > directory) || (crc32(data.data() + member, size) != crc))
+        {
+            std::printf("FAILED: %s: %s data does not match the CRC\n", file.c_str(), name.c_str());
+            failures++;
+            break;
+        }
+        if(!check_npy(file + ":" + name, data, member, size, i))
+            failures++;
+        position = extra + extra_length + comment_length;
+    }
+    return failures;
+}
+
+}
+
+int main()
+{
+    int failures = check_npy_directory() + check_npz_archive();
+    if(failures == 0)
+        std::printf("NumPy export: OK\n");
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+/*
+    Checks the frequency response of the Butterworth cascades: -3 dB at the cutoff
+    and 0 dB in the passband for the orders 1 to 6, low-pass and high-pass.
+*/
+
+#include "witmotion/filter.h"
+
+#include <cmath>
+#include <complex>
+#include <cstdio>
+
+using namespace witmotion;
+
+namespace
+{
+
+double response_db(const std::vector<witmotion_biquad>& cascade, const double frequency)
+{
+    std::complex<double> z = std::polar(1.0, -2.0 * M_PI * frequency); // z^-1
+    std::complex<double> response(1.0, 0.0);
+    for(auto i = cascade.begin(); i != cascade.end(); i++)
+        response *= (static_cast<double>(i->b0) + static_cast<double>(i->b1) * z + static_cast<double>(i->b2) * z * z) /
+                    (1.0 + static_cast<double>(i->a1) * z + static_cast<double>(i->a2) * z * z);
+    return 20.0 * std::log10(std::abs(response));
+}
+
+}
+
+int main()
+{
+    static const double cutoffs[] = {0.02, 0.1, 0.25};
+    static const double tolerance = 0.05; // dB, the coefficients are rounded to float
+    int failures = 0;
+    for(size_t order = 1; order <= 6; order++)
+    {
+        for(size_t c = 0; c < sizeof(cutoffs) / sizeof(cutoffs[0]); c++)
+        {
+            for(int type = 0; type < 2; type++)
+            {
+                witmotion_filter_type filter_type = (type == 0) ? filterLowPass : filterHighPass;
+                std::vector<witmotion_biquad> cascade = design_butterworth(order, cutoffs[c], filter_type);
+                double at_cutoff = response_db(cascade, cutoffs[c]);
+                double passband = response_db(cascade, (type == 0) ? 0.0 : 0.5);
+                bool sections = (cascade.size() == (order + 1) / 2);
+                if(!sections || (std::fabs(at_cutoff + 10.0 * std::log10(2.0)) > tolerance) || (std::fabs(passband) > tolerance))
+                {
+                    std::printf("FAILED: %s order %zu, cutoff %.2f: %zu sections, %.3f dB at the cutoff, %.3f dB in the passband\n",
+                                (type == 0) ? "low-pass" : "high-pass", order, cutoffs[c], cascade.size(), at_cutoff, passband);
+                    failures++;
+                }
+            }
+        }
+    }
+    if(failures == 0)
+        std::printf("Butterworth response: OK\n");
+    return (failures == 0) ? 0 : 1;
+}